@@ -0,0 +1,154 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+static std::atomic<uint64_t> gAllocationCount{0};
+
+// Counting every allocation in the process is what lets the benchmarks
+// report allocations per operation.
+void*
+operator new(size_t aSize)
+{
+  gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(aSize ? aSize : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void*
+operator new[](size_t aSize)
+{
+  return operator new(aSize);
+}
+
+void
+operator delete(void* aPtr) noexcept
+{
+  std::free(aPtr);
+}
+
+void
+operator delete[](void* aPtr) noexcept
+{
+  std::free(aPtr);
+}
+
+void
+operator delete(void* aPtr, size_t) noexcept
+{
+  std::free(aPtr);
+}
+
+void
+operator delete[](void* aPtr, size_t) noexcept
+{
+  std::free(aPtr);
+}
+
+namespace aspk {
+namespace bench {
+
+static constexpr size_t kMaxIterations = size_t(1) << 32;
+
+uint64_t
+GetAllocationCount()
+{
+  return gAllocationCount.load(std::memory_order_relaxed);
+}
+
+static double
+TimeRun(BenchmarkFn aFn, size_t aIterations)
+{
+  auto start = std::chrono::steady_clock::now();
+  aFn(aIterations);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+static void
+WriteJsonString(char const * aText)
+{
+  std::putchar('"');
+  for (char const * p = aText; *p; ++p) {
+    if (*p == '"' || *p == '\\') {
+      std::putchar('\\');
+    }
+    std::putchar(*p);
+  }
+  std::putchar('"');
+}
+
+size_t
+RunBenchmarks(Benchmark const * aBenchmarks, size_t aCount,
+              BenchmarkOptions const &aOptions)
+{
+  if (aOptions.mText) {
+    std::printf("%-40s %12s %12s %12s %10s\n", "benchmark", "iterations",
+                "ns/op", "min ns/op", "allocs/op");
+  }
+
+  size_t numRun = 0;
+  for (size_t b = 0; b < aCount; ++b) {
+    Benchmark const &benchmark = aBenchmarks[b];
+    if (std::string_view(benchmark.mName).find(aOptions.mFilter) ==
+        std::string_view::npos) {
+      continue;
+    }
+
+    // Grow the iteration count until one run takes a tenth of the target,
+    // then extrapolate. This also warms up any lazily created state.
+    size_t iterations = 1;
+    double seconds = TimeRun(benchmark.mFn, iterations);
+    const double calibrateSeconds = aOptions.mMinSeconds / 10;
+    while (seconds < calibrateSeconds && iterations < kMaxIterations) {
+      const double growth = seconds > 0 ? calibrateSeconds / seconds * 1.5 : 10;
+      iterations = std::max(iterations + 1,
+                            static_cast<size_t>(iterations * std::min(growth, 10.0)));
+      seconds = TimeRun(benchmark.mFn, iterations);
+    }
+    // Never extrapolate more than tenfold, in case the calibration run was
+    // too quick to time meaningfully
+    const double scale = std::min(aOptions.mMinSeconds / std::max(seconds, 1e-9),
+                                  10.0);
+    iterations = std::clamp<size_t>(static_cast<size_t>(iterations * scale), 1,
+                                    kMaxIterations);
+
+    std::vector<double> nsPerOp;
+    uint64_t allocations = 0;
+    const size_t repetitions = std::max<size_t>(1, aOptions.mRepetitions);
+    for (size_t r = 0; r < repetitions; ++r) {
+      const uint64_t allocationsBefore = GetAllocationCount();
+      seconds = TimeRun(benchmark.mFn, iterations);
+      allocations = GetAllocationCount() - allocationsBefore;
+      nsPerOp.push_back(seconds * 1e9 / iterations);
+    }
+
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    const double median = nsPerOp[nsPerOp.size() / 2];
+    const double allocsPerOp = double(allocations) / iterations;
+
+    if (aOptions.mText) {
+      std::printf("%-40s %12zu %12.2f %12.2f %10.3f\n", benchmark.mName,
+                  iterations, median, nsPerOp.front(), allocsPerOp);
+    } else {
+      std::printf("{\"name\":");
+      WriteJsonString(benchmark.mName);
+      std::printf(",\"iterations\":%zu,\"ns_per_op\":%.3f,"
+                  "\"min_ns_per_op\":%.3f,\"allocs_per_op\":%.4f}\n",
+                  iterations, median, nsPerOp.front(), allocsPerOp);
+    }
+    std::fflush(stdout);
+    ++numRun;
+  }
+  return numRun;
+}
+
+} // namespace bench
+} // namespace aspk
@@ -0,0 +1,60 @@
+#ifndef __ASPK_BENCHMARK_H
+#define __ASPK_BENCHMARK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace aspk {
+namespace bench {
+
+// Runs the body of a benchmark aIterations times. Any setup a benchmark needs
+// should be kept in function statics, since the harness calls it repeatedly.
+using BenchmarkFn = void (*)(size_t aIterations);
+
+struct Benchmark
+{
+  char const *  mName;
+  BenchmarkFn   mFn;
+};
+
+struct BenchmarkOptions
+{
+  // Benchmarks whose name does not contain this are skipped
+  std::string_view  mFilter;
+  // Each repetition runs for at least this long
+  double            mMinSeconds = 0.2;
+  size_t            mRepetitions = 5;
+  // Human-readable table instead of JSON lines
+  bool              mText = false;
+};
+
+// Calibrates an iteration count for each benchmark, runs it
+// aOptions.mRepetitions times and writes one result per benchmark to stdout.
+// By default each result is a JSON object on its own line:
+//   {"name":...,"iterations":...,"ns_per_op":...,"min_ns_per_op":...,
+//    "allocs_per_op":...}
+// ns_per_op is the median over repetitions. Returns the number run.
+size_t RunBenchmarks(Benchmark const * aBenchmarks, size_t aCount,
+                     BenchmarkOptions const &aOptions);
+
+// Heap allocations made through operator new so far, on any thread
+uint64_t GetAllocationCount();
+
+// Keeps the compiler from discarding a computed value
+template <typename T>
+inline void
+DoNotOptimize(T const &aValue)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(aValue) : "memory");
+#else
+  static volatile char const * sSink;
+  sSink = reinterpret_cast<char const volatile *>(&aValue);
+#endif
+}
+
+} // namespace bench
+} // namespace aspk
+
+#endif // __ASPK_BENCHMARK_H
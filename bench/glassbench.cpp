@@ -0,0 +1,633 @@
+// Microbenchmarks for the platform-neutral core: DPI scaling, printf
+// formatting and tokenizing, row insertion, logging and offscreen painting.
+//
+// Usage: glassbench [--filter=<substring>] [--min-time-ms=<n>]
+//                   [--repetitions=<n>] [--text] [--list]
+//
+// Results go to stdout as JSON lines unless --text is given. The "Legacy/"
+// cases replicate code paths that have since been replaced, so that the
+// improvement stays measurable.
+
+#include "Benchmark.h"
+
+#include "BatchScale.h"
+#include "CompiledFormat.h"
+#include "ConsolePainter.h"
+#include "DpiScaler.h"
+#include "FramePacer.h"
+#include "LatencyHistogram.h"
+#include "Log.h"
+#include "PaintSurface.h"
+#include "PixelFill.h"
+#include "PrintfBuffer.h"
+#include "RowStore.h"
+#include "TextExtents.h"
+#include "ThreadPool.h"
+#include "UiTask.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace aspk;
+using namespace aspk::bench;
+
+namespace {
+
+constexpr size_t kBatchSize = 1024;
+
+// A row as the console sees it: three tab-separated columns
+constexpr wchar_t kRowFormat[] = L"%d\t%ls\t%.3f";
+constexpr wchar_t kRowText[] = L"12345\tWM_WINDOWPOSCHANGED\t1.250";
+
+//
+// Scaling
+//
+
+void
+ScaleRectTo(size_t aIterations)
+{
+  DpiScalerHandle from = DpiScaler::GetForScale(100, 100);
+  DpiScalerHandle to = DpiScaler::GetForScale(150, 150);
+  ScaledRect rect(from, {10, 20, 310, 220});
+  for (size_t i = 0; i < aIterations; ++i) {
+    DoNotOptimize(rect);
+    ScaledRect scaled = rect.ScaleTo(to);
+    DoNotOptimize(scaled);
+  }
+}
+
+// Before scalers were interned and ratios became exact: a shared_ptr per
+// value and a rounded division per coordinate
+struct LegacyScaler
+{
+  int mXScale;
+  int mYScale;
+};
+
+struct LegacyScaledRect
+{
+  std::shared_ptr<LegacyScaler> mScaler;
+  int                           mValues[4];
+};
+
+LegacyScaledRect
+LegacyScaleTo(LegacyScaledRect const &aRect,
+              std::shared_ptr<LegacyScaler> const &aTo)
+{
+  LegacyScaledRect result{aTo, {}};
+  const int scales[] = {aTo->mXScale * 100 / aRect.mScaler->mXScale,
+                        aTo->mYScale * 100 / aRect.mScaler->mYScale};
+  for (size_t i = 0; i < 4; ++i) {
+    const int value = aRect.mValues[i] - (i >= 2 ? 1 : 0);
+    const int scaled = value * scales[i % 2];
+    result.mValues[i] = (scaled >= 0 ? scaled + 50 : scaled - 50) / 100 +
+                        (i >= 2 ? 1 : 0);
+  }
+  return result;
+}
+
+void
+LegacyScaleRectTo(size_t aIterations)
+{
+  auto from = std::make_shared<LegacyScaler>(LegacyScaler{100, 100});
+  auto to = std::make_shared<LegacyScaler>(LegacyScaler{150, 150});
+  LegacyScaledRect rect{from, {10, 20, 310, 220}};
+  for (size_t i = 0; i < aIterations; ++i) {
+    DoNotOptimize(rect);
+    LegacyScaledRect scaled = LegacyScaleTo(rect, to);
+    DoNotOptimize(scaled);
+  }
+}
+
+std::vector<ScaledRect>
+MakeRects(DpiScalerHandle aScaler)
+{
+  std::vector<ScaledRect> rects;
+  rects.reserve(kBatchSize);
+  for (size_t i = 0; i < kBatchSize; ++i) {
+    const int v = static_cast<int>(i);
+    rects.push_back(ScaledRect(aScaler, {v, v * 2, v + 100, v * 2 + 40}));
+  }
+  return rects;
+}
+
+// Per rect; alternates between two scales so every pass does real work
+void
+ScaleAllRects(size_t aIterations)
+{
+  static DpiScalerHandle scalers[] = {DpiScaler::GetForScale(100, 100),
+                                      DpiScaler::GetForScale(175, 175)};
+  static std::vector<ScaledRect> rects = MakeRects(scalers[0]);
+  size_t next = 1;
+  for (size_t done = 0; done < aIterations; done += kBatchSize) {
+    ScaledRect::ScaleAllTo(rects, scalers[next]);
+    next ^= 1;
+    DoNotOptimize(rects.front());
+  }
+}
+
+template <void (*Kernel)(int*, size_t, size_t, ScaleRatio const &,
+                         ScaleRatio const &)>
+void
+ScaleRectBatch(size_t aIterations)
+{
+  static std::vector<int> rects = []() {
+    std::vector<int> values(kBatchSize * 4);
+    for (size_t i = 0; i < values.size(); ++i) {
+      values[i] = static_cast<int>(i);
+    }
+    return values;
+  }();
+  static const ScaleRatio ratios[] = {GetScaleRatio(100, 175),
+                                      GetScaleRatio(175, 100)};
+  size_t next = 0;
+  for (size_t done = 0; done < aIterations; done += kBatchSize) {
+    Kernel(rects.data(), 4 * sizeof(int), kBatchSize, ratios[next],
+           ratios[next]);
+    next ^= 1;
+    DoNotOptimize(rects.front());
+  }
+}
+
+//
+// Formatting
+//
+
+void
+FormatPrintfBuffer(size_t aIterations)
+{
+  PrintfBuffer buf;
+  for (size_t i = 0; i < aIterations; ++i) {
+    buf.Format(kRowFormat, static_cast<int>(i), L"WM_WINDOWPOSCHANGED", 1.25);
+    DoNotOptimize(buf.GetText());
+  }
+}
+
+void
+FormatCompiled(size_t aIterations)
+{
+  using Formatter = CompiledFormat<L"%d\t%ls\t%.3f", int, wchar_t const *, double>;
+  PrintfBuffer buf;
+  Formatter::Cells cells;
+  for (size_t i = 0; i < aIterations; ++i) {
+    Formatter::Format(buf, cells, static_cast<int>(i), L"WM_WINDOWPOSCHANGED",
+                      1.25);
+    DoNotOptimize(cells);
+  }
+}
+
+// The original row path: measure, format into a fresh buffer, then split
+// into owned strings
+void
+LegacyFormatRow(size_t aIterations)
+{
+  for (size_t i = 0; i < aIterations; ++i) {
+    wchar_t probe[1];
+    int len = std::swprintf(probe, 0, kRowFormat, static_cast<int>(i),
+                            L"WM_WINDOWPOSCHANGED", 1.25);
+    std::unique_ptr<wchar_t[]> text(new wchar_t[(len > 0 ? len : 256) + 1]);
+    std::swprintf(text.get(), (len > 0 ? len : 256) + 1, kRowFormat,
+                  static_cast<int>(i), L"WM_WINDOWPOSCHANGED", 1.25);
+    std::vector<std::wstring> cells;
+    wchar_t* state = nullptr;
+    for (wchar_t* token = std::wcstok(text.get(), L"\t", &state); token;
+         token = std::wcstok(nullptr, L"\t", &state)) {
+      cells.push_back(token);
+    }
+    DoNotOptimize(cells);
+  }
+}
+
+//
+// Tokenizing
+//
+
+void
+TokenizeSplitInPlace(size_t aIterations)
+{
+  PrintfBuffer buf;
+  std::vector<std::wstring_view> tokens;
+  for (size_t i = 0; i < aIterations; ++i) {
+    buf.Assign(kRowText);
+    buf.SplitInPlace(L'\t', tokens);
+    DoNotOptimize(tokens);
+  }
+}
+
+void
+LegacyTokenizeWcstok(size_t aIterations)
+{
+  wchar_t text[sizeof(kRowText) / sizeof(kRowText[0])];
+  for (size_t i = 0; i < aIterations; ++i) {
+    std::wmemcpy(text, kRowText, sizeof(kRowText) / sizeof(kRowText[0]));
+    std::vector<std::wstring> tokens;
+    wchar_t* state = nullptr;
+    for (wchar_t* token = std::wcstok(text, L"\t", &state); token;
+         token = std::wcstok(nullptr, L"\t", &state)) {
+      tokens.push_back(token);
+    }
+    DoNotOptimize(tokens);
+  }
+}
+
+//
+// Row insertion. Stores are recreated now and then so that memory use stays
+// bounded however long a benchmark runs.
+//
+
+constexpr size_t kRowsPerStore = 1 << 20;
+
+void
+RowStoreAppendCell(size_t aIterations)
+{
+  auto store = std::make_unique<RowStore>(3);
+  for (size_t i = 0; i < aIterations; ++i) {
+    if (store->GetRowCount() == kRowsPerStore) {
+      store = std::make_unique<RowStore>(3);
+    }
+    store->AppendCell(L"12345");
+    store->AppendCell(L"WM_WINDOWPOSCHANGED");
+    store->AppendCell(L"1.250");
+  }
+  DoNotOptimize(store->GetRowCount());
+}
+
+// Per row: the column-width bookkeeping ListView now does for each cell
+void
+RowStoreTrackExtents(size_t aIterations)
+{
+  // Proportional-looking advances without a font
+  GlyphAdvanceTable advances([](wchar_t aFirst, int* aAdvances) {
+    for (size_t i = 0; i < GlyphAdvanceTable::kPageSize; ++i) {
+      aAdvances[i] = 4 + static_cast<int>((aFirst + i) % 7);
+    }
+    return true;
+  }, 7);
+  ColumnExtents extents;
+  extents.SetNumColumns(3);
+  for (size_t i = 0; i < aIterations; ++i) {
+    extents.Add(0, L"12345", advances);
+    extents.Add(1, L"WM_WINDOWPOSCHANGED", advances);
+    extents.Add(2, L"1.250", advances);
+  }
+  DoNotOptimize(extents.GetWidth(1));
+}
+
+void
+RowStoreAppendLinesImpl(size_t aIterations, size_t aBudget)
+{
+  auto makeStore = [aBudget]() {
+    auto store = std::make_unique<RowStore>(1);
+    store->SetMemoryBudget(aBudget);
+    return store;
+  };
+  auto store = makeStore();
+  for (size_t i = 0; i < aIterations; ++i) {
+    if (store->GetRowCount() == kRowsPerStore) {
+      store = makeStore();
+    }
+    store->AppendLines(L"[12345] WM_WINDOWPOSCHANGED took 1.250 ms\n");
+  }
+  DoNotOptimize(store->GetRowCount());
+}
+
+void
+RowStoreAppendLines(size_t aIterations)
+{
+  RowStoreAppendLinesImpl(aIterations, 0);
+}
+
+void
+RowStoreAppendLinesSpilling(size_t aIterations)
+{
+  RowStoreAppendLinesImpl(aIterations, 1024 * 1024);
+}
+
+//
+// Logging
+//
+
+void
+LogCompiledOut(size_t aIterations)
+{
+  for (size_t i = 0; i < aIterations; ++i) {
+    Log<eLogVerbose>(L"Row ", i, L" took ", 1.25, L" ms");
+    DoNotOptimize(i);
+  }
+}
+
+void
+LogDisabled(size_t aIterations)
+{
+  SetLogLevel(eLogInfo);
+  for (size_t i = 0; i < aIterations; ++i) {
+    Log<eLogDebug>(L"Row ", i, L" took ", 1.25, L" ms");
+  }
+}
+
+std::shared_ptr<RingLogSink>
+GetBenchLogSink()
+{
+  // Replaces the default stderr sink for the life of the process
+  static std::shared_ptr<RingLogSink> sSink = []() {
+    auto sink = std::make_shared<RingLogSink>(1024);
+    AddLogSink(sink);
+    return sink;
+  }();
+  return sSink;
+}
+
+void
+LogToRing(size_t aIterations)
+{
+  GetBenchLogSink();
+  SetLogLevel(eLogInfo);
+  for (size_t i = 0; i < aIterations; ++i) {
+    Log<eLogInfo>(L"Row ", i, L" took ", 1.25, L" ms");
+  }
+}
+
+// Before the per-thread buffer: a stream per message
+void
+LegacyLogToRing(size_t aIterations)
+{
+  std::shared_ptr<RingLogSink> sink = GetBenchLogSink();
+  for (size_t i = 0; i < aIterations; ++i) {
+    std::wstring message(L"Row ");
+    message += std::to_wstring(i);
+    message += L" took ";
+    message += std::to_wstring(1.25);
+    message += L" ms";
+    sink->Write(eLogInfo, message);
+  }
+}
+
+//
+// Paint-time helpers
+//
+
+void
+RecordLatency(size_t aIterations)
+{
+  LatencyHistogram histogram;
+  uint64_t value = 1;
+  for (size_t i = 0; i < aIterations; ++i) {
+    // Cheap pseudo-random spread over many buckets
+    value = value * 6364136223846793005ull + 1442695040888963407ull;
+    histogram.Record(value >> 40);
+  }
+  DoNotOptimize(histogram.GetCount());
+}
+
+// Per 256x256 fill
+template <void (*Kernel)(uint32_t*, ptrdiff_t, int, int, uint32_t)>
+void
+FillPixelBlock(size_t aIterations)
+{
+  static std::vector<uint32_t> pixels(256 * 256);
+  const uint32_t pixel = MakePremultipliedPixel(0x20, 0x40, 0x80, 0xC0);
+  for (size_t i = 0; i < aIterations; ++i) {
+    Kernel(pixels.data(), 256, 256, 256, pixel);
+    DoNotOptimize(pixels.front());
+  }
+}
+
+// Per 800x600 frame: erase, then a screenful of console lines
+void
+PaintConsoleFrame(size_t aIterations)
+{
+  static RowStore lines(1);
+  if (!lines.GetRowCount()) {
+    for (int i = 0; i < 10000; ++i) {
+      lines.AppendLines(L"[12345] WM_WINDOWPOSCHANGED took 1.250 ms\n");
+    }
+  }
+  static BitmapSurface surface(800, 600);
+  const PixelRect clientRect{0, 0, surface.GetWidth(), surface.GetHeight()};
+  const uint32_t background = MakePremultipliedPixel(0xF0, 0xF0, 0xF0);
+  for (size_t i = 0; i < aIterations; ++i) {
+    surface.FillRect(clientRect, background);
+    PaintConsoleLines(surface, lines, i % 9000, surface.GetLineHeight(),
+                      clientRect);
+    DoNotOptimize(surface.GetPixel(0, 0));
+  }
+}
+
+// Per invalidation request in a storm of one every 10us, against a simulated
+// 60Hz clock; about one in 1700 requests presents a frame
+void
+PaceFrameStorm(size_t aIterations)
+{
+  FramePacer pacer;
+  FramePacer::Clock::time_point now{};
+  pacer.SetTiming(now, FramePacer::kDefaultInterval);
+  for (size_t i = 0; i < aIterations; ++i) {
+    now += std::chrono::microseconds(10);
+    pacer.Request();
+    if (pacer.IsPending() && pacer.GetNextFrameTime(now) <= now) {
+      pacer.Present(now);
+    }
+  }
+  DoNotOptimize(pacer.GetPresentedCount());
+}
+
+//
+// UI tasks, pumped by hand
+//
+
+// Runs background work on the submitting thread; the resumption still goes
+// through the scheduler's queue
+void
+RunWorkInline(BackgroundWork* aWork)
+{
+  aWork->Run();
+}
+
+UiTask
+AddInBackground(uint64_t &aSum, uint64_t aValue)
+{
+  aSum += co_await RunInBackground([aValue] { return aValue * 2; });
+}
+
+// Per task: spawn, one background hop, resume on the "UI thread", finish
+void
+TaskSpawnAndResume(size_t aIterations)
+{
+  bool woken = false;
+  TaskScheduler scheduler([&woken] { woken = true; });
+  scheduler.SetBackgroundExecutor(&RunWorkInline);
+  TaskScope scope(scheduler);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < aIterations; ++i) {
+    scope.Spawn(AddInBackground(sum, i));
+    if (woken) {
+      woken = false;
+      scheduler.RunPending();
+    }
+  }
+  DoNotOptimize(sum);
+}
+
+UiTask
+YieldRepeatedly(size_t aCount)
+{
+  for (size_t i = 0; i < aCount; ++i) {
+    co_await YieldToUi();
+  }
+}
+
+// Per resume of a task that keeps requeueing itself
+void
+TaskYield(size_t aIterations)
+{
+  TaskScheduler scheduler([] {});
+  TaskScope scope(scheduler);
+  scope.Spawn(YieldRepeatedly(aIterations));
+  while (scheduler.RunPending()) {
+  }
+}
+
+//
+// Thread pool
+//
+
+ThreadPool&
+GetBenchPool()
+{
+  static ThreadPool sPool;
+  return sPool;
+}
+
+// Per 64K-row pass, in chunks of 1024 rows
+void
+PoolParallelFor(size_t aIterations)
+{
+  static std::vector<uint32_t> rows(64 * 1024, 1);
+  ThreadPool& pool = GetBenchPool();
+  for (size_t i = 0; i < aIterations; ++i) {
+    std::atomic<uint64_t> total(0);
+    pool.ParallelFor(0, rows.size(), 1024, [&total](size_t aBegin, size_t aEnd) {
+      uint64_t sum = 0;
+      for (size_t row = aBegin; row < aEnd; ++row) {
+        sum += rows[row];
+      }
+      total.fetch_add(sum, std::memory_order_relaxed);
+    });
+    DoNotOptimize(total.load(std::memory_order_relaxed));
+  }
+}
+
+uint64_t
+SumForkJoin(ThreadPool &aPool, uint32_t const * aBegin, uint32_t const * aEnd)
+{
+  if (aEnd - aBegin <= 1024) {
+    uint64_t sum = 0;
+    for (uint32_t const * p = aBegin; p != aEnd; ++p) {
+      sum += *p;
+    }
+    return sum;
+  }
+  uint32_t const * middle = aBegin + (aEnd - aBegin) / 2;
+  uint64_t left = 0;
+  uint64_t right = 0;
+  aPool.Invoke([&] { left = SumForkJoin(aPool, aBegin, middle); },
+               [&] { right = SumForkJoin(aPool, middle, aEnd); });
+  return left + right;
+}
+
+// Per 64K-row pass, split recursively down to 1024 rows
+void
+PoolForkJoin(size_t aIterations)
+{
+  static std::vector<uint32_t> rows(64 * 1024, 1);
+  ThreadPool& pool = GetBenchPool();
+  for (size_t i = 0; i < aIterations; ++i) {
+    DoNotOptimize(SumForkJoin(pool, rows.data(), rows.data() + rows.size()));
+  }
+}
+
+const Benchmark kBenchmarks[] = {
+  {"Scale/ScaledRect.ScaleTo",              ScaleRectTo},
+  {"Scale/Legacy/ScaledRect.ScaleTo",       LegacyScaleRectTo},
+  {"Scale/ScaledRect.ScaleAllTo",           ScaleAllRects},
+  {"Scale/ScaleRects/Scalar",               ScaleRectBatch<detail::ScaleRectsScalar>},
+#ifdef ASPK_HAVE_X86_SCALE
+  {"Scale/ScaleRects/Sse2",                 ScaleRectBatch<detail::ScaleRectsSse2>},
+#endif
+  {"Format/PrintfBuffer",                   FormatPrintfBuffer},
+  {"Format/CompiledFormat",                 FormatCompiled},
+  {"Format/Legacy/Row",                     LegacyFormatRow},
+  {"Tokenize/SplitInPlace",                 TokenizeSplitInPlace},
+  {"Tokenize/Legacy/Wcstok",                LegacyTokenizeWcstok},
+  {"RowStore/AppendCell",                   RowStoreAppendCell},
+  {"RowStore/TrackExtents",                 RowStoreTrackExtents},
+  {"RowStore/AppendLines",                  RowStoreAppendLines},
+  {"RowStore/AppendLines/Spilling",         RowStoreAppendLinesSpilling},
+  {"Log/CompiledOut",                       LogCompiledOut},
+  {"Log/Disabled",                          LogDisabled},
+  {"Log/RingSink",                          LogToRing},
+  {"Log/Legacy/RingSink",                   LegacyLogToRing},
+  {"Paint/LatencyHistogram.Record",         RecordLatency},
+  {"Paint/FillPixels/Scalar",               FillPixelBlock<detail::FillPixelsScalar>},
+#ifdef ASPK_HAVE_X86_FILL
+  {"Paint/FillPixels/Sse2",                 FillPixelBlock<detail::FillPixelsSse2>},
+#endif
+  {"Paint/ConsoleFrame",                    PaintConsoleFrame},
+  {"Paint/FramePacer.Storm",                PaceFrameStorm},
+  {"Task/SpawnAndResume",                   TaskSpawnAndResume},
+  {"Task/Yield",                            TaskYield},
+  {"Pool/ParallelFor",                      PoolParallelFor},
+  {"Pool/ForkJoin",                         PoolForkJoin},
+};
+
+bool
+ParseOption(char const * aArg, char const * aName, char const *& aValue)
+{
+  const size_t len = std::strlen(aName);
+  if (std::strncmp(aArg, aName, len) != 0 || aArg[len] != '=') {
+    return false;
+  }
+  aValue = aArg + len + 1;
+  return true;
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char* argv[])
+{
+  BenchmarkOptions options;
+  for (int i = 1; i < argc; ++i) {
+    char const * value = nullptr;
+    if (ParseOption(argv[i], "--filter", value)) {
+      options.mFilter = value;
+    } else if (ParseOption(argv[i], "--min-time-ms", value)) {
+      options.mMinSeconds = std::atof(value) / 1000.0;
+    } else if (ParseOption(argv[i], "--repetitions", value)) {
+      options.mRepetitions = std::strtoul(value, nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--text")) {
+      options.mText = true;
+    } else if (!std::strcmp(argv[i], "--list")) {
+      for (Benchmark const &benchmark : kBenchmarks) {
+        std::printf("%s\n", benchmark.mName);
+      }
+      return 0;
+    } else {
+      std::fprintf(stderr, "Usage: %s [--filter=<substring>] [--min-time-ms=<n>] "
+                           "[--repetitions=<n>] [--text] [--list]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  const size_t count = sizeof(kBenchmarks) / sizeof(kBenchmarks[0]);
+  if (!RunBenchmarks(kBenchmarks, count, options)) {
+    std::fprintf(stderr, "No benchmarks match the filter\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,234 @@
+#ifndef __ASPK_LOG_H
+#define __ASPK_LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cwchar>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace aspk {
+
+enum LogLevel
+{
+  eLogError,
+  eLogWarning,
+  eLogInfo,
+  eLogDebug,
+  eLogVerbose
+};
+
+// Calls above this level compile to nothing. Override by defining
+// ASPK_MAX_LOG_LEVEL to one of the LogLevel values.
+#if defined(ASPK_MAX_LOG_LEVEL)
+constexpr LogLevel kMaxLogLevel = static_cast<LogLevel>(ASPK_MAX_LOG_LEVEL);
+#elif defined(NDEBUG)
+constexpr LogLevel kMaxLogLevel = eLogInfo;
+#else
+constexpr LogLevel kMaxLogLevel = eLogDebug;
+#endif
+
+wchar_t const * GetLogLevelName(LogLevel aLevel);
+
+// Receives every message that passes the level checks. Write may be called
+// from any thread, but never concurrently with itself.
+class LogSink
+{
+public:
+  virtual ~LogSink() {}
+  // aMessage does not include a line terminator
+  virtual void Write(LogLevel aLevel, std::wstring_view aMessage) = 0;
+};
+
+// OutputDebugStringW on Windows, stderr elsewhere. Installed by default.
+class DebuggerLogSink : public LogSink
+{
+public:
+  void Write(LogLevel aLevel, std::wstring_view aMessage) override;
+
+private:
+  std::wstring  mLine;
+};
+
+// Appends UTF-8 lines to a file
+class FileLogSink : public LogSink
+{
+public:
+  explicit FileLogSink(std::filesystem::path const &aPath);
+
+  explicit operator bool() const { return mFile.is_open(); }
+  void Write(LogLevel aLevel, std::wstring_view aMessage) override;
+
+private:
+  std::ofstream mFile;
+  std::string   mLine;
+};
+
+// Keeps the most recent aCapacity messages in memory. Once the ring has
+// wrapped, slots are reused without allocating unless a message is longer
+// than the one it replaces.
+class RingLogSink : public LogSink
+{
+public:
+  struct Entry
+  {
+    LogLevel      mLevel;
+    std::wstring  mMessage;
+  };
+
+  explicit RingLogSink(size_t aCapacity);
+
+  void Write(LogLevel aLevel, std::wstring_view aMessage) override;
+
+  // Copies the retained messages, oldest first
+  std::vector<Entry> GetEntries() const;
+  uint64_t GetTotalCount() const;
+
+private:
+  mutable std::mutex  mLock;
+  std::vector<Entry>  mEntries;
+  size_t              mNext;
+  uint64_t            mTotalCount;
+};
+
+// Sinks may be added or removed at any time. Before the first AddLogSink call
+// a DebuggerLogSink is in place; adding a sink replaces it.
+void AddLogSink(std::shared_ptr<LogSink> aSink);
+void RemoveLogSink(std::shared_ptr<LogSink> const &aSink);
+
+namespace detail {
+
+inline std::atomic<int> gLogLevel{eLogDebug};
+
+void DispatchLog(LogLevel aLevel, std::wstring_view aMessage);
+
+inline std::wstring&
+GetThreadLogBuffer()
+{
+  thread_local std::wstring sBuffer;
+  return sBuffer;
+}
+
+template <typename T>
+void
+AppendUnsigned(std::wstring &aBuf, T aValue)
+{
+  wchar_t digits[24];
+  wchar_t* end = digits + 24;
+  wchar_t* p = end;
+  do {
+    *--p = static_cast<wchar_t>(L'0' + aValue % 10);
+    aValue /= 10;
+  } while (aValue);
+  aBuf.append(p, end - p);
+}
+
+template <typename T>
+void
+AppendLogValue(std::wstring &aBuf, T const &aValue)
+{
+  if constexpr (std::is_convertible_v<T const &, wchar_t const *>) {
+    wchar_t const * str = aValue;
+    aBuf.append(str ? str : L"(null)");
+  } else if constexpr (std::is_convertible_v<T const &, std::wstring_view>) {
+    aBuf.append(std::wstring_view(aValue));
+  } else if constexpr (std::is_same_v<T, wchar_t>) {
+    aBuf.push_back(aValue);
+  } else if constexpr (std::is_convertible_v<T const &, char const *>) {
+    for (char const * str = aValue; str && *str; ++str) {
+      aBuf.push_back(static_cast<unsigned char>(*str));
+    }
+  } else if constexpr (std::is_same_v<T, bool>) {
+    aBuf.append(aValue ? L"true" : L"false");
+  } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+    using Int = std::conditional_t<std::is_enum_v<T>,
+                                   std::underlying_type<T>,
+                                   std::type_identity<T>>::type;
+    using Unsigned = std::make_unsigned_t<Int>;
+    const Int value = static_cast<Int>(aValue);
+    if (value < 0) {
+      aBuf.push_back(L'-');
+      AppendUnsigned(aBuf, static_cast<Unsigned>(Unsigned(0) -
+                                                 static_cast<Unsigned>(value)));
+    } else {
+      AppendUnsigned(aBuf, static_cast<Unsigned>(value));
+    }
+  } else if constexpr (std::is_floating_point_v<T>) {
+    wchar_t text[32];
+    int len = std::swprintf(text, 32, L"%g", static_cast<double>(aValue));
+    if (len > 0) {
+      aBuf.append(text, len);
+    }
+  } else if constexpr (std::is_pointer_v<T>) {
+    wchar_t text[24];
+    int len = std::swprintf(text, 24, L"0x%llx",
+      static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(aValue)));
+    if (len > 0) {
+      aBuf.append(text, len);
+    }
+#if defined(_WIN32)
+  } else if constexpr (std::is_same_v<T, RECT>) {
+    aBuf.append(L"Left: ");
+    AppendLogValue(aBuf, aValue.left);
+    aBuf.append(L", Top: ");
+    AppendLogValue(aBuf, aValue.top);
+    aBuf.append(L", Right: ");
+    AppendLogValue(aBuf, aValue.right);
+    aBuf.append(L", Bottom: ");
+    AppendLogValue(aBuf, aValue.bottom);
+#endif
+  } else {
+    static_assert(sizeof(T) == 0, "Unsupported log argument type");
+  }
+}
+
+} // namespace detail
+
+// Changes the runtime threshold. Levels above kMaxLogLevel stay compiled out
+// regardless.
+inline void
+SetLogLevel(LogLevel aLevel)
+{
+  detail::gLogLevel.store(aLevel, std::memory_order_relaxed);
+}
+
+inline bool
+IsLogLevelEnabled(LogLevel aLevel)
+{
+  return aLevel <= kMaxLogLevel &&
+         aLevel <= detail::gLogLevel.load(std::memory_order_relaxed);
+}
+
+// Concatenates aArgs into a per-thread buffer and hands the result to every
+// sink. Once the buffer has grown, a call allocates nothing. Calls above
+// kMaxLogLevel generate no code, though their arguments are still evaluated,
+// so keep them free of side effects.
+template <LogLevel Level, typename ...Args>
+inline void
+Log(Args const &... aArgs)
+{
+  if constexpr (Level <= kMaxLogLevel) {
+    if (Level > detail::gLogLevel.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    std::wstring& buf = detail::GetThreadLogBuffer();
+    buf.clear();
+    (detail::AppendLogValue(buf, aArgs), ...);
+    detail::DispatchLog(Level, buf);
+  }
+}
+
+} // namespace aspk
+
+#endif // __ASPK_LOG_H
@@ -0,0 +1,143 @@
+#ifndef __ASPK_MPSCQUEUE_H
+#define __ASPK_MPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace aspk {
+
+struct MpscNode
+{
+  std::atomic<MpscNode*> mNext{nullptr};
+};
+
+// Intrusive, unbounded multi-producer/single-consumer queue (Vyukov). Push is
+// wait-free and may be called from any thread; Pop must only be called from a
+// single consumer thread. T must derive from MpscNode.
+template <typename T>
+class MpscQueue
+{
+  static_assert(std::is_base_of<MpscNode, T>::value,
+                "MpscQueue elements must derive from MpscNode");
+
+public:
+  MpscQueue()
+    : mHead(&mStub)
+    , mTail(&mStub)
+    , mDepth(0)
+    , mHighWaterMark(0)
+  {
+  }
+
+  // Frees any items still queued through Push
+  ~MpscQueue()
+  {
+    while (Pop()) {
+    }
+  }
+
+  // Returns true if the queue was observed to be empty before this push.
+  // Producers may use this to decide whether the consumer needs waking.
+  bool Push(std::unique_ptr<T> aItem)
+  {
+    return PushNode(aItem.release());
+  }
+
+  // Returns nullptr when the queue is empty or when a producer is midway
+  // through a push; in the latter case that producer's item will be visible
+  // to a subsequent Pop.
+  std::unique_ptr<T> Pop()
+  {
+    return std::unique_ptr<T>(PopNode());
+  }
+
+  // Non-owning variants, for nodes whose storage is managed elsewhere. Do not
+  // mix with Push/Pop on the same queue.
+  bool PushNode(T* aItem)
+  {
+    size_t depth = mDepth.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t highWater = mHighWaterMark.load(std::memory_order_relaxed);
+    while (depth > highWater &&
+           !mHighWaterMark.compare_exchange_weak(highWater, depth,
+                                                 std::memory_order_relaxed)) {
+    }
+
+    Link(aItem);
+    return depth == 1;
+  }
+
+  T* PopNode()
+  {
+    MpscNode* tail = mTail;
+    MpscNode* next = tail->mNext.load(std::memory_order_acquire);
+
+    if (tail == &mStub) {
+      if (!next) {
+        return nullptr;
+      }
+      mTail = next;
+      tail = next;
+      next = next->mNext.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+      mTail = next;
+      return Take(tail);
+    }
+
+    if (tail != mHead.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+
+    Link(&mStub);
+
+    next = tail->mNext.load(std::memory_order_acquire);
+    if (next) {
+      mTail = next;
+      return Take(tail);
+    }
+
+    return nullptr;
+  }
+
+  size_t GetDepth() const
+  {
+    return mDepth.load(std::memory_order_relaxed);
+  }
+
+  size_t GetHighWaterMark() const
+  {
+    return mHighWaterMark.load(std::memory_order_relaxed);
+  }
+
+private:
+  void Link(MpscNode* aNode)
+  {
+    aNode->mNext.store(nullptr, std::memory_order_relaxed);
+    MpscNode* prev = mHead.exchange(aNode, std::memory_order_acq_rel);
+    prev->mNext.store(aNode, std::memory_order_release);
+  }
+
+  T* Take(MpscNode* aNode)
+  {
+    mDepth.fetch_sub(1, std::memory_order_relaxed);
+    return static_cast<T*>(aNode);
+  }
+
+private:
+  MpscQueue(MpscQueue const &) = delete;
+  MpscQueue& operator=(MpscQueue const &) = delete;
+
+private:
+  std::atomic<MpscNode*>  mHead;
+  MpscNode*               mTail;  // Only touched by the consumer
+  MpscNode                mStub;
+  std::atomic<size_t>     mDepth;
+  std::atomic<size_t>     mHighWaterMark;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_MPSCQUEUE_H
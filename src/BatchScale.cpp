@@ -0,0 +1,163 @@
+#include "BatchScale.h"
+
+#if defined(ASPK_HAVE_X86_SCALE)
+#include <emmintrin.h>
+#endif
+
+namespace aspk {
+namespace detail {
+
+static inline int*
+Advance(int* aPtr, size_t aStride)
+{
+  return reinterpret_cast<int*>(reinterpret_cast<char*>(aPtr) + aStride);
+}
+
+void
+ScaleRectsScalar(int* aFirst, size_t aStride, size_t aCount,
+                 ScaleRatio const &aX, ScaleRatio const &aY)
+{
+  for (size_t i = 0; i < aCount; ++i, aFirst = Advance(aFirst, aStride)) {
+    // Right and bottom are exclusive, so scale the last pixel inside
+    aFirst[0] = aX.Apply(aFirst[0]);
+    aFirst[1] = aY.Apply(aFirst[1]);
+    aFirst[2] = aX.Apply(aFirst[2] - 1) + 1;
+    aFirst[3] = aY.Apply(aFirst[3] - 1) + 1;
+  }
+}
+
+void
+ScalePointsScalar(int* aFirst, size_t aStride, size_t aCount,
+                  ScaleRatio const &aX, ScaleRatio const &aY)
+{
+  for (size_t i = 0; i < aCount; ++i, aFirst = Advance(aFirst, aStride)) {
+    aFirst[0] = aX.Apply(aFirst[0]);
+    aFirst[1] = aY.Apply(aFirst[1]);
+  }
+}
+
+#if defined(ASPK_HAVE_X86_SCALE)
+
+// Per-lane constants for registers laid out as x, y, x, y. pmuludq only reads
+// the even lanes, which conveniently are all x (and, shifted down, all y),
+// so each axis can use its own magic number and shift.
+struct RatioLanes
+{
+  explicit RatioLanes(ScaleRatio const &aX, ScaleRatio const &aY)
+    : mNumerators(_mm_setr_epi32(aX.mNumerator, aY.mNumerator,
+                                 aX.mNumerator, aY.mNumerator))
+    , mHalves(_mm_setr_epi32(aX.mDenominator / 2, aY.mDenominator / 2,
+                             aX.mDenominator / 2, aY.mDenominator / 2))
+    , mXMagic(_mm_set1_epi32(aX.mMagic))
+    , mYMagic(_mm_set1_epi32(aY.mMagic))
+    , mXShift(_mm_cvtsi32_si128(aX.mShift))
+    , mYShift(_mm_cvtsi32_si128(aY.mShift))
+  {
+  }
+
+  __m128i mNumerators;
+  __m128i mHalves;
+  __m128i mXMagic;
+  __m128i mYMagic;
+  __m128i mXShift;
+  __m128i mYShift;
+};
+
+// Low 32 bits of each lane's product. SSE2 has no pmulld, so multiply the
+// even and odd lanes separately and interleave.
+static inline __m128i
+MulLo32(__m128i aA, __m128i aB)
+{
+  const __m128i even = _mm_mul_epu32(aA, aB);
+  const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(aA, 32),
+                                    _mm_srli_epi64(aB, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// ScaleRatio::Apply for each lane
+static inline __m128i
+Apply(__m128i aValues, RatioLanes const &aRatios)
+{
+  const __m128i sign = _mm_srai_epi32(aValues, 31);
+  const __m128i magnitude = _mm_sub_epi32(_mm_xor_si128(aValues, sign), sign);
+  const __m128i n = _mm_add_epi32(MulLo32(magnitude, aRatios.mNumerators),
+                                  aRatios.mHalves);
+
+  const __m128i x = _mm_srl_epi64(_mm_mul_epu32(n, aRatios.mXMagic),
+                                  aRatios.mXShift);
+  const __m128i y = _mm_srl_epi64(
+    _mm_mul_epu32(_mm_srli_epi64(n, 32), aRatios.mYMagic), aRatios.mYShift);
+  const __m128i quotient = _mm_or_si128(x, _mm_slli_epi64(y, 32));
+
+  return _mm_sub_epi32(_mm_xor_si128(quotient, sign), sign);
+}
+
+void
+ScaleRectsSse2(int* aFirst, size_t aStride, size_t aCount,
+               ScaleRatio const &aX, ScaleRatio const &aY)
+{
+  const RatioLanes ratios(aX, aY);
+  const __m128i exclusive = _mm_setr_epi32(0, 0, 1, 1);
+
+  // One rect per register
+  for (size_t i = 0; i < aCount; ++i, aFirst = Advance(aFirst, aStride)) {
+    __m128i* p = reinterpret_cast<__m128i*>(aFirst);
+    __m128i values = _mm_sub_epi32(_mm_loadu_si128(p), exclusive);
+    values = Apply(values, ratios);
+    _mm_storeu_si128(p, _mm_add_epi32(values, exclusive));
+  }
+}
+
+void
+ScalePointsSse2(int* aFirst, size_t aStride, size_t aCount,
+                ScaleRatio const &aX, ScaleRatio const &aY)
+{
+  const RatioLanes ratios(aX, aY);
+
+  // Two points per register
+  size_t i = 0;
+  for (; i + 2 <= aCount; i += 2) {
+    int* second = Advance(aFirst, aStride);
+    __m128i* p0 = reinterpret_cast<__m128i*>(aFirst);
+    __m128i* p1 = reinterpret_cast<__m128i*>(second);
+    __m128i values = _mm_unpacklo_epi64(_mm_loadl_epi64(p0),
+                                        _mm_loadl_epi64(p1));
+    values = Apply(values, ratios);
+    _mm_storel_epi64(p0, values);
+    _mm_storel_epi64(p1, _mm_unpackhi_epi64(values, values));
+    aFirst = Advance(second, aStride);
+  }
+
+  if (i < aCount) {
+    ScalePointsScalar(aFirst, aStride, 1, aX, aY);
+  }
+}
+
+#endif // defined(ASPK_HAVE_X86_SCALE)
+
+} // namespace detail
+
+void
+ScaleRects(int* aFirst, size_t aStride, size_t aCount, ScaleRatio const &aX,
+           ScaleRatio const &aY)
+{
+#if defined(ASPK_HAVE_X86_SCALE)
+  detail::ScaleRectsSse2(aFirst, aStride, aCount, aX, aY);
+#else
+  detail::ScaleRectsScalar(aFirst, aStride, aCount, aX, aY);
+#endif
+}
+
+void
+ScalePoints(int* aFirst, size_t aStride, size_t aCount, ScaleRatio const &aX,
+            ScaleRatio const &aY)
+{
+#if defined(ASPK_HAVE_X86_SCALE)
+  detail::ScalePointsSse2(aFirst, aStride, aCount, aX, aY);
+#else
+  detail::ScalePointsScalar(aFirst, aStride, aCount, aX, aY);
+#endif
+}
+
+} // namespace aspk
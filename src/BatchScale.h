@@ -0,0 +1,39 @@
+#ifndef __ASPK_BATCHSCALE_H
+#define __ASPK_BATCHSCALE_H
+
+#include <cstddef>
+
+#include "ScaleRatio.h"
+
+namespace aspk {
+
+// Rescales aCount rects (left, top, right, bottom ints) or points (x, y ints)
+// in place, aStride bytes apart, applying aX to x coordinates and aY to y
+// coordinates. Results are bit-identical to ScaledValue::ScaleTo, including
+// its treatment of right/bottom as exclusive, within ScaleRatio's exact
+// range. Uses SSE2 when available and falls back to scalar code elsewhere.
+void ScaleRects(int* aFirst, size_t aStride, size_t aCount,
+                ScaleRatio const &aX, ScaleRatio const &aY);
+void ScalePoints(int* aFirst, size_t aStride, size_t aCount,
+                 ScaleRatio const &aX, ScaleRatio const &aY);
+
+namespace detail {
+
+// Individual kernels, exposed for testing and benchmarking
+void ScaleRectsScalar(int* aFirst, size_t aStride, size_t aCount,
+                      ScaleRatio const &aX, ScaleRatio const &aY);
+void ScalePointsScalar(int* aFirst, size_t aStride, size_t aCount,
+                       ScaleRatio const &aX, ScaleRatio const &aY);
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ASPK_HAVE_X86_SCALE
+void ScaleRectsSse2(int* aFirst, size_t aStride, size_t aCount,
+                    ScaleRatio const &aX, ScaleRatio const &aY);
+void ScalePointsSse2(int* aFirst, size_t aStride, size_t aCount,
+                     ScaleRatio const &aX, ScaleRatio const &aY);
+#endif
+
+} // namespace detail
+
+} // namespace aspk
+
+#endif // __ASPK_BATCHSCALE_H
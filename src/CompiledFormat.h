@@ -0,0 +1,583 @@
+#ifndef __ASPK_COMPILEDFORMAT_H
+#define __ASPK_COMPILEDFORMAT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "PrintfBuffer.h"
+
+namespace aspk {
+
+// A format string literal usable as a template argument, e.g.
+//   CompiledFormat<L"%d\t%s\n", int, wchar_t const *>
+template <size_t N>
+struct FixedFormat
+{
+  constexpr FixedFormat(wchar_t const (&aText)[N])
+  {
+    for (size_t i = 0; i < N; ++i) {
+      mText[i] = aText[i];
+    }
+  }
+
+  constexpr size_t size() const { return N - 1; }
+  constexpr wchar_t operator[](size_t aIndex) const { return mText[aIndex]; }
+
+  wchar_t mText[N] = {};
+};
+
+namespace detail {
+
+enum class FormatOpKind : uint8_t
+{
+  eLiteral,
+  eCellBreak,
+  eSigned,
+  eUnsigned,
+  eChar,
+  eString,
+  eFloat,
+  ePointer
+};
+
+enum FormatFlags : uint8_t
+{
+  eFormatLeft = 1,
+  eFormatZero = 2,
+  eFormatPlus = 4,
+  eFormatSpace = 8,
+  eFormatAlt = 16
+};
+
+enum class FormatLength : uint8_t
+{
+  eNone,
+  eChar,     // hh
+  eShort,    // h
+  eLong,     // l
+  eLongLong, // ll
+  eSize      // z
+};
+
+struct FormatOp
+{
+  FormatOpKind  mKind = FormatOpKind::eLiteral;
+  uint8_t       mFlags = 0;
+  FormatLength  mLength = FormatLength::eNone;
+  wchar_t       mConversion = 0;
+  int           mWidth = -1;
+  int           mPrecision = -1;
+  // For literals, the range of format text to copy. For conversions, the
+  // range of the conversion specification itself.
+  size_t        mBegin = 0;
+  size_t        mEnd = 0;
+  size_t        mArgIndex = 0;
+};
+
+static constexpr size_t kMaxSpecLength = 31;
+
+// Every op consumes at least one character of the format, so N ops suffice
+template <size_t N>
+struct ParsedFormat
+{
+  std::array<FormatOp, N>   mOps{};
+  std::array<size_t, N>     mArgOps{};  // Op index for each argument
+  size_t                    mNumOps = 0;
+  size_t                    mNumArgs = 0;
+  size_t                    mNumColumns = 1;
+};
+
+// Deliberately not constexpr: reaching this during constant evaluation makes
+// the offending format string a compile error that names the problem.
+inline void
+InvalidFormatString(char const * /* aReason */)
+{
+}
+
+template <size_t N>
+constexpr ParsedFormat<N>
+ParseFormat(FixedFormat<N> const &aFmt)
+{
+  ParsedFormat<N> result;
+  const size_t len = aFmt.size();
+  size_t i = 0;
+  size_t literalStart = 0;
+
+  auto addOp = [&result](FormatOp const &aOp) {
+    result.mOps[result.mNumOps++] = aOp;
+  };
+
+  auto flushLiteral = [&](size_t aEnd) {
+    if (aEnd > literalStart) {
+      FormatOp op;
+      op.mBegin = literalStart;
+      op.mEnd = aEnd;
+      addOp(op);
+    }
+  };
+
+  auto parseNumber = [&]() {
+    int value = 0;
+    while (i < len && aFmt[i] >= L'0' && aFmt[i] <= L'9') {
+      value = value * 10 + (aFmt[i] - L'0');
+      ++i;
+    }
+    return value;
+  };
+
+  while (i < len) {
+    const wchar_t c = aFmt[i];
+
+    if (c == L'\t') {
+      flushLiteral(i);
+      FormatOp op;
+      op.mKind = FormatOpKind::eCellBreak;
+      addOp(op);
+      ++result.mNumColumns;
+      literalStart = ++i;
+      continue;
+    }
+
+    if (c != L'%') {
+      ++i;
+      continue;
+    }
+
+    flushLiteral(i);
+    FormatOp op;
+    op.mBegin = i++;
+
+    if (i < len && aFmt[i] == L'%') {
+      op.mBegin = i;
+      op.mEnd = ++i;
+      addOp(op);
+      literalStart = i;
+      continue;
+    }
+
+    for (bool moreFlags = true; moreFlags && i < len; ) {
+      switch (aFmt[i]) {
+        case L'-': op.mFlags |= eFormatLeft; ++i; break;
+        case L'0': op.mFlags |= eFormatZero; ++i; break;
+        case L'+': op.mFlags |= eFormatPlus; ++i; break;
+        case L' ': op.mFlags |= eFormatSpace; ++i; break;
+        case L'#': op.mFlags |= eFormatAlt; ++i; break;
+        default: moreFlags = false; break;
+      }
+    }
+
+    if (i < len && aFmt[i] == L'*') {
+      InvalidFormatString("'*' width is not supported");
+    }
+
+    if (i < len && aFmt[i] >= L'1' && aFmt[i] <= L'9') {
+      op.mWidth = parseNumber();
+    }
+
+    if (i < len && aFmt[i] == L'.') {
+      ++i;
+      if (i < len && aFmt[i] == L'*') {
+        InvalidFormatString("'*' precision is not supported");
+      }
+      op.mPrecision = parseNumber();
+    }
+
+    if (i < len && aFmt[i] == L'h') {
+      ++i;
+      op.mLength = FormatLength::eShort;
+      if (i < len && aFmt[i] == L'h') {
+        ++i;
+        op.mLength = FormatLength::eChar;
+      }
+    } else if (i < len && aFmt[i] == L'l') {
+      ++i;
+      op.mLength = FormatLength::eLong;
+      if (i < len && aFmt[i] == L'l') {
+        ++i;
+        op.mLength = FormatLength::eLongLong;
+      }
+    } else if (i < len && aFmt[i] == L'z') {
+      ++i;
+      op.mLength = FormatLength::eSize;
+    }
+
+    if (i >= len) {
+      InvalidFormatString("Incomplete conversion specification");
+      break;
+    }
+
+    op.mConversion = aFmt[i++];
+    op.mEnd = i;
+
+    switch (op.mConversion) {
+      case L'd':
+      case L'i':
+        op.mKind = FormatOpKind::eSigned;
+        break;
+      case L'u':
+      case L'o':
+      case L'x':
+      case L'X':
+        op.mKind = FormatOpKind::eUnsigned;
+        break;
+      case L'c':
+        op.mKind = FormatOpKind::eChar;
+        break;
+      case L's':
+        op.mKind = FormatOpKind::eString;
+        break;
+      case L'f':
+      case L'F':
+      case L'e':
+      case L'E':
+      case L'g':
+      case L'G':
+      case L'a':
+      case L'A':
+        op.mKind = FormatOpKind::eFloat;
+        break;
+      case L'p':
+        op.mKind = FormatOpKind::ePointer;
+        break;
+      default:
+        InvalidFormatString("Unsupported conversion specifier");
+        break;
+    }
+
+    if ((op.mKind == FormatOpKind::eChar ||
+         op.mKind == FormatOpKind::eString) &&
+        op.mLength != FormatLength::eNone &&
+        op.mLength != FormatLength::eLong) {
+      InvalidFormatString("Only wide characters and strings are supported");
+    }
+
+    if ((op.mKind == FormatOpKind::eFloat ||
+         op.mKind == FormatOpKind::ePointer) &&
+        op.mLength != FormatLength::eNone &&
+        op.mLength != FormatLength::eLong) {
+      InvalidFormatString("Invalid length modifier");
+    }
+
+    if (op.mEnd - op.mBegin > kMaxSpecLength) {
+      InvalidFormatString("Conversion specification is too long");
+    }
+
+    op.mArgIndex = result.mNumArgs;
+    result.mArgOps[result.mNumArgs++] = result.mNumOps;
+    addOp(op);
+    literalStart = i;
+  }
+
+  flushLiteral(len);
+  return result;
+}
+
+constexpr size_t
+GetLengthSize(FormatLength aLength)
+{
+  switch (aLength) {
+    case FormatLength::eLong:
+      return sizeof(long);
+    case FormatLength::eLongLong:
+      return sizeof(long long);
+    case FormatLength::eSize:
+      return sizeof(size_t);
+    default:
+      // Anything narrower is promoted to int
+      return sizeof(int);
+  }
+}
+
+template <typename T>
+constexpr bool
+ArgMatches(FormatOp const &aOp)
+{
+  using U = std::decay_t<T>;
+
+  switch (aOp.mKind) {
+    case FormatOpKind::eSigned:
+      return std::is_integral_v<U> && !std::is_same_v<U, wchar_t> &&
+             (std::is_signed_v<U> || sizeof(U) < sizeof(int) ||
+              std::is_same_v<U, bool>) &&
+             sizeof(U) <= GetLengthSize(aOp.mLength);
+    case FormatOpKind::eUnsigned:
+      return std::is_integral_v<U> && !std::is_same_v<U, wchar_t> &&
+             sizeof(U) <= GetLengthSize(aOp.mLength);
+    case FormatOpKind::eChar:
+      return std::is_same_v<U, wchar_t>;
+    case FormatOpKind::eString:
+      return std::is_same_v<U, wchar_t*> ||
+             std::is_same_v<U, wchar_t const *> ||
+             std::is_same_v<U, std::wstring> ||
+             std::is_same_v<U, std::wstring_view>;
+    case FormatOpKind::eFloat:
+      return std::is_same_v<U, float> || std::is_same_v<U, double>;
+    case FormatOpKind::ePointer:
+      return std::is_pointer_v<U> || std::is_null_pointer_v<U>;
+    default:
+      return false;
+  }
+}
+
+inline void
+AppendPadded(PrintfBuffer& aBuf, FormatOp const &aOp, std::wstring_view aText)
+{
+  const size_t padding = aOp.mWidth > static_cast<int>(aText.size()) ?
+                           aOp.mWidth - aText.size() : 0;
+  if (!(aOp.mFlags & eFormatLeft)) {
+    aBuf.Append(padding, L' ');
+  }
+  aBuf.Append(aText);
+  if (aOp.mFlags & eFormatLeft) {
+    aBuf.Append(padding, L' ');
+  }
+}
+
+inline void
+AppendInteger(PrintfBuffer& aBuf, FormatOp const &aOp,
+              unsigned long long aMagnitude, bool aNegative)
+{
+  static const wchar_t kLowerDigits[] = L"0123456789abcdef";
+  static const wchar_t kUpperDigits[] = L"0123456789ABCDEF";
+
+  unsigned base = 10;
+  wchar_t const * digitChars = kLowerDigits;
+  switch (aOp.mConversion) {
+    case L'o':
+      base = 8;
+      break;
+    case L'x':
+      base = 16;
+      break;
+    case L'X':
+      base = 16;
+      digitChars = kUpperDigits;
+      break;
+    default:
+      break;
+  }
+
+  // Digits are produced least significant first
+  wchar_t digits[24];
+  size_t numDigits = 0;
+  if (aMagnitude || aOp.mPrecision) {
+    do {
+      digits[numDigits++] = digitChars[aMagnitude % base];
+      aMagnitude /= base;
+    } while (aMagnitude);
+  }
+
+  const bool isZero = numDigits == 0 ||
+                      (numDigits == 1 && digits[0] == L'0');
+
+  wchar_t prefix[2];
+  size_t prefixLen = 0;
+  if (aOp.mKind == FormatOpKind::eSigned) {
+    if (aNegative) {
+      prefix[prefixLen++] = L'-';
+    } else if (aOp.mFlags & eFormatPlus) {
+      prefix[prefixLen++] = L'+';
+    } else if (aOp.mFlags & eFormatSpace) {
+      prefix[prefixLen++] = L' ';
+    }
+  } else if ((aOp.mFlags & eFormatAlt) && !isZero && base == 16) {
+    prefix[prefixLen++] = L'0';
+    prefix[prefixLen++] = aOp.mConversion;
+  }
+
+  size_t precisionZeros = aOp.mPrecision > static_cast<int>(numDigits) ?
+                            aOp.mPrecision - numDigits : 0;
+  if ((aOp.mFlags & eFormatAlt) && base == 8 && !precisionZeros &&
+      (!numDigits || digits[numDigits - 1] != L'0')) {
+    precisionZeros = 1;
+  }
+
+  const size_t contentLen = prefixLen + precisionZeros + numDigits;
+  size_t padding = aOp.mWidth > static_cast<int>(contentLen) ?
+                     aOp.mWidth - contentLen : 0;
+
+  const bool zeroPad = (aOp.mFlags & eFormatZero) &&
+                       !(aOp.mFlags & eFormatLeft) && aOp.mPrecision < 0;
+  if (zeroPad) {
+    precisionZeros += padding;
+    padding = 0;
+  }
+
+  if (!(aOp.mFlags & eFormatLeft)) {
+    aBuf.Append(padding, L' ');
+  }
+  aBuf.Append(std::wstring_view(prefix, prefixLen));
+  aBuf.Append(precisionZeros, L'0');
+  while (numDigits) {
+    aBuf.Append(1, digits[--numDigits]);
+  }
+  if (aOp.mFlags & eFormatLeft) {
+    aBuf.Append(padding, L' ');
+  }
+}
+
+template <typename T>
+inline void
+AppendArg(PrintfBuffer& aBuf, FormatOp const &aOp, wchar_t const * aSpec,
+          T const &aArg)
+{
+  using U = std::decay_t<T>;
+
+  if constexpr (std::is_integral_v<U> && !std::is_same_v<U, wchar_t>) {
+    // bool has no unsigned counterpart; like any vararg it arrives as an int
+    using Promoted = std::conditional_t<std::is_same_v<U, bool>, int, U>;
+    if (aOp.mKind == FormatOpKind::eSigned) {
+      // hh and h convert the promoted argument back to their type
+      long long value = static_cast<long long>(static_cast<Promoted>(aArg));
+      if (aOp.mLength == FormatLength::eChar) {
+        value = static_cast<signed char>(value);
+      } else if (aOp.mLength == FormatLength::eShort) {
+        value = static_cast<short>(value);
+      }
+      const unsigned long long magnitude =
+        value < 0 ? 0ULL - static_cast<unsigned long long>(value)
+                  : static_cast<unsigned long long>(value);
+      AppendInteger(aBuf, aOp, magnitude, value < 0);
+    } else {
+      unsigned long long value =
+        static_cast<std::make_unsigned_t<Promoted>>(aArg);
+      if (aOp.mLength == FormatLength::eChar) {
+        value = static_cast<unsigned char>(value);
+      } else if (aOp.mLength == FormatLength::eShort) {
+        value = static_cast<unsigned short>(value);
+      } else if (sizeof(U) < sizeof(int)) {
+        // Promoted to int, then reinterpreted as unsigned int
+        value = static_cast<unsigned int>(static_cast<int>(aArg));
+      }
+      AppendInteger(aBuf, aOp, value, false);
+    }
+  } else if constexpr (std::is_same_v<U, wchar_t>) {
+    AppendPadded(aBuf, aOp, std::wstring_view(&aArg, 1));
+  } else if constexpr (std::is_same_v<U, wchar_t*> ||
+                       std::is_same_v<U, wchar_t const *>) {
+    wchar_t const * str = aArg;
+    std::wstring_view text(str ? str : L"(null)");
+    if (aOp.mPrecision >= 0 && text.size() > size_t(aOp.mPrecision)) {
+      text = text.substr(0, aOp.mPrecision);
+    }
+    AppendPadded(aBuf, aOp, text);
+  } else if constexpr (std::is_same_v<U, std::wstring> ||
+                       std::is_same_v<U, std::wstring_view>) {
+    std::wstring_view text(aArg);
+    if (aOp.mPrecision >= 0 && text.size() > size_t(aOp.mPrecision)) {
+      text = text.substr(0, aOp.mPrecision);
+    }
+    AppendPadded(aBuf, aOp, text);
+  } else if constexpr (std::is_floating_point_v<U>) {
+    // Floating point conversion is not worth reimplementing; format just this
+    // one specification with the CRT.
+    aBuf.AppendFormat(aSpec, static_cast<double>(aArg));
+  } else {
+    aBuf.AppendFormat(aSpec, static_cast<void const *>(aArg));
+  }
+}
+
+} // namespace detail
+
+// Printf-style formatter whose format string is parsed, and whose argument
+// types are checked, at compile time. Each distinct format string yields a
+// specialized formatter with no runtime format parsing or varargs.
+//
+// Supported conversions are d i u o x X c s f F e E g G a A p with the usual
+// flags, a literal width and precision, and the hh h l ll z length modifiers.
+// As with the wide CRT functions, %s and %c take wide strings and characters.
+//
+// Tabs in the format string delimit columns, so the number of columns is
+// known at compile time. Tabs inside arguments do not start a new column, and
+// empty columns are preserved.
+template <FixedFormat Fmt, typename... Args>
+class CompiledFormat
+{
+  static constexpr auto kParsed = detail::ParseFormat(Fmt);
+
+  template <size_t... ArgIndex>
+  static constexpr bool
+  AllArgsMatch(std::index_sequence<ArgIndex...>)
+  {
+    return (detail::ArgMatches<Args>(kParsed.mOps[kParsed.mArgOps[ArgIndex]]) && ...);
+  }
+
+public:
+  static constexpr size_t kNumColumns = kParsed.mNumColumns;
+  using Cells = std::array<std::wstring_view, kNumColumns>;
+
+  static_assert(sizeof...(Args) == kParsed.mNumArgs,
+                "Wrong number of arguments for format string");
+  static_assert(AllArgsMatch(std::index_sequence_for<Args...>()),
+                "Argument type does not match its conversion specifier");
+
+  // Replaces the contents of aBuf with the formatted text and points aCells
+  // at each column. Column views do not include the separating tabs, and are
+  // invalidated by the next modification of aBuf.
+  static void
+  Format(PrintfBuffer& aBuf, Cells& aCells, Args const &... aArgs)
+  {
+    std::array<size_t, kNumColumns + 1> bounds;
+    bounds[0] = 0;
+    size_t column = 0;
+
+    aBuf.Clear();
+    EmitOps(aBuf, bounds, column, std::forward_as_tuple(aArgs...),
+            std::make_index_sequence<kParsed.mNumOps>());
+    bounds[kNumColumns] = aBuf.GetLength();
+
+    std::wstring_view text = aBuf.GetText();
+    for (size_t i = 0; i < kNumColumns; ++i) {
+      aCells[i] = text.substr(bounds[i], bounds[i + 1] - bounds[i]);
+    }
+  }
+
+private:
+  template <size_t OpIndex>
+  static constexpr auto
+  GetSpec()
+  {
+    constexpr detail::FormatOp op = kParsed.mOps[OpIndex];
+    std::array<wchar_t, detail::kMaxSpecLength + 1> spec{};
+    for (size_t i = op.mBegin; i < op.mEnd; ++i) {
+      spec[i - op.mBegin] = Fmt[i];
+    }
+    return spec;
+  }
+
+  template <typename Tuple, size_t... OpIndex>
+  static void
+  EmitOps(PrintfBuffer& aBuf, std::array<size_t, kNumColumns + 1>& aBounds,
+          size_t& aColumn, Tuple const &aArgs, std::index_sequence<OpIndex...>)
+  {
+    (EmitOp<OpIndex>(aBuf, aBounds, aColumn, aArgs), ...);
+  }
+
+  template <size_t OpIndex, typename Tuple>
+  static void
+  EmitOp(PrintfBuffer& aBuf, std::array<size_t, kNumColumns + 1>& aBounds,
+         size_t& aColumn, Tuple const &aArgs)
+  {
+    constexpr detail::FormatOp op = kParsed.mOps[OpIndex];
+
+    if constexpr (op.mKind == detail::FormatOpKind::eLiteral) {
+      aBuf.Append(std::wstring_view(Fmt.mText + op.mBegin,
+                                    op.mEnd - op.mBegin));
+    } else if constexpr (op.mKind == detail::FormatOpKind::eCellBreak) {
+      aBounds[++aColumn] = aBuf.GetLength();
+    } else {
+      static constexpr auto kSpec = GetSpec<OpIndex>();
+      detail::AppendArg(aBuf, op, kSpec.data(), std::get<op.mArgIndex>(aArgs));
+    }
+  }
+};
+
+} // namespace aspk
+
+#endif // __ASPK_COMPILEDFORMAT_H
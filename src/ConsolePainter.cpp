@@ -0,0 +1,70 @@
+#include "ConsolePainter.h"
+
+#include <algorithm>
+
+namespace aspk {
+
+size_t
+PaintConsoleLines(PaintSurface& aSurface, RowStore const &aLines,
+                  size_t aTopLine, int aLineHeight, PixelRect const &aClientRect)
+{
+  const size_t lineCount = aLines.GetRowCount();
+  if (aLineHeight <= 0 || aTopLine >= lineCount) {
+    return 0;
+  }
+
+  PixelRect paintRect = aSurface.GetClipRect().Intersect(aClientRect);
+  if (paintRect.IsEmpty()) {
+    return 0;
+  }
+
+  const int paintTop = paintRect.mTop - aClientRect.mTop;
+  const int paintBottom = paintRect.mBottom - aClientRect.mTop;
+  const size_t firstLine = aTopLine + paintTop / aLineHeight;
+  const size_t endLine = std::min(lineCount,
+                                  aTopLine +
+                                  (paintBottom + aLineHeight - 1) / aLineHeight);
+
+  aSurface.SetFont(PaintSurface::eMessageFont);
+  size_t numDrawn = 0;
+  PixelRect lineRect = aClientRect;
+  for (size_t line = firstLine; line < endLine; ++line) {
+    std::wstring_view text = aLines.GetCell(line, 0);
+    if (text.empty()) {
+      continue;
+    }
+
+    lineRect.mTop = aClientRect.mTop +
+                    static_cast<int>(line - aTopLine) * aLineHeight;
+    lineRect.mBottom = lineRect.mTop + aLineHeight;
+    if (!aSurface.DrawText(lineRect, text)) {
+      break;
+    }
+    ++numDrawn;
+  }
+  return numDrawn;
+}
+
+void
+PaintCornerOverlay(PaintSurface& aSurface, std::wstring_view aText,
+                   PixelRect const &aClientRect, int aMargin,
+                   uint32_t aBackPixel, uint32_t aColor)
+{
+  aSurface.SetFont(PaintSurface::eFixedFont);
+  const PixelSize size = aSurface.MeasureText(aText);
+
+  PixelRect textRect;
+  textRect.mRight = aClientRect.mRight - aMargin;
+  textRect.mBottom = aClientRect.mBottom - aMargin;
+  textRect.mLeft = textRect.mRight - size.mWidth;
+  textRect.mTop = textRect.mBottom - size.mHeight;
+
+  aSurface.FillRect(PixelRect{textRect.mLeft - aMargin, textRect.mTop - aMargin,
+                              textRect.mRight + aMargin,
+                              textRect.mBottom + aMargin},
+                    aBackPixel);
+  aSurface.DrawText(textRect, aText, aColor);
+  aSurface.SetFont(PaintSurface::eMessageFont);
+}
+
+} // namespace aspk
@@ -0,0 +1,28 @@
+#ifndef __ASPK_CONSOLEPAINTER_H
+#define __ASPK_CONSOLEPAINTER_H
+
+#include <cstddef>
+
+#include "PaintSurface.h"
+#include "RowStore.h"
+
+namespace aspk {
+
+// Draws the text-mode console: the lines of the single-column aLines, with
+// aTopLine at the top of aClientRect and aLineHeight pixels apart. Only lines
+// that intersect the surface's clip rect are drawn, so the cost of a paint
+// does not depend on how much scrollback there is. Empty lines are skipped.
+// Returns the number of lines drawn.
+size_t PaintConsoleLines(PaintSurface& aSurface, RowStore const &aLines,
+                         size_t aTopLine, int aLineHeight,
+                         PixelRect const &aClientRect);
+
+// Draws aText in aColor over a aBackPixel panel anchored to the bottom-right
+// corner of aClientRect, aMargin pixels in from each edge, in the fixed font
+void PaintCornerOverlay(PaintSurface& aSurface, std::wstring_view aText,
+                        PixelRect const &aClientRect, int aMargin,
+                        uint32_t aBackPixel, uint32_t aColor);
+
+} // namespace aspk
+
+#endif // __ASPK_CONSOLEPAINTER_H
@@ -1,15 +1,119 @@
 #include "DpiScaler.h"
 
 #include "odbs.h"
-#include "UniqueHandle.h"
 
+#ifdef _WIN32
 #include <ShellScalingApi.h>
+#endif
+
+#include <map>
+#include <mutex>
+#include <utility>
 
 namespace aspk {
 
+static constexpr DpiScaler sNominal(100, 100);
+
+// Constant-initialized, so handles work during static initialization
+DpiScaler const * DpiScaler::sShared[DpiScaler::kMaxSharedScalers] = { &sNominal };
+// 100% is standard scale 0
+std::array<uint8_t, 2> DpiScaler::sSharedScaleIndex[DpiScaler::kMaxSharedScalers] = {};
+
+namespace {
+
+struct DpiCache
+{
+  DpiCache()
+    : mSharedCount(1)
+#ifdef _WIN32
+    , mHasSystem(false)
+#endif
+  {
+    mScales.emplace(std::make_pair(100, 100), DpiScalerHandle());
+  }
+
+  std::mutex                                          mMutex;
+  // Every scaler ever handed out, keyed by scale. There are only ever a few.
+  std::map<std::pair<int, int>, DpiScalerHandle>      mScales;
+  size_t                                              mSharedCount;
+#ifdef _WIN32
+  std::map<HMONITOR, DpiScalerHandle>                 mMonitors;
+  DpiScalerHandle                                     mSystem;
+  bool                                                mHasSystem;
+#endif
+};
+
+DpiCache&
+GetDpiCache()
+{
+  static DpiCache sCache;
+  return sCache;
+}
+
+} // anonymous namespace
+
+void
+DpiScaler::Invalidate(int aNewXDpi, int aNewYDpi)
+{
+  mXScalePercent = (aNewXDpi * 100) / NOMINAL_DPI;
+  mYScalePercent = (aNewYDpi * 100) / NOMINAL_DPI;
+  Log<eLogVerbose>(L"DpiScaler::Invalidate X: ", mXScalePercent, L"%, Y: ", mYScalePercent, L"%");
+}
+
+/* static */ DpiScalerHandle
+DpiScaler::GetForDpi(int aXDpi, int aYDpi)
+{
+  return GetForScale((aXDpi * 100) / NOMINAL_DPI, (aYDpi * 100) / NOMINAL_DPI);
+}
+
+/* static */ DpiScalerHandle
+DpiScaler::GetForScale(int aXScalePercent, int aYScalePercent)
+{
+  DpiCache &cache = GetDpiCache();
+  std::lock_guard<std::mutex> lock(cache.mMutex);
+  auto key = std::make_pair(aXScalePercent, aYScalePercent);
+  auto itr = cache.mScales.find(key);
+  if (itr != cache.mScales.end()) {
+    return itr->second;
+  }
+
+  if (cache.mSharedCount == kMaxSharedScalers) {
+    Log<eLogWarning>(L"Too many distinct DPI scales, using nominal");
+    return DpiScalerHandle();
+  }
+
+  // Shared scalers are deliberately never freed, so handles cannot dangle
+  const uint16_t index = static_cast<uint16_t>(cache.mSharedCount++);
+  sShared[index] = new DpiScaler(aXScalePercent, aYScalePercent);
+  sSharedScaleIndex[index] = {
+    static_cast<uint8_t>(detail::GetStandardScaleIndex(aXScalePercent)),
+    static_cast<uint8_t>(detail::GetStandardScaleIndex(aYScalePercent))
+  };
+  Log<eLogVerbose>(L"DpiScaler shared X: ", aXScalePercent, L"%, Y: ",
+                   aYScalePercent, L"%");
+  DpiScalerHandle handle(index);
+  cache.mScales.emplace(key, handle);
+  return handle;
+}
+
+#ifdef _WIN32
+
 typedef LRESULT (WINAPI* GetDpiForMonitorPtr)(HMONITOR,MONITOR_DPI_TYPE,UINT*,UINT*);
 
-std::shared_ptr<DpiScaler const> DpiScaler::sNominal = std::make_shared<DpiScaler>(100, 100);
+// Resolved once per process. shcore.dll is deliberately never unloaded.
+static GetDpiForMonitorPtr
+GetDpiForMonitorEntryPoint()
+{
+  static const GetDpiForMonitorPtr sGetDpiForMonitor = []() {
+    HMODULE shcore = ::LoadLibraryW(L"shcore.dll");
+    if (!shcore) {
+      return GetDpiForMonitorPtr(nullptr);
+    }
+    return reinterpret_cast<GetDpiForMonitorPtr>(
+      ::GetProcAddress(shcore, "GetDpiForMonitor"));
+  }();
+  return sGetDpiForMonitor;
+}
 
 DpiScaler::DpiScaler(HWND aHwnd)
   : mXScalePercent(0)
@@ -26,53 +130,104 @@ DpiScaler::DpiScaler()
   Init();
 }
 
-DpiScaler::DpiScaler(const int aXScalePercent,
-                     const int aYScalePercent)
-  : mXScalePercent(aXScalePercent)
-  , mYScalePercent(aYScalePercent)
+void
+DpiScaler::Init(HMONITOR aMonitor)
 {
+  *this = *GetForMonitor(aMonitor);
 }
 
 void
-DpiScaler::Init(HMONITOR aMonitor)
+DpiScaler::Init()
+{
+  *this = *GetForSystem();
+}
+
+/* static */ bool
+DpiScaler::QueryMonitorDpi(HMONITOR aMonitor, UINT &aXDpi, UINT &aYDpi)
 {
-  UINT x, y;
   // Try the Windows 8 monitor-aware way
-  UniqueModule shcore(::LoadLibraryW(L"shcore.dll"));
-  if (shcore) {
-    GetDpiForMonitorPtr pGetDpiForMonitor = (GetDpiForMonitorPtr) GetProcAddress(shcore.get(), "GetDpiForMonitor");
-    if (pGetDpiForMonitor) {
-      if (SUCCEEDED(pGetDpiForMonitor(aMonitor, MDT_EFFECTIVE_DPI, &x, &y))) {
-        Invalidate(x, y);
-        return;
-      }
-    }
-  }
-  // Oh well, try the old system-wide way
-  Init();
+  GetDpiForMonitorPtr pGetDpiForMonitor = GetDpiForMonitorEntryPoint();
+  return pGetDpiForMonitor &&
+         SUCCEEDED(pGetDpiForMonitor(aMonitor, MDT_EFFECTIVE_DPI, &aXDpi, &aYDpi));
 }
 
-void
-DpiScaler::Init()
+/* static */ bool
+DpiScaler::QuerySystemDpi(UINT &aXDpi, UINT &aYDpi)
 {
   HDC dc = GetDC(NULL);
   if (!dc) {
-    return;
+    return false;
   }
-  UINT x = GetDeviceCaps(dc, LOGPIXELSX);
-  UINT y = GetDeviceCaps(dc, LOGPIXELSY);
+  aXDpi = GetDeviceCaps(dc, LOGPIXELSX);
+  aYDpi = GetDeviceCaps(dc, LOGPIXELSY);
   ReleaseDC(NULL, dc);
-  odbs(L"Device Caps says ", x * 100 / 96, L"%");
-  Invalidate(x, y);
+  odbs(L"Device Caps says ", aXDpi * 100 / 96, L"%");
+  return true;
 }
 
-void
-DpiScaler::Invalidate(int aNewXDpi, int aNewYDpi)
+/* static */ DpiScalerHandle
+DpiScaler::GetForMonitor(HMONITOR aMonitor)
 {
-  mXScalePercent = (aNewXDpi * 100) / NOMINAL_DPI;
-  mYScalePercent = (aNewYDpi * 100) / NOMINAL_DPI;
-  odbs(L"DpiScaler::Invalidate X: ", mXScalePercent, L"%, Y: ", mYScalePercent, L"%");
+  DpiCache &cache = GetDpiCache();
+  {
+    std::lock_guard<std::mutex> lock(cache.mMutex);
+    auto itr = cache.mMonitors.find(aMonitor);
+    if (itr != cache.mMonitors.end()) {
+      return itr->second;
+    }
+  }
+
+  UINT x, y;
+  if (!QueryMonitorDpi(aMonitor, x, y)) {
+    // Oh well, use the old system-wide value
+    return GetForSystem();
+  }
+
+  DpiScalerHandle handle = GetForDpi(x, y);
+  std::lock_guard<std::mutex> lock(cache.mMutex);
+  cache.mMonitors[aMonitor] = handle;
+  return handle;
 }
 
-} // namespace aspk
+/* static */ DpiScalerHandle
+DpiScaler::GetForWindow(HWND aHwnd)
+{
+  return GetForMonitor(::MonitorFromWindow(aHwnd, MONITOR_DEFAULTTONEAREST));
+}
+
+/* static */ DpiScalerHandle
+DpiScaler::GetForSystem()
+{
+  DpiCache &cache = GetDpiCache();
+  {
+    std::lock_guard<std::mutex> lock(cache.mMutex);
+    if (cache.mHasSystem) {
+      return cache.mSystem;
+    }
+  }
+
+  UINT x, y;
+  if (!QuerySystemDpi(x, y)) {
+    // Don't cache a failure
+    return DpiScalerHandle();
+  }
 
+  DpiScalerHandle handle = GetForDpi(x, y);
+  std::lock_guard<std::mutex> lock(cache.mMutex);
+  cache.mSystem = handle;
+  cache.mHasSystem = true;
+  return handle;
+}
+
+/* static */ void
+DpiScaler::InvalidateMonitorCache()
+{
+  DpiCache &cache = GetDpiCache();
+  std::lock_guard<std::mutex> lock(cache.mMutex);
+  cache.mMonitors.clear();
+  cache.mHasSystem = false;
+}
+
+#endif // _WIN32
+
+} // namespace aspk
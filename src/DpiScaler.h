@@ -3,20 +3,72 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdint>
 #include <initializer_list>
-#include <memory>
+#include <span>
 #include <stdexcept>
+#include <type_traits>
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
+
+#include "BatchScale.h"
+#include "ScaleRatio.h"
 
 namespace aspk {
 
+class DpiScaler;
+
+// A small, trivially copyable reference to one of the process's shared
+// DpiScalers. Handles never dangle: shared scalers live until exit. The
+// default handle refers to the nominal (100%) scaler.
+class DpiScalerHandle
+{
+public:
+  constexpr DpiScalerHandle()
+    : mIndex(0)
+  {
+  }
+
+  inline DpiScaler const * get() const;
+
+  DpiScaler const * operator->() const { return get(); }
+  DpiScaler const & operator*() const { return *get(); }
+
+  bool operator==(DpiScalerHandle const &aOther) const = default;
+
+  uint16_t GetIndex() const { return mIndex; }
+
+private:
+  friend class DpiScaler;
+
+  explicit constexpr DpiScalerHandle(uint16_t aIndex)
+    : mIndex(aIndex)
+  {
+  }
+
+  uint16_t mIndex;
+};
+
+// Converts between 96 DPI coordinates and a display's DPI. Scalers returned
+// by the static Get* functions are immutable and shared process-wide: there
+// is exactly one per distinct scale, so windows on the same monitor (or on
+// monitors with the same DPI) share a scaler and ScaledValue can compare
+// scalers by handle. The scaling math and the shared registry have no Win32
+// dependencies; only querying displays does.
 class DpiScaler
 {
 public:
+#ifdef _WIN32
   explicit DpiScaler(HWND aHwnd);
   DpiScaler();
-  DpiScaler(const int aXScalePercent, const int aYScalePercent);
+#endif
+  constexpr DpiScaler(const int aXScalePercent, const int aYScalePercent)
+    : mXScalePercent(aXScalePercent)
+    , mYScalePercent(aYScalePercent)
+  {
+  }
 
   int ScaleX(int aRaw) const
   {
@@ -49,22 +101,77 @@ public:
     Invalidate(NOMINAL_DPI, NOMINAL_DPI);
   }
 
-  static std::shared_ptr<DpiScaler const> GetNominal()
+  static DpiScalerHandle GetNominal()
   {
-    return sNominal;
+    return DpiScalerHandle();
   }
 
+  // The X and Y ratios from one shared scaler to another. Between standard
+  // scales this indexes the precomputed ratio table by handle, without
+  // touching the scalers themselves.
+  static inline std::array<ScaleRatio, 2>
+  GetScaleRatios(DpiScalerHandle aFrom, DpiScalerHandle aTo);
+
+  // Shared scalers. Monitor and system DPIs are cached, so after the first
+  // query these make no loader or GDI calls.
+  static DpiScalerHandle GetForDpi(int aXDpi, int aYDpi);
+  static DpiScalerHandle GetForScale(int aXScalePercent, int aYScalePercent);
+#ifdef _WIN32
+  static DpiScalerHandle GetForMonitor(HMONITOR aMonitor);
+  static DpiScalerHandle GetForWindow(HWND aHwnd);
+  static DpiScalerHandle GetForSystem();
+  // For WM_DISPLAYCHANGE and WM_SETTINGCHANGE: monitors may have been added,
+  // removed or rescaled. Handles already handed out remain valid.
+  static void InvalidateMonitorCache();
+#endif
+
+  // Upper bound on distinct shared scales; beyond it GetForScale returns the
+  // nominal scaler
+  static const size_t kMaxSharedScalers = 1024;
+
 private:
+  friend class DpiScalerHandle;
+
+#ifdef _WIN32
+  static bool QueryMonitorDpi(HMONITOR aMonitor, UINT &aXDpi, UINT &aYDpi);
+  static bool QuerySystemDpi(UINT &aXDpi, UINT &aYDpi);
+
   void Init(HMONITOR aMonitor);
   void Init();
+#endif
 
   int mXScalePercent;
   int mYScalePercent;
 
   static const int NOMINAL_DPI = 96;
-  static std::shared_ptr<DpiScaler const> sNominal;
+  // Append-only; entry 0 is the nominal scaler
+  static DpiScaler const * sShared[kMaxSharedScalers];
+  // For each shared scaler, the indexes of its X and Y scales in
+  // kStandardScalePercents, or detail::kNotStandardScale
+  static std::array<uint8_t, 2> sSharedScaleIndex[kMaxSharedScalers];
 };
 
+inline DpiScaler const *
+DpiScalerHandle::get() const
+{
+  return DpiScaler::sShared[mIndex];
+}
+
+/* static */ inline std::array<ScaleRatio, 2>
+DpiScaler::GetScaleRatios(DpiScalerHandle aFrom, DpiScalerHandle aTo)
+{
+  std::array<uint8_t, 2> const &from = sSharedScaleIndex[aFrom.mIndex];
+  std::array<uint8_t, 2> const &to = sSharedScaleIndex[aTo.mIndex];
+  // Standard indexes are below 16, so only a non-standard one sets every bit
+  if ((from[0] | from[1] | to[0] | to[1]) != detail::kNotStandardScale) {
+    constexpr size_t count = kStandardScalePercents.size();
+    return {detail::kStandardScaleRatios[from[0] * count + to[0]],
+            detail::kStandardScaleRatios[from[1] * count + to[1]]};
+  }
+  return {GetScaleRatio(aFrom->GetXScale(), aTo->GetXScale()),
+          GetScaleRatio(aFrom->GetYScale(), aTo->GetYScale())};
+}
+
 namespace detail {
 
 enum Dimension
@@ -76,26 +183,42 @@ enum Dimension
 
 } // namespace detail
 
+inline void
+RectExToIn(std::array<int, 4>& aRect)
+{
+  aRect[2] -= 1;
+  aRect[3] -= 1;
+}
+
+inline void
+RectInToEx(std::array<int, 4>& aRect)
+{
+  aRect[2] += 1;
+  aRect[3] += 1;
+}
+
 template <size_t N, detail::Dimension Dim = detail::eDimensionCount>
 class ScaledValue
 {
 public:
-  explicit ScaledValue(std::shared_ptr<DpiScaler const> aScaler)
+  explicit ScaledValue(DpiScalerHandle aScaler)
     : mScaler(aScaler)
     , mRescale(true)
   {
     mValues.fill(0);
   }
 
-  ScaledValue(std::shared_ptr<DpiScaler const> aScaler,
+#ifdef _WIN32
+  ScaledValue(DpiScalerHandle aScaler,
               RECT const &aRect)
     : mScaler(aScaler)
     , mRescale(true)
   {
     mValues = {aRect.left, aRect.top, aRect.right, aRect.bottom};
   }
+#endif
 
-  ScaledValue(std::shared_ptr<DpiScaler const> aScaler,
+  ScaledValue(DpiScalerHandle aScaler,
               std::initializer_list<int> const &aInitList)
     : mScaler(aScaler)
     , mRescale(true)
@@ -103,17 +226,17 @@ public:
     std::copy(aInitList.begin(), aInitList.end(), mValues.begin());
   }
 
-  ScaledValue(std::shared_ptr<DpiScaler const> aScaler,
+  ScaledValue(DpiScalerHandle aScaler,
               std::array<int, N> &aInitData)
-    : mScaler(aScaler)
-    , mValues(aInitData)
+    : mValues(aInitData)
+    , mScaler(aScaler)
     , mRescale(true)
   {
   }
 
   void SetNoRescale()
   {
-    mRescale = false3;
+    mRescale = false;
   }
 
   int* ptr()
@@ -144,51 +267,78 @@ public:
     return mValues.at(aIndex);
   }
 
-  std::shared_ptr<DpiScaler const>
+  DpiScalerHandle
   GetScaler() const
   {
     return mScaler;
   }
 
   inline ScaledValue<N>
-  ScaleTo(std::shared_ptr<DpiScaler const> const &aOtherScaler) const
+  ScaleTo(DpiScalerHandle aOtherScaler) const
   {
     if (!mRescale || mScaler == aOtherScaler) {
       return *this;
     }
-    int ratios[] = {
-      aOtherScaler->GetXScale() * 100 / mScaler->GetXScale(),
-      aOtherScaler->GetYScale() * 100 / mScaler->GetYScale()
-    };
+    const std::array<ScaleRatio, 2> ratios =
+      DpiScaler::GetScaleRatios(mScaler, aOtherScaler);
+    static_assert(N % 2 == 0, "Values alternate between X and Y");
     std::array<int, N> newValues(mValues);
-    if (N == 4) {
+    if constexpr (N == 4) {
       // Treat indexes 2 and 3 as exclusive
       RectExToIn(newValues);
     }
-    int i = 0;
-    std::for_each(newValues.begin(), newValues.end(), [&](int& a) {
-      a *= ratios[i % 2];
-      a = rounded_div(a, 100);
-      ++i;
-    });
-    if (N == 4) {
+    for (size_t i = 0; i < N; i += 2) {
+      newValues[i] = ratios[0].Apply(newValues[i]);
+      newValues[i + 1] = ratios[1].Apply(newValues[i + 1]);
+    }
+    if constexpr (N == 4) {
       // Treat indexes 2 and 3 as exclusive
       RectInToEx(newValues);
     }
     return ScaledValue<N>(aOtherScaler, newValues);
   }
 
-private:
-  ScaledValue() = delete;
-  static int rounded_div(int const aN, int const aD)
+  // Rescales every value in aValues to aOtherScaler in place, with results
+  // identical to calling ScaleTo on each. Runs of values sharing a scaler
+  // are handed to the SIMD kernels in one call.
+  static void
+  ScaleAllTo(std::span<ScaledValue> aValues, DpiScalerHandle aOtherScaler)
   {
-    return ((aN < 0) ^ (aD < 0)) ?
-             ((aN - aD / 2) / aD) :
-             ((aN + aD / 2) / aD);
+    static_assert(N == 2 || N == 4, "Only points and rects are batched");
+    size_t first = 0;
+    while (first < aValues.size()) {
+      ScaledValue const &head = aValues[first];
+      size_t end = first + 1;
+      while (end < aValues.size() && aValues[end].mScaler == head.mScaler &&
+             aValues[end].mRescale == head.mRescale) {
+        ++end;
+      }
+
+      if (head.mRescale && head.mScaler != aOtherScaler) {
+        const std::array<ScaleRatio, 2> ratios =
+          DpiScaler::GetScaleRatios(head.mScaler, aOtherScaler);
+        int* values = aValues[first].mValues.data();
+        if constexpr (N == 4) {
+          ScaleRects(values, sizeof(ScaledValue), end - first, ratios[0],
+                     ratios[1]);
+        } else {
+          ScalePoints(values, sizeof(ScaledValue), end - first, ratios[0],
+                      ratios[1]);
+        }
+        for (size_t i = first; i < end; ++i) {
+          aValues[i].mScaler = aOtherScaler;
+        }
+      }
+      first = end;
+    }
   }
 
-  std::shared_ptr<DpiScaler const>  mScaler;
+private:
+  ScaledValue() = delete;
+
+  // Values first, so the handle and flag pack into the tail
   std::array<int, N>                mValues;
+  DpiScalerHandle                   mScaler;
   bool                              mRescale;
 };
 
@@ -196,16 +346,16 @@ template<detail::Dimension Dim>
 class ScaledValue<1, Dim>
 {
 public:
-  explicit ScaledValue(std::shared_ptr<DpiScaler const> aScaler)
-    : mScaler(aScaler)
-    , mValue(0)
+  explicit ScaledValue(DpiScalerHandle aScaler)
+    : mValue(0)
+    , mScaler(aScaler)
     , mRescale(true)
   {
   }
 
-  ScaledValue(std::shared_ptr<DpiScaler const> aScaler, int const &aInit)
-    : mScaler(aScaler)
-    , mValue(aInit)
+  ScaledValue(DpiScalerHandle aScaler, int const &aInit)
+    : mValue(aInit)
+    , mScaler(aScaler)
     , mRescale(true)
   {
   }
@@ -221,23 +371,21 @@ public:
     return mValue;
   }
 
-  std::shared_ptr<DpiScaler const>
+  DpiScalerHandle
   GetScaler() const
   {
     return mScaler;
   }
 
   inline ScaledValue<1, Dim>
-  ScaleTo(std::shared_ptr<DpiScaler const> const &aOtherScaler) const
+  ScaleTo(DpiScalerHandle aOtherScaler) const
   {
     if (!mRescale || mScaler == aOtherScaler) {
       return *this;
     }
-    int ratio = Dim == detail::eDimensionX ?
-                  (aOtherScaler->GetXScale() * 100 / mScaler->GetXScale()) :
-                  (aOtherScaler->GetYScale() * 100 / mScaler->GetYScale());
-    // int newValue = mValue * ratio / 100;
-    int newValue = rounded_div(mValue * ratio, 100);
+    const ScaleRatio ratio =
+      DpiScaler::GetScaleRatios(mScaler, aOtherScaler)[Dim];
+    int newValue = ratio.Apply(mValue);
     return ScaledValue<1, Dim>(aOtherScaler, newValue);
   }
 
@@ -263,15 +411,9 @@ public:
 
 private:
   ScaledValue() = delete;
-  static int rounded_div(int const aN, int const aD)
-  {
-    return ((aN < 0) ^ (aD < 0)) ?
-             ((aN - aD / 2) / aD) :
-             ((aN + aD / 2) / aD);
-  }
 
-  std::shared_ptr<DpiScaler const>  mScaler;
   int                               mValue;
+  DpiScalerHandle                   mScaler;
   bool                              mRescale;
 };
 
@@ -280,30 +422,52 @@ typedef ScaledValue<1, detail::eDimensionY> ScaledDimensionY;
 typedef ScaledValue<2> ScaledPoint;
 typedef ScaledValue<4> ScaledRect;
 
-inline ScaledDimensionX
-RectWidth(ScaledRect const &aRect)
+// These are passed around by value during layout
+static_assert(std::is_trivially_copyable_v<ScaledDimensionX> &&
+              std::is_trivially_copyable_v<ScaledPoint> &&
+              std::is_trivially_copyable_v<ScaledRect>);
+static_assert(sizeof(ScaledDimensionX) <= 8);
+
+#ifdef _WIN32
+// Rescales plain RECTs/POINTs, such as damage or hit-test rects, from one
+// scaler to another exactly as ScaledRect/ScaledPoint::ScaleTo would
+inline void
+ScaleRects(std::span<RECT> aRects, DpiScalerHandle aFrom, DpiScalerHandle aTo)
 {
-  return ScaledDimensionX(aRect.GetScaler(), aRect[2] - aRect[0]);
+  static_assert(sizeof(LONG) == sizeof(int));
+  if (aFrom == aTo || aRects.empty()) {
+    return;
+  }
+  const std::array<ScaleRatio, 2> ratios =
+    DpiScaler::GetScaleRatios(aFrom, aTo);
+  ScaleRects(reinterpret_cast<int*>(aRects.data()), sizeof(RECT), aRects.size(),
+             ratios[0], ratios[1]);
 }
 
-inline ScaledDimensionY
-RectHeight(ScaledRect const &aRect)
+inline void
+ScalePoints(std::span<POINT> aPoints, DpiScalerHandle aFrom, DpiScalerHandle aTo)
 {
-  return ScaledDimensionY(aRect.GetScaler(), aRect[3] - aRect[1]);
+  static_assert(sizeof(LONG) == sizeof(int));
+  if (aFrom == aTo || aPoints.empty()) {
+    return;
+  }
+  const std::array<ScaleRatio, 2> ratios =
+    DpiScaler::GetScaleRatios(aFrom, aTo);
+  ScalePoints(reinterpret_cast<int*>(aPoints.data()), sizeof(POINT),
+              aPoints.size(), ratios[0], ratios[1]);
 }
+#endif // _WIN32
 
-inline void
-RectExToIn(std::array<int, 4>& aRect)
+inline ScaledDimensionX
+RectWidth(ScaledRect const &aRect)
 {
-  aRect[2] -= 1;
-  aRect[3] -= 1;
+  return ScaledDimensionX(aRect.GetScaler(), aRect[2] - aRect[0]);
 }
 
-inline void
-RectInToEx(std::array<int, 4>& aRect)
+inline ScaledDimensionY
+RectHeight(ScaledRect const &aRect)
 {
-  aRect[2] += 1;
-  aRect[3] += 1;
+  return ScaledDimensionY(aRect.GetScaler(), aRect[3] - aRect[1]);
 }
 
 template<detail::Dimension Dim>
@@ -322,6 +486,7 @@ ScalarInToEx(ScaledValue<1, Dim> &aIn)
 
 } // namespace aspk
 
+#ifdef _WIN32
 inline RECT*
 operator&(aspk::ScaledRect &aRect)
 {
@@ -333,6 +498,7 @@ operator&(aspk::ScaledRect const &aRect)
 {
   return reinterpret_cast<RECT const *>(aRect.ptr());
 }
+#endif // _WIN32
 
 #endif // __ASPK_DPISCALER_H
 
@@ -0,0 +1,84 @@
+#include "FramePacer.h"
+
+#include <cwchar>
+
+namespace aspk {
+
+FramePacer::FramePacer()
+  : mVBlank()
+  , mInterval(kDefaultInterval)
+  , mLastPresent()
+  , mHasPresented(false)
+  , mPending(false)
+  , mRequestCount(0)
+  , mPresentedCount(0)
+  , mSkippedCount(0)
+{
+}
+
+void
+FramePacer::SetTiming(Clock::time_point aVBlank,
+                      std::chrono::nanoseconds aInterval)
+{
+  if (aInterval.count() <= 0) {
+    return;
+  }
+  mVBlank = aVBlank;
+  mInterval = aInterval;
+}
+
+bool
+FramePacer::Request()
+{
+  ++mRequestCount;
+  if (mPending) {
+    ++mSkippedCount;
+    return false;
+  }
+  mPending = true;
+  return true;
+}
+
+int64_t
+FramePacer::GetIntervalIndex(Clock::time_point aTime) const
+{
+  const int64_t offset = (aTime - mVBlank).count();
+  const int64_t interval = std::chrono::duration_cast<Clock::duration>(mInterval).count();
+  // Round towards negative infinity, for times before the reference vblank
+  return offset >= 0 ? offset / interval : -((-offset + interval - 1) / interval);
+}
+
+FramePacer::Clock::time_point
+FramePacer::GetNextFrameTime(Clock::time_point aNow) const
+{
+  const int64_t lastIndex = GetIntervalIndex(mLastPresent);
+  if (!mHasPresented || GetIntervalIndex(aNow) > lastIndex) {
+    // Nothing presented in this interval yet
+    return aNow;
+  }
+  return mVBlank + std::chrono::duration_cast<Clock::duration>(mInterval) *
+                     (lastIndex + 1);
+}
+
+void
+FramePacer::Present(Clock::time_point aNow)
+{
+  mPending = false;
+  mHasPresented = true;
+  mLastPresent = aNow;
+  ++mPresentedCount;
+}
+
+void
+FramePacer::AppendReport(std::wstring &aOut) const
+{
+  wchar_t line[128];
+  std::swprintf(line, sizeof(line) / sizeof(line[0]),
+                L"frames: %llu presented, %llu skipped at %.1f Hz\n",
+                static_cast<unsigned long long>(mPresentedCount),
+                static_cast<unsigned long long>(GetSkippedCount()),
+                1e9 / static_cast<double>(mInterval.count()));
+  aOut.append(line);
+}
+
+} // namespace aspk
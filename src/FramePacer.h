@@ -0,0 +1,65 @@
+#ifndef __ASPK_FRAMEPACER_H
+#define __ASPK_FRAMEPACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace aspk {
+
+// Decides when coalesced repaints should be flushed, so that a window
+// presents at most one frame per display refresh. Time is divided into
+// refresh intervals starting at a vblank; the first request in an interval
+// with nothing presented yet is flushed right away, and anything later waits
+// for the next vblank. Requests made while a frame is pending are counted as
+// skipped frames. This class has no Win32 dependencies.
+class FramePacer
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // 60Hz, for when the compositor's timing is unavailable
+  static constexpr std::chrono::nanoseconds kDefaultInterval{16666667};
+
+  FramePacer();
+
+  // The phase and period of the display's refresh. Non-positive intervals
+  // are ignored.
+  void SetTiming(Clock::time_point aVBlank, std::chrono::nanoseconds aInterval);
+  std::chrono::nanoseconds GetInterval() const { return mInterval; }
+
+  // Notes that something needs repainting. Returns true if no frame was
+  // pending, in which case the caller should call Present at
+  // GetNextFrameTime.
+  bool Request();
+  bool IsPending() const { return mPending; }
+  Clock::time_point GetNextFrameTime(Clock::time_point aNow) const;
+  // The pending frame has been flushed
+  void Present(Clock::time_point aNow);
+
+  uint64_t GetRequestCount() const { return mRequestCount; }
+  uint64_t GetPresentedCount() const { return mPresentedCount; }
+  // Requests folded into a frame that was already pending
+  uint64_t GetSkippedCount() const { return mSkippedCount; }
+
+  // One line: presented and skipped counts, and the refresh rate
+  void AppendReport(std::wstring &aOut) const;
+
+private:
+  // The refresh interval containing aTime; negative before mVBlank
+  int64_t GetIntervalIndex(Clock::time_point aTime) const;
+
+private:
+  Clock::time_point         mVBlank;
+  std::chrono::nanoseconds  mInterval;
+  Clock::time_point         mLastPresent;
+  bool                      mHasPresented;
+  bool                      mPending;
+  uint64_t                  mRequestCount;
+  uint64_t                  mPresentedCount;
+  uint64_t                  mSkippedCount;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_FRAMEPACER_H
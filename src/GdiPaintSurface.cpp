@@ -0,0 +1,169 @@
+#include "GdiPaintSurface.h"
+
+#include "PixelFill.h"
+
+namespace aspk {
+
+GdiPaintSurface::GdiPaintSurface(HDC aDc, RECT const &aBounds,
+                                 RenderResources& aResources, int aScalePercent)
+  : mDc(aDc)
+  , mBounds(aBounds)
+  , mResources(aResources)
+  , mScalePercent(aScalePercent)
+  , mBits(nullptr)
+  , mStride(0)
+  , mBitsRect{}
+  , mFont(eMessageFont)
+  , mSelectedFont(NULL)
+  , mOriginalFont(NULL)
+{
+}
+
+GdiPaintSurface::~GdiPaintSurface()
+{
+  // Fonts belong to the cache, so they must not stay selected into the DC
+  if (mOriginalFont) {
+    SelectObject(mDc, mOriginalFont);
+  }
+}
+
+void
+GdiPaintSurface::SetBits(uint32_t* aBits, ptrdiff_t aStride,
+                         RECT const &aBitsRect)
+{
+  mBits = aBits;
+  mStride = aStride;
+  mBitsRect = aBitsRect;
+}
+
+bool
+GdiPaintSurface::SetPaintBuffer(HPAINTBUFFER aBuffer)
+{
+  RGBQUAD* bits = nullptr;
+  int rowPixels = 0;
+  RECT targetRect;
+  if (!aBuffer ||
+      FAILED(GetBufferedPaintBits(aBuffer, &bits, &rowPixels)) ||
+      FAILED(GetBufferedPaintTargetRect(aBuffer, &targetRect))) {
+    return false;
+  }
+  SetBits(reinterpret_cast<uint32_t*>(bits), rowPixels, targetRect);
+  return true;
+}
+
+PixelRect
+GdiPaintSurface::GetClipRect()
+{
+  RECT clipRect;
+  if (GetClipBox(mDc, &clipRect) == ERROR) {
+    clipRect = mBounds;
+  }
+  return ToPixelRect(clipRect);
+}
+
+void
+GdiPaintSurface::FillRect(PixelRect const &aRect, uint32_t aPixel)
+{
+  RECT rect = ToRect(aRect);
+  if (!mBits) {
+    ::FillRect(mDc, &rect, mResources.GetSolidBrush(PixelToColor(aPixel)));
+    return;
+  }
+
+  RECT fillRect;
+  if (!IntersectRect(&fillRect, &rect, &mBitsRect)) {
+    return;
+  }
+  uint32_t* origin = mBits + (fillRect.top - mBitsRect.top) * mStride +
+                     (fillRect.left - mBitsRect.left);
+  FillPixels(origin, mStride, fillRect.right - fillRect.left,
+             fillRect.bottom - fillRect.top, aPixel);
+}
+
+void
+GdiPaintSurface::SetFont(Font aFont)
+{
+  mFont = aFont;
+}
+
+HFONT
+GdiPaintSurface::SelectFont()
+{
+  HFONT font = mFont == eFixedFont ? mResources.GetFixedFont(mScalePercent)
+                                   : mResources.GetMessageFont(mScalePercent);
+  if (font && font != mSelectedFont) {
+    HGDIOBJ previous = SelectObject(mDc, font);
+    if (!mOriginalFont) {
+      mOriginalFont = previous;
+    }
+    mSelectedFont = font;
+  }
+  return font;
+}
+
+int
+GdiPaintSurface::GetLineHeight()
+{
+  TEXTMETRIC tm;
+  if (!SelectFont() || !GetTextMetrics(mDc, &tm)) {
+    return 0;
+  }
+  return tm.tmHeight + tm.tmExternalLeading;
+}
+
+PixelSize
+GdiPaintSurface::MeasureText(std::wstring_view aText)
+{
+  RECT textRect = {};
+  if (!SelectFont() ||
+      !DrawTextW(mDc, aText.data(), static_cast<int>(aText.size()), &textRect,
+                 DT_LEFT | DT_NOPREFIX | DT_CALCRECT)) {
+    return PixelSize{0, 0};
+  }
+  return PixelSize{textRect.right - textRect.left,
+                   textRect.bottom - textRect.top};
+}
+
+bool
+GdiPaintSurface::DrawText(PixelRect const &aRect, std::wstring_view aText,
+                          uint32_t aColor)
+{
+  HTHEME theme = mResources.GetTheme();
+  if (!SelectFont()) {
+    return false;
+  }
+
+  DWORD format = DT_LEFT | DT_NOPREFIX | DT_NOCLIP;
+  if (aText.find(L'\n') == std::wstring_view::npos) {
+    format |= DT_SINGLELINE;
+  }
+
+  // Composited text writes alpha, which plain GDI text would leave at zero
+  DTTOPTS dttOpts = { sizeof(DTTOPTS) };
+  dttOpts.dwFlags = DTT_COMPOSITED;
+  if (aColor != kDefaultTextColor) {
+    dttOpts.dwFlags |= DTT_TEXTCOLOR;
+    dttOpts.crText = PixelToColor(aColor);
+  }
+
+  RECT textRect = ToRect(aRect);
+  return SUCCEEDED(DrawThemeTextEx(theme, mDc, 0, 0, aText.data(),
+                                   static_cast<int>(aText.size()), format,
+                                   &textRect, &dttOpts));
+}
+
+/* static */ COLORREF
+GdiPaintSurface::PixelToColor(uint32_t aPixel)
+{
+  const uint32_t alpha = aPixel >> 24;
+  auto channel = [aPixel, alpha](unsigned aShift) -> BYTE {
+    const uint32_t value = (aPixel >> aShift) & 0xFF;
+    if (!alpha || alpha == 0xFF) {
+      return static_cast<BYTE>(value);
+    }
+    return static_cast<BYTE>(std::min<uint32_t>(0xFF, (value * 0xFF + alpha / 2) / alpha));
+  };
+  return RGB(channel(16), channel(8), channel(0));
+}
+
+} // namespace aspk
@@ -0,0 +1,79 @@
+#ifndef __ASPK_GDIPAINTSURFACE_H
+#define __ASPK_GDIPAINTSURFACE_H
+
+#include <windows.h>
+#include <uxtheme.h>
+
+#include "PaintSurface.h"
+#include "RenderResources.h"
+
+namespace aspk {
+
+inline PixelRect
+ToPixelRect(RECT const &aRect)
+{
+  return PixelRect{static_cast<int>(aRect.left), static_cast<int>(aRect.top),
+                   static_cast<int>(aRect.right), static_cast<int>(aRect.bottom)};
+}
+
+inline RECT
+ToRect(PixelRect const &aRect)
+{
+  return RECT{aRect.mLeft, aRect.mTop, aRect.mRight, aRect.mBottom};
+}
+
+// Paints into a GDI device context with theme text and the window's cached
+// fonts and brushes. When the DC's 32-bit pixels are available (a buffered
+// paint or a DIB section), fills write them directly so that alpha is
+// honoured; otherwise they fall back to GDI brushes, which leave alpha alone.
+class GdiPaintSurface : public PaintSurface
+{
+public:
+  // aBounds is used when the DC has no clip box. Fonts are looked up at
+  // aScalePercent.
+  GdiPaintSurface(HDC aDc, RECT const &aBounds, RenderResources& aResources,
+                  int aScalePercent);
+  ~GdiPaintSurface();
+
+  // aBits covers aBitsRect, in DC coordinates, with rows aStride pixels apart
+  void SetBits(uint32_t* aBits, ptrdiff_t aStride, RECT const &aBitsRect);
+  // Uses the bits of a BeginBufferedPaint buffer. Returns false, leaving the
+  // surface on the GDI fallback, if the buffer has none.
+  bool SetPaintBuffer(HPAINTBUFFER aBuffer);
+
+  HDC GetDC() const { return mDc; }
+
+  PixelRect GetClipRect() override;
+  void FillRect(PixelRect const &aRect, uint32_t aPixel) override;
+  void SetFont(Font aFont) override;
+  int GetLineHeight() override;
+  PixelSize MeasureText(std::wstring_view aText) override;
+  bool DrawText(PixelRect const &aRect, std::wstring_view aText,
+                uint32_t aColor = kDefaultTextColor) override;
+
+  // Undoes the premultiplication of aPixel, ignoring its alpha
+  static COLORREF PixelToColor(uint32_t aPixel);
+
+private:
+  HFONT SelectFont();
+
+private:
+  GdiPaintSurface(GdiPaintSurface const &) = delete;
+  GdiPaintSurface& operator=(GdiPaintSurface const &) = delete;
+
+private:
+  HDC               mDc;
+  RECT              mBounds;
+  RenderResources&  mResources;
+  int               mScalePercent;
+  uint32_t*         mBits;
+  ptrdiff_t         mStride;
+  RECT              mBitsRect;
+  Font              mFont;
+  HFONT             mSelectedFont;
+  HGDIOBJ           mOriginalFont;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_GDIPAINTSURFACE_H
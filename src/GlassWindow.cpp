@@ -1,10 +1,13 @@
 #include "GlassWindow.h"
+#include "ConsolePainter.h"
+#include "GdiPaintSurface.h"
+#include "GlassWindowApp.h"
 #include "PaintContext.h"
+#include "PixelFill.h"
 #include "UniqueHandle.h"
 
 #include <windows.h>
 
-#include <gdiplus.h>
 #include <windowsx.h>
 #include <uxtheme.h>
 #include <vssym32.h>
@@ -12,9 +15,18 @@
 #include <wtsapi32.h>
 
 #include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include "odbs.h"
+#include "Trace.h"
 
 namespace aspk {
 
@@ -82,6 +94,9 @@ GlassWindow::Params::Params()
   , mBackgroundBrush((HBRUSH)(COLOR_WINDOW + 1))
   , mQuitOnDestroy(false)
   , mVisualDebug(false)
+  , mMessageTiming(false)
+  , mPaintProfiling(false)
+  , mOutputMemoryBudget(0)
 {
 }
 
@@ -121,6 +136,14 @@ GlassWindow::Params::SetFlags(unsigned int aFlags)
   if (aFlags & eVisualDebug) {
     mVisualDebug = true;
   }
+
+  if (aFlags & eMessageTiming) {
+    mMessageTiming = true;
+  }
+
+  if (aFlags & ePaintProfiling) {
+    mPaintProfiling = true;
+  }
 }
 
 wchar_t const GlassWindow::kClassName[] = L"ASPKGlassWindowClass";
@@ -128,10 +151,28 @@ wchar_t const GlassWindow::kClassName[] = L"ASPKGlassWindowClass";
 GlassWindow::GlassWindow(HINSTANCE aInstance, std::wstring const &aTitleText)
   : mInstance(aInstance)
   , mHwnd(NULL)
+  , mClassAtom(0)
   , mWTSRegistered(false)
+  , mNcDpiFollowsWindow(false)
   , mQuitOnDestroy(false)
   , mDebug(false)
-  , mPrintfBufLen(0)
+  , mBatchDepth(0)
+  , mBatchNeedsInvalidate(false)
+  , mIdleBatchOpen(false)
+  , mIdleCallbackId(0)
+  , mFrameBatchOpen(false)
+  , mFrameDirtyRect{}
+  , mOutputMemoryBudget(0)
+  , mBackgroundBrush(nullptr)
+  , mBackgroundColor(0)
+  , mBackgroundPixel(0)
+  , mHasBackgroundPixel(false)
+  , mConsoleLines(1)
+  , mConsoleTopLine(0)
+  , mConsoleDirtyLine(SIZE_MAX)
+  , mConsoleLineHeight(0)
+  , mConsoleFollowTail(true)
+  , mPostTarget(NULL)
 {
   MARGINS margins = {};
   Init(aTitleText, 0, 0, 640, 480, margins, (HBRUSH)(COLOR_WINDOW + 1));
@@ -140,11 +181,38 @@ GlassWindow::GlassWindow(HINSTANCE aInstance, std::wstring const &aTitleText)
 GlassWindow::GlassWindow(HINSTANCE aInstance, GlassWindow::Params const &aParams)
   : mInstance(aInstance)
   , mHwnd(NULL)
+  , mClassAtom(0)
   , mWTSRegistered(false)
+  , mNcDpiFollowsWindow(false)
   , mQuitOnDestroy(aParams.QuitOnDestroy())
   , mDebug(aParams.IsVisualDebugMode())
-  , mPrintfBufLen(0)
+  , mBatchDepth(0)
+  , mBatchNeedsInvalidate(false)
+  , mIdleBatchOpen(false)
+  , mIdleCallbackId(0)
+  , mFrameBatchOpen(false)
+  , mFrameDirtyRect{}
+  , mOutputMemoryBudget(aParams.GetOutputMemoryBudget())
+  , mBackgroundBrush(nullptr)
+  , mBackgroundColor(0)
+  , mBackgroundPixel(0)
+  , mHasBackgroundPixel(false)
+  , mConsoleLines(1)
+  , mConsoleTopLine(0)
+  , mConsoleDirtyLine(SIZE_MAX)
+  , mConsoleLineHeight(0)
+  , mConsoleFollowTail(true)
+  , mPostTarget(NULL)
 {
+  mConsoleLines.SetMemoryBudget(mOutputMemoryBudget);
+  // The visual debug overlay shows these, so it implies timing
+  if (aParams.IsMessageTimingEnabled() || mDebug) {
+    mWndProcStats = std::make_unique<MessageStats>();
+    mNcWndProcStats = std::make_unique<MessageStats>();
+  }
+  if (aParams.IsPaintProfilingEnabled() || mDebug) {
+    mPaintProfiler = std::make_unique<PaintProfiler>();
+  }
   Init(aParams.GetTitleText(),
        aParams.GetStyleToggles(),
        aParams.GetExStyleToggles(),
@@ -163,22 +231,14 @@ GlassWindow::Init(std::wstring const &aTitleText,
                   MARGINS const & aMargins,
                   HBRUSH aBackgroundBrush)
 {
-  WNDCLASSEXW wc = { sizeof(WNDCLASSEXW) };
-  wc.style = CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS;
-  wc.lpfnWndProc = &GlassWindow::WndProc;
-  wc.hInstance = mInstance;
-  wc.hCursor = LoadCursor(NULL, IDC_ARROW);
-  if (mDebug) {
-    wc.hbrBackground = CreateSolidBrush(RGB(0xFF, 0, 0));
-  } else {
-    wc.hbrBackground = aBackgroundBrush;
-  }
-  wc.lpszClassName = kClassName;
-
-  if (!RegisterClassExW(&wc)) {
+  mClassAtom = AcquireWindowClass(mInstance, aBackgroundBrush, mDebug,
+                                  mBackgroundBrush);
+  if (!mClassAtom) {
     return;
   }
 
+  UpdateBackgroundPixel();
+
   DWORD styles = WS_OVERLAPPEDWINDOW | WS_POPUPWINDOW;
   styles ^= aStyleToggles;
   DWORD exStyles = WS_EX_APPWINDOW | WS_EX_OVERLAPPEDWINDOW;
@@ -186,7 +246,7 @@ GlassWindow::Init(std::wstring const &aTitleText,
 
   auto context = std::make_pair(this, &aMargins);
   mHwnd = CreateWindowExW(exStyles,
-                          kClassName,
+                          MAKEINTATOM(mClassAtom),
                           aTitleText.c_str(),
                           styles,
                           CW_USEDEFAULT,
@@ -197,11 +257,129 @@ GlassWindow::Init(std::wstring const &aTitleText,
                           NULL,
                           mInstance,
                           &context);
-
 }
 
 GlassWindow::~GlassWindow()
 {
+  if (mHwnd) {
+    // Our own OnDestroy runs, but not that of any subclass, which is gone by
+    // now. Must be called on the thread that created the window.
+    ::DestroyWindow(mHwnd);
+  }
+  if (mClassAtom) {
+    ReleaseWindowClass(mInstance, mClassAtom);
+  }
+}
+
+namespace {
+
+// Window classes are process-wide while windows come and go, so each class
+// variant is registered on first use and unregistered once the last window
+// using it is gone.
+struct WindowClassEntry
+{
+  HINSTANCE       mInstance;
+  HBRUSH          mRequestedBrush;
+  bool            mDebug;
+  ATOM            mAtom;
+  HBRUSH          mClassBrush;
+  UniqueGdiHandle mOwnedBrush;  // Backs mClassBrush when we created it
+  size_t          mRefCount;
+};
+
+struct WindowClassRegistry
+{
+  std::mutex                    mMutex;
+  std::vector<WindowClassEntry> mEntries;
+  unsigned int                  mNextVariant = 0;
+};
+
+WindowClassRegistry&
+GetWindowClassRegistry()
+{
+  static WindowClassRegistry sRegistry;
+  return sRegistry;
+}
+
+// Windows that end the message loop of their thread once all are destroyed
+thread_local size_t tQuitOnDestroyWindows = 0;
+
+} // anonymous namespace
+
+/* static */ ATOM
+GlassWindow::AcquireWindowClass(HINSTANCE aInstance, HBRUSH aBackgroundBrush,
+                                bool aDebug, HBRUSH &aClassBrush)
+{
+  // The debug background is always the same red, whatever was asked for
+  HBRUSH requestedBrush = aDebug ? NULL : aBackgroundBrush;
+
+  WindowClassRegistry &registry = GetWindowClassRegistry();
+  std::lock_guard<std::mutex> lock(registry.mMutex);
+  for (WindowClassEntry &entry : registry.mEntries) {
+    if (entry.mInstance == aInstance && entry.mDebug == aDebug &&
+        entry.mRequestedBrush == requestedBrush) {
+      ++entry.mRefCount;
+      aClassBrush = entry.mClassBrush;
+      return entry.mAtom;
+    }
+  }
+
+  WindowClassEntry entry = {aInstance, requestedBrush, aDebug, 0,
+                            aBackgroundBrush, nullptr, 1};
+  if (aDebug) {
+    entry.mOwnedBrush.reset(CreateSolidBrush(RGB(0xFF, 0, 0)));
+    entry.mClassBrush = static_cast<HBRUSH>(entry.mOwnedBrush.get());
+  }
+
+  // The first variant keeps the plain class name
+  std::wstring className(kClassName);
+  if (registry.mNextVariant) {
+    className += L'.';
+    className += std::to_wstring(registry.mNextVariant);
+  }
+
+  WNDCLASSEXW wc = { sizeof(WNDCLASSEXW) };
+  wc.style = CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS;
+  wc.lpfnWndProc = &GlassWindow::WndProc;
+  wc.hInstance = aInstance;
+  wc.hCursor = LoadCursor(NULL, IDC_ARROW);
+  wc.hbrBackground = entry.mClassBrush;
+  wc.lpszClassName = className.c_str();
+
+  entry.mAtom = RegisterClassExW(&wc);
+  if (!entry.mAtom) {
+    Log<eLogError>(L"RegisterClassExW failed for ", className, L": ",
+                   ::GetLastError());
+    return 0;
+  }
+
+  ++registry.mNextVariant;
+  aClassBrush = entry.mClassBrush;
+  registry.mEntries.push_back(std::move(entry));
+  return registry.mEntries.back().mAtom;
+}
+
+/* static */ void
+GlassWindow::ReleaseWindowClass(HINSTANCE aInstance, ATOM aAtom)
+{
+  WindowClassRegistry &registry = GetWindowClassRegistry();
+  std::lock_guard<std::mutex> lock(registry.mMutex);
+  auto itr = std::find_if(registry.mEntries.begin(), registry.mEntries.end(),
+                          [aInstance, aAtom](WindowClassEntry const &aEntry) {
+                            return aEntry.mInstance == aInstance &&
+                                   aEntry.mAtom == aAtom;
+                          });
+  if (itr == registry.mEntries.end() || --itr->mRefCount) {
+    return;
+  }
+
+  // Fails if a window of this class is somehow still alive, in which case
+  // its brush must outlive it too
+  if (!UnregisterClassW(MAKEINTATOM(aAtom), aInstance)) {
+    Log<eLogWarning>(L"UnregisterClassW failed: ", ::GetLastError());
+    itr->mOwnedBrush.release();
+  }
+  registry.mEntries.erase(itr);
 }
 
 void
@@ -216,6 +394,41 @@ GlassWindow::Update()
   UpdateWindow(mHwnd);
 }
 
+bool
+GlassWindow::CreateListView()
+{
+  if (!mHwnd) {
+    return false;
+  }
+
+  mListView = std::make_unique<ListView>(*this);
+  if (!(*mListView)) {
+    return false;
+  }
+
+  mListView->SetMemoryBudget(mOutputMemoryBudget);
+
+  // The list covers the client area, so the text console is gone for good
+  ::ShowScrollBar(mHwnd, SB_VERT, FALSE);
+
+  if (mBatchDepth) {
+    // We are in the middle of a batch; the list must join it
+    mListView->BeginBatch();
+  }
+
+  return true;
+}
+
+void
+GlassWindow::SetOutputMemoryBudget(size_t aBytes)
+{
+  mOutputMemoryBudget = aBytes;
+  mConsoleLines.SetMemoryBudget(aBytes);
+  if (mListView) {
+    mListView->SetMemoryBudget(aBytes);
+  }
+}
+
 void
 GlassWindow::MaybeCreateListView(const size_t aNumCols)
 {
@@ -223,8 +436,7 @@ GlassWindow::MaybeCreateListView(const size_t aNumCols)
     return;
   }
 
-  mListView = std::make_unique<ListView>(*this);
-  if (!(*mListView)) {
+  if (!CreateListView()) {
     return;
   }
 
@@ -241,8 +453,7 @@ GlassWindow::SetColumns(const std::vector<wchar_t const *>& aColumnNames)
     return;
   }
 
-  mListView = std::make_unique<ListView>(*this);
-  if (!(*mListView)) {
+  if (!CreateListView()) {
     return;
   }
 
@@ -260,43 +471,492 @@ GlassWindow::Printf(const wchar_t* aFmt, ...)
   va_list argptr;
   va_start(argptr, aFmt);
 
-  int result = -1;
+  mPrintfBuf.VFormat(aFmt, argptr);
+
+  va_end(argptr);
+
+  OutputPrintfBuf();
+}
+
+void
+GlassWindow::PostPrintf(const wchar_t* aFmt, ...)
+{
+  va_list argptr;
+  va_start(argptr, aFmt);
+
+  // Each producer thread formats into its own reusable buffer, so the
+  // per-call allocations are just the queue node and its copy of the text.
+  static thread_local PrintfBuffer sFormatBuf;
+  bool ok = sFormatBuf.VFormat(aFmt, argptr);
+
+  va_end(argptr);
+
+  if (!ok) {
+    return;
+  }
+
+  auto posted = std::make_unique<PostedText>();
+  posted->mText.assign(sFormatBuf.GetText());
+
+  if (mPostedTextQueue.Push(std::move(posted))) {
+    // Only the producer that found the queue empty needs to wake the UI
+    // thread; everybody else will be picked up by the same drain. Before
+    // OnCreate there is nobody to wake, and OnCreate drains instead; the
+    // fences pair with the one there, so one side sees the other.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (HWND target = mPostTarget.load(std::memory_order_relaxed)) {
+      ::PostMessage(target, kDrainPostedTextMsg, 0, 0);
+    }
+  }
+}
+
+void
+GlassWindow::DrainPostedText()
+{
+  // Under GlassWindowApp::Run, keep the batch open until the next frame, or
+  // failing that until the input queue is empty, so that every drain until
+  // then shares one list commit and one invalidation. Otherwise commit right
+  // away.
+  std::optional<AutoBatch> batch;
+  GlassWindowApp* app = GlassWindowApp::GetForCurrentThread();
+  if (OpenFrameBatch()) {
+    // Committed by PresentFrame
+  } else if (app && app->IsRunning() && mIdleCallbackId) {
+    if (!mIdleBatchOpen) {
+      BeginBatch();
+      mIdleBatchOpen = true;
+      app->RequestIdle();
+    }
+  } else {
+    batch.emplace(*this);
+  }
 
-  if (mPrintfBufLen) {
-    result = _vsnwprintf_s(mPrintfBuf.get(), mPrintfBufLen, _TRUNCATE, aFmt,
-                           argptr);
+  while (std::unique_ptr<PostedText> posted = mPostedTextQueue.Pop()) {
+    mPrintfBuf.Assign(posted->mText);
+    OutputPrintfBuf();
   }
 
-  if (result == -1) {
-    mPrintfBufLen = _vscwprintf(aFmt, argptr) + 1;
-    mPrintfBuf.reset(new wchar_t[mPrintfBufLen]);
+  if (mPostedTextQueue.GetDepth()) {
+    // A producer was midway through a push when we looked. Its item will be
+    // visible shortly, but it will not wake us again, so schedule another pass.
+    ::PostMessage(mHwnd, kDrainPostedTextMsg, 0, 0);
+  }
+}
 
-    _vsnwprintf_s(mPrintfBuf.get(), mPrintfBufLen, _TRUNCATE, aFmt, argptr);
+bool
+GlassWindow::OnIdle()
+{
+  if (mIdleBatchOpen) {
+    mIdleBatchOpen = false;
+    EndBatch();
   }
+  return false;
+}
 
-  if (mListView || wcschr(mPrintfBuf.get(), L'\t')) {
+bool
+GlassWindow::IsFramePaced() const
+{
+  // Without a running loop the timer would never be seen
+  GlassWindowApp* app = GlassWindowApp::GetForCurrentThread();
+  return mFrameTimer && app && app->IsRunning();
+}
+
+bool
+GlassWindow::OpenFrameBatch()
+{
+  if (!IsFramePaced()) {
+    return false;
+  }
+  if (!mFrameBatchOpen) {
+    BeginBatch();
+    mFrameBatchOpen = true;
+  } else if (mFramePacer.IsPending()) {
+    // This batch has already requested the pending frame. One request per
+    // batch, not per line drained, so that skipped counts frames.
+    return true;
+  }
+  if (mFramePacer.Request()) {
+    ScheduleFrame();
+  }
+  return true;
+}
+
+void
+GlassWindow::RequestFrame(RECT const * aDirtyRect)
+{
+  RECT dirtyRect;
+  if (aDirtyRect) {
+    dirtyRect = *aDirtyRect;
+  } else if (!::GetClientRect(mHwnd, &dirtyRect)) {
+    return;
+  }
+
+  if (!IsFramePaced()) {
+    ::InvalidateRect(mHwnd, &dirtyRect, TRUE);
+    return;
+  }
+  ::UnionRect(&mFrameDirtyRect, &mFrameDirtyRect, &dirtyRect);
+  if (mFramePacer.Request()) {
+    ScheduleFrame();
+  }
+}
+
+void
+GlassWindow::RefreshFrameTiming()
+{
+  // DwmFlush would give us the same phase, but blocks the message loop until
+  // the next composition
+  DWM_TIMING_INFO timing = {};
+  timing.cbSize = sizeof(timing);
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  if (FAILED(::DwmGetCompositionTimingInfo(nullptr, &timing)) ||
+      !timing.qpcRefreshPeriod || !::QueryPerformanceFrequency(&frequency) ||
+      !::QueryPerformanceCounter(&counter)) {
+    // Keep the last timing we had, or 60Hz
+    return;
+  }
+
+  const FramePacer::Clock::time_point now = FramePacer::Clock::now();
+  auto toDuration = [&frequency](LONGLONG aTicks) {
+    return std::chrono::nanoseconds(aTicks * 1000000000 / frequency.QuadPart);
+  };
+  const LONGLONG sinceVBlank =
+    counter.QuadPart - static_cast<LONGLONG>(timing.qpcVBlank);
+  mFramePacer.SetTiming(now - toDuration(sinceVBlank),
+                        toDuration(static_cast<LONGLONG>(timing.qpcRefreshPeriod)));
+}
+
+void
+GlassWindow::ScheduleFrame()
+{
+  RefreshFrameTiming();
+  const FramePacer::Clock::time_point now = FramePacer::Clock::now();
+  const auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    mFramePacer.GetNextFrameTime(now) - now);
+
+  // Even a frame that is due now goes through the timer, so that the rest of
+  // the messages already queued join it. Relative due times are negative, in
+  // 100ns units.
+  LARGE_INTEGER dueTime;
+  dueTime.QuadPart = -std::max<LONGLONG>(1, delay.count() / 100);
+  if (!::SetWaitableTimer(mFrameTimer.get(), &dueTime, 0, nullptr, nullptr,
+                          FALSE)) {
+    Log<eLogWarning>(L"SetWaitableTimer failed: ", ::GetLastError());
+    PresentFrame();
+  }
+}
+
+void
+GlassWindow::PresentFrame()
+{
+  if (!mFramePacer.IsPending()) {
+    return;
+  }
+  mFramePacer.Present(FramePacer::Clock::now());
+
+  if (!::IsRectEmpty(&mFrameDirtyRect)) {
+    ::InvalidateRect(mHwnd, &mFrameDirtyRect, TRUE);
+    ::SetRectEmpty(&mFrameDirtyRect);
+  }
+  if (mFrameBatchOpen) {
+    mFrameBatchOpen = false;
+    EndBatch();
+  }
+}
+
+void
+GlassWindow::OnDrainPostedText(HWND hwnd)
+{
+  GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+  if (!instance) {
+    return;
+  }
+
+  instance->DrainPostedText();
+}
+
+void
+GlassWindow::OutputPrintfBuf()
+{
+  if (mListView || mPrintfBuf.GetText().find(L'\t') != std::wstring_view::npos) {
     // Send to ListView
 
-    // First, split mPrintfBuf
-    std::vector<wchar_t*> items;
-    wchar_t* context = nullptr;
-    wchar_t* tok = wcstok_s(mPrintfBuf.get(), L"\t", &context);
-    while (tok) {
-      items.push_back(tok);
-      tok = wcstok_s(nullptr, L"\t", &context);
-    }
+    // First, split mPrintfBuf. mPrintfCells keeps its capacity between calls.
+    mPrintfBuf.SplitInPlace(L'\t', mPrintfCells);
+    OutputCells(mPrintfCells.data(), mPrintfCells.size());
+  } else {
+    OutputText();
+  }
+}
 
-    MaybeCreateListView(items.size());
+void
+GlassWindow::OutputCells(std::wstring_view const * aCells, size_t aNumCells)
+{
+  MaybeCreateListView(aNumCells);
+  OpenFrameBatch();
 
-    for (auto&& item : items) {
-      bool ok = mListView->InsertCell(item);
-      assert(ok);
-    }
+  for (size_t i = 0; i < aNumCells; ++i) {
+    bool ok = mListView->InsertCell(aCells[i]);
+    assert(ok);
+  }
+}
+
+void
+GlassWindow::OutputText()
+{
+  OpenFrameBatch();
+
+  // An open last line gets extended, so it needs repainting too
+  const size_t firstChanged = mConsoleLines.GetRowCount() -
+                              (mConsoleLines.IsLineOpen() ? 1 : 0);
+  mConsoleLines.AppendLines(mPrintfBuf.GetText());
+
+  if (mBatchDepth) {
+    mConsoleDirtyLine = std::min<size_t>(mConsoleDirtyLine, firstChanged);
+    mBatchNeedsInvalidate = true;
+  } else {
+    InvalidateConsoleLines(firstChanged);
+  }
+}
+
+int
+GlassWindow::GetConsoleLineHeight()
+{
+  if (mConsoleLineHeight || !mRenderResources) {
+    return mConsoleLineHeight;
+  }
+
+  HFONT font = mRenderResources->GetMessageFont(mDpiScaler->GetYScale());
+  if (!font) {
+    return 0;
+  }
+
+  HDC dc = ::GetDC(mHwnd);
+  if (!dc) {
+    return 0;
+  }
+
+  HGDIOBJ oldFont = SelectObject(dc, font);
+  TEXTMETRIC tm;
+  if (GetTextMetrics(dc, &tm)) {
+    mConsoleLineHeight = tm.tmHeight + tm.tmExternalLeading;
+  }
+  SelectObject(dc, oldFont);
+  ::ReleaseDC(mHwnd, dc);
+
+  return mConsoleLineHeight;
+}
+
+size_t
+GlassWindow::GetConsolePageLines()
+{
+  const int lineHeight = GetConsoleLineHeight();
+  RECT clientRect;
+  if (!lineHeight || !::GetClientRect(mHwnd, &clientRect)) {
+    return 1;
+  }
+
+  return std::max<size_t>(1, RectHeight(clientRect) / lineHeight);
+}
+
+void
+GlassWindow::UpdateConsoleScrollInfo()
+{
+  const size_t lineCount = mConsoleLines.GetRowCount();
+
+  SCROLLINFO si = { sizeof(si), SIF_RANGE | SIF_PAGE | SIF_POS };
+  si.nMin = 0;
+  si.nMax = static_cast<int>(std::min<size_t>(lineCount ? lineCount - 1 : 0,
+                                              INT_MAX));
+  si.nPage = static_cast<UINT>(std::min<size_t>(GetConsolePageLines(),
+                                                INT_MAX));
+  si.nPos = static_cast<int>(std::min<size_t>(mConsoleTopLine, INT_MAX));
+  // This also shows or hides the scroll bar as needed
+  ::SetScrollInfo(mHwnd, SB_VERT, &si, TRUE);
+}
+
+void
+GlassWindow::ScrollConsoleTo(size_t aTopLine)
+{
+  const size_t lineCount = mConsoleLines.GetRowCount();
+  const size_t pageLines = GetConsolePageLines();
+  const size_t maxTopLine = lineCount > pageLines ? lineCount - pageLines : 0;
+
+  aTopLine = std::min<size_t>(aTopLine, maxTopLine);
+  // Keep showing new output for as long as the user stays at the bottom
+  mConsoleFollowTail = aTopLine == maxTopLine;
+
+  if (aTopLine == mConsoleTopLine) {
+    UpdateConsoleScrollInfo();
+    return;
+  }
+
+  const ptrdiff_t delta = static_cast<ptrdiff_t>(aTopLine) -
+                          static_cast<ptrdiff_t>(mConsoleTopLine);
+  mConsoleTopLine = aTopLine;
+  UpdateConsoleScrollInfo();
+
+  if (static_cast<size_t>(std::abs(delta)) < pageLines) {
+    // Reuse the pixels that are still visible; only the exposed strip is
+    // invalidated
+    const int dy = static_cast<int>(-delta * GetConsoleLineHeight());
+    ::ScrollWindowEx(mHwnd, 0, dy, nullptr, nullptr, nullptr, nullptr,
+                     SW_INVALIDATE | SW_ERASE);
   } else {
     ::InvalidateRect(mHwnd, nullptr, TRUE);
   }
+}
 
-  va_end(argptr);
+void
+GlassWindow::ScrollConsoleBy(ptrdiff_t aLines)
+{
+  if (aLines < 0) {
+    const size_t up = static_cast<size_t>(-aLines);
+    ScrollConsoleTo(mConsoleTopLine > up ? mConsoleTopLine - up : 0);
+  } else {
+    ScrollConsoleTo(mConsoleTopLine + static_cast<size_t>(aLines));
+  }
+}
+
+void
+GlassWindow::InvalidateConsoleLines(size_t aFirstLine)
+{
+  if (mConsoleFollowTail) {
+    ScrollConsoleTo(SIZE_MAX);
+  } else {
+    UpdateConsoleScrollInfo();
+  }
+
+  const int lineHeight = GetConsoleLineHeight();
+  RECT dirtyRect;
+  if (!lineHeight || !::GetClientRect(mHwnd, &dirtyRect)) {
+    ::InvalidateRect(mHwnd, nullptr, TRUE);
+    return;
+  }
+
+  const size_t lineCount = mConsoleLines.GetRowCount();
+  const size_t firstVisible = std::max<size_t>(aFirstLine, mConsoleTopLine);
+  const size_t endVisible =
+    std::min<size_t>(lineCount, mConsoleTopLine + GetConsolePageLines() + 1);
+  if (firstVisible >= endVisible) {
+    return;
+  }
+
+  dirtyRect.top = static_cast<LONG>((firstVisible - mConsoleTopLine) * lineHeight);
+  dirtyRect.bottom = static_cast<LONG>((endVisible - mConsoleTopLine) * lineHeight);
+  ::InvalidateRect(mHwnd, &dirtyRect, TRUE);
+}
+
+void
+GlassWindow::OnConsoleScroll(UINT aCode)
+{
+  const size_t pageLines = GetConsolePageLines();
+  size_t topLine = mConsoleTopLine;
+
+  switch (aCode) {
+    case SB_LINEUP:
+      ScrollConsoleBy(-1);
+      return;
+    case SB_LINEDOWN:
+      ScrollConsoleBy(1);
+      return;
+    case SB_PAGEUP:
+      ScrollConsoleBy(-static_cast<ptrdiff_t>(pageLines));
+      return;
+    case SB_PAGEDOWN:
+      ScrollConsoleBy(static_cast<ptrdiff_t>(pageLines));
+      return;
+    case SB_TOP:
+      topLine = 0;
+      break;
+    case SB_BOTTOM:
+      topLine = SIZE_MAX;
+      break;
+    case SB_THUMBTRACK:
+    case SB_THUMBPOSITION: {
+      // The position in the message is only 16 bits wide
+      SCROLLINFO si = { sizeof(si), SIF_TRACKPOS };
+      if (!::GetScrollInfo(mHwnd, SB_VERT, &si)) {
+        return;
+      }
+      topLine = static_cast<size_t>(si.nTrackPos);
+      break;
+    }
+    default:
+      return;
+  }
+
+  ScrollConsoleTo(topLine);
+}
+
+void
+GlassWindow::OnVScroll(HWND aHwnd, HWND aHwndCtl, UINT aCode, int aPos)
+{
+  GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(aHwnd, GWLP_USERDATA));
+  if (!instance || instance->mListView) {
+    return;
+  }
+
+  instance->OnConsoleScroll(aCode);
+}
+
+void
+GlassWindow::OnMouseWheel(HWND aHwnd, int aXPos, int aYPos, int aZDelta,
+                          UINT aFwKeys)
+{
+  GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(aHwnd, GWLP_USERDATA));
+  if (!instance || instance->mListView) {
+    return;
+  }
+
+  UINT linesPerNotch = 3;
+  ::SystemParametersInfo(SPI_GETWHEELSCROLLLINES, 0, &linesPerNotch, 0);
+  if (linesPerNotch == WHEEL_PAGESCROLL) {
+    linesPerNotch = static_cast<UINT>(instance->GetConsolePageLines());
+  }
+
+  instance->ScrollConsoleBy(-static_cast<ptrdiff_t>(aZDelta) *
+                            static_cast<ptrdiff_t>(linesPerNotch) / WHEEL_DELTA);
+}
+
+bool
+GlassWindow::Spawn(UiTask aTask)
+{
+  if (!mHwnd || !mTaskScope) {
+    return false;
+  }
+  return mTaskScope->Spawn(std::move(aTask));
+}
+
+void
+GlassWindow::BeginBatch()
+{
+  if (mBatchDepth++) {
+    return;
+  }
+
+  if (mListView) {
+    mListView->BeginBatch();
+  }
+}
+
+void
+GlassWindow::EndBatch()
+{
+  if (!mBatchDepth || --mBatchDepth) {
+    return;
+  }
+
+  if (mListView) {
+    mListView->EndBatch();
+  }
+
+  if (mBatchNeedsInvalidate) {
+    mBatchNeedsInvalidate = false;
+    InvalidateConsoleLines(mConsoleDirtyLine);
+    mConsoleDirtyLine = SIZE_MAX;
+  }
 }
 
 void
@@ -316,13 +976,13 @@ GlassWindow::RefreshDwmInfo(HWND hwnd)
   if (instance->mMargins->HasMargins()) {
     HRESULT hr = DwmExtendFrameIntoClientArea(hwnd, instance->mMargins->GetMargins());
     if (FAILED(hr)) {
-      odbs(L"DwmExtendFrameIntoClientArea failed");
+      Log<eLogWarning>(L"DwmExtendFrameIntoClientArea failed");
     }
     DWMNCRENDERINGPOLICY ncPolicy = DWMNCRP_ENABLED;
     hr = DwmSetWindowAttribute(hwnd, DWMWA_NCRENDERING_POLICY, &ncPolicy,
                                sizeof(ncPolicy));
     if (FAILED(hr)) {
-      odbs(L"DwmSetWindowAttribute failed");
+      Log<eLogWarning>(L"DwmSetWindowAttribute failed");
     }
 
     DWM_BLURBEHIND dwmBlur = {
@@ -333,7 +993,7 @@ GlassWindow::RefreshDwmInfo(HWND hwnd)
     };
     hr = DwmEnableBlurBehindWindow(hwnd, &dwmBlur);
     if (FAILED(hr)) {
-      odbs(L"DwmEnableBlurBehindWindow failed");
+      Log<eLogWarning>(L"DwmEnableBlurBehindWindow failed");
     }
   }
 
@@ -371,7 +1031,7 @@ GlassWindow::GetClientRectInset(RECT &aRect)
 {
   if (IsWindows10OrGreater()) {
     GlassMargins const & margins = GetMargins();
-    std::shared_ptr<DpiScaler const> scaler = GetDpiScaler();
+    DpiScalerHandle scaler = GetDpiScaler();
     aRect.left += margins.GetFrameBorderXWidth(scaler).GetValue();
     aRect.right -= margins.GetFrameBorderXWidth(scaler).GetValue();
     aRect.bottom -= margins.GetFrameBorderYWidth(scaler).GetValue();
@@ -402,7 +1062,7 @@ GlassWindow::ConvertMouseCoords(LPARAM &aParam)
   SetLastError(ERROR_SUCCESS);
   if (!MapWindowPoints(NULL, mHwnd, &pt, 1) &&
       GetLastError() != ERROR_SUCCESS) {
-    odbs(L"ConvertMouseCoords failed");
+    Log<eLogWarning>(L"ConvertMouseCoords failed");
     return false;
   }
   aParam = MAKELONG(pt.x, pt.y);
@@ -445,9 +1105,32 @@ GlassWindow::OnCreate(HWND aHwnd, MARGINS const & aMargins)
 
   mWTSRegistered =
     ::WTSRegisterSessionNotification(aHwnd, NOTIFY_FOR_THIS_SESSION);
+  if (mQuitOnDestroy) {
+    ++tQuitOnDestroyWindows;
+  }
+  if (GlassWindowApp* app = GlassWindowApp::GetForCurrentThread()) {
+    mIdleCallbackId = app->AddIdleCallback(
+      [this](std::chrono::steady_clock::time_point) { return OnIdle(); });
+    if (TaskScheduler* scheduler = app->GetTaskScheduler()) {
+      mTaskScope = std::make_unique<TaskScope>(*scheduler);
+    }
+
+    // High resolution where available (Windows 10 1803+); the default timer
+    // can be a whole tick late, which is most of a frame
+    mFrameTimer.reset(::CreateWaitableTimerExW(
+      nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS));
+    if (!mFrameTimer) {
+      mFrameTimer.reset(::CreateWaitableTimerW(nullptr, FALSE, nullptr));
+    }
+    if (mFrameTimer &&
+        !app->AddWaitHandle(mFrameTimer.get(), [this](HANDLE) { PresentFrame(); })) {
+      mFrameTimer.reset();
+    }
+  }
 
   BufferedPaintInit();
-  mDpiScaler = std::make_shared<DpiScaler>(mHwnd);
+  mRenderResources = std::make_unique<RenderResources>(mHwnd);
+  mDpiScaler = DpiScaler::GetForWindow(mHwnd);
   POINT pt = {0, 0};
 
   static auto pGetThreadDpiAwarenessContext =
@@ -457,9 +1140,10 @@ GlassWindow::OnCreate(HWND aHwnd, MARGINS const & aMargins)
 
   if (pGetThreadDpiAwarenessContext &&
       pGetThreadDpiAwarenessContext() == DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2) {
+    mNcDpiFollowsWindow = true;
     mNcDpiScaler = mDpiScaler;
   } else {
-    mNcDpiScaler = std::make_shared<DpiScaler>();
+    mNcDpiScaler = DpiScaler::GetForSystem();
   }
 
   odbs(L"mNcDpiScaler is running at ", mNcDpiScaler->GetXScale(), L"%");
@@ -467,6 +1151,17 @@ GlassWindow::OnCreate(HWND aHwnd, MARGINS const & aMargins)
   mMargins->Invalidate(this);
   odbs(L"GetThemeAppProperties: ", GetThemeAppProperties());
   RefreshFrame(aHwnd);
+
+  if (mDebug && mWndProcStats) {
+    ::SetTimer(aHwnd, kStatsOverlayTimerId, kStatsOverlayIntervalMs, nullptr);
+  }
+
+  // Pick up anything PostPrintf queued before there was a window to wake
+  mPostTarget.store(aHwnd, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mPostedTextQueue.GetDepth()) {
+    ::PostMessage(aHwnd, kDrainPostedTextMsg, 0, 0);
+  }
 }
 
 BOOL
@@ -479,9 +1174,9 @@ GlassWindow::OnCreate(HWND hwnd, LPCREATESTRUCT lpcs)
 }
 
 void
-GlassWindow::OnPaint(HDC aDc)
+GlassWindow::OnPaint(PaintSurface& aSurface)
 {
-  if (mListView || !mPrintfBuf) {
+  if (mListView || !mConsoleLines.GetRowCount()) {
     return;
   }
 
@@ -493,29 +1188,18 @@ GlassWindow::OnPaint(HDC aDc)
   // TODO: Adjust client rect with some padding
   // TODO: a11y for window text
 
-  UniqueThemeHandle theme(::OpenThemeData(mHwnd, L"CompositedWindow::Window"));
-
-  LOGFONT logFont;
-  if (FAILED(GetThemeSysFont(theme.get(), TMT_MSGBOXFONT, &logFont))) {
-    return;
-  }
-
-  UniqueGdiHandle font(::CreateFontIndirect(&logFont));
-  if (!font) {
+  const int lineHeight = GetConsoleLineHeight();
+  if (!lineHeight) {
     return;
   }
 
-  SelectObject(aDc, (HGDIOBJ)font.get());
+  RECT const &textRect = *reinterpret_cast<RECT*>(clientRect.ptr());
+  Trace<L"Text rect: %ld,%ld,%ld,%ld">(textRect.left, textRect.top,
+                                       textRect.right, textRect.bottom);
 
-  DTTOPTS dttOpts = { sizeof(DTTOPTS) };
-  dttOpts.dwFlags = DTT_COMPOSITED;
-  odbs(L"Text rect: ", *reinterpret_cast<RECT*>(clientRect.ptr()));
-  HRESULT hr = DrawThemeTextEx(theme.get(), aDc, 0, 0, mPrintfBuf.get(),
-                               wcslen(mPrintfBuf.get()), DT_LEFT, &clientRect,
-                               &dttOpts);
-  if (FAILED(hr)) {
-    return;
-  }
+  PaintProfiler::Scope stage(mPaintProfiler.get(), "DrawConsoleLines");
+  PaintConsoleLines(aSurface, mConsoleLines, mConsoleTopLine, lineHeight,
+                    ToPixelRect(textRect));
 }
 
 void
@@ -529,7 +1213,36 @@ GlassWindow::OnDestroy()
     }
   }
 
-  if (mQuitOnDestroy) {
+  if (mIdleCallbackId) {
+    if (GlassWindowApp* app = GlassWindowApp::GetForCurrentThread()) {
+      app->RemoveIdleCallback(mIdleCallbackId);
+    }
+    mIdleCallbackId = 0;
+  }
+  mIdleBatchOpen = false;
+
+  if (mFrameTimer) {
+    ::CancelWaitableTimer(mFrameTimer.get());
+    if (GlassWindowApp* app = GlassWindowApp::GetForCurrentThread()) {
+      app->RemoveWaitHandle(mFrameTimer.get());
+    }
+  }
+  mFrameBatchOpen = false;
+  if (mDebug) {
+    Log<eLogInfo>(L"Frames presented: ", mFramePacer.GetPresentedCount(),
+                  L", skipped: ", mFramePacer.GetSkippedCount());
+  }
+
+  // Suspended tasks are destroyed rather than resumed against a dead window.
+  // The scope itself stays, so that late Spawn calls fail cleanly.
+  if (mTaskScope) {
+    mTaskScope->Cancel();
+  }
+
+  // The list view is a child window, which is being destroyed along with us
+  mListView.reset();
+
+  if (mQuitOnDestroy && !--tQuitOnDestroyWindows) {
     PostQuitMessage(0);
   }
 }
@@ -544,89 +1257,337 @@ GlassWindow::OnDestroy(HWND hwnd)
 void
 GlassWindow::OnNcDestroy(HWND hwnd)
 {
+  GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+  if (!instance) {
+    return;
+  }
+
+  // The GlassWindow may outlive its window; stop routing messages to it
+  SetWindowLongPtrW(hwnd, GWLP_USERDATA, 0);
+  instance->mHwnd = NULL;
+  instance->mPostTarget.store(NULL, std::memory_order_relaxed);
 }
 
 void
 GlassWindow::DrawDebugRect(HDC aDc, RECT const &aRect, COLORREF aColor)
 {
   if (mDebug) {
-    HBRUSH hbr = CreateSolidBrush(aColor);
-    FrameRect(aDc, &aRect, hbr);
-    DeleteObject(hbr);
+    FrameRect(aDc, &aRect, mRenderResources->GetSolidBrush(aColor));
   }
 }
 
 void
-GlassWindow::OnErase(HDC aDc, RECT const &aRect)
+GlassWindow::ResetMessageStats()
 {
-  odbs(L"GlassWindow::OnErase -- ", aRect);
-  RECT clientEraseRect(aRect);
-  if (!IsWindows10OrGreater() || IsRectEmpty(&clientEraseRect)) {
-    return;
+  if (mWndProcStats) {
+    mWndProcStats->Reset();
+  }
+  if (mNcWndProcStats) {
+    mNcWndProcStats->Reset();
+  }
+}
+
+bool
+GlassWindow::DumpMessageStats(std::filesystem::path const &aPath) const
+{
+  if (!mWndProcStats) {
+    return false;
   }
 
-  WNDCLASSEX clsEx = { sizeof(clsEx) };
-  GetClassInfoEx(mInstance, kClassName, &clsEx);
+  std::wstring report(L"WndProc\n");
+  mWndProcStats->AppendReport(report, &GetMessageName);
+  report.append(L"\nNcWndProc\n");
+  mNcWndProcStats->AppendReport(report, &GetMessageName);
 
-  // Using GDI+ here so that the background is alpha-aware
+  int utf8Len = ::WideCharToMultiByte(CP_UTF8, 0, report.data(),
+                                      static_cast<int>(report.size()),
+                                      nullptr, 0, nullptr, nullptr);
+  if (utf8Len <= 0) {
+    return false;
+  }
+  std::string utf8(static_cast<size_t>(utf8Len), '\0');
+  ::WideCharToMultiByte(CP_UTF8, 0, report.data(),
+                        static_cast<int>(report.size()), utf8.data(), utf8Len,
+                        nullptr, nullptr);
+
+  std::ofstream file(aPath, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    Log<eLogWarning>(L"Failed to open message stats file ", aPath.c_str());
+    return false;
+  }
+  file.write(utf8.data(), utf8.size());
+  return !!file;
+}
 
-  HBRUSH bgBrush = clsEx.hbrBackground;
-  // If the window class specifies a system brush color, convert it to a real
-  // HBRUSH so that we can query it.
+bool
+GlassWindow::DumpPaintTrace(std::filesystem::path const &aPath) const
+{
+  if (!mPaintProfiler) {
+    return false;
+  }
+
+  if (!mPaintProfiler->WriteChromeTrace(aPath)) {
+    Log<eLogWarning>(L"Failed to write paint trace ", aPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+/* static */ wchar_t const *
+GlassWindow::GetMessageName(uint32_t aMsg)
+{
+#define ASPK_MSG_NAME(msg) case msg: return L ## #msg
+  switch (aMsg) {
+    ASPK_MSG_NAME(WM_CREATE);
+    ASPK_MSG_NAME(WM_DESTROY);
+    ASPK_MSG_NAME(WM_MOVE);
+    ASPK_MSG_NAME(WM_SIZE);
+    ASPK_MSG_NAME(WM_ACTIVATE);
+    ASPK_MSG_NAME(WM_SETFOCUS);
+    ASPK_MSG_NAME(WM_KILLFOCUS);
+    ASPK_MSG_NAME(WM_PAINT);
+    ASPK_MSG_NAME(WM_CLOSE);
+    ASPK_MSG_NAME(WM_ERASEBKGND);
+    ASPK_MSG_NAME(WM_SHOWWINDOW);
+    ASPK_MSG_NAME(WM_ACTIVATEAPP);
+    ASPK_MSG_NAME(WM_SETCURSOR);
+    ASPK_MSG_NAME(WM_MOUSEACTIVATE);
+    ASPK_MSG_NAME(WM_GETMINMAXINFO);
+    ASPK_MSG_NAME(WM_WINDOWPOSCHANGING);
+    ASPK_MSG_NAME(WM_WINDOWPOSCHANGED);
+    ASPK_MSG_NAME(WM_NOTIFY);
+    ASPK_MSG_NAME(WM_GETICON);
+    ASPK_MSG_NAME(WM_NCCREATE);
+    ASPK_MSG_NAME(WM_NCDESTROY);
+    ASPK_MSG_NAME(WM_NCCALCSIZE);
+    ASPK_MSG_NAME(WM_NCHITTEST);
+    ASPK_MSG_NAME(WM_NCPAINT);
+    ASPK_MSG_NAME(WM_NCACTIVATE);
+    ASPK_MSG_NAME(WM_NCMOUSEMOVE);
+    ASPK_MSG_NAME(WM_NCLBUTTONDOWN);
+    ASPK_MSG_NAME(WM_KEYDOWN);
+    ASPK_MSG_NAME(WM_KEYUP);
+    ASPK_MSG_NAME(WM_CHAR);
+    ASPK_MSG_NAME(WM_SYSKEYDOWN);
+    ASPK_MSG_NAME(WM_SYSCOMMAND);
+    ASPK_MSG_NAME(WM_TIMER);
+    ASPK_MSG_NAME(WM_VSCROLL);
+    ASPK_MSG_NAME(WM_MOUSEMOVE);
+    ASPK_MSG_NAME(WM_LBUTTONDOWN);
+    ASPK_MSG_NAME(WM_LBUTTONUP);
+    ASPK_MSG_NAME(WM_RBUTTONDOWN);
+    ASPK_MSG_NAME(WM_RBUTTONUP);
+    ASPK_MSG_NAME(WM_MOUSEWHEEL);
+    ASPK_MSG_NAME(WM_ENTERSIZEMOVE);
+    ASPK_MSG_NAME(WM_EXITSIZEMOVE);
+    ASPK_MSG_NAME(WM_CAPTURECHANGED);
+    ASPK_MSG_NAME(WM_IME_SETCONTEXT);
+    ASPK_MSG_NAME(WM_IME_NOTIFY);
+    ASPK_MSG_NAME(WM_NCMOUSELEAVE);
+    ASPK_MSG_NAME(WM_MOUSELEAVE);
+    ASPK_MSG_NAME(WM_WTSSESSION_CHANGE);
+    ASPK_MSG_NAME(WM_DPICHANGED);
+    ASPK_MSG_NAME(WM_DISPLAYCHANGE);
+    ASPK_MSG_NAME(WM_SETTINGCHANGE);
+    ASPK_MSG_NAME(WM_THEMECHANGED);
+    ASPK_MSG_NAME(WM_DWMNCRENDERINGCHANGED);
+    ASPK_MSG_NAME(WM_DWMCOMPOSITIONCHANGED);
+    ASPK_MSG_NAME(WM_DWMCOLORIZATIONCOLORCHANGED);
+    case kDrainPostedTextMsg: return L"DrainPostedText";
+    default: return nullptr;
+  }
+#undef ASPK_MSG_NAME
+}
+
+void
+GlassWindow::UpdateBackgroundPixel()
+{
+  mHasBackgroundPixel = false;
+
+  HBRUSH bgBrush = mBackgroundBrush;
+  if (!bgBrush) {
+    return;
+  }
+
+  COLORREF color;
+  // If the window class specifies a system brush color, we can look up its
+  // color directly.
   if (bgBrush <= ((HBRUSH)(COLOR_MENUBAR + 1))) {
-    bgBrush = GetSysColorBrush(((intptr_t)bgBrush) - 1);
+    color = GetSysColor(static_cast<int>((intptr_t)bgBrush) - 1);
+  } else {
+    // Get the color of the GDI HBRUSH
+    LOGBRUSH logBrush = {0};
+    int dataLen = GetObject(bgBrush, sizeof(logBrush), &logBrush);
+    if (dataLen != sizeof(logBrush)) {
+      Log<eLogWarning>(L"GetObject failed");
+      return;
+    }
+    if (logBrush.lbStyle != BS_SOLID) {
+      Log<eLogWarning>(L"Unsupported background brush style");
+      return;
+    }
+    color = logBrush.lbColor;
+  }
+
+  mBackgroundColor = color;
+  mBackgroundPixel = MakePremultipliedPixel(GetRValue(color),
+                                            GetGValue(color),
+                                            GetBValue(color));
+  mHasBackgroundPixel = true;
+}
+
+void
+GlassWindow::OnErase(PaintSurface& aSurface, RECT const &aRect)
+{
+  Trace<L"GlassWindow::OnErase -- %ld,%ld,%ld,%ld">(aRect.left, aRect.top,
+                                                    aRect.right, aRect.bottom);
+  RECT clientEraseRect(aRect);
+  if (!IsWindows10OrGreater() || IsRectEmpty(&clientEraseRect) ||
+      !mHasBackgroundPixel) {
+    return;
   }
-  // Get the color of the GDI HBRUSH
-  LOGBRUSH logBrush = {0};
-  int dataLen = GetObject(bgBrush, sizeof(logBrush), &logBrush);
-  if (dataLen != sizeof(logBrush)) {
-    odbs(L"GetObject failed");
+
+  // With a paint buffer, the premultiplied background goes straight into its
+  // DIB so that the background is alpha-aware. Without one (eg, remote
+  // sessions) the surface falls back to a plain brush fill.
+  aSurface.FillRect(ToPixelRect(clientEraseRect), mBackgroundPixel);
+}
+
+void
+GlassWindow::DrawMessageStatsOverlay(PaintSurface& aSurface)
+{
+  if (!mWndProcStats) {
     return;
   }
-  odbs(L"clientEraseRect: ", clientEraseRect);
-  if (logBrush.lbStyle != BS_SOLID) {
-    odbs(L"Unsupported background brush style");
+
+  mStatsOverlayText.clear();
+  mWndProcStats->AppendReport(mStatsOverlayText, &GetMessageName,
+                              kStatsOverlayMaxLines);
+  mFramePacer.AppendReport(mStatsOverlayText);
+
+  RECT clientRect;
+  if (!::GetClientRect(mHwnd, &clientRect)) {
     return;
   }
-  // Now draw with GDI+
-  Gdiplus::Graphics gfx(aDc);
-  Gdiplus::Color bgColor;
-  bgColor.SetFromCOLORREF(logBrush.lbColor);
-  Gdiplus::SolidBrush solidBrush(bgColor);
-  Gdiplus::Rect gdipBgRect(clientEraseRect.left,
-                           clientEraseRect.top,
-                           RectWidth(clientEraseRect),
-                           RectHeight(clientEraseRect));
-  gfx.FillRectangle(&solidBrush, gdipBgRect);
-  // FillRect(aDc, &clientEraseRect, bgBrush);
+
+  PaintCornerOverlay(aSurface, mStatsOverlayText, ToPixelRect(clientRect),
+                     LayoutConstant<4>::At(mDpiScaler->GetXScale()),
+                     MakePremultipliedPixel(0, 0, 0, 0xC0),
+                     MakePremultipliedPixel(0xFF, 0xFF, 0xFF));
+}
+
+void
+GlassWindow::RenderFrame(PaintSurface& aSurface, RECT const &aEraseRect,
+                         bool aErase)
+{
+  PaintProfiler* profiler = mPaintProfiler.get();
+  if (aErase) {
+    PaintProfiler::Scope stage(profiler, "OnErase");
+    OnErase(aSurface, aEraseRect);
+  }
+  {
+    PaintProfiler::Scope stage(profiler, "OnPaint");
+    OnPaint(aSurface);
+  }
+  if (mDebug) {
+    PaintProfiler::Scope stage(profiler, "DrawMessageStatsOverlay");
+    DrawMessageStatsOverlay(aSurface);
+  }
+}
+
+bool
+GlassWindow::RenderToBitmapFile(std::filesystem::path const &aPath)
+{
+  RECT clientRect;
+  if (!mHwnd || !::GetClientRect(mHwnd, &clientRect) ||
+      IsRectEmpty(&clientRect)) {
+    return false;
+  }
+  const int width = RectWidth(clientRect);
+  const int height = RectHeight(clientRect);
+
+  BITMAPINFO info = {};
+  info.bmiHeader.biSize = sizeof(info.bmiHeader);
+  info.bmiHeader.biWidth = width;
+  info.bmiHeader.biHeight = -height;  // Top-down, like a paint buffer
+  info.bmiHeader.biPlanes = 1;
+  info.bmiHeader.biBitCount = 32;
+  info.bmiHeader.biCompression = BI_RGB;
+
+  void* bits = nullptr;
+  UniqueGdiHandle bitmap(CreateDIBSection(NULL, &info, DIB_RGB_COLORS, &bits,
+                                          NULL, 0));
+  if (!bitmap || !bits) {
+    Log<eLogWarning>(L"RenderToBitmapFile: CreateDIBSection failed");
+    return false;
+  }
+
+  HDC dc = CreateCompatibleDC(NULL);
+  if (!dc) {
+    return false;
+  }
+  HGDIOBJ oldBitmap = SelectObject(dc, bitmap.get());
+  {
+    GdiPaintSurface surface(dc, clientRect, *mRenderResources,
+                            mDpiScaler->GetYScale());
+    surface.SetBits(static_cast<uint32_t*>(bits), width, clientRect);
+    // Unlike a paint buffer, a new DIB section starts out fully transparent,
+    // so always erase
+    RenderFrame(surface, clientRect, true);
+  }
+  GdiFlush();
+  SelectObject(dc, oldBitmap);
+  DeleteDC(dc);
+
+  if (!WriteBitmapFile(aPath, static_cast<uint32_t const *>(bits), width,
+                       height, width)) {
+    Log<eLogWarning>(L"Failed to write bitmap ", aPath.c_str());
+    return false;
+  }
+  return true;
 }
 
 void
 GlassWindow::OnPaint(HWND hwnd)
 {
   GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+  PaintProfiler* profiler = instance->mPaintProfiler.get();
+  // Declared before paintContext, so that EndPaint is included in the frame
+  PaintProfiler::FrameScope frame(profiler);
   bool local = !IsRemote();
-  PaintContext paintContext(hwnd);
-  PAINTSTRUCT &ps = paintContext.GetPaintStruct();
-  HDC hdc = paintContext.GetDC();
 
-  if (BufferedPaintRenderAnimation(hwnd, hdc)) {
-    return;
+  std::optional<PaintContext> paintContext;
+  {
+    PaintProfiler::Scope stage(profiler, "BeginPaint");
+    paintContext.emplace(hwnd);
+  }
+  PAINTSTRUCT &ps = paintContext->GetPaintStruct();
+  HDC hdc = paintContext->GetDC();
+
+  {
+    PaintProfiler::Scope stage(profiler, "BufferedPaintRenderAnimation");
+    if (BufferedPaintRenderAnimation(hwnd, hdc)) {
+      return;
+    }
   }
 
   HPAINTBUFFER buffer = NULL;
   HDC paintDC = hdc;
 #ifndef NO_BUFFERED_PAINT
   if (local) {
+    PaintProfiler::Scope stage(profiler, "BeginBufferedPaint");
     buffer = BeginBufferedPaint(hdc, &ps.rcPaint, BPBF_TOPDOWNDIB, nullptr, &paintDC);
   }
 #endif
-  if (ps.fErase) {
-    instance->OnErase(paintDC, ps.rcPaint);
+  {
+    GdiPaintSurface surface(paintDC, ps.rcPaint, *instance->mRenderResources,
+                            instance->mDpiScaler->GetYScale());
+    surface.SetPaintBuffer(buffer);
+    instance->RenderFrame(surface, ps.rcPaint, !!ps.fErase);
   }
-  instance->OnPaint(paintDC);
 #ifndef NO_BUFFERED_PAINT
   if (local && buffer) {
+    PaintProfiler::Scope stage(profiler, "EndBufferedPaint");
     EndBufferedPaint(buffer, TRUE);
   }
 #endif
@@ -636,7 +1597,15 @@ void
 GlassWindow::OnDpiChanged(HWND hwnd, UINT newXDpi, UINT newYDpi, RECT const &newScaledWindowRect)
 {
   GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
-  instance->mDpiScaler->Invalidate(newXDpi, newYDpi);
+  // Scalers are shared with other windows, so switch rather than mutate
+  instance->mDpiScaler = DpiScaler::GetForDpi(newXDpi, newYDpi);
+  if (instance->mNcDpiFollowsWindow) {
+    instance->mNcDpiScaler = instance->mDpiScaler;
+  }
+  instance->mRenderResources->InvalidateTheme();
+  instance->mConsoleLineHeight = 0;
+  instance->mMargins->SetDpiScalers(instance->mDpiScaler,
+                                    instance->mNcDpiScaler);
   instance->mMargins->Invalidate(instance);
   SetWindowPos(hwnd, HWND_TOP,
                newScaledWindowRect.left,
@@ -644,13 +1613,49 @@ GlassWindow::OnDpiChanged(HWND hwnd, UINT newXDpi, UINT newYDpi, RECT const &new
                RectWidth(newScaledWindowRect),
                RectHeight(newScaledWindowRect),
                SWP_NOZORDER | SWP_NOACTIVATE);
+  if (instance->mListView) {
+    instance->mListView->RefreshTextMetrics(false);
+  }
   RefreshDwmInfo(hwnd);
   RedrawWindow(hwnd, NULL, NULL, RDW_ERASE | RDW_INVALIDATE);
 }
 
+void
+GlassWindow::OnDisplaySettingsChange(HWND hwnd)
+{
+  // Every top-level window gets these, so this is typically redundant, but
+  // clearing the cache is cheap. A change to this window's own DPI arrives
+  // separately as WM_DPICHANGED.
+  DpiScaler::InvalidateMonitorCache();
+}
+
 void
 GlassWindow::OnThemeChanged()
 {
+  if (!mRenderResources) {
+    return;
+  }
+
+  mRenderResources->InvalidateAll();
+  // System colors may have changed along with the theme
+  UpdateBackgroundPixel();
+  mConsoleLineHeight = 0;
+  if (mListView) {
+    mListView->RefreshTextMetrics(true);
+  } else {
+    ScrollConsoleTo(mConsoleFollowTail ? SIZE_MAX : mConsoleTopLine);
+  }
+  ::InvalidateRect(mHwnd, nullptr, TRUE);
+}
+
+void
+GlassWindow::OnTimer(HWND hwnd, UINT id)
+{
+  GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+  if (instance && id == kStatsOverlayTimerId) {
+    // Repaint so the debug overlay picks up the latest statistics
+    instance->RequestFrame();
+  }
 }
 
 BOOL
@@ -663,13 +1668,32 @@ void
 GlassWindow::OnSize(HWND aHwnd, UINT aState, int aCx, int aCy)
 {
   GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(aHwnd, GWLP_USERDATA));
-  if (!instance || !instance->mListView) {
+  if (!instance) {
+    return;
+  }
+
+  if (!instance->mListView) {
+    // The number of visible lines changed; stay pinned to the bottom if we were
+    instance->ScrollConsoleTo(instance->mConsoleFollowTail ?
+                                SIZE_MAX : instance->mConsoleTopLine);
     return;
   }
 
   instance->mListView->Resize(aCx, aCy);
 }
 
+LRESULT
+GlassWindow::OnNotify(HWND aHwnd, int aIdFrom, NMHDR* aNmhdr)
+{
+  GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(aHwnd, GWLP_USERDATA));
+  if (!instance || !instance->mListView ||
+      aNmhdr->hwndFrom != *instance->mListView) {
+    return FORWARD_WM_NOTIFY(aHwnd, aIdFrom, aNmhdr, DefWindowProc);
+  }
+
+  return instance->mListView->OnNotify(aNmhdr);
+}
+
 void
 GlassWindow::OnSessionChange(HWND aHwnd, WPARAM aSessionChangeEvent)
 {
@@ -706,9 +1730,36 @@ GlassWindow::OnSessionChange(WPARAM aSessionChangeEvent)
 
 LRESULT CALLBACK
 GlassWindow::WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+  GlassWindow* instance = reinterpret_cast<GlassWindow*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+  if (!instance || !instance->mWndProcStats) {
+    return HandleMessage(instance, hwnd, uMsg, wParam, lParam);
+  }
+
+  // Times include any messages sent to us while this one is handled
+  auto start = std::chrono::steady_clock::now();
+  LRESULT lResult = HandleMessage(instance, hwnd, uMsg, wParam, lParam);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  instance->mWndProcStats->Record(
+    uMsg, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  return lResult;
+}
+
+/* static */ LRESULT
+GlassWindow::HandleMessage(GlassWindow* aInstance, HWND hwnd, UINT uMsg,
+                           WPARAM wParam, LPARAM lParam)
 {
   bool handled = false;
-  LRESULT lResult = NcWndProc(hwnd, uMsg, wParam, lParam, handled);
+  LRESULT lResult;
+  if (aInstance && aInstance->mNcWndProcStats) {
+    auto start = std::chrono::steady_clock::now();
+    lResult = NcWndProc(hwnd, uMsg, wParam, lParam, handled);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    aInstance->mNcWndProcStats->Record(
+      uMsg, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  } else {
+    lResult = NcWndProc(hwnd, uMsg, wParam, lParam, handled);
+  }
   if (handled) {
     return lResult;
   }
@@ -720,8 +1771,19 @@ GlassWindow::WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
       return 0;
     HANDLE_MSG(hwnd, WM_ERASEBKGND, OnEraseBackground);
     HANDLE_MSG(hwnd, WM_NCDESTROY, OnNcDestroy);
+    HANDLE_MSG(hwnd, WM_NOTIFY, OnNotify);
     HANDLE_MSG(hwnd, WM_PAINT, OnPaint);
     HANDLE_MSG(hwnd, WM_SIZE, OnSize);
+    HANDLE_MSG(hwnd, WM_TIMER, OnTimer);
+    HANDLE_MSG(hwnd, WM_VSCROLL, OnVScroll);
+    HANDLE_MSG(hwnd, WM_MOUSEWHEEL, OnMouseWheel);
+    case kDrainPostedTextMsg:
+      OnDrainPostedText(hwnd);
+      return 0;
+    case WM_DISPLAYCHANGE:
+    case WM_SETTINGCHANGE:
+      OnDisplaySettingsChange(hwnd);
+      break;
     case WM_WTSSESSION_CHANGE:
       OnSessionChange(hwnd, wParam);
       return 0;
@@ -757,7 +1819,7 @@ GlassWindow::GetClientRect(ScaledRect &aRect)
     return false;
   }
   /*
-  std::shared_ptr<DpiScaler const> scaler = GetDpiScaler();
+  DpiScalerHandle scaler = GetDpiScaler();
   aRect.top = mDpiScaler->ScaleY(aRect.top) + mMargins->GetFrameBorderYWidth(scaler) + mMargins->GetCaptionWidth(scaler);
   aRect.bottom = mDpiScaler->ScaleY(aRect.bottom) - mMargins->GetFrameBorderYWidth(scaler);
   aRect.left = mDpiScaler->ScaleX(aRect.left) + mMargins->GetFrameBorderXWidth(scaler);
@@ -772,7 +1834,7 @@ GlassWindow::ScreenToWindow(ScaledRect &aRect)
   SetLastError(ERROR_SUCCESS);
   if (!MapWindowPoints(NULL, mHwnd, (LPPOINT)&aRect, 2) &&
       GetLastError() != ERROR_SUCCESS) {
-    odbs(L"MapWindowPoints failed");
+    Log<eLogWarning>(L"MapWindowPoints failed");
     return false;
   }
   return true;
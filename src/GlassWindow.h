@@ -1,6 +1,9 @@
 #ifndef __ASPK_GLASSWND_H
 #define __ASPK_GLASSWND_H
 
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
 #include <map>
 #include <memory>
 #include <string>
@@ -8,9 +11,21 @@
 
 #include <windows.h>
 #include <dwmapi.h>
+#include <uxtheme.h>
 
+#include "CompiledFormat.h"
 #include "DpiScaler.h"
+#include "FramePacer.h"
 #include "ListView.h"
+#include "MessageStats.h"
+#include "MpscQueue.h"
+#include "PaintProfiler.h"
+#include "PaintSurface.h"
+#include "PrintfBuffer.h"
+#include "RenderResources.h"
+#include "RowStore.h"
+#include "UiTask.h"
+#include "UniqueHandle.h"
 
 namespace aspk {
 
@@ -30,8 +45,8 @@ class GlassMargins
 {
 public:
   explicit GlassMargins(MARGINS const &aMargins,
-                        std::shared_ptr<DpiScaler const> aDpiScaler,
-                        std::shared_ptr<DpiScaler const> aNcDpiScaler)
+                        DpiScalerHandle aDpiScaler,
+                        DpiScalerHandle aNcDpiScaler)
     : mFrameBorderXWidth(aNcDpiScaler)
     , mFrameBorderYWidth(aNcDpiScaler)
     , mCaptionWidth(aNcDpiScaler)
@@ -43,6 +58,13 @@ public:
   }
 
   void Invalidate(GlassWindow* aGlassWindow);
+  // Call Invalidate afterwards to recompute the frame metrics
+  void SetDpiScalers(DpiScalerHandle aDpiScaler,
+                     DpiScalerHandle aNcDpiScaler)
+  {
+    mDpiScaler = aDpiScaler;
+    mNcDpiScaler = aNcDpiScaler;
+  }
 
   operator PMARGINS()
   {
@@ -50,19 +72,19 @@ public:
   }
 
   inline ScaledDimensionX
-  GetFrameBorderXWidth(std::shared_ptr<DpiScaler const> &aScaler) const
+  GetFrameBorderXWidth(DpiScalerHandle aScaler) const
   {
     return mFrameBorderXWidth.ScaleTo(aScaler);
   }
 
   inline ScaledDimensionY
-  GetFrameBorderYWidth(std::shared_ptr<DpiScaler const> &aScaler) const
+  GetFrameBorderYWidth(DpiScalerHandle aScaler) const
   {
     return mFrameBorderYWidth.ScaleTo(aScaler);
   }
 
   inline ScaledDimensionY
-  GetCaptionWidth(std::shared_ptr<DpiScaler const> &aScaler) const
+  GetCaptionWidth(DpiScalerHandle aScaler) const
   {
     return mCaptionWidth.ScaleTo(aScaler);
   }
@@ -91,8 +113,8 @@ private:
   ScaledDimensionY                  mCaptionWidth;
   MARGINS                           mMargins;
   MARGINS                           mUserMargins;
-  std::shared_ptr<DpiScaler const>  mDpiScaler;
-  std::shared_ptr<DpiScaler const>  mNcDpiScaler;
+  DpiScalerHandle                   mDpiScaler;
+  DpiScalerHandle                   mNcDpiScaler;
 };
 
 class GlassWindow
@@ -103,11 +125,15 @@ public:
   public:
     enum Flags
     {
+      // Ends the thread's message loop once every window on the thread
+      // created with this flag has been destroyed
       eQuitOnDestroy = 1,
       eSolidGlass = 2,
       eAlwaysOnTop = 4,
       eFixedSize = 8,
       eVisualDebug = 16,
+      eMessageTiming = 32,
+      ePaintProfiling = 64,
       eDefaultFlags = eQuitOnDestroy | eSolidGlass
     };
     Params();
@@ -115,6 +141,8 @@ public:
     inline void SetSize(int aWidth, int aHeight) { mWidth = aWidth; mHeight = aHeight; }
     void SetFlags(unsigned int aFlags);
     inline void SetMargins(MARGINS &aMargins) { mMargins = aMargins; }
+    // Caps the memory used to hold printed output; see SetOutputMemoryBudget
+    inline void SetOutputMemoryBudget(size_t aBytes) { mOutputMemoryBudget = aBytes; }
 
     inline bool QuitOnDestroy() const { return mQuitOnDestroy; }
     inline wchar_t const * GetTitleText() const { return mTitleText.c_str(); }
@@ -125,6 +153,9 @@ public:
     inline MARGINS const & GetMargins() const { return mMargins; }
     inline HBRUSH GetBackgroundBrush() const { return mBackgroundBrush; }
     inline bool IsVisualDebugMode() const { return mVisualDebug; }
+    inline bool IsMessageTimingEnabled() const { return mMessageTiming; }
+    inline bool IsPaintProfilingEnabled() const { return mPaintProfiling; }
+    inline size_t GetOutputMemoryBudget() const { return mOutputMemoryBudget; }
 
   private:
     std::wstring    mTitleText;
@@ -136,11 +167,17 @@ public:
     HBRUSH          mBackgroundBrush;
     bool            mQuitOnDestroy;
     bool            mVisualDebug;
+    bool            mMessageTiming;
+    bool            mPaintProfiling;
     DWORD           mCaptionFlags;
+    size_t          mOutputMemoryBudget;
   };
 
+  // Any number of windows may exist at once, sharing one GlassWindowApp.
+  // Window classes are registered on first use and shared.
   GlassWindow(HINSTANCE aInstance, std::wstring const &aTitleText);
   GlassWindow(HINSTANCE aInstance, Params const &aParams);
+  // Destroys the window if it still exists
   ~GlassWindow();
 
   void Show(int aShow);
@@ -161,12 +198,12 @@ public:
     return *mMargins;
   }
 
-  std::shared_ptr<DpiScaler const> GetDpiScaler() const
+  DpiScalerHandle GetDpiScaler() const
   {
     return mDpiScaler;
   }
 
-  std::shared_ptr<DpiScaler const> GetNcDpiScaler() const
+  DpiScalerHandle GetNcDpiScaler() const
   {
     return mNcDpiScaler;
   }
@@ -189,8 +226,33 @@ public:
 
   HICON GetCaptionIcon() const;
 
+  // Exposes the paint resource cache's hit/miss counters
+  RenderResources const * GetRenderResources() const
+  {
+    return mRenderResources.get();
+  }
+
   void DrawDebugRect(HDC aDc, RECT const &aRect, COLORREF aColor);
 
+  // Per-message latency histograms, present when created with eMessageTiming
+  // or eVisualDebug. WndProc times include nested messages and NcWndProc.
+  MessageStats const * GetWndProcStats() const { return mWndProcStats.get(); }
+  MessageStats const * GetNcWndProcStats() const { return mNcWndProcStats.get(); }
+  void ResetMessageStats();
+  // Writes both reports to aPath as UTF-8 text
+  bool DumpMessageStats(std::filesystem::path const &aPath) const;
+
+  // Per-stage timings of recent paints, present when created with
+  // ePaintProfiling or eVisualDebug
+  PaintProfiler const * GetPaintProfiler() const { return mPaintProfiler.get(); }
+  // Writes recent paints to aPath as Chrome trace-event JSON
+  bool DumpPaintTrace(std::filesystem::path const &aPath) const;
+
+  // Paints the whole client area, background included, into an offscreen
+  // bitmap and writes it to aPath as a 32-bit BMP. The window need not be
+  // visible.
+  bool RenderToBitmapFile(std::filesystem::path const &aPath);
+
   inline bool IsMaximized() const
   {
     return !!::IsZoomed(mHwnd);
@@ -227,10 +289,86 @@ public:
   }
 
   void SetColumns(const std::vector<wchar_t const *>& aColumnNames);
+
+  // Approximate cap, in bytes, on the memory holding printed output. Older
+  // output beyond the budget is moved to a temporary file and read back when
+  // scrolled into view. 0 (the default) keeps everything in memory.
+  void SetOutputMemoryBudget(size_t aBytes);
+
   void Printf(const wchar_t* aFmt, ...);
 
+  // Compile-time checked variant of Printf, e.g.
+  //   window.Printf<L"%d\t%s\n">(count, name);
+  // See CompiledFormat for the supported conversions. Columns come from the
+  // tabs in the format string alone, and empty columns are preserved.
+  template <FixedFormat Fmt, typename... Args>
+  void Printf(Args const &... aArgs)
+  {
+    using Formatter = CompiledFormat<Fmt, Args...>;
+    typename Formatter::Cells cells;
+    Formatter::Format(mPrintfBuf, cells, aArgs...);
+
+    if (Formatter::kNumColumns > 1 || mListView) {
+      OutputCells(cells.data(), cells.size());
+    } else {
+      OutputText();
+    }
+  }
+
+  // Like Printf, but may be called from any thread. The text is formatted on
+  // the calling thread and queued; the UI thread drains the queue in bulk.
+  // Never blocks on the UI thread. Text posted before the window is created
+  // is shown once it is.
+  void PostPrintf(const wchar_t* aFmt, ...);
+  size_t GetPostedTextDepth() const { return mPostedTextQueue.GetDepth(); }
+  size_t GetPostedTextHighWaterMark() const { return mPostedTextQueue.GetHighWaterMark(); }
+
+  // Starts aTask on this window's thread. It runs until its first co_await,
+  // and is then resumed from GlassWindowApp's loop. Destroying the window
+  // cancels it. Returns false, without starting it, if there is no app or the
+  // window is gone.
+  bool Spawn(UiTask aTask);
+
+  // Invalidates aDirtyRect, or the whole client area if null, at the next
+  // frame. For animations and other repaints the window drives itself.
+  void RequestFrame(RECT const * aDirtyRect = nullptr);
+  // Under GlassWindowApp::Run, output and RequestFrame are flushed at most
+  // once per display refresh; this counts the frames that were presented and
+  // the invalidations folded into them
+  FramePacer const & GetFramePacer() const { return mFramePacer; }
+
+  // Coalesces the redraw work of every Printf between BeginBatch and the
+  // matching EndBatch into a single relayout and invalidation. Batches may
+  // nest; only the outermost EndBatch commits.
+  void BeginBatch();
+  void EndBatch();
+
+  class AutoBatch
+  {
+  public:
+    explicit AutoBatch(GlassWindow& aWindow)
+      : mWindow(aWindow)
+    {
+      mWindow.BeginBatch();
+    }
+
+    ~AutoBatch()
+    {
+      mWindow.EndBatch();
+    }
+
+  private:
+    AutoBatch(AutoBatch const &) = delete;
+    AutoBatch& operator=(AutoBatch const &) = delete;
+
+  private:
+    GlassWindow& mWindow;
+  };
+
 protected:
-  virtual void OnPaint(HDC aDc);
+  // Draws the window contents. aSurface is either the window's paint buffer
+  // or an offscreen bitmap; see RenderToBitmapFile.
+  virtual void OnPaint(PaintSurface& aSurface);
   virtual void OnDestroy();
 
   // Resume timers and animations
@@ -241,21 +379,64 @@ protected:
 
 protected:
   // Types
+  struct PostedText : public MpscNode
+  {
+    std::wstring  mText;
+  };
 
 protected:
   // Instance Variables
   HINSTANCE                       mInstance;
   HWND                            mHwnd;
+  ATOM                            mClassAtom;
   BOOL                            mWTSRegistered;
-  std::shared_ptr<DpiScaler>      mDpiScaler;
-  std::shared_ptr<DpiScaler>      mNcDpiScaler;
+  DpiScalerHandle                 mDpiScaler;
+  DpiScalerHandle                 mNcDpiScaler;
+  // The non-client area follows the window's DPI (per-monitor v2)
+  bool                            mNcDpiFollowsWindow;
   std::unique_ptr<GlassMargins>   mMargins;
+  std::unique_ptr<RenderResources> mRenderResources;
+  HBRUSH                          mBackgroundBrush;
+  COLORREF                        mBackgroundColor;
+  uint32_t                        mBackgroundPixel; // Premultiplied BGRA
+  bool                            mHasBackgroundPixel;
   bool                            mQuitOnDestroy;
   bool                            mDebug;
 
-  std::unique_ptr<wchar_t[]>      mPrintfBuf;
-  int                             mPrintfBufLen;
+  PrintfBuffer                    mPrintfBuf;
+  std::vector<std::wstring_view>  mPrintfCells;
   std::unique_ptr<ListView>       mListView;
+  int                             mBatchDepth;
+  bool                            mBatchNeedsInvalidate;
+  // Posted text holds a batch open until GlassWindowApp's idle phase
+  bool                            mIdleBatchOpen;
+  size_t                          mIdleCallbackId;
+  size_t                          mOutputMemoryBudget;
+
+  // Text mode scrollback; one row per line
+  RowStore                        mConsoleLines;
+  size_t                          mConsoleTopLine;
+  size_t                          mConsoleDirtyLine;  // First line to repaint at EndBatch
+  int                             mConsoleLineHeight; // 0 until measured
+  bool                            mConsoleFollowTail;
+  MpscQueue<PostedText>           mPostedTextQueue;
+  // Where producers send the drain message; null until OnCreate and after
+  // WM_NCDESTROY, in which case text waits in the queue
+  std::atomic<HWND>               mPostTarget;
+  // Tasks started by Spawn; cancelled in OnDestroy
+  std::unique_ptr<TaskScope>      mTaskScope;
+
+  FramePacer                      mFramePacer;
+  // Fires at the next frame time; waited on by GlassWindowApp
+  UniqueKernelHandle              mFrameTimer;
+  // Output holds a batch open until the next frame
+  bool                            mFrameBatchOpen;
+  RECT                            mFrameDirtyRect;
+
+  std::unique_ptr<MessageStats>   mWndProcStats;
+  std::unique_ptr<MessageStats>   mNcWndProcStats;
+  std::wstring                    mStatsOverlayText;
+  std::unique_ptr<PaintProfiler>  mPaintProfiler;
 
 private:
   // Member functions
@@ -263,14 +444,46 @@ private:
             DWORD aExStyleToggles, int aWidth, int aHeight,
             MARGINS const & aMargins, HBRUSH aBackgroundBrush);
   void OnCreate(HWND aHwnd, MARGINS const & aMargins);
-  void OnErase(HDC aDc, RECT const &aRect);
+  void OnErase(PaintSurface& aSurface, RECT const &aRect);
+  void DrawMessageStatsOverlay(PaintSurface& aSurface);
+  // Everything after BeginPaint: erase, contents and the debug overlay
+  void RenderFrame(PaintSurface& aSurface, RECT const &aEraseRect, bool aErase);
+  void UpdateBackgroundPixel();
   void OnThemeChanged();
   void OnSessionChange(WPARAM aSessionChangeEvent);
   void GetClientRectInset(RECT &aRect);
   void MaybeCreateListView(const size_t aNumCols);
+  bool CreateListView();
+  void OutputPrintfBuf();
+  void OutputCells(std::wstring_view const * aCells, size_t aNumCells);
+  void OutputText();
+  int GetConsoleLineHeight();
+  size_t GetConsolePageLines();
+  void UpdateConsoleScrollInfo();
+  void ScrollConsoleTo(size_t aTopLine);
+  void ScrollConsoleBy(ptrdiff_t aLines);
+  void InvalidateConsoleLines(size_t aFirstLine);
+  void OnConsoleScroll(UINT aCode);
+  void DrainPostedText();
+  // GlassWindowApp idle callback
+  bool OnIdle();
+  bool IsFramePaced() const;
+  // Holds a batch open until the next frame and requests one. Returns false,
+  // leaving the caller to commit as before, if frames are not paced.
+  bool OpenFrameBatch();
+  void ScheduleFrame();
+  // Frame timer callback: commits the frame batch and pending invalidations
+  void PresentFrame();
+  // Picks up the compositor's refresh phase and period
+  void RefreshFrameTiming();
 
 private:
   // Static Functions
+  // Returns the shared class for windows with this background, registering it
+  // on first use, and the brush the class actually uses
+  static ATOM AcquireWindowClass(HINSTANCE aInstance, HBRUSH aBackgroundBrush,
+                                 bool aDebug, HBRUSH &aClassBrush);
+  static void ReleaseWindowClass(HINSTANCE aInstance, ATOM aAtom);
   static void RefreshFrame(HWND hwnd);
   static void RefreshDwmInfo(HWND hwnd);
   static void OnActivate(HWND hwnd, UINT state, HWND hwndActDeact, BOOL minimized);
@@ -280,19 +493,31 @@ private:
   static void OnSize(HWND hwnd, UINT state, int cx, int cy);
   static void OnShowWindow(HWND hwnd, BOOL show, UINT status);
   static LRESULT OnNcHitTest(HWND hwnd, int x, int y);
+  static void OnVScroll(HWND hwnd, HWND hwndCtl, UINT code, int pos);
+  static void OnMouseWheel(HWND hwnd, int xPos, int yPos, int zDelta, UINT fwKeys);
+  static LRESULT OnNotify(HWND hwnd, int idFrom, NMHDR* aNmhdr);
   static LRESULT NcWndProc(HWND aHwnd, UINT aMsg, WPARAM aWParam, LPARAM aLParam, bool& aHandled);
   static BOOL OnCreate(HWND hwnd, LPCREATESTRUCT lpcs);
   static void OnDestroy(HWND hwnd);
+  static void OnDrainPostedText(HWND hwnd);
   static void OnDpiChanged(HWND hwnd, UINT newXDpi, UINT newYDpi, RECT const &newScaledWindowRect);
+  static void OnDisplaySettingsChange(HWND hwnd);
   static BOOL OnEraseBackground(HWND aHwnd, HDC aDc);
   static void OnNcDestroy(HWND hwnd);
   static void OnPaint(HWND hwnd);
+  static void OnTimer(HWND hwnd, UINT id);
+  static wchar_t const * GetMessageName(uint32_t aMsg);
+  static LRESULT HandleMessage(GlassWindow* aInstance, HWND aHwnd, UINT aMsg, WPARAM aWParam, LPARAM aLParam);
   static LRESULT CALLBACK WndProc(HWND aHwnd, UINT aMsg, WPARAM aWParam, LPARAM aLParam);
 
 private:
   // Constants
   static wchar_t const kClassName[];
   static wchar_t const kGlassWindowKey[];
+  static const UINT kDrainPostedTextMsg = WM_USER + 1;
+  static const UINT_PTR kStatsOverlayTimerId = 1;
+  static const UINT kStatsOverlayIntervalMs = 1000;
+  static const size_t kStatsOverlayMaxLines = 12;
 };
 
 } // namespace aspk
@@ -1,16 +1,48 @@
 #include "GlassWindowApp.h"
+#include "Log.h"
+#include "Trace.h"
 
 #include <windows.h>
 
 #include <commctrl.h>
 #include <gdiplus.h>
 
+#include <algorithm>
+
 namespace aspk {
 
+static thread_local GlassWindowApp* tCurrentApp = nullptr;
+
 GlassWindowApp::GlassWindowApp()
   : mInitOk(false)
+  , mRunning(false)
   , mGdiPlusToken(0)
+  , mPreviousApp(tCurrentApp)
+  , mNextIdleId(1)
+  , mIdleResumeId(0)
+  , mIdleBudget(std::chrono::milliseconds(4))
+  , mIdleRequested(false)
+  , mIdleEvent(::CreateEventW(nullptr, FALSE, FALSE, nullptr))
+  , mTaskEvent(::CreateEventW(nullptr, FALSE, FALSE, nullptr))
 {
+  tCurrentApp = this;
+
+  if (!mIdleEvent || !mTaskEvent) {
+    return;
+  }
+
+  mThreadPool = std::make_unique<ThreadPool>();
+  HANDLE taskEvent = mTaskEvent.get();
+  mTaskScheduler =
+    std::make_unique<TaskScheduler>([taskEvent] { ::SetEvent(taskEvent); });
+  ThreadPool* pool = mThreadPool.get();
+  mTaskScheduler->SetBackgroundExecutor([pool](BackgroundWork* aWork) {
+    pool->Submit([](void* aContext) {
+      static_cast<BackgroundWork*>(aContext)->Run();
+    }, aWork);
+  });
+  AddWaitHandle(taskEvent, [this](HANDLE) { mTaskScheduler->RunPending(); });
+
   INITCOMMONCONTROLSEX icc = { sizeof(icc),
                                ICC_STANDARD_CLASSES | ICC_LISTVIEW_CLASSES };
 
@@ -28,28 +60,220 @@ GlassWindowApp::GlassWindowApp()
 
 GlassWindowApp::~GlassWindowApp()
 {
+  tCurrentApp = mPreviousApp;
+
+  // Background work may still be using GDI+, and must not wake a dead event.
+  // The scheduler waits for its work, which runs on the pool, so it goes
+  // first.
+  if (mTaskScheduler) {
+    RemoveWaitHandle(mTaskEvent.get());
+    mTaskScheduler.reset();
+  }
+  mThreadPool.reset();
+
+  // Don't lose the tail of a trace the app started
+  StopTrace();
+
   if (mInitOk) {
     Gdiplus::GdiplusShutdown(mGdiPlusToken);
   }
 }
 
-int
-GlassWindowApp::Run()
+/* static */ GlassWindowApp*
+GlassWindowApp::GetForCurrentThread()
 {
-  MSG msg;
+  return tCurrentApp;
+}
 
-  while (::GetMessage(&msg, nullptr, 0, 0)) {
-    // We don't check for bRet == -1 here because that is only returned for
-    // invalid parameters to GetMessage().
-    // See https://blogs.msdn.microsoft.com/oldnewthing/20130322-00/?p=4873
+bool
+GlassWindowApp::AddWaitHandle(HANDLE aHandle, WaitCallback aCallback)
+{
+  if (!aHandle || mWaitEntries.size() == kMaxWaitHandles) {
+    return false;
+  }
+  for (WaitEntry const &entry : mWaitEntries) {
+    if (entry.mHandle == aHandle) {
+      return false;
+    }
+  }
+  mWaitEntries.push_back(WaitEntry{aHandle, std::move(aCallback)});
+  return true;
+}
+
+void
+GlassWindowApp::RemoveWaitHandle(HANDLE aHandle)
+{
+  mWaitEntries.erase(std::remove_if(mWaitEntries.begin(), mWaitEntries.end(),
+                                    [aHandle](WaitEntry const &aEntry) {
+                                      return aEntry.mHandle == aHandle;
+                                    }),
+                     mWaitEntries.end());
+}
+
+GlassWindowApp::IdleCallbackId
+GlassWindowApp::AddIdleCallback(IdleCallback aCallback)
+{
+  const IdleCallbackId id = mNextIdleId++;
+  mIdleEntries.push_back(IdleEntry{id, std::move(aCallback)});
+  return id;
+}
+
+void
+GlassWindowApp::RemoveIdleCallback(IdleCallbackId aId)
+{
+  mIdleEntries.erase(std::remove_if(mIdleEntries.begin(), mIdleEntries.end(),
+                                    [aId](IdleEntry const &aEntry) {
+                                      return aEntry.mId == aId;
+                                    }),
+                     mIdleEntries.end());
+}
+
+void
+GlassWindowApp::RequestIdle()
+{
+  // Only the first request since the last idle phase needs to wake the loop
+  if (!mIdleRequested.exchange(true, std::memory_order_acq_rel)) {
+    ::SetEvent(mIdleEvent.get());
+  }
+}
+
+bool
+GlassWindowApp::DispatchPendingMessages(int &aExitCode)
+{
+  MSG msg;
+  while (::PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+    if (msg.message == WM_QUIT) {
+      aExitCode = static_cast<int>(msg.wParam);
+      return false;
+    }
     ::TranslateMessage(&msg);
     if (!::CallMsgFilter(&msg, 0)) {
       ::DispatchMessage(&msg);
     }
   }
+  return true;
+}
 
-  return 0;
+GlassWindowApp::WaitCallback const *
+GlassWindowApp::FindWaitCallback(HANDLE aHandle) const
+{
+  for (WaitEntry const &entry : mWaitEntries) {
+    if (entry.mHandle == aHandle) {
+      return &entry.mCallback;
+    }
+  }
+  return nullptr;
 }
 
-} // namespace aspk
+bool
+GlassWindowApp::RunIdleCallbacks()
+{
+  const auto deadline = std::chrono::steady_clock::now() + mIdleBudget;
+  bool moreWork = false;
+
+  // Callbacks may add or remove callbacks, so walk by id. Entries are in id
+  // order; start with the first one the last phase did not reach and wrap
+  // around, so a slow callback cannot starve the ones after it.
+  std::vector<IdleCallbackId> ids;
+  ids.reserve(mIdleEntries.size());
+  auto resume = std::lower_bound(mIdleEntries.begin(), mIdleEntries.end(),
+                                 mIdleResumeId,
+                                 [](IdleEntry const &aEntry, IdleCallbackId aId) {
+                                   return aEntry.mId < aId;
+                                 });
+  for (auto itr = resume; itr != mIdleEntries.end(); ++itr) {
+    ids.push_back(itr->mId);
+  }
+  for (auto itr = mIdleEntries.begin(); itr != resume; ++itr) {
+    ids.push_back(itr->mId);
+  }
+  mIdleResumeId = 0;
+
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      // Out of budget; pick up here after checking input
+      mIdleResumeId = ids[i];
+      return true;
+    }
+    auto itr = std::find_if(mIdleEntries.begin(), mIdleEntries.end(),
+                            [id = ids[i]](IdleEntry const &aEntry) {
+                              return aEntry.mId == id;
+                            });
+    if (itr == mIdleEntries.end()) {
+      continue;
+    }
+    IdleCallback callback = itr->mCallback;
+    moreWork |= callback(deadline);
+  }
+  return moreWork;
+}
+
+int
+GlassWindowApp::Run()
+{
+  mRunning = true;
+  int exitCode = 0;
+  std::vector<HANDLE> handles;
+
+  while (DispatchPendingMessages(exitCode)) {
+    // The input queue is empty: time for coalesced work
+    bool moreIdleWork = false;
+    if (mIdleRequested.exchange(false, std::memory_order_acq_rel)) {
+      moreIdleWork = RunIdleCallbacks();
+      if (moreIdleWork) {
+        mIdleRequested.store(true, std::memory_order_release);
+      }
+    }
+
+    handles.clear();
+    handles.push_back(mIdleEvent.get());
+    for (WaitEntry const &entry : mWaitEntries) {
+      handles.push_back(entry.mHandle);
+    }
+
+    // MWMO_INPUTAVAILABLE, so that messages which arrived while we were busy
+    // wake us even though they have already been seen
+    const DWORD result =
+      ::MsgWaitForMultipleObjectsEx(static_cast<DWORD>(handles.size()),
+                                    handles.data(),
+                                    moreIdleWork ? 0 : INFINITE, QS_ALLINPUT,
+                                    MWMO_ALERTABLE | MWMO_INPUTAVAILABLE);
+    if (result == WAIT_FAILED) {
+      Log<eLogError>(L"MsgWaitForMultipleObjectsEx failed: ", ::GetLastError());
+      // Fall back to a plain message wait rather than spin
+      ::WaitMessage();
+      continue;
+    }
 
+    size_t signaled;
+    if (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles.size()) {
+      signaled = result - WAIT_OBJECT_0;
+    } else if (result >= WAIT_ABANDONED_0 &&
+               result < WAIT_ABANDONED_0 + handles.size()) {
+      signaled = result - WAIT_ABANDONED_0;
+    } else {
+      // Input, an APC (WAIT_IO_COMPLETION), or the idle timeout
+      continue;
+    }
+
+    // Index 0 is the idle event; its request flag is already set. The wait
+    // only reports the first signaled handle, so poll the ones after it too,
+    // or a busy handle could starve the rest. Callbacks may add or remove
+    // handles, including their own, so each one is looked up again.
+    for (size_t i = std::max<size_t>(signaled, 1); i < handles.size(); ++i) {
+      WaitCallback const * registered = FindWaitCallback(handles[i]);
+      if (!registered ||
+          (i != signaled &&
+           ::WaitForSingleObject(handles[i], 0) != WAIT_OBJECT_0)) {
+        continue;
+      }
+      WaitCallback callback = *registered;
+      callback(handles[i]);
+    }
+  }
+
+  mRunning = false;
+  return exitCode;
+}
+
+} // namespace aspk
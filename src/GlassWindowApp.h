@@ -1,18 +1,94 @@
 #ifndef __ASPK_GLASSWINDOWAPP_H
 #define __ASPK_GLASSWINDOWAPP_H
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
 #include <windows.h>
 
+#include "ThreadPool.h"
+#include "UiTask.h"
+#include "UniqueHandle.h"
+
 namespace aspk {
 
+// Owns process-wide UI initialization and the UI thread's message loop. The
+// loop waits on registered kernel handles alongside messages, and once the
+// input queue is empty runs idle callbacks within a time budget. It also owns
+// the thread's TaskScheduler, whose resumptions run from the loop, and a
+// ThreadPool that runs the scheduler's background work.
 class GlassWindowApp
 {
 public:
+  // Called on the UI thread when the handle it was registered with is
+  // signaled
+  using WaitCallback = std::function<void(HANDLE aHandle)>;
+  // Called on the UI thread during the idle phase. Should stop by aDeadline
+  // where it can, and return true if it has more work, in which case the idle
+  // phase resumes as soon as pending input has been handled.
+  using IdleCallback = std::function<bool(std::chrono::steady_clock::time_point aDeadline)>;
+  using IdleCallbackId = size_t;
+
   GlassWindowApp();
   ~GlassWindowApp();
 
   explicit operator bool() { return mInitOk; }
+  // Runs until WM_QUIT and returns its exit code
   int Run();
+  bool IsRunning() const { return mRunning; }
+
+  // The app created on the calling thread, if any
+  static GlassWindowApp* GetForCurrentThread();
+
+  // Waits on aHandle (an event, waitable timer, process, etc) while the loop
+  // runs. Auto-reset objects are reset by the wait itself; manual-reset ones
+  // must be reset by aCallback or they will fire continuously. Returns false
+  // if the handle is already registered or the kMaxWaitHandles limit is hit.
+  // UI thread only, like everything here but RequestIdle.
+  bool AddWaitHandle(HANDLE aHandle, WaitCallback aCallback);
+  void RemoveWaitHandle(HANDLE aHandle);
+
+  IdleCallbackId AddIdleCallback(IdleCallback aCallback);
+  void RemoveIdleCallback(IdleCallbackId aId);
+  // Schedules an idle phase once the input queue is next empty. Idle
+  // callbacks only run when requested, so a quiet app does not spin. May be
+  // called from any thread.
+  void RequestIdle();
+  // How long one idle phase may run before input is checked again
+  void SetIdleBudget(std::chrono::microseconds aBudget) { mIdleBudget = aBudget; }
+
+  // Null if initialization failed. Destroyed, after waiting for its
+  // background work, before GDI+ shuts down.
+  TaskScheduler* GetTaskScheduler() const { return mTaskScheduler.get(); }
+  // One worker per hardware thread. Shut down after the scheduler, so also
+  // before GDI+. Null if initialization failed.
+  ThreadPool* GetThreadPool() const { return mThreadPool.get(); }
+
+  // Handles registered with MsgWaitForMultipleObjectsEx, less our idle event.
+  // The task scheduler's event counts against this.
+  static const size_t kMaxWaitHandles = MAXIMUM_WAIT_OBJECTS - 1;
+
+private:
+  struct WaitEntry
+  {
+    HANDLE        mHandle;
+    WaitCallback  mCallback;
+  };
+
+  struct IdleEntry
+  {
+    IdleCallbackId  mId;
+    IdleCallback    mCallback;
+  };
+
+  // Returns false once WM_QUIT has been seen
+  bool DispatchPendingMessages(int &aExitCode);
+  WaitCallback const * FindWaitCallback(HANDLE aHandle) const;
+  // Returns true if any callback has more work
+  bool RunIdleCallbacks();
 
 private:
   GlassWindowApp(const GlassWindowApp&) = delete;
@@ -21,11 +97,27 @@ private:
   GlassWindowApp& operator=(GlassWindowApp&&) = delete;
 
 private:
-  bool      mInitOk;
-  ULONG_PTR mGdiPlusToken;
+  bool                      mInitOk;
+  bool                      mRunning;
+  ULONG_PTR                 mGdiPlusToken;
+  GlassWindowApp*           mPreviousApp;
+
+  std::vector<WaitEntry>    mWaitEntries;
+  std::vector<IdleEntry>    mIdleEntries;
+  IdleCallbackId            mNextIdleId;
+  // The callback the next idle phase starts with, if the last one ran out of
+  // budget before reaching it
+  IdleCallbackId            mIdleResumeId;
+  std::chrono::microseconds mIdleBudget;
+  std::atomic<bool>         mIdleRequested;
+  // Wakes the loop when idle work is requested from another thread
+  UniqueKernelHandle        mIdleEvent;
+  // Set by the scheduler, from any thread, when it has resumptions queued
+  UniqueKernelHandle        mTaskEvent;
+  std::unique_ptr<ThreadPool> mThreadPool;
+  std::unique_ptr<TaskScheduler> mTaskScheduler;
 };
 
 } // namespace aspk
 
 #endif // __ASPK_GLASSWINDOWAPP_H
-
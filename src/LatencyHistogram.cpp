@@ -0,0 +1,111 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace aspk {
+
+static constexpr uint64_t kSubBucketCount = uint64_t(1) << LatencyHistogram::kSubBucketBits;
+
+LatencyHistogram::LatencyHistogram()
+{
+  Reset();
+}
+
+/* static */ size_t
+LatencyHistogram::GetBucketIndex(uint64_t aValue)
+{
+  if (aValue < kSubBucketCount) {
+    return static_cast<size_t>(aValue);
+  }
+
+  // Shift the value so that its leading bit lands just above the sub-bucket
+  // bits; the shift then selects the octave and the remaining bits the
+  // linear bucket within it.
+  const unsigned width = static_cast<unsigned>(std::bit_width(aValue));
+  if (width > kMaxValueBits) {
+    return kNumBuckets - 1;
+  }
+
+  const unsigned shift = width - (kSubBucketBits + 1);
+  return static_cast<size_t>((uint64_t(shift) << kSubBucketBits) +
+                             (aValue >> shift));
+}
+
+/* static */ uint64_t
+LatencyHistogram::GetBucketLowerBound(size_t aIndex)
+{
+  if (aIndex < 2 * kSubBucketCount) {
+    return aIndex;
+  }
+
+  const unsigned shift = static_cast<unsigned>(aIndex >> kSubBucketBits) - 1;
+  const uint64_t mantissa = aIndex - (uint64_t(shift) << kSubBucketBits);
+  return mantissa << shift;
+}
+
+/* static */ uint64_t
+LatencyHistogram::GetBucketUpperBound(size_t aIndex)
+{
+  if (aIndex + 1 >= kNumBuckets) {
+    return UINT64_MAX;
+  }
+  return GetBucketLowerBound(aIndex + 1) - 1;
+}
+
+void
+LatencyHistogram::Record(uint64_t aValue)
+{
+  ++mBuckets[GetBucketIndex(aValue)];
+  ++mCount;
+  mTotal += aValue;
+  mMin = std::min(mMin, aValue);
+  mMax = std::max(mMax, aValue);
+}
+
+void
+LatencyHistogram::Merge(LatencyHistogram const &aOther)
+{
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    mBuckets[i] += aOther.mBuckets[i];
+  }
+  mCount += aOther.mCount;
+  mTotal += aOther.mTotal;
+  mMin = std::min(mMin, aOther.mMin);
+  mMax = std::max(mMax, aOther.mMax);
+}
+
+void
+LatencyHistogram::Reset()
+{
+  mBuckets.fill(0);
+  mCount = 0;
+  mTotal = 0;
+  mMin = UINT64_MAX;
+  mMax = 0;
+}
+
+uint64_t
+LatencyHistogram::GetPercentile(double aPercentile) const
+{
+  if (!mCount) {
+    return 0;
+  }
+
+  const double clamped = std::clamp(aPercentile, 0.0, 100.0);
+  const uint64_t rank = std::max<uint64_t>(
+    1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * double(mCount))));
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += mBuckets[i];
+    if (seen >= rank) {
+      return std::clamp(GetBucketUpperBound(i), GetMin(), mMax);
+    }
+  }
+
+  return mMax;
+}
+
+} // namespace aspk
@@ -0,0 +1,56 @@
+#ifndef __ASPK_LATENCYHISTOGRAM_H
+#define __ASPK_LATENCYHISTOGRAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace aspk {
+
+// Fixed-size log-linear histogram of non-negative integer samples, typically
+// durations in nanoseconds. Values below 2^kSubBucketBits are counted
+// exactly; above that, each power of two is split into 2^kSubBucketBits
+// linear buckets, so any reported percentile is within 1/16 (6.25%) of the
+// true sample. Values of 2^kMaxValueBits and above, about 18 minutes in
+// nanoseconds, share the last bucket. Recording never allocates. This class
+// has no Win32 dependencies.
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned kSubBucketBits = 4;
+  static constexpr unsigned kMaxValueBits = 40;
+  static constexpr size_t kNumBuckets =
+    (kMaxValueBits - kSubBucketBits + 1) << kSubBucketBits;
+
+  LatencyHistogram();
+
+  void Record(uint64_t aValue);
+  void Merge(LatencyHistogram const &aOther);
+  void Reset();
+
+  uint64_t GetCount() const { return mCount; }
+  uint64_t GetTotal() const { return mTotal; }
+  uint64_t GetMin() const { return mCount ? mMin : 0; }
+  uint64_t GetMax() const { return mMax; }
+
+  // Returns the smallest value v such that at least aPercentile percent of
+  // samples are <= v, rounded up to the end of v's bucket but never beyond
+  // the largest sample. Returns 0 when empty.
+  uint64_t GetPercentile(double aPercentile) const;
+
+  // Bucket mapping, exposed for testing
+  static size_t GetBucketIndex(uint64_t aValue);
+  static uint64_t GetBucketLowerBound(size_t aIndex);
+  static uint64_t GetBucketUpperBound(size_t aIndex);
+
+private:
+  std::array<uint64_t, kNumBuckets> mBuckets;
+  uint64_t                          mCount;
+  uint64_t                          mTotal;
+  uint64_t                          mMin;
+  uint64_t                          mMax;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_LATENCYHISTOGRAM_H
@@ -1,20 +1,32 @@
 #include "ListView.h"
 
 #include "GlassWindow.h"
+#include "ScaleRatio.h"
 
 #include <commctrl.h>
 
+#include <algorithm>
+
 static const int kMinColWidth = 100;
+// Space around cell text, as LVSCW_AUTOSIZE leaves, at 100%
+static const int kCellPadding = 12;
 
 namespace aspk {
 
-ListView::ListView(GlassWindow& aParent)
-  : mHwnd(nullptr)
+ListView::ListView(GlassWindow& aParent, Mode aMode)
+  : mParent(aParent)
+  , mHwnd(nullptr)
   , mNextColIndex(0)
   , mNumColumns(mNextColIndex)
   , mCurRow(0)
   , mCurCol(0)
+  , mBatchDepth(0)
+  , mAdvances(nullptr)
 {
+  if (aMode == eOwnerData) {
+    mRowStore = std::make_unique<RowStore>();
+  }
+
   ScaledRect clientRect(aParent.GetDpiScaler());
   if (!aParent.GetClientRect(clientRect)) {
     return;
@@ -22,6 +34,9 @@ ListView::ListView(GlassWindow& aParent)
 
   DWORD winStyles = WS_CHILD | WS_BORDER | WS_VISIBLE;
   DWORD lvStyles = LVS_REPORT | LVS_NOCOLUMNHEADER | LVS_NOSORTHEADER;
+  if (mRowStore) {
+    lvStyles |= LVS_OWNERDATA;
+  }
   DWORD lvExStyles = LVS_EX_FULLROWSELECT |
                      LVS_EX_GRIDLINES;
 
@@ -70,6 +85,13 @@ ListView::InsertColumn(const wchar_t* aText)
   }
 
   mNextColIndex = newIndex + 1;
+  if (mRowStore) {
+    mRowStore->SetNumColumns(mNumColumns);
+  }
+  mColumnExtents.SetNumColumns(mNumColumns);
+  if (aText) {
+    TrackCellExtent(newIndex, aText);
+  }
   return true;
 }
 
@@ -91,44 +113,157 @@ ListView::IncrementCurRowCol(const bool aHasNewline)
   }
 }
 
+GlyphAdvanceTable&
+ListView::GetAdvances()
+{
+  if (mAdvances) {
+    return *mAdvances;
+  }
+
+  HFONT font = reinterpret_cast<HFONT>(::SendMessage(mHwnd, WM_GETFONT, 0, 0));
+  if (!font) {
+    font = static_cast<HFONT>(::GetStockObject(DEFAULT_GUI_FONT));
+  }
+  const int scalePercent = mParent.GetDpiScaler()->GetXScale();
+
+  std::unique_ptr<GlyphAdvanceTable>& table =
+    mAdvanceTables[std::make_pair(font, scalePercent)];
+  if (!table) {
+    HWND hwnd = mHwnd;
+    int averageWidth = 0;
+    if (HDC dc = ::GetDC(hwnd)) {
+      HGDIOBJ oldFont = ::SelectObject(dc, font);
+      TEXTMETRICW tm;
+      if (::GetTextMetricsW(dc, &tm)) {
+        averageWidth = tm.tmAveCharWidth;
+      }
+      ::SelectObject(dc, oldFont);
+      ::ReleaseDC(hwnd, dc);
+    }
+
+    // One GetCharWidth32 per page of characters, rather than a
+    // GetTextExtentPoint32 per cell
+    auto fillPage = [hwnd, font](wchar_t aFirst, int* aAdvances) {
+      HDC dc = ::GetDC(hwnd);
+      if (!dc) {
+        return false;
+      }
+      HGDIOBJ oldFont = ::SelectObject(dc, font);
+      const UINT first = static_cast<UINT>(aFirst);
+      BOOL ok = ::GetCharWidth32W(dc, first,
+                                  first + GlyphAdvanceTable::kPageSize - 1,
+                                  aAdvances);
+      ::SelectObject(dc, oldFont);
+      ::ReleaseDC(hwnd, dc);
+      return !!ok;
+    };
+    table = std::make_unique<GlyphAdvanceTable>(fillPage, averageWidth);
+  }
+
+  mAdvances = table.get();
+  return *mAdvances;
+}
+
 void
-ListView::ResizeColumns()
+ListView::TrackCellExtent(size_t aColumn, std::wstring_view aText)
 {
-  if (!mNumColumns) {
-    return;
+  if (!aText.empty() && aText.back() == L'\n') {
+    aText.remove_suffix(1);
   }
+  if (mColumnExtents.Add(aColumn, aText, GetAdvances()) && !mBatchDepth) {
+    FitColumns(true);
+  }
+}
 
-  RECT rect;
-  if (!::GetWindowRect(mHwnd, &rect)) {
+void
+ListView::FitColumns(bool aSuspendRedraw)
+{
+  if (!mColumnExtents.HasChanges()) {
     return;
   }
 
-  int colWidth = (rect.right - rect.left) / mNumColumns;
+  const int padding =
+    LayoutConstant<kCellPadding>::At(mParent.GetDpiScaler()->GetXScale());
 
+  if (aSuspendRedraw) {
+    ::SendMessage(mHwnd, WM_SETREDRAW, FALSE, 0);
+  }
   for (int i = 0; i < mNumColumns; ++i) {
-    ListView_SetColumnWidth(mHwnd, i, colWidth);
+    if (mColumnExtents.IsChanged(i)) {
+      ListView_SetColumnWidth(mHwnd, i,
+                              std::max<int>(kMinColWidth,
+                                            mColumnExtents.GetWidth(i) + padding));
+    }
+  }
+  mColumnExtents.ClearChanges();
+  if (aSuspendRedraw) {
+    ::SendMessage(mHwnd, WM_SETREDRAW, TRUE, 0);
+    ::InvalidateRect(mHwnd, nullptr, TRUE);
+  }
+}
+
+void
+ListView::RefreshTextMetrics(bool aFontsChanged)
+{
+  if (aFontsChanged) {
+    mAdvanceTables.clear();
+  }
+  mAdvances = nullptr;
+  mColumnExtents.Remeasure(GetAdvances());
+  if (!mBatchDepth) {
+    FitColumns(true);
   }
 }
 
 bool
-ListView::InsertCell(const wchar_t* aText)
+ListView::InsertVirtualCell(std::wstring_view aText)
 {
-  std::wstring strText;
-  if (aText) {
-    strText = aText;
+  const size_t oldRowCount = mRowStore->GetRowCount();
+  const size_t column = mRowStore->GetCurrentColumn();
+  mRowStore->AppendCell(aText);
+  const size_t rowCount = mRowStore->GetRowCount();
+  TrackCellExtent(column, aText);
+
+  if (mBatchDepth) {
+    // EndBatch will tell the control about the new rows
+    return true;
+  }
+
+  if (rowCount == oldRowCount) {
+    // We filled in another column of an existing row
+    const int lastRow = static_cast<int>(rowCount - 1);
+    ListView_RedrawItems(mHwnd, lastRow, lastRow);
+    return true;
   }
 
-  const bool hasNewline = strText.empty() ? false : strText.back() == L'\n';
+  if (!ListView_SetItemCountEx(mHwnd, rowCount,
+                               LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL)) {
+    return false;
+  }
+
+  return true;
+}
+
+bool
+ListView::InsertCell(std::wstring_view aText)
+{
+  if (mRowStore) {
+    return InsertVirtualCell(aText);
+  }
+
+  const bool hasNewline = aText.empty() ? false : aText.back() == L'\n';
   if (hasNewline) {
-    strText.pop_back();
+    aText.remove_suffix(1);
   }
 
   LVITEMW lvItem = {};
   lvItem.iItem = mCurRow;
 
-  if (!strText.empty()) {
+  if (!aText.empty()) {
+    // The control needs a null-terminated copy
+    mCellScratch.assign(aText);
     lvItem.mask |= LVIF_TEXT;
-    lvItem.pszText = const_cast<LPWSTR>(strText.c_str());
+    lvItem.pszText = const_cast<LPWSTR>(mCellScratch.c_str());
   }
 
   if (!mCurCol) {
@@ -137,11 +272,7 @@ ListView::InsertCell(const wchar_t* aText)
       return false;
     }
 
-    if (!newIndex) {
-      // We inserted our first row. Let's set column sizes
-      ResizeColumns();
-    }
-
+    TrackCellExtent(0, aText);
     mCurRow = newIndex;
     IncrementCurRowCol(hasNewline);
     return true;
@@ -154,15 +285,93 @@ ListView::InsertCell(const wchar_t* aText)
     return false;
   }
 
+  TrackCellExtent(mCurCol, aText);
   IncrementCurRowCol(hasNewline);
   return true;
 }
 
+size_t
+ListView::GetRowCount() const
+{
+  if (mRowStore) {
+    return mRowStore->GetRowCount();
+  }
+
+  return static_cast<size_t>(ListView_GetItemCount(mHwnd));
+}
+
+void
+ListView::BeginBatch()
+{
+  if (mBatchDepth++) {
+    return;
+  }
+
+  ::SendMessage(mHwnd, WM_SETREDRAW, FALSE, 0);
+}
+
+void
+ListView::EndBatch()
+{
+  if (!mBatchDepth || --mBatchDepth) {
+    return;
+  }
+
+  const size_t rowCount = GetRowCount();
+
+  if (mRowStore) {
+    ListView_SetItemCountEx(mHwnd, rowCount,
+                            LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+  }
+
+  // Every column that grew during the batch, while redraw is still off
+  FitColumns(false);
+
+  ::SendMessage(mHwnd, WM_SETREDRAW, TRUE, 0);
+  ::InvalidateRect(mHwnd, nullptr, TRUE);
+}
+
+LRESULT
+ListView::OnNotify(NMHDR* aNmhdr)
+{
+  switch (aNmhdr->code) {
+    case LVN_GETDISPINFOW: {
+      if (!mRowStore) {
+        break;
+      }
+      LVITEMW& item = reinterpret_cast<NMLVDISPINFOW*>(aNmhdr)->item;
+      if (item.mask & LVIF_TEXT) {
+        // The store keeps its text null-terminated, and the pointer stays
+        // valid until the store is next touched, which is after the control
+        // has consumed it. So we may hand it over instead of copying.
+        std::wstring_view text = mRowStore->GetCell(item.iItem, item.iSubItem);
+        item.pszText = const_cast<LPWSTR>(text.data());
+      }
+      break;
+    }
+    case LVN_ODFINDITEMW:
+      // We do not support incremental search
+      return -1;
+    default:
+      break;
+  }
+
+  return 0;
+}
+
 void
 ListView::Resize(int aCx, int aCy)
 {
+  // Columns fit their content, so they keep their widths
   ::MoveWindow(mHwnd, 0, 0, aCx, aCy, TRUE);
-  ResizeColumns();
+}
+
+void
+ListView::SetMemoryBudget(size_t aBytes)
+{
+  if (mRowStore) {
+    mRowStore->SetMemoryBudget(aBytes);
+  }
 }
 
 } // namespace aspk
@@ -1,8 +1,17 @@
 #ifndef __ASPK_LISTVIEW_H
 #define __ASPK_LISTVIEW_H
 
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
 #include <windows.h>
 
+#include "RowStore.h"
+#include "TextExtents.h"
+
 namespace aspk {
 
 class GlassWindow;
@@ -10,27 +19,68 @@ class GlassWindow;
 class ListView
 {
 public:
-  explicit ListView(GlassWindow& aParent);
+  enum Mode
+  {
+    // Cell text is kept in a RowStore and served via LVN_GETDISPINFO
+    eOwnerData,
+    // Cell text is copied into the control itself
+    eStandard
+  };
+
+  explicit ListView(GlassWindow& aParent, Mode aMode = eOwnerData);
   ~ListView();
 
   bool InsertColumn(const wchar_t* aText = nullptr);
-  bool InsertCell(const wchar_t* aText);
+  bool InsertCell(std::wstring_view aText);
   int GetNumColumns() const { return mNumColumns; }
   void Resize(int aCx, int aCy);
 
+  // Caps the memory used by the row store; no effect in eStandard mode
+  void SetMemoryBudget(size_t aBytes);
+
+  // Suspends redraw until the matching EndBatch. Rows inserted in between are
+  // committed to the control, and columns are fitted, once at EndBatch.
+  // Batches may nest.
+  void BeginBatch();
+  void EndBatch();
+
+  // Refits the columns for a new DPI or theme. aFontsChanged drops the cached
+  // advance tables, whose font handles may have been recycled.
+  void RefreshTextMetrics(bool aFontsChanged);
+
+  // Handles WM_NOTIFY messages that originate from this control
+  LRESULT OnNotify(NMHDR* aNmhdr);
+
   explicit operator bool() const { return !!mHwnd; }
   operator HWND() { return mHwnd; }
 
 private:
   void IncrementCurRowCol(const bool aHasNewline);
-  void ResizeColumns();
+  // Widens aColumn if aText is its widest cell so far
+  void TrackCellExtent(size_t aColumn, std::wstring_view aText);
+  // Applies the widths of the columns whose content extent changed, in one
+  // pass. aSuspendRedraw brackets the pass with WM_SETREDRAW, for callers
+  // that are not already inside a batch.
+  void FitColumns(bool aSuspendRedraw);
+  // Advances for the control's current font at the parent's DPI
+  GlyphAdvanceTable& GetAdvances();
+  bool InsertVirtualCell(std::wstring_view aText);
+  size_t GetRowCount() const;
 
 private:
-  HWND  mHwnd;
-  int   mNextColIndex;
-  int&  mNumColumns;  // Synonym of mNextColIndex
-  int   mCurRow;
-  int   mCurCol;
+  GlassWindow&              mParent;
+  HWND                      mHwnd;
+  int                       mNextColIndex;
+  int&                      mNumColumns;  // Synonym of mNextColIndex
+  int                       mCurRow;
+  int                       mCurCol;
+  int                       mBatchDepth;
+  std::unique_ptr<RowStore> mRowStore;    // Only present in eOwnerData mode
+  std::wstring              mCellScratch; // Reused by eStandard mode
+  ColumnExtents             mColumnExtents;
+  // Keyed by font and scale percentage
+  std::map<std::pair<HFONT, int>, std::unique_ptr<GlyphAdvanceTable>> mAdvanceTables;
+  GlyphAdvanceTable*        mAdvances;    // Current entry of mAdvanceTables
 };
 
 } // namespace aspk
@@ -0,0 +1,206 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace aspk {
+
+namespace {
+
+struct SinkRegistry
+{
+  std::mutex                            mLock;
+  std::vector<std::shared_ptr<LogSink>> mSinks;
+  bool                                  mHasUserSinks = false;
+};
+
+SinkRegistry&
+GetSinkRegistry()
+{
+  static SinkRegistry sRegistry;
+  static std::once_flag sInitOnce;
+  std::call_once(sInitOnce, [] {
+    sRegistry.mSinks.push_back(std::make_shared<DebuggerLogSink>());
+  });
+  return sRegistry;
+}
+
+void
+AppendUtf8(std::string &aOut, std::wstring_view aText)
+{
+  for (size_t i = 0; i < aText.size(); ++i) {
+    uint32_t c = static_cast<uint32_t>(aText[i]);
+    if (sizeof(wchar_t) == 2 && c >= 0xD800 && c < 0xDC00 &&
+        i + 1 < aText.size()) {
+      const uint32_t low = static_cast<uint32_t>(aText[i + 1]);
+      if (low >= 0xDC00 && low < 0xE000) {
+        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        ++i;
+      }
+    }
+
+    if (c < 0x80) {
+      aOut.push_back(static_cast<char>(c));
+    } else if (c < 0x800) {
+      aOut.push_back(static_cast<char>(0xC0 | (c >> 6)));
+      aOut.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+      aOut.push_back(static_cast<char>(0xE0 | (c >> 12)));
+      aOut.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+      aOut.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    } else {
+      aOut.push_back(static_cast<char>(0xF0 | (c >> 18)));
+      aOut.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+      aOut.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+      aOut.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+  }
+}
+
+} // namespace
+
+wchar_t const *
+GetLogLevelName(LogLevel aLevel)
+{
+  switch (aLevel) {
+    case eLogError:
+      return L"error";
+    case eLogWarning:
+      return L"warning";
+    case eLogInfo:
+      return L"info";
+    case eLogDebug:
+      return L"debug";
+    case eLogVerbose:
+      return L"verbose";
+    default:
+      return L"unknown";
+  }
+}
+
+void
+DebuggerLogSink::Write(LogLevel /* aLevel */, std::wstring_view aMessage)
+{
+  mLine.assign(aMessage);
+  mLine.push_back(L'\n');
+#if defined(_WIN32)
+  ::OutputDebugStringW(mLine.c_str());
+#else
+  std::fputws(mLine.c_str(), stderr);
+#endif
+}
+
+FileLogSink::FileLogSink(std::filesystem::path const &aPath)
+  : mFile(aPath, std::ios::binary | std::ios::app)
+{
+}
+
+void
+FileLogSink::Write(LogLevel aLevel, std::wstring_view aMessage)
+{
+  if (!mFile.is_open()) {
+    return;
+  }
+
+  mLine.clear();
+  mLine.push_back('[');
+  AppendUtf8(mLine, GetLogLevelName(aLevel));
+  mLine.append("] ");
+  AppendUtf8(mLine, aMessage);
+  mLine.push_back('\n');
+  mFile.write(mLine.data(), mLine.size());
+  mFile.flush();
+}
+
+RingLogSink::RingLogSink(size_t aCapacity)
+  : mEntries(std::max<size_t>(aCapacity, 1))
+  , mNext(0)
+  , mTotalCount(0)
+{
+}
+
+void
+RingLogSink::Write(LogLevel aLevel, std::wstring_view aMessage)
+{
+  std::lock_guard<std::mutex> lock(mLock);
+  Entry& entry = mEntries[mNext];
+  entry.mLevel = aLevel;
+  entry.mMessage.assign(aMessage);
+  mNext = (mNext + 1) % mEntries.size();
+  ++mTotalCount;
+}
+
+std::vector<RingLogSink::Entry>
+RingLogSink::GetEntries() const
+{
+  std::lock_guard<std::mutex> lock(mLock);
+  const size_t count = static_cast<size_t>(
+    std::min<uint64_t>(mTotalCount, mEntries.size()));
+  const size_t first = (mNext + mEntries.size() - count) % mEntries.size();
+
+  std::vector<Entry> result;
+  result.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    result.push_back(mEntries[(first + i) % mEntries.size()]);
+  }
+  return result;
+}
+
+uint64_t
+RingLogSink::GetTotalCount() const
+{
+  std::lock_guard<std::mutex> lock(mLock);
+  return mTotalCount;
+}
+
+void
+AddLogSink(std::shared_ptr<LogSink> aSink)
+{
+  if (!aSink) {
+    return;
+  }
+
+  SinkRegistry& registry = GetSinkRegistry();
+  std::lock_guard<std::mutex> lock(registry.mLock);
+  if (!registry.mHasUserSinks) {
+    // Explicit configuration replaces the default debugger sink
+    registry.mSinks.clear();
+    registry.mHasUserSinks = true;
+  }
+  registry.mSinks.push_back(std::move(aSink));
+}
+
+void
+RemoveLogSink(std::shared_ptr<LogSink> const &aSink)
+{
+  SinkRegistry& registry = GetSinkRegistry();
+  std::lock_guard<std::mutex> lock(registry.mLock);
+  auto& sinks = registry.mSinks;
+  sinks.erase(std::remove(sinks.begin(), sinks.end(), aSink), sinks.end());
+}
+
+namespace detail {
+
+void
+DispatchLog(LogLevel aLevel, std::wstring_view aMessage)
+{
+  // A sink that logs would otherwise deadlock on the registry lock
+  thread_local bool sDispatching = false;
+  if (sDispatching) {
+    return;
+  }
+
+  sDispatching = true;
+  SinkRegistry& registry = GetSinkRegistry();
+  {
+    std::lock_guard<std::mutex> lock(registry.mLock);
+    for (auto const &sink : registry.mSinks) {
+      sink->Write(aLevel, aMessage);
+    }
+  }
+  sDispatching = false;
+}
+
+} // namespace detail
+
+} // namespace aspk
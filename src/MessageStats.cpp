@@ -0,0 +1,108 @@
+#include "MessageStats.h"
+
+#include <algorithm>
+#include <cwchar>
+
+namespace aspk {
+
+MessageStats::MessageStats(size_t aCapacity)
+  : mHistograms(std::make_unique<LatencyHistogram[]>(aCapacity))
+  , mCapacity(aCapacity)
+{
+  mSlots.reserve(aCapacity);
+}
+
+MessageStats::~MessageStats()
+{
+}
+
+void
+MessageStats::Record(uint32_t aMsg, uint64_t aNanoseconds)
+{
+  auto it = std::lower_bound(mSlots.begin(), mSlots.end(), aMsg,
+    [](Slot const &aSlot, uint32_t aValue) {
+      return aSlot.mMsg < aValue;
+    });
+  if (it == mSlots.end() || it->mMsg != aMsg) {
+    if (mSlots.size() == mCapacity) {
+      mOther.Record(aNanoseconds);
+      return;
+    }
+    // Histograms are handed out in order, so the next free one is at the
+    // current slot count
+    LatencyHistogram* histogram = &mHistograms[mSlots.size()];
+    histogram->Reset();
+    it = mSlots.insert(it, Slot{aMsg, histogram});
+  }
+  it->mHistogram->Record(aNanoseconds);
+}
+
+void
+MessageStats::Reset()
+{
+  mSlots.clear();
+  mOther.Reset();
+}
+
+std::vector<MessageStats::Entry>
+MessageStats::GetEntries() const
+{
+  std::vector<Entry> entries;
+  entries.reserve(mSlots.size() + 1);
+  for (Slot const &slot : mSlots) {
+    entries.push_back(Entry{slot.mMsg, slot.mHistogram});
+  }
+  if (mOther.GetCount()) {
+    entries.push_back(Entry{kOtherMessages, &mOther});
+  }
+
+  std::stable_sort(entries.begin(), entries.end(),
+    [](Entry const &a, Entry const &b) {
+      return a.mHistogram->GetTotal() > b.mHistogram->GetTotal();
+    });
+  return entries;
+}
+
+void
+MessageStats::AppendReport(std::wstring &aOut, NameFn aName,
+                           size_t aMaxLines) const
+{
+  wchar_t line[160];
+  std::swprintf(line, sizeof(line) / sizeof(line[0]),
+                L"%-24ls %10ls %12ls %10ls %10ls %10ls\n",
+                L"message", L"count", L"total ms", L"p50 us", L"p99 us",
+                L"max us");
+  aOut.append(line);
+
+  size_t numLines = 0;
+  for (Entry const &entry : GetEntries()) {
+    if (aMaxLines && numLines++ == aMaxLines) {
+      break;
+    }
+
+    wchar_t number[16];
+    wchar_t const * name = nullptr;
+    if (entry.mMsg == kOtherMessages) {
+      name = L"(other)";
+    } else if (aName) {
+      name = aName(entry.mMsg);
+    }
+    if (!name) {
+      std::swprintf(number, sizeof(number) / sizeof(number[0]), L"0x%04x",
+                    entry.mMsg);
+      name = number;
+    }
+
+    LatencyHistogram const &histogram = *entry.mHistogram;
+    std::swprintf(line, sizeof(line) / sizeof(line[0]),
+                  L"%-24ls %10llu %12.3f %10.1f %10.1f %10.1f\n", name,
+                  static_cast<unsigned long long>(histogram.GetCount()),
+                  histogram.GetTotal() / 1e6,
+                  histogram.GetPercentile(50.0) / 1e3,
+                  histogram.GetPercentile(99.0) / 1e3,
+                  histogram.GetMax() / 1e3);
+    aOut.append(line);
+  }
+}
+
+} // namespace aspk
@@ -0,0 +1,69 @@
+#ifndef __ASPK_MESSAGESTATS_H
+#define __ASPK_MESSAGESTATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "LatencyHistogram.h"
+
+namespace aspk {
+
+// Per-message latency histograms, keyed by window message id. Histograms for
+// up to aCapacity distinct messages are allocated up front, so recording
+// never allocates; messages seen once the capacity is used up are counted
+// together under kOtherMessages. This class has no Win32 dependencies.
+class MessageStats
+{
+public:
+  using NameFn = wchar_t const * (*)(uint32_t aMsg);
+
+  // A window sees a few dozen distinct messages in practice
+  static constexpr size_t kDefaultCapacity = 64;
+  // The id of the entry for messages beyond the capacity
+  static constexpr uint32_t kOtherMessages = UINT32_MAX;
+
+  struct Entry
+  {
+    uint32_t                  mMsg;
+    LatencyHistogram const *  mHistogram;
+  };
+
+  explicit MessageStats(size_t aCapacity = kDefaultCapacity);
+  ~MessageStats();
+
+  void Record(uint32_t aMsg, uint64_t aNanoseconds);
+  void Reset();
+
+  // Messages seen so far, most total time first. Includes kOtherMessages
+  // if the capacity has been exceeded.
+  std::vector<Entry> GetEntries() const;
+
+  // Appends one line per message (at most aMaxLines, 0 for all) with count,
+  // total time and p50/p99/max. aName may return nullptr for unknown
+  // messages, which are then shown by number.
+  void AppendReport(std::wstring &aOut, NameFn aName, size_t aMaxLines = 0) const;
+
+private:
+  MessageStats(MessageStats const &) = delete;
+  MessageStats& operator=(MessageStats const &) = delete;
+
+private:
+  struct Slot
+  {
+    uint32_t            mMsg;
+    LatencyHistogram*   mHistogram;
+  };
+
+  // Sorted by message id; reserved to the capacity, so inserts never grow it
+  std::vector<Slot>                   mSlots;
+  std::unique_ptr<LatencyHistogram[]> mHistograms;
+  size_t                              mCapacity;
+  LatencyHistogram                    mOther;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_MESSAGESTATS_H
@@ -0,0 +1,185 @@
+#include "PaintProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+namespace aspk {
+
+PaintProfiler::PaintProfiler(size_t aFrameCapacity)
+  : mFrames(std::max<size_t>(1, aFrameCapacity))
+  , mFrameCount(0)
+  , mCurrent(nullptr)
+  , mDepth(0)
+{
+}
+
+/* static */ int64_t
+PaintProfiler::GetNowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void
+PaintProfiler::BeginFrame()
+{
+  // A frame that was never ended (eg, reentrant paint) is simply replaced
+  FrameRecord &frame = mFrames[mFrameCount % mFrames.size()];
+  frame.mFrameId = mFrameCount++;
+  frame.mStartNs = GetNowNs();
+  frame.mEndNs = frame.mStartNs;
+  frame.mStageCount = 0;
+  frame.mDroppedStages = 0;
+  mCurrent = &frame;
+  mDepth = 0;
+}
+
+void
+PaintProfiler::EndFrame()
+{
+  if (!mCurrent) {
+    return;
+  }
+
+  mCurrent->mEndNs = GetNowNs();
+  mCurrent = nullptr;
+}
+
+size_t
+PaintProfiler::BeginStage(char const * aName)
+{
+  if (!mCurrent) {
+    return kNoStage;
+  }
+
+  if (mCurrent->mStageCount == kMaxStagesPerFrame) {
+    ++mCurrent->mDroppedStages;
+    return kNoStage;
+  }
+
+  const size_t index = mCurrent->mStageCount++;
+  StageRecord &stage = mCurrent->mStages[index];
+  stage.mName = aName;
+  stage.mDepth = mDepth++;
+  stage.mStartNs = GetNowNs();
+  stage.mEndNs = stage.mStartNs;
+  return index;
+}
+
+void
+PaintProfiler::EndStage(size_t aIndex)
+{
+  if (!mCurrent || aIndex >= mCurrent->mStageCount) {
+    return;
+  }
+
+  mCurrent->mStages[aIndex].mEndNs = GetNowNs();
+  if (mDepth) {
+    --mDepth;
+  }
+}
+
+void
+PaintProfiler::Reset()
+{
+  mFrameCount = 0;
+  mCurrent = nullptr;
+  mDepth = 0;
+}
+
+std::vector<PaintProfiler::FrameRecord const *>
+PaintProfiler::GetFrames() const
+{
+  const size_t capacity = mFrames.size();
+  uint64_t first = mFrameCount > capacity ? mFrameCount - capacity : 0;
+  // The frame in progress is not complete yet
+  uint64_t end = mCurrent ? mFrameCount - 1 : mFrameCount;
+
+  std::vector<FrameRecord const *> frames;
+  frames.reserve(static_cast<size_t>(end - std::min(first, end)));
+  for (uint64_t i = first; i < end; ++i) {
+    frames.push_back(&mFrames[i % capacity]);
+  }
+  return frames;
+}
+
+static void
+WriteJsonString(std::ostream &aOut, char const * aText)
+{
+  aOut.put('"');
+  for (char const * p = aText ? aText : ""; *p; ++p) {
+    const unsigned char c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\') {
+      aOut.put('\\');
+      aOut.put(*p);
+    } else if (c < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      aOut << escaped;
+    } else {
+      aOut.put(*p);
+    }
+  }
+  aOut.put('"');
+}
+
+static void
+WriteCompleteEvent(std::ostream &aOut, char const * aName, char const * aCategory,
+                   int64_t aStartNs, int64_t aEndNs, int64_t aBaseNs,
+                   uint64_t aFrameId, uint32_t aDroppedStages)
+{
+  // Microseconds with nanosecond precision
+  char times[96];
+  std::snprintf(times, sizeof(times), "\"ts\":%lld.%03lld,\"dur\":%lld.%03lld",
+                static_cast<long long>((aStartNs - aBaseNs) / 1000),
+                static_cast<long long>((aStartNs - aBaseNs) % 1000),
+                static_cast<long long>((aEndNs - aStartNs) / 1000),
+                static_cast<long long>((aEndNs - aStartNs) % 1000));
+
+  aOut << "{\"name\":";
+  WriteJsonString(aOut, aName);
+  aOut << ",\"cat\":\"" << aCategory << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+       << times << ",\"args\":{\"frame\":" << aFrameId;
+  if (aDroppedStages) {
+    aOut << ",\"droppedStages\":" << aDroppedStages;
+  }
+  aOut << "}}";
+}
+
+void
+PaintProfiler::WriteChromeTrace(std::ostream &aOut) const
+{
+  std::vector<FrameRecord const *> frames = GetFrames();
+  const int64_t baseNs = frames.empty() ? 0 : frames.front()->mStartNs;
+
+  aOut << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  aOut << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+          "\"args\":{\"name\":\"Paint\"}}";
+  for (FrameRecord const * frame : frames) {
+    aOut << ",\n";
+    WriteCompleteEvent(aOut, "Frame", "frame", frame->mStartNs, frame->mEndNs,
+                       baseNs, frame->mFrameId, frame->mDroppedStages);
+    for (uint32_t i = 0; i < frame->mStageCount; ++i) {
+      StageRecord const &stage = frame->mStages[i];
+      aOut << ",\n";
+      WriteCompleteEvent(aOut, stage.mName, "paint", stage.mStartNs,
+                         stage.mEndNs, baseNs, frame->mFrameId, 0);
+    }
+  }
+  aOut << "]}\n";
+}
+
+bool
+PaintProfiler::WriteChromeTrace(std::filesystem::path const &aPath) const
+{
+  std::ofstream file(aPath, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  WriteChromeTrace(file);
+  return !!file;
+}
+
+} // namespace aspk
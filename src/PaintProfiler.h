@@ -0,0 +1,135 @@
+#ifndef __ASPK_PAINTPROFILER_H
+#define __ASPK_PAINTPROFILER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <vector>
+
+namespace aspk {
+
+// Records nested, named stage timings for each painted frame into a ring of
+// the most recent frames, and exports them as Chrome trace-event JSON
+// (chrome://tracing, Perfetto). Stage names must be string literals, since
+// only the pointer is stored. Recording never allocates. This class has no
+// Win32 dependencies and is meant to be used from a single thread.
+class PaintProfiler
+{
+public:
+  static constexpr size_t kDefaultFrameCapacity = 256;
+  static constexpr size_t kMaxStagesPerFrame = 16;
+  static constexpr size_t kNoStage = SIZE_MAX;
+
+  struct StageRecord
+  {
+    char const *  mName;
+    int64_t       mStartNs;
+    int64_t       mEndNs;
+    uint32_t      mDepth;
+  };
+
+  struct FrameRecord
+  {
+    uint64_t                                      mFrameId;
+    int64_t                                       mStartNs;
+    int64_t                                       mEndNs;
+    uint32_t                                      mStageCount;
+    // Stages that did not fit in mStages
+    uint32_t                                      mDroppedStages;
+    std::array<StageRecord, kMaxStagesPerFrame>   mStages;
+  };
+
+  // Brackets one frame; stages outside a frame are ignored. A null profiler
+  // makes this a no-op.
+  class FrameScope
+  {
+  public:
+    explicit FrameScope(PaintProfiler* aProfiler)
+      : mProfiler(aProfiler)
+    {
+      if (mProfiler) {
+        mProfiler->BeginFrame();
+      }
+    }
+
+    ~FrameScope()
+    {
+      if (mProfiler) {
+        mProfiler->EndFrame();
+      }
+    }
+
+  private:
+    FrameScope(FrameScope const &) = delete;
+    FrameScope& operator=(FrameScope const &) = delete;
+
+  private:
+    PaintProfiler* mProfiler;
+  };
+
+  // Times one stage of the current frame. Scopes nest.
+  class Scope
+  {
+  public:
+    Scope(PaintProfiler* aProfiler, char const * aName)
+      : mProfiler(aProfiler)
+      , mIndex(aProfiler ? aProfiler->BeginStage(aName) : kNoStage)
+    {
+    }
+
+    ~Scope()
+    {
+      if (mIndex != kNoStage) {
+        mProfiler->EndStage(mIndex);
+      }
+    }
+
+  private:
+    Scope(Scope const &) = delete;
+    Scope& operator=(Scope const &) = delete;
+
+  private:
+    PaintProfiler*  mProfiler;
+    size_t          mIndex;
+  };
+
+  explicit PaintProfiler(size_t aFrameCapacity = kDefaultFrameCapacity);
+
+  void BeginFrame();
+  void EndFrame();
+  // Returns kNoStage when not in a frame or when the frame is full
+  size_t BeginStage(char const * aName);
+  void EndStage(size_t aIndex);
+
+  void Reset();
+
+  // Total frames recorded; only the last GetFrameCapacity() are retained
+  uint64_t GetFrameCount() const { return mFrameCount; }
+  size_t GetFrameCapacity() const { return mFrames.size(); }
+  // Retained frames, oldest first
+  std::vector<FrameRecord const *> GetFrames() const;
+
+  // Writes a {"traceEvents": [...]} document with one complete ("X") event
+  // per frame and per stage. Timestamps are microseconds relative to the
+  // oldest retained frame.
+  void WriteChromeTrace(std::ostream &aOut) const;
+  bool WriteChromeTrace(std::filesystem::path const &aPath) const;
+
+private:
+  PaintProfiler(PaintProfiler const &) = delete;
+  PaintProfiler& operator=(PaintProfiler const &) = delete;
+
+  static int64_t GetNowNs();
+
+private:
+  std::vector<FrameRecord>  mFrames;
+  uint64_t                  mFrameCount;
+  FrameRecord*              mCurrent;
+  uint32_t                  mDepth;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_PAINTPROFILER_H
@@ -0,0 +1,170 @@
+#include "PaintSurface.h"
+
+#include "PixelFill.h"
+
+#include <fstream>
+
+namespace aspk {
+
+BitmapSurface::BitmapSurface(int aWidth, int aHeight)
+  : mWidth(std::max(aWidth, 0))
+  , mHeight(std::max(aHeight, 0))
+  , mPixels(static_cast<size_t>(mWidth) * mHeight, 0)
+  , mClip{0, 0, mWidth, mHeight}
+  , mFont(eMessageFont)
+  , mCells{{8, 16}, {7, 14}}
+{
+}
+
+void
+BitmapSurface::SetClipRect(PixelRect const &aRect)
+{
+  mClip = aRect.Intersect(PixelRect{0, 0, mWidth, mHeight});
+}
+
+void
+BitmapSurface::SetCellSize(Font aFont, int aWidth, int aHeight)
+{
+  mCells[aFont] = PixelSize{std::max(aWidth, 1), std::max(aHeight, 1)};
+}
+
+void
+BitmapSurface::FillRect(PixelRect const &aRect, uint32_t aPixel)
+{
+  PixelRect fillRect = aRect.Intersect(mClip);
+  if (fillRect.IsEmpty()) {
+    return;
+  }
+  FillPixels(mPixels.data() + fillRect.mTop * GetStride() + fillRect.mLeft,
+             GetStride(), fillRect.GetWidth(), fillRect.GetHeight(), aPixel);
+}
+
+PixelSize
+BitmapSurface::MeasureText(std::wstring_view aText)
+{
+  PixelSize const &cell = mCells[mFont];
+  size_t lines = 1;
+  size_t lineLength = 0;
+  size_t maxLength = 0;
+  for (wchar_t c : aText) {
+    if (c == L'\n') {
+      ++lines;
+      lineLength = 0;
+    } else {
+      maxLength = std::max(maxLength, ++lineLength);
+    }
+  }
+  return PixelSize{static_cast<int>(maxLength) * cell.mWidth,
+                   static_cast<int>(lines) * cell.mHeight};
+}
+
+bool
+BitmapSurface::DrawText(PixelRect const &aRect, std::wstring_view aText,
+                        uint32_t aColor)
+{
+  PixelSize const &cell = mCells[mFont];
+  const uint32_t pixel = aColor == kDefaultTextColor ? kTextPixel : aColor;
+  int x = aRect.mLeft;
+  int y = aRect.mTop;
+  for (wchar_t c : aText) {
+    if (c == L'\n') {
+      x = aRect.mLeft;
+      y += cell.mHeight;
+      continue;
+    }
+    if (c != L' ' && c != L'\t') {
+      FillRect(PixelRect{x, y, x + cell.mWidth - 1, y + cell.mHeight - 1},
+               pixel);
+    }
+    x += cell.mWidth;
+  }
+  return true;
+}
+
+bool
+BitmapSurface::WriteBitmapFile(std::filesystem::path const &aPath) const
+{
+  return aspk::WriteBitmapFile(aPath, mPixels.data(), mWidth, mHeight,
+                               GetStride());
+}
+
+namespace {
+
+void
+PutLE(std::vector<uint8_t> &aOut, uint32_t aValue, size_t aBytes)
+{
+  for (size_t i = 0; i < aBytes; ++i) {
+    aOut.push_back(static_cast<uint8_t>(aValue >> (8 * i)));
+  }
+}
+
+} // anonymous namespace
+
+bool
+WriteBitmapFile(std::filesystem::path const &aPath, uint32_t const * aPixels,
+                int aWidth, int aHeight, ptrdiff_t aStride)
+{
+  if (aWidth <= 0 || aHeight <= 0) {
+    return false;
+  }
+
+  // BITMAPFILEHEADER followed by a BITMAPV4HEADER, whose channel masks are
+  // what make viewers honour the alpha channel
+  const uint32_t kFileHeaderSize = 14;
+  const uint32_t kInfoHeaderSize = 108;
+  const uint32_t imageSize = static_cast<uint32_t>(aWidth) * aHeight * 4;
+  std::vector<uint8_t> data;
+  data.reserve(kFileHeaderSize + kInfoHeaderSize + imageSize);
+
+  data.push_back('B');
+  data.push_back('M');
+  PutLE(data, kFileHeaderSize + kInfoHeaderSize + imageSize, 4);
+  PutLE(data, 0, 4);
+  PutLE(data, kFileHeaderSize + kInfoHeaderSize, 4);
+
+  PutLE(data, kInfoHeaderSize, 4);
+  PutLE(data, static_cast<uint32_t>(aWidth), 4);
+  PutLE(data, static_cast<uint32_t>(-aHeight), 4);  // Top-down
+  PutLE(data, 1, 2);                                 // Planes
+  PutLE(data, 32, 2);                                // Bits per pixel
+  PutLE(data, 3, 4);                                 // BI_BITFIELDS
+  PutLE(data, imageSize, 4);
+  PutLE(data, 3780, 4);                              // 96 DPI, in pixels/metre
+  PutLE(data, 3780, 4);
+  PutLE(data, 0, 4);                                 // Palette size
+  PutLE(data, 0, 4);
+  PutLE(data, 0x00FF0000, 4);                        // Red mask
+  PutLE(data, 0x0000FF00, 4);
+  PutLE(data, 0x000000FF, 4);
+  PutLE(data, 0xFF000000, 4);                        // Alpha mask
+  PutLE(data, 0x73524742, 4);                        // LCS_sRGB
+  data.resize(kFileHeaderSize + kInfoHeaderSize, 0); // Endpoints and gamma
+
+  // BMP alpha is straight, not premultiplied
+  for (int y = 0; y < aHeight; ++y) {
+    uint32_t const * row = aPixels + y * aStride;
+    for (int x = 0; x < aWidth; ++x) {
+      const uint32_t pixel = row[x];
+      const uint32_t alpha = pixel >> 24;
+      uint32_t straight = pixel;
+      if (alpha && alpha != 0xFF) {
+        straight = alpha << 24;
+        for (unsigned shift = 0; shift < 24; shift += 8) {
+          const uint32_t channel = (pixel >> shift) & 0xFF;
+          straight |= std::min<uint32_t>(0xFF, (channel * 0xFF + alpha / 2) / alpha)
+                      << shift;
+        }
+      }
+      PutLE(data, straight, 4);
+    }
+  }
+
+  std::ofstream file(aPath, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  file.write(reinterpret_cast<char const *>(data.data()), data.size());
+  return !!file;
+}
+
+} // namespace aspk
@@ -0,0 +1,133 @@
+#ifndef __ASPK_PAINTSURFACE_H
+#define __ASPK_PAINTSURFACE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+namespace aspk {
+
+// A rectangle in surface pixels; right and bottom are exclusive, as with RECT
+struct PixelRect
+{
+  int mLeft;
+  int mTop;
+  int mRight;
+  int mBottom;
+
+  int GetWidth() const { return mRight - mLeft; }
+  int GetHeight() const { return mBottom - mTop; }
+  bool IsEmpty() const { return mRight <= mLeft || mBottom <= mTop; }
+
+  PixelRect
+  Intersect(PixelRect const &aOther) const
+  {
+    return PixelRect{std::max<int>(mLeft, aOther.mLeft),
+                     std::max<int>(mTop, aOther.mTop),
+                     std::min<int>(mRight, aOther.mRight),
+                     std::min<int>(mBottom, aOther.mBottom)};
+  }
+};
+
+struct PixelSize
+{
+  int mWidth;
+  int mHeight;
+};
+
+// Where the paint pipeline draws. GlassWindow paints through a GdiPaintSurface;
+// a BitmapSurface renders the same pipeline into memory, without a window.
+// Colors are 32-bit premultiplied BGRA pixels (see MakePremultipliedPixel).
+class PaintSurface
+{
+public:
+  enum Font
+  {
+    eMessageFont,
+    eFixedFont
+  };
+
+  // Draws text in the surface's default color
+  static constexpr uint32_t kDefaultTextColor = 0;
+
+  virtual ~PaintSurface() {}
+
+  // The area that needs painting. Drawing outside it is allowed but wasted.
+  virtual PixelRect GetClipRect() = 0;
+
+  // Replaces the pixels in aRect, alpha included
+  virtual void FillRect(PixelRect const &aRect, uint32_t aPixel) = 0;
+
+  // Selects the font used by the text methods below. Surfaces start out with
+  // eMessageFont.
+  virtual void SetFont(Font aFont) = 0;
+  // Distance between baselines of consecutive lines; 0 if unknown
+  virtual int GetLineHeight() = 0;
+  // aText may contain newlines. No prefix or tab processing is done.
+  virtual PixelSize MeasureText(std::wstring_view aText) = 0;
+  // Draws aText left-aligned from the top-left of aRect, without clipping to
+  // it. Returns false if the surface cannot draw text.
+  virtual bool DrawText(PixelRect const &aRect, std::wstring_view aText,
+                        uint32_t aColor = kDefaultTextColor) = 0;
+};
+
+// An in-memory, top-down 32-bit premultiplied surface. It has no font
+// rasterizer: each non-space character is drawn as a solid cell, inset by a
+// pixel, on a fixed grid. That keeps output pixel-exact on every platform
+// while still exercising layout. This class has no Win32 dependencies.
+class BitmapSurface : public PaintSurface
+{
+public:
+  BitmapSurface(int aWidth, int aHeight);
+
+  int GetWidth() const { return mWidth; }
+  int GetHeight() const { return mHeight; }
+  // In pixels
+  ptrdiff_t GetStride() const { return mWidth; }
+  uint32_t const * GetPixels() const { return mPixels.data(); }
+  uint32_t GetPixel(int aX, int aY) const { return mPixels[aY * mWidth + aX]; }
+
+  // Limits drawing to aRect, like the update region of a partial repaint.
+  // Defaults to the whole surface.
+  void SetClipRect(PixelRect const &aRect);
+  // Glyph cell size used for aFont
+  void SetCellSize(Font aFont, int aWidth, int aHeight);
+
+  PixelRect GetClipRect() override { return mClip; }
+  void FillRect(PixelRect const &aRect, uint32_t aPixel) override;
+  void SetFont(Font aFont) override { mFont = aFont; }
+  int GetLineHeight() override { return mCells[mFont].mHeight; }
+  PixelSize MeasureText(std::wstring_view aText) override;
+  bool DrawText(PixelRect const &aRect, std::wstring_view aText,
+                uint32_t aColor = kDefaultTextColor) override;
+
+  // Writes the pixels as a 32-bit top-down BMP
+  bool WriteBitmapFile(std::filesystem::path const &aPath) const;
+
+private:
+  BitmapSurface(BitmapSurface const &) = delete;
+  BitmapSurface& operator=(BitmapSurface const &) = delete;
+
+private:
+  int                   mWidth;
+  int                   mHeight;
+  std::vector<uint32_t> mPixels;
+  PixelRect             mClip;
+  Font                  mFont;
+  PixelSize             mCells[2];
+
+  static constexpr uint32_t kTextPixel = 0xFF000000; // Opaque black
+};
+
+// Writes aHeight rows of aWidth premultiplied pixels, aStride pixels apart, as
+// a 32-bit top-down BMP with an alpha channel
+bool WriteBitmapFile(std::filesystem::path const &aPath,
+                     uint32_t const * aPixels, int aWidth, int aHeight,
+                     ptrdiff_t aStride);
+
+} // namespace aspk
+
+#endif // __ASPK_PAINTSURFACE_H
@@ -0,0 +1,129 @@
+#include "PixelFill.h"
+
+#if defined(ASPK_HAVE_X86_FILL)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ASPK_TARGET_AVX2
+#else
+#define ASPK_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace aspk {
+namespace detail {
+
+void
+FillPixelsScalar(uint32_t* aBits, ptrdiff_t aStride, int aWidth, int aHeight,
+                 uint32_t aPixel)
+{
+  for (int y = 0; y < aHeight; ++y, aBits += aStride) {
+    for (int x = 0; x < aWidth; ++x) {
+      aBits[x] = aPixel;
+    }
+  }
+}
+
+#if defined(ASPK_HAVE_X86_FILL)
+
+void
+FillPixelsSse2(uint32_t* aBits, ptrdiff_t aStride, int aWidth, int aHeight,
+               uint32_t aPixel)
+{
+  const __m128i pixels = _mm_set1_epi32(static_cast<int>(aPixel));
+
+  for (int y = 0; y < aHeight; ++y, aBits += aStride) {
+    int x = 0;
+    for (; x + 16 <= aWidth; x += 16) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(aBits + x), pixels);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(aBits + x + 4), pixels);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(aBits + x + 8), pixels);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(aBits + x + 12), pixels);
+    }
+    for (; x + 4 <= aWidth; x += 4) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(aBits + x), pixels);
+    }
+    for (; x < aWidth; ++x) {
+      aBits[x] = aPixel;
+    }
+  }
+}
+
+ASPK_TARGET_AVX2 void
+FillPixelsAvx2(uint32_t* aBits, ptrdiff_t aStride, int aWidth, int aHeight,
+               uint32_t aPixel)
+{
+  const __m256i pixels = _mm256_set1_epi32(static_cast<int>(aPixel));
+
+  for (int y = 0; y < aHeight; ++y, aBits += aStride) {
+    int x = 0;
+    for (; x + 32 <= aWidth; x += 32) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(aBits + x), pixels);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(aBits + x + 8), pixels);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(aBits + x + 16), pixels);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(aBits + x + 24), pixels);
+    }
+    for (; x + 8 <= aWidth; x += 8) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(aBits + x), pixels);
+    }
+    for (; x < aWidth; ++x) {
+      aBits[x] = aPixel;
+    }
+  }
+  _mm256_zeroupper();
+}
+
+bool
+HasAvx2()
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx) {
+    return false;
+  }
+
+  // The OS must be saving the YMM registers for us
+  if ((_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // defined(ASPK_HAVE_X86_FILL)
+
+} // namespace detail
+
+void
+FillPixels(uint32_t* aBits, ptrdiff_t aStride, int aWidth, int aHeight,
+           uint32_t aPixel)
+{
+  if (aWidth <= 0 || aHeight <= 0) {
+    return;
+  }
+
+#if defined(ASPK_HAVE_X86_FILL)
+  static const bool sHasAvx2 = detail::HasAvx2();
+  if (sHasAvx2) {
+    detail::FillPixelsAvx2(aBits, aStride, aWidth, aHeight, aPixel);
+  } else {
+    detail::FillPixelsSse2(aBits, aStride, aWidth, aHeight, aPixel);
+  }
+#else
+  detail::FillPixelsScalar(aBits, aStride, aWidth, aHeight, aPixel);
+#endif
+}
+
+} // namespace aspk
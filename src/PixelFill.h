@@ -0,0 +1,46 @@
+#ifndef __ASPK_PIXELFILL_H
+#define __ASPK_PIXELFILL_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace aspk {
+
+// Returns a 32-bit BGRA pixel with premultiplied alpha, as used by top-down
+// DIBs and BeginBufferedPaint.
+constexpr uint32_t
+MakePremultipliedPixel(uint8_t aRed, uint8_t aGreen, uint8_t aBlue,
+                       uint8_t aAlpha = 0xFF)
+{
+  return (uint32_t(aAlpha) << 24) |
+         (uint32_t(aRed * aAlpha / 0xFF) << 16) |
+         (uint32_t(aGreen * aAlpha / 0xFF) << 8) |
+         uint32_t(aBlue * aAlpha / 0xFF);
+}
+
+// Fills a aWidth x aHeight rectangle of 32-bit pixels starting at aBits.
+// aStride is the distance between rows, in pixels. Uses AVX2 or SSE2 when
+// available and falls back to scalar code elsewhere.
+void FillPixels(uint32_t* aBits, ptrdiff_t aStride, int aWidth, int aHeight,
+                uint32_t aPixel);
+
+namespace detail {
+
+// Individual kernels, exposed for testing and benchmarking. The SIMD kernels
+// are only present on x86/x64 and must only be called when supported.
+void FillPixelsScalar(uint32_t* aBits, ptrdiff_t aStride, int aWidth,
+                      int aHeight, uint32_t aPixel);
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ASPK_HAVE_X86_FILL
+void FillPixelsSse2(uint32_t* aBits, ptrdiff_t aStride, int aWidth,
+                    int aHeight, uint32_t aPixel);
+void FillPixelsAvx2(uint32_t* aBits, ptrdiff_t aStride, int aWidth,
+                    int aHeight, uint32_t aPixel);
+bool HasAvx2();
+#endif
+
+} // namespace detail
+
+} // namespace aspk
+
+#endif // __ASPK_PIXELFILL_H
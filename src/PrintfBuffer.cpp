@@ -0,0 +1,155 @@
+#include "PrintfBuffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cwchar>
+
+namespace aspk {
+
+PrintfBuffer::PrintfBuffer()
+  : mCapacity(0)
+  , mLength(0)
+  , mGrowCount(0)
+{
+}
+
+bool
+PrintfBuffer::Format(const wchar_t* aFmt, ...)
+{
+  va_list argptr;
+  va_start(argptr, aFmt);
+  bool result = VFormat(aFmt, argptr);
+  va_end(argptr);
+  return result;
+}
+
+bool
+PrintfBuffer::VFormat(const wchar_t* aFmt, va_list aArgs)
+{
+  Clear();
+  return AppendVFormat(aFmt, aArgs);
+}
+
+bool
+PrintfBuffer::AppendFormat(const wchar_t* aFmt, ...)
+{
+  va_list argptr;
+  va_start(argptr, aFmt);
+  bool result = AppendVFormat(aFmt, argptr);
+  va_end(argptr);
+  return result;
+}
+
+bool
+PrintfBuffer::AppendVFormat(const wchar_t* aFmt, va_list aArgs)
+{
+  EnsureCapacity(mLength + 1);
+
+  while (true) {
+    // Each attempt needs its own copy; a va_list may only be consumed once
+    va_list args;
+    va_copy(args, aArgs);
+    errno = 0;
+    int result = std::vswprintf(mBuf.get() + mLength, mCapacity - mLength,
+                                aFmt, args);
+    va_end(args);
+
+    if (result >= 0) {
+      mLength += static_cast<size_t>(result);
+      return true;
+    }
+
+    // A string argument that cannot be converted fails at any size
+    if (errno == EILSEQ || mCapacity >= kMaxCapacity) {
+      break;
+    }
+
+    EnsureCapacity(mCapacity * 2);
+  }
+
+  mBuf[mLength] = L'\0';
+  return false;
+}
+
+void
+PrintfBuffer::Assign(std::wstring_view aText)
+{
+  Clear();
+  Append(aText);
+}
+
+void
+PrintfBuffer::Append(std::wstring_view aText)
+{
+  EnsureCapacity(mLength + aText.size() + 1);
+  std::memcpy(mBuf.get() + mLength, aText.data(),
+              aText.size() * sizeof(wchar_t));
+  mLength += aText.size();
+  mBuf[mLength] = L'\0';
+}
+
+void
+PrintfBuffer::Append(size_t aCount, wchar_t aChar)
+{
+  EnsureCapacity(mLength + aCount + 1);
+  std::fill_n(mBuf.get() + mLength, aCount, aChar);
+  mLength += aCount;
+  mBuf[mLength] = L'\0';
+}
+
+void
+PrintfBuffer::Clear()
+{
+  mLength = 0;
+  if (mBuf) {
+    mBuf[0] = L'\0';
+  }
+}
+
+void
+PrintfBuffer::SplitInPlace(wchar_t aDelim,
+                           std::vector<std::wstring_view>& aTokens)
+{
+  aTokens.clear();
+
+  wchar_t* cur = mBuf.get();
+  wchar_t* const end = cur + mLength;
+
+  while (cur < end) {
+    wchar_t* tokEnd = std::wmemchr(cur, aDelim, end - cur);
+    if (!tokEnd) {
+      tokEnd = end;
+    }
+
+    if (tokEnd != cur) {
+      aTokens.emplace_back(cur, tokEnd - cur);
+    }
+
+    *tokEnd = L'\0';
+    cur = tokEnd + 1;
+  }
+}
+
+void
+PrintfBuffer::EnsureCapacity(size_t aCapacity)
+{
+  if (aCapacity <= mCapacity) {
+    return;
+  }
+
+  const size_t newCapacity = std::max({aCapacity, mCapacity * 2,
+                                       kInitialCapacity});
+  auto newBuf = std::make_unique<wchar_t[]>(newCapacity);
+  if (mBuf) {
+    std::memcpy(newBuf.get(), mBuf.get(), (mLength + 1) * sizeof(wchar_t));
+  } else {
+    newBuf[0] = L'\0';
+  }
+
+  mBuf = std::move(newBuf);
+  mCapacity = newCapacity;
+  ++mGrowCount;
+}
+
+} // namespace aspk
@@ -0,0 +1,75 @@
+#ifndef __ASPK_PRINTFBUFFER_H
+#define __ASPK_PRINTFBUFFER_H
+
+#include <cstdarg>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace aspk {
+
+// Reusable, growable target for printf-style formatting. Once the buffer has
+// grown to fit the largest message seen, formatting performs a single pass and
+// no heap allocation. This class has no Win32 dependencies.
+class PrintfBuffer
+{
+public:
+  PrintfBuffer();
+
+  // Replaces the contents of the buffer. Returns false if aFmt could not be
+  // formatted, in which case the buffer is left empty.
+  bool Format(const wchar_t* aFmt, ...);
+  bool VFormat(const wchar_t* aFmt, va_list aArgs);
+  void Assign(std::wstring_view aText);
+
+  // Appending variants of the above. A failed AppendFormat leaves the existing
+  // contents untouched.
+  bool AppendFormat(const wchar_t* aFmt, ...);
+  bool AppendVFormat(const wchar_t* aFmt, va_list aArgs);
+  void Append(std::wstring_view aText);
+  void Append(size_t aCount, wchar_t aChar);
+
+  void Clear();
+
+  std::wstring_view GetText() const
+  {
+    return std::wstring_view(mBuf.get(), mLength);
+  }
+
+  size_t GetLength() const { return mLength; }
+  bool IsEmpty() const { return !mLength; }
+
+  // Splits the contents on aDelim by overwriting each delimiter with a null,
+  // appending a view of each token to aTokens (which is cleared first). Every
+  // view is null-terminated. Like wcstok, empty tokens are skipped. The
+  // buffer's text is no longer contiguous afterwards.
+  void SplitInPlace(wchar_t aDelim, std::vector<std::wstring_view>& aTokens);
+
+  // Number of times the underlying storage has been (re)allocated
+  size_t GetGrowCount() const { return mGrowCount; }
+
+private:
+  // Grows the storage to hold at least aCapacity characters (including the
+  // terminator), preserving the current contents.
+  void EnsureCapacity(size_t aCapacity);
+
+private:
+  PrintfBuffer(PrintfBuffer const &) = delete;
+  PrintfBuffer& operator=(PrintfBuffer const &) = delete;
+
+private:
+  std::unique_ptr<wchar_t[]>  mBuf;
+  size_t                      mCapacity;
+  size_t                      mLength;
+  size_t                      mGrowCount;
+
+  static constexpr size_t kInitialCapacity = 256;
+  // Besides encoding errors, formatting failures are indistinguishable from
+  // truncation, so stop growing somewhere
+  static constexpr size_t kMaxCapacity = 16 * 1024 * 1024;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_PRINTFBUFFER_H
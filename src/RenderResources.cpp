@@ -0,0 +1,123 @@
+#include "RenderResources.h"
+
+#include <vssym32.h>
+
+#include "odbs.h"
+
+namespace aspk {
+
+wchar_t const RenderResources::kThemeClass[] = L"CompositedWindow::Window";
+
+RenderResources::RenderResources(HWND aHwnd)
+  : mHwnd(aHwnd)
+  , mHits(0)
+  , mMisses(0)
+{
+}
+
+HTHEME
+RenderResources::GetTheme()
+{
+  if (mTheme) {
+    ++mHits;
+    return mTheme.get();
+  }
+
+  ++mMisses;
+  mTheme.reset(::OpenThemeData(mHwnd, kThemeClass));
+  return mTheme.get();
+}
+
+HFONT
+RenderResources::GetMessageFont(int aScalePercent)
+{
+  auto itr = mFonts.find(aScalePercent);
+  if (itr != mFonts.end()) {
+    ++mHits;
+    return static_cast<HFONT>(itr->second.get());
+  }
+
+  ++mMisses;
+  // Not through GetTheme, which would count this one lookup a second time
+  if (!mTheme) {
+    mTheme.reset(::OpenThemeData(mHwnd, kThemeClass));
+  }
+
+  LOGFONT logFont;
+  if (FAILED(::GetThemeSysFont(mTheme.get(), TMT_MSGBOXFONT, &logFont))) {
+    return nullptr;
+  }
+
+  UniqueGdiHandle font(::CreateFontIndirect(&logFont));
+  if (!font) {
+    Log<eLogWarning>(L"CreateFontIndirect failed");
+    return nullptr;
+  }
+
+  HFONT result = static_cast<HFONT>(font.get());
+  mFonts.emplace(aScalePercent, std::move(font));
+  return result;
+}
+
+HFONT
+RenderResources::GetFixedFont(int aScalePercent)
+{
+  auto itr = mFixedFonts.find(aScalePercent);
+  if (itr != mFixedFonts.end()) {
+    ++mHits;
+    return static_cast<HFONT>(itr->second.get());
+  }
+
+  ++mMisses;
+  const int height = -::MulDiv(kFixedFontPoints, 96 * aScalePercent, 72 * 100);
+  UniqueGdiHandle font(::CreateFontW(height, 0, 0, 0, FW_NORMAL, FALSE, FALSE,
+                                     FALSE, DEFAULT_CHARSET,
+                                     OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                                     CLEARTYPE_QUALITY,
+                                     FIXED_PITCH | FF_MODERN, L"Consolas"));
+  if (!font) {
+    Log<eLogWarning>(L"CreateFontW failed");
+    return nullptr;
+  }
+
+  HFONT result = static_cast<HFONT>(font.get());
+  mFixedFonts.emplace(aScalePercent, std::move(font));
+  return result;
+}
+
+HBRUSH
+RenderResources::GetSolidBrush(COLORREF aColor)
+{
+  auto itr = mBrushes.find(aColor);
+  if (itr != mBrushes.end()) {
+    ++mHits;
+    return static_cast<HBRUSH>(itr->second.get());
+  }
+
+  ++mMisses;
+  UniqueGdiHandle brush(::CreateSolidBrush(aColor));
+  if (!brush) {
+    return nullptr;
+  }
+
+  HBRUSH result = static_cast<HBRUSH>(brush.get());
+  mBrushes.emplace(aColor, std::move(brush));
+  return result;
+}
+
+void
+RenderResources::InvalidateAll()
+{
+  mTheme.reset();
+  mFonts.clear();
+  mFixedFonts.clear();
+  mBrushes.clear();
+}
+
+void
+RenderResources::InvalidateTheme()
+{
+  mTheme.reset();
+}
+
+} // namespace aspk
@@ -0,0 +1,56 @@
+#ifndef __ASPK_RENDERRESOURCES_H
+#define __ASPK_RENDERRESOURCES_H
+
+#include <map>
+
+#include <windows.h>
+#include <uxtheme.h>
+
+#include "UniqueHandle.h"
+
+namespace aspk {
+
+// Per-window cache of the GDI and theme objects used while painting, so that a
+// paint does not need to create any. Objects are created on first use and are
+// only released by the Invalidate* methods.
+class RenderResources
+{
+public:
+  explicit RenderResources(HWND aHwnd);
+
+  HTHEME GetTheme();
+  // The theme's message box font, keyed by scale percentage
+  HFONT GetMessageFont(int aScalePercent);
+  // A fixed-pitch font for tabular debug output, keyed by scale percentage
+  HFONT GetFixedFont(int aScalePercent);
+  HBRUSH GetSolidBrush(COLORREF aColor);
+
+  // For WM_THEMECHANGED: everything may have changed
+  void InvalidateAll();
+  // For WM_DPICHANGED: theme metrics follow the window's DPI. Fonts are kept,
+  // since they are already cached per DPI.
+  void InvalidateTheme();
+
+  size_t GetHitCount() const { return mHits; }
+  size_t GetMissCount() const { return mMisses; }
+
+private:
+  RenderResources(RenderResources const &) = delete;
+  RenderResources& operator=(RenderResources const &) = delete;
+
+private:
+  HWND                                mHwnd;
+  UniqueThemeHandle                   mTheme;
+  std::map<int, UniqueGdiHandle>      mFonts;
+  std::map<int, UniqueGdiHandle>      mFixedFonts;
+  std::map<COLORREF, UniqueGdiHandle> mBrushes;
+  size_t                              mHits;
+  size_t                              mMisses;
+
+  static wchar_t const kThemeClass[];
+  static const int kFixedFontPoints = 9;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_RENDERRESOURCES_H
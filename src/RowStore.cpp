@@ -0,0 +1,400 @@
+#include "RowStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace aspk {
+
+namespace {
+
+// A spilled chunk is written as one record: this header, then the row starts,
+// the cell refs and the text, copied verbatim from the in-memory chunk.
+// Records are padded to a multiple of 8 bytes so every array stays aligned
+// when mapped back in. The spill file only ever lives as long as the process
+// that wrote it, so native byte order and wchar_t size are fine.
+struct SpilledChunkHeader
+{
+  uint32_t  mMagic;
+  uint16_t  mVersion;
+  uint16_t  mCharSize;
+  uint32_t  mNumRows;
+  uint32_t  mNumCells;
+  uint32_t  mNumChars;
+  uint32_t  mReserved;
+};
+
+const uint32_t kSpillMagic = 0x4b505341; // "ASPK"
+const uint16_t kSpillVersion = 1;
+const size_t kSpillAlignment = 8;
+
+} // namespace
+
+size_t
+RowStore::Chunk::GetByteSize() const
+{
+  return mRowStarts.capacity() * sizeof(uint32_t) +
+         mCells.capacity() * sizeof(CellRef) +
+         mText.capacity() * sizeof(wchar_t);
+}
+
+RowStore::RowStore(size_t aNumColumns)
+  : mNumColumns(aNumColumns)
+  , mCurCol(0)
+  , mLineOpen(false)
+  , mRowCount(0)
+  , mMemoryBudget(0)
+  , mResidentBytes(0)
+  , mFirstResident(0)
+  , mSpilledChunkCount(0)
+  , mSpillFailed(false)
+  , mMapClock(0)
+{
+}
+
+RowStore::~RowStore()
+{
+}
+
+void
+RowStore::SetMemoryBudget(size_t aBytes)
+{
+  mMemoryBudget = aBytes;
+  EnforceBudget();
+}
+
+void
+RowStore::AppendCell(std::wstring_view aText)
+{
+  const bool hasNewline = !aText.empty() && aText.back() == L'\n';
+  if (hasNewline) {
+    aText.remove_suffix(1);
+  }
+
+  Chunk& chunk = mCurCol ? *mChunks.back().mResident : BeginRow();
+  chunk.mCells.push_back(StoreText(chunk, aText));
+
+  if (hasNewline || !mNumColumns) {
+    mCurCol = 0;
+  } else {
+    mCurCol = (mCurCol + 1) % mNumColumns;
+  }
+}
+
+void
+RowStore::AppendLines(std::wstring_view aText)
+{
+  while (!aText.empty()) {
+    const size_t newline = aText.find(L'\n');
+    std::wstring_view line = aText.substr(0, newline);
+
+    if (mLineOpen) {
+      ExtendLastCell(line);
+    } else {
+      Chunk& chunk = BeginRow();
+      chunk.mCells.push_back(StoreText(chunk, line));
+    }
+
+    if (newline == std::wstring_view::npos) {
+      mLineOpen = true;
+      return;
+    }
+
+    mLineOpen = false;
+    aText.remove_prefix(newline + 1);
+  }
+}
+
+RowStore::Chunk&
+RowStore::BeginRow()
+{
+  Chunk* chunk = mChunks.empty() ? nullptr : mChunks.back().mResident.get();
+  if (!chunk || chunk->mText.size() >= kChunkChars ||
+      chunk->mRowStarts.size() >= kMaxChunkRows) {
+    if (chunk) {
+      // Seal the current chunk; it now counts against the budget
+      mResidentBytes += chunk->GetByteSize();
+    }
+
+    auto fresh = std::make_unique<Chunk>();
+    fresh->mText.reserve(kChunkChars);
+    chunk = fresh.get();
+    mChunks.push_back(ChunkEntry{mRowCount, std::move(fresh), 0, 0});
+    EnforceBudget();
+  }
+
+  chunk->mRowStarts.push_back(static_cast<uint32_t>(chunk->mCells.size()));
+  ++mRowCount;
+  return *chunk;
+}
+
+void
+RowStore::ExtendLastCell(std::wstring_view aText)
+{
+  if (aText.empty()) {
+    return;
+  }
+
+  Chunk& chunk = *mChunks.back().mResident;
+  CellRef& last = chunk.mCells.back();
+  if (!last.mLength) {
+    last = StoreText(chunk, aText);
+    return;
+  }
+
+  if (last.mOffset + last.mLength + 1 == chunk.mText.size()) {
+    // Grow in place, overwriting the old terminator
+    chunk.mText.pop_back();
+    chunk.mText.insert(chunk.mText.end(), aText.begin(), aText.end());
+    chunk.mText.push_back(L'\0');
+    last.mLength += static_cast<uint32_t>(aText.size());
+    return;
+  }
+
+  // Relocate the line; its old text becomes dead space. Copy it out first,
+  // as appending may reallocate the chunk's text.
+  std::wstring oldText(chunk.mText.data() + last.mOffset, last.mLength);
+  last = StoreText(chunk, oldText, aText);
+}
+
+RowStore::CellRef
+RowStore::StoreText(Chunk& aChunk, std::wstring_view aText,
+                    std::wstring_view aSuffix)
+{
+  if (aText.empty() && aSuffix.empty()) {
+    return CellRef{0, 0};
+  }
+
+  CellRef ref = {static_cast<uint32_t>(aChunk.mText.size()),
+                 static_cast<uint32_t>(aText.size() + aSuffix.size())};
+  aChunk.mText.insert(aChunk.mText.end(), aText.begin(), aText.end());
+  aChunk.mText.insert(aChunk.mText.end(), aSuffix.begin(), aSuffix.end());
+  aChunk.mText.push_back(L'\0');
+  return ref;
+}
+
+void
+RowStore::EnforceBudget()
+{
+  if (!mMemoryBudget || mSpillFailed) {
+    return;
+  }
+
+  // The last chunk is still being appended to and always stays resident
+  while (mResidentBytes > mMemoryBudget && mFirstResident + 1 < mChunks.size()) {
+    ChunkEntry& entry = mChunks[mFirstResident];
+    if (entry.mResident && !SpillChunk(entry)) {
+      // Keep everything in memory rather than lose output
+      mSpillFailed = true;
+      return;
+    }
+    ++mFirstResident;
+  }
+}
+
+bool
+RowStore::SpillChunk(ChunkEntry& aEntry)
+{
+  if (!mSpillFile) {
+    mSpillFile = SpillFile::CreateTemporary();
+    if (!mSpillFile) {
+      return false;
+    }
+  }
+
+  std::vector<uint8_t> record;
+  SerializeChunk(*aEntry.mResident, record);
+
+  uint64_t offset;
+  if (!mSpillFile->Append(record.data(), record.size(), offset)) {
+    return false;
+  }
+
+  aEntry.mSpillOffset = offset;
+  aEntry.mSpillSize = record.size();
+  mResidentBytes -= aEntry.mResident->GetByteSize();
+  aEntry.mResident.reset();
+  ++mSpilledChunkCount;
+  return true;
+}
+
+/* static */ void
+RowStore::SerializeChunk(Chunk const & aChunk, std::vector<uint8_t>& aRecord)
+{
+  SpilledChunkHeader header = {};
+  header.mMagic = kSpillMagic;
+  header.mVersion = kSpillVersion;
+  header.mCharSize = sizeof(wchar_t);
+  header.mNumRows = static_cast<uint32_t>(aChunk.mRowStarts.size());
+  header.mNumCells = static_cast<uint32_t>(aChunk.mCells.size());
+  header.mNumChars = static_cast<uint32_t>(aChunk.mText.size());
+
+  const size_t rowBytes = header.mNumRows * sizeof(uint32_t);
+  const size_t cellBytes = header.mNumCells * sizeof(CellRef);
+  const size_t textBytes = header.mNumChars * sizeof(wchar_t);
+  size_t size = sizeof(header) + rowBytes + cellBytes + textBytes;
+  size = (size + kSpillAlignment - 1) & ~(kSpillAlignment - 1);
+
+  aRecord.assign(size, 0);
+  uint8_t* dest = aRecord.data();
+  std::memcpy(dest, &header, sizeof(header));
+  dest += sizeof(header);
+  if (rowBytes) {
+    std::memcpy(dest, aChunk.mRowStarts.data(), rowBytes);
+    dest += rowBytes;
+  }
+  if (cellBytes) {
+    std::memcpy(dest, aChunk.mCells.data(), cellBytes);
+    dest += cellBytes;
+  }
+  if (textBytes) {
+    std::memcpy(dest, aChunk.mText.data(), textBytes);
+  }
+}
+
+/* static */ bool
+RowStore::ParseChunk(void const * aRecord, size_t aSize, ChunkView& aView)
+{
+  if (aSize < sizeof(SpilledChunkHeader)) {
+    return false;
+  }
+
+  auto bytes = static_cast<uint8_t const *>(aRecord);
+  SpilledChunkHeader header;
+  std::memcpy(&header, bytes, sizeof(header));
+  if (header.mMagic != kSpillMagic || header.mVersion != kSpillVersion ||
+      header.mCharSize != sizeof(wchar_t)) {
+    return false;
+  }
+
+  const size_t rowBytes = header.mNumRows * sizeof(uint32_t);
+  const size_t cellBytes = header.mNumCells * sizeof(CellRef);
+  const size_t textBytes = header.mNumChars * sizeof(wchar_t);
+  if (sizeof(header) + rowBytes + cellBytes + textBytes > aSize) {
+    return false;
+  }
+
+  bytes += sizeof(header);
+  aView.mRowStarts = reinterpret_cast<uint32_t const *>(bytes);
+  aView.mCells = reinterpret_cast<CellRef const *>(bytes + rowBytes);
+  aView.mText = reinterpret_cast<wchar_t const *>(bytes + rowBytes + cellBytes);
+  aView.mNumRows = header.mNumRows;
+  aView.mNumCells = header.mNumCells;
+  return true;
+}
+
+bool
+RowStore::GetChunkView(size_t aChunkIndex, ChunkView& aView) const
+{
+  ChunkEntry const & entry = mChunks[aChunkIndex];
+  if (entry.mResident) {
+    Chunk const & chunk = *entry.mResident;
+    aView.mRowStarts = chunk.mRowStarts.data();
+    aView.mCells = chunk.mCells.data();
+    aView.mText = chunk.mText.data();
+    aView.mNumRows = static_cast<uint32_t>(chunk.mRowStarts.size());
+    aView.mNumCells = static_cast<uint32_t>(chunk.mCells.size());
+    return true;
+  }
+
+  for (MappedChunk& mapped : mMappedChunks) {
+    if (mapped.mChunkIndex == aChunkIndex) {
+      mapped.mLastUse = ++mMapClock;
+      aView = mapped.mView;
+      return true;
+    }
+  }
+
+  auto mapping = mSpillFile->Map(entry.mSpillOffset, entry.mSpillSize);
+  if (!mapping || !ParseChunk(mapping->GetData(), entry.mSpillSize, aView)) {
+    return false;
+  }
+
+  MappedChunk fresh = {aChunkIndex, ++mMapClock, std::move(mapping), aView};
+  if (mMappedChunks.size() < kMaxMappedChunks) {
+    mMappedChunks.push_back(std::move(fresh));
+  } else {
+    // Replace the least recently used mapping
+    auto victim = std::min_element(mMappedChunks.begin(), mMappedChunks.end(),
+      [](MappedChunk const & a, MappedChunk const & b) {
+        return a.mLastUse < b.mLastUse;
+      });
+    *victim = std::move(fresh);
+  }
+  return true;
+}
+
+std::wstring_view
+RowStore::GetCell(size_t aRow, size_t aCol) const
+{
+  if (aRow >= mRowCount) {
+    return std::wstring_view(L"");
+  }
+
+  // Most lookups are near the tail, so try the last chunk first
+  size_t chunkIndex = mChunks.size() - 1;
+  if (aRow < mChunks[chunkIndex].mFirstRow) {
+    auto it = std::upper_bound(mChunks.begin(), mChunks.end(), aRow,
+      [](size_t aValue, ChunkEntry const & aEntry) {
+        return aValue < aEntry.mFirstRow;
+      });
+    chunkIndex = (it - mChunks.begin()) - 1;
+  }
+
+  ChunkView view;
+  if (!GetChunkView(chunkIndex, view)) {
+    return std::wstring_view(L"");
+  }
+
+  const size_t row = aRow - mChunks[chunkIndex].mFirstRow;
+  if (row >= view.mNumRows) {
+    return std::wstring_view(L"");
+  }
+
+  const size_t rowEnd = row + 1 < view.mNumRows ? view.mRowStarts[row + 1]
+                                                : view.mNumCells;
+  const size_t cellIndex = view.mRowStarts[row] + aCol;
+  if (cellIndex >= rowEnd) {
+    return std::wstring_view(L"");
+  }
+
+  CellRef const &ref = view.mCells[cellIndex];
+  if (!ref.mLength) {
+    return std::wstring_view(L"");
+  }
+
+  return std::wstring_view(view.mText + ref.mOffset, ref.mLength);
+}
+
+void
+RowStore::Clear()
+{
+  mCurCol = 0;
+  mLineOpen = false;
+  mRowCount = 0;
+  mChunks.clear();
+  mResidentBytes = 0;
+  mFirstResident = 0;
+  mSpilledChunkCount = 0;
+  mSpillFailed = false;
+  mMappedChunks.clear();
+  mSpillFile.reset();
+}
+
+size_t
+RowStore::GetResidentBytes() const
+{
+  size_t bytes = mResidentBytes;
+  if (!mChunks.empty() && mChunks.back().mResident) {
+    bytes += mChunks.back().mResident->GetByteSize();
+  }
+  return bytes;
+}
+
+uint64_t
+RowStore::GetSpilledBytes() const
+{
+  return mSpillFile ? mSpillFile->GetSize() : 0;
+}
+
+} // namespace aspk
@@ -0,0 +1,154 @@
+#ifndef __ASPK_ROWSTORE_H
+#define __ASPK_ROWSTORE_H
+
+#include "SpillFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace aspk {
+
+// Append-only storage for tabular text. Rows are packed into self-contained
+// chunks of null-terminated text plus a small cell index, so that a virtual
+// list can hand out pointers directly from LVN_GETDISPINFO without copying.
+//
+// With a memory budget set, the oldest sealed chunks are written to a spill
+// file once the budget is exceeded and mapped back in when they are read, so
+// memory use stays flat however much is appended. This class has no Win32
+// dependencies.
+class RowStore
+{
+public:
+  explicit RowStore(size_t aNumColumns = 0);
+  ~RowStore();
+
+  void SetNumColumns(size_t aNumColumns) { mNumColumns = aNumColumns; }
+  size_t GetNumColumns() const { return mNumColumns; }
+
+  // Approximate cap, in bytes, on chunks held in memory. 0 (the default)
+  // keeps everything in memory. The chunk being appended to is always
+  // resident, as are up to kMaxMappedChunks spilled chunks being read.
+  void SetMemoryBudget(size_t aBytes);
+  size_t GetMemoryBudget() const { return mMemoryBudget; }
+
+  // Appends a cell at the current cursor position. A trailing newline in
+  // aText terminates the current row, as does filling its last column.
+  void AppendCell(std::wstring_view aText);
+  // The column the next AppendCell fills
+  size_t GetCurrentColumn() const { return mCurCol; }
+
+  // Console-style append for single-column stores, where each row is a line.
+  // aText is split on newlines; text following the last newline leaves its
+  // line open, and the next call continues that line. Do not mix with
+  // AppendCell on the same store.
+  void AppendLines(std::wstring_view aText);
+  bool IsLineOpen() const { return mLineOpen; }
+
+  // Number of rows that contain at least one cell, including a partially
+  // filled last row.
+  size_t GetRowCount() const { return mRowCount; }
+
+  // The returned view is always null-terminated. Since older rows may be
+  // paged in and out, it is only valid until the next call to any other
+  // method of the store, including GetCell.
+  std::wstring_view GetCell(size_t aRow, size_t aCol) const;
+
+  void Clear();
+
+  // Bytes held by in-memory chunks, not counting mapped spilled chunks
+  size_t GetResidentBytes() const;
+  size_t GetSpilledChunkCount() const { return mSpilledChunkCount; }
+  uint64_t GetSpilledBytes() const;
+
+private:
+  struct CellRef
+  {
+    uint32_t  mOffset;  // Into the chunk's text
+    uint32_t  mLength;  // Excluding the terminator; 0 for empty cells
+  };
+
+  // A chunk being appended to, or one that is still resident once sealed.
+  // Rows never span chunks.
+  struct Chunk
+  {
+    std::vector<uint32_t> mRowStarts; // Index into mCells of each row's first cell
+    std::vector<CellRef>  mCells;
+    std::vector<wchar_t>  mText;
+
+    size_t GetByteSize() const;
+  };
+
+  // Read-only access to a chunk, either resident or mapped from the spill file
+  struct ChunkView
+  {
+    uint32_t const *  mRowStarts;
+    CellRef const *   mCells;
+    wchar_t const *   mText;
+    uint32_t          mNumRows;
+    uint32_t          mNumCells;
+  };
+
+  struct ChunkEntry
+  {
+    size_t                  mFirstRow;
+    std::unique_ptr<Chunk>  mResident;    // Null once spilled
+    uint64_t                mSpillOffset;
+    size_t                  mSpillSize;
+  };
+
+  struct MappedChunk
+  {
+    size_t                              mChunkIndex;
+    uint64_t                            mLastUse;
+    std::unique_ptr<SpillFile::Mapping> mMapping;
+    ChunkView                           mView;
+  };
+
+  // Returns the chunk a new row should go into, sealing the current one if
+  // it is full
+  Chunk& BeginRow();
+  CellRef StoreText(Chunk& aChunk, std::wstring_view aText,
+                    std::wstring_view aSuffix = {});
+  void ExtendLastCell(std::wstring_view aText);
+
+  // Spills the oldest resident sealed chunks until within budget
+  void EnforceBudget();
+  bool SpillChunk(ChunkEntry& aEntry);
+  bool GetChunkView(size_t aChunkIndex, ChunkView& aView) const;
+
+  // On-disk chunk format; see RowStore.cpp
+  static void SerializeChunk(Chunk const & aChunk, std::vector<uint8_t>& aRecord);
+  static bool ParseChunk(void const * aRecord, size_t aSize, ChunkView& aView);
+
+private:
+  RowStore(RowStore const &) = delete;
+  RowStore& operator=(RowStore const &) = delete;
+
+private:
+  size_t                      mNumColumns;
+  size_t                      mCurCol;
+  bool                        mLineOpen;  // Last row may still be extended by AppendLines
+  size_t                      mRowCount;
+  std::vector<ChunkEntry>     mChunks;
+
+  size_t                      mMemoryBudget;
+  size_t                      mResidentBytes;   // Sealed resident chunks only
+  size_t                      mFirstResident;   // Oldest chunk that may still be resident
+  size_t                      mSpilledChunkCount;
+  bool                        mSpillFailed;     // Don't keep retrying a broken spill file
+  std::unique_ptr<SpillFile>  mSpillFile;
+
+  mutable std::vector<MappedChunk>  mMappedChunks;
+  mutable uint64_t                  mMapClock;
+
+  static constexpr size_t kChunkChars = 64 * 1024;
+  static constexpr size_t kMaxChunkRows = 8 * 1024;
+  static constexpr size_t kMaxMappedChunks = 4;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_ROWSTORE_H
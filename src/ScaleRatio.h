@@ -0,0 +1,165 @@
+#ifndef __ASPK_SCALERATIO_H
+#define __ASPK_SCALERATIO_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace aspk {
+
+// The exact ratio between two scale percentages, reduced to lowest terms,
+// with a reciprocal so that applying it needs no division:
+// floor(n / mDenominator) == (n * mMagic) >> mShift for all n < 2^31.
+// Apply rounds halves away from zero. Results are exact while
+// |value| * mNumerator + mDenominator / 2 < 2^31. This header has no Win32
+// dependencies and everything in it is usable in constant expressions.
+struct ScaleRatio
+{
+  uint32_t  mNumerator;
+  uint32_t  mDenominator;
+  uint32_t  mMagic;
+  uint32_t  mShift;
+
+  static constexpr ScaleRatio
+  Make(int aFromPercent, int aToPercent)
+  {
+    if (aFromPercent <= 0 || aToPercent <= 0) {
+      // Not a real scale; leave values alone
+      return Make(1, 1);
+    }
+
+    uint32_t num = static_cast<uint32_t>(aToPercent);
+    uint32_t den = static_cast<uint32_t>(aFromPercent);
+    for (uint32_t a = num, b = den; ; ) {
+      if (!b) {
+        num /= a;
+        den /= a;
+        break;
+      }
+      const uint32_t r = a % b;
+      a = b;
+      b = r;
+    }
+
+    // With shift = 31 + ceil(log2(den)), the rounding error of the magic
+    // number times any n < 2^31 stays below 2^shift, and the magic number
+    // still fits in 32 bits.
+    uint32_t log2Den = 0;
+    while ((uint64_t(1) << log2Den) < den) {
+      ++log2Den;
+    }
+    const uint32_t shift = 31 + log2Den;
+    const uint64_t magic = ((uint64_t(1) << shift) + den - 1) / den;
+    return ScaleRatio{num, den, static_cast<uint32_t>(magic), shift};
+  }
+
+  constexpr int
+  Apply(int aValue) const
+  {
+    const uint32_t magnitude = aValue < 0 ? 0u - static_cast<uint32_t>(aValue)
+                                          : static_cast<uint32_t>(aValue);
+    const uint32_t n = magnitude * mNumerator + mDenominator / 2;
+    const int quotient = static_cast<int>((uint64_t(n) * mMagic) >> mShift);
+    return aValue < 0 ? -quotient : quotient;
+  }
+
+  constexpr bool
+  IsIdentity() const
+  {
+    return mNumerator == mDenominator;
+  }
+};
+
+// The scale steps offered by Windows display settings
+inline constexpr std::array<int, 12> kStandardScalePercents = {
+  100, 125, 150, 175, 200, 225, 250, 300, 350, 400, 450, 500
+};
+
+namespace detail {
+
+inline constexpr int kMinStandardScale = 100;
+inline constexpr int kMaxStandardScale = 500;
+inline constexpr uint8_t kNotStandardScale = 0xFF;
+
+// Maps a percentage in [100, 500] to its index in kStandardScalePercents
+inline constexpr auto kStandardScaleIndex = []() {
+  std::array<uint8_t, kMaxStandardScale - kMinStandardScale + 1> index{};
+  index.fill(kNotStandardScale);
+  for (size_t i = 0; i < kStandardScalePercents.size(); ++i) {
+    index[kStandardScalePercents[i] - kMinStandardScale] = static_cast<uint8_t>(i);
+  }
+  return index;
+}();
+
+inline constexpr auto kStandardScaleRatios = []() {
+  constexpr size_t count = kStandardScalePercents.size();
+  std::array<ScaleRatio, count * count> ratios{};
+  for (size_t from = 0; from < count; ++from) {
+    for (size_t to = 0; to < count; ++to) {
+      ratios[from * count + to] =
+        ScaleRatio::Make(kStandardScalePercents[from], kStandardScalePercents[to]);
+    }
+  }
+  return ratios;
+}();
+
+constexpr size_t
+GetStandardScaleIndex(int aPercent)
+{
+  if (aPercent < kMinStandardScale || aPercent > kMaxStandardScale) {
+    return kNotStandardScale;
+  }
+  return kStandardScaleIndex[aPercent - kMinStandardScale];
+}
+
+} // namespace detail
+
+// Standard steps come from the precomputed table; anything else is reduced
+// on the fly, which is the only case that divides.
+constexpr ScaleRatio
+GetScaleRatio(int aFromPercent, int aToPercent)
+{
+  const size_t from = detail::GetStandardScaleIndex(aFromPercent);
+  const size_t to = detail::GetStandardScaleIndex(aToPercent);
+  if (from != detail::kNotStandardScale && to != detail::kNotStandardScale) {
+    return detail::kStandardScaleRatios[from * kStandardScalePercents.size() + to];
+  }
+  return ScaleRatio::Make(aFromPercent, aToPercent);
+}
+
+// Scales a 96 DPI (100%) value to aPercent
+constexpr int
+ScaleFromNominal(int aValue, int aPercent)
+{
+  return GetScaleRatio(100, aPercent).Apply(aValue);
+}
+
+// A layout constant given at 96 DPI, with its value at every standard scale
+// resolved at compile time
+template <int Nominal>
+struct LayoutConstant
+{
+  static constexpr int kNominal = Nominal;
+
+  static constexpr auto kScaled = []() {
+    std::array<int, kStandardScalePercents.size()> values{};
+    for (size_t i = 0; i < values.size(); ++i) {
+      values[i] = ScaleFromNominal(Nominal, kStandardScalePercents[i]);
+    }
+    return values;
+  }();
+
+  static constexpr int
+  At(int aPercent)
+  {
+    const size_t index = detail::GetStandardScaleIndex(aPercent);
+    if (index != detail::kNotStandardScale) {
+      return kScaled[index];
+    }
+    return ScaleFromNominal(Nominal, aPercent);
+  }
+};
+
+} // namespace aspk
+
+#endif // __ASPK_SCALERATIO_H
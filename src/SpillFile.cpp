@@ -0,0 +1,171 @@
+#include "SpillFile.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace aspk {
+
+static size_t
+GetMappingGranularity()
+{
+#if defined(_WIN32)
+  SYSTEM_INFO sysInfo;
+  ::GetSystemInfo(&sysInfo);
+  return sysInfo.dwAllocationGranularity;
+#else
+  return static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+}
+
+SpillFile::Mapping::Mapping(void* aBase, size_t aBaseLength,
+                            size_t aDataOffset)
+  : mBase(aBase)
+  , mBaseLength(aBaseLength)
+  , mDataOffset(aDataOffset)
+{
+}
+
+SpillFile::Mapping::~Mapping()
+{
+#if defined(_WIN32)
+  ::UnmapViewOfFile(mBase);
+#else
+  ::munmap(mBase, mBaseLength);
+#endif
+}
+
+SpillFile::SpillFile(intptr_t aHandle)
+  : mHandle(aHandle)
+  , mSize(0)
+{
+}
+
+SpillFile::~SpillFile()
+{
+#if defined(_WIN32)
+  ::CloseHandle(reinterpret_cast<HANDLE>(mHandle));
+#else
+  ::close(static_cast<int>(mHandle));
+#endif
+}
+
+/* static */ std::unique_ptr<SpillFile>
+SpillFile::CreateTemporary()
+{
+#if defined(_WIN32)
+  wchar_t tempDir[MAX_PATH + 1];
+  if (!::GetTempPathW(MAX_PATH + 1, tempDir)) {
+    return nullptr;
+  }
+
+  wchar_t tempFile[MAX_PATH + 1];
+  if (!::GetTempFileNameW(tempDir, L"asp", 0, tempFile)) {
+    return nullptr;
+  }
+
+  HANDLE file = ::CreateFileW(tempFile, GENERIC_READ | GENERIC_WRITE, 0,
+                              nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY |
+                              FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    ::DeleteFileW(tempFile);
+    return nullptr;
+  }
+
+  return std::unique_ptr<SpillFile>(
+    new SpillFile(reinterpret_cast<intptr_t>(file)));
+#else
+  char const * tempDir = ::getenv("TMPDIR");
+  std::string path(tempDir && *tempDir ? tempDir : P_tmpdir);
+  path += "/aspk-spill-XXXXXX";
+
+  int fd = ::mkstemp(&path[0]);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  // The file lives on only as long as our descriptor does
+  ::unlink(path.c_str());
+  return std::unique_ptr<SpillFile>(new SpillFile(fd));
+#endif
+}
+
+bool
+SpillFile::Append(void const * aData, size_t aSize, uint64_t& aOffset)
+{
+  aOffset = mSize;
+
+  auto bytes = static_cast<uint8_t const *>(aData);
+  size_t remaining = aSize;
+  while (remaining) {
+#if defined(_WIN32)
+    DWORD toWrite = static_cast<DWORD>(std::min<size_t>(remaining, MAXDWORD));
+    DWORD written = 0;
+    if (!::WriteFile(reinterpret_cast<HANDLE>(mHandle), bytes, toWrite,
+                     &written, nullptr) || !written) {
+      return false;
+    }
+#else
+    ssize_t written = ::pwrite(static_cast<int>(mHandle), bytes, remaining,
+                               static_cast<off_t>(mSize));
+    if (written <= 0) {
+      return false;
+    }
+#endif
+    bytes += written;
+    remaining -= written;
+    mSize += written;
+  }
+
+  return true;
+}
+
+std::unique_ptr<SpillFile::Mapping>
+SpillFile::Map(uint64_t aOffset, size_t aSize)
+{
+  if (!aSize || aOffset + aSize > mSize) {
+    return nullptr;
+  }
+
+  static const size_t sGranularity = GetMappingGranularity();
+  const uint64_t baseOffset = aOffset - (aOffset % sGranularity);
+  const size_t dataOffset = static_cast<size_t>(aOffset - baseOffset);
+  const size_t baseLength = dataOffset + aSize;
+
+#if defined(_WIN32)
+  // The mapping object may be closed as soon as the view exists
+  HANDLE mapping = ::CreateFileMappingW(reinterpret_cast<HANDLE>(mHandle),
+                                        nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    return nullptr;
+  }
+
+  void* base = ::MapViewOfFile(mapping, FILE_MAP_READ,
+                               static_cast<DWORD>(baseOffset >> 32),
+                               static_cast<DWORD>(baseOffset), baseLength);
+  ::CloseHandle(mapping);
+  if (!base) {
+    return nullptr;
+  }
+#else
+  void* base = ::mmap(nullptr, baseLength, PROT_READ, MAP_SHARED,
+                      static_cast<int>(mHandle),
+                      static_cast<off_t>(baseOffset));
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+#endif
+
+  return std::make_unique<Mapping>(base, baseLength, dataOffset);
+}
+
+} // namespace aspk
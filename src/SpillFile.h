@@ -0,0 +1,60 @@
+#ifndef __ASPK_SPILLFILE_H
+#define __ASPK_SPILLFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace aspk {
+
+// Anonymous, append-only temporary file whose contents can be memory-mapped
+// back in. The file is deleted when the object is destroyed (or the process
+// exits). Implemented for both Win32 and POSIX.
+class SpillFile
+{
+public:
+  // A read-only view of part of the file
+  class Mapping
+  {
+  public:
+    Mapping(void* aBase, size_t aBaseLength, size_t aDataOffset);
+    ~Mapping();
+
+    void const * GetData() const
+    {
+      return static_cast<uint8_t const *>(mBase) + mDataOffset;
+    }
+
+  private:
+    Mapping(Mapping const &) = delete;
+    Mapping& operator=(Mapping const &) = delete;
+
+  private:
+    void*   mBase;        // Start of the view, aligned as the OS requires
+    size_t  mBaseLength;
+    size_t  mDataOffset;  // Offset of the requested range within the view
+  };
+
+  // Returns nullptr if no temporary file could be created
+  static std::unique_ptr<SpillFile> CreateTemporary();
+  ~SpillFile();
+
+  // Appends aSize bytes, returning the offset they were written at via aOffset
+  bool Append(void const * aData, size_t aSize, uint64_t& aOffset);
+  std::unique_ptr<Mapping> Map(uint64_t aOffset, size_t aSize);
+
+  uint64_t GetSize() const { return mSize; }
+
+private:
+  explicit SpillFile(intptr_t aHandle);
+  SpillFile(SpillFile const &) = delete;
+  SpillFile& operator=(SpillFile const &) = delete;
+
+private:
+  intptr_t  mHandle;  // HANDLE on Windows, file descriptor elsewhere
+  uint64_t  mSize;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_SPILLFILE_H
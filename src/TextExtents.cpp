@@ -0,0 +1,139 @@
+#include "TextExtents.h"
+
+#include <algorithm>
+
+namespace aspk {
+
+GlyphAdvanceTable::GlyphAdvanceTable(PageFiller aFiller, int aFallbackAdvance)
+  : mFiller(std::move(aFiller))
+  , mFallbackAdvance(std::max(aFallbackAdvance, 0))
+  , mFilledPages(0)
+{
+}
+
+uint16_t const *
+GlyphAdvanceTable::GetPage(size_t aIndex)
+{
+  if (uint16_t const * page = mPages[aIndex].get()) {
+    return page;
+  }
+
+  std::array<int, kPageSize> advances;
+  if (!mFiller ||
+      !mFiller(static_cast<wchar_t>(aIndex * kPageSize), advances.data())) {
+    advances.fill(mFallbackAdvance);
+  }
+
+  auto page = std::make_unique<uint16_t[]>(kPageSize);
+  for (size_t i = 0; i < kPageSize; ++i) {
+    page[i] = static_cast<uint16_t>(std::clamp(advances[i], 0, 0xFFFF));
+  }
+  mPages[aIndex] = std::move(page);
+  ++mFilledPages;
+  return mPages[aIndex].get();
+}
+
+int
+GlyphAdvanceTable::GetAdvance(wchar_t aChar)
+{
+  const uint32_t code = static_cast<uint32_t>(aChar);
+  if (code > 0xFFFF || (code >= 0xD800 && code <= 0xDBFF)) {
+    return mFallbackAdvance;
+  }
+  if (code >= 0xDC00 && code <= 0xDFFF) {
+    // The high surrogate already counted the pair
+    return 0;
+  }
+  return GetPage(code / kPageSize)[code % kPageSize];
+}
+
+int
+GlyphAdvanceTable::Measure(std::wstring_view aText)
+{
+  // Text rarely leaves its page, so look the page up only when it changes
+  int width = 0;
+  size_t pageIndex = kNumPages;
+  uint16_t const * page = nullptr;
+  for (wchar_t c : aText) {
+    const uint32_t code = static_cast<uint32_t>(c);
+    if (code > 0xFFFF || (code >= 0xD800 && code <= 0xDFFF)) {
+      width += GetAdvance(c);
+      continue;
+    }
+    if (code / kPageSize != pageIndex) {
+      pageIndex = code / kPageSize;
+      page = GetPage(pageIndex);
+    }
+    width += page[code % kPageSize];
+  }
+  return width;
+}
+
+void
+ColumnExtents::SetNumColumns(size_t aNumColumns)
+{
+  mColumns.resize(aNumColumns);
+}
+
+bool
+ColumnExtents::Add(size_t aColumn, std::wstring_view aText,
+                   GlyphAdvanceTable& aAdvances)
+{
+  if (aColumn >= mColumns.size()) {
+    return false;
+  }
+
+  Column& column = mColumns[aColumn];
+  const int width = aAdvances.Measure(aText);
+  if (width <= column.mWidth) {
+    return false;
+  }
+  column.mWidth = width;
+  column.mWidestText.assign(aText);
+  column.mChanged = true;
+  mHasChanges = true;
+  return true;
+}
+
+int
+ColumnExtents::GetWidth(size_t aColumn) const
+{
+  return aColumn < mColumns.size() ? mColumns[aColumn].mWidth : 0;
+}
+
+void
+ColumnExtents::Remeasure(GlyphAdvanceTable& aAdvances)
+{
+  for (Column& column : mColumns) {
+    const int width = aAdvances.Measure(column.mWidestText);
+    if (width != column.mWidth) {
+      column.mWidth = width;
+      column.mChanged = true;
+      mHasChanges = true;
+    }
+  }
+}
+
+bool
+ColumnExtents::IsChanged(size_t aColumn) const
+{
+  return aColumn < mColumns.size() && mColumns[aColumn].mChanged;
+}
+
+void
+ColumnExtents::ClearChanges()
+{
+  for (Column& column : mColumns) {
+    column.mChanged = false;
+  }
+  mHasChanges = false;
+}
+
+void
+ColumnExtents::Clear()
+{
+  mColumns.clear();
+  mHasChanges = false;
+}
+
+} // namespace aspk
@@ -0,0 +1,93 @@
+#ifndef __ASPK_TEXTEXTENTS_H
+#define __ASPK_TEXTEXTENTS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace aspk {
+
+// Advance widths of one font at one DPI, for measuring text without a DC.
+// Pages of kPageSize characters are filled through a callback on first use,
+// so typical text costs one or two font queries for the table's lifetime.
+// Kerning and shaping are ignored, which suits estimates such as column
+// widths. Characters outside the BMP, and each surrogate pair, count as the
+// fallback advance. This class has no Win32 dependencies.
+class GlyphAdvanceTable
+{
+public:
+  static constexpr size_t kPageSize = 256;
+
+  // Fills aAdvances[0..kPageSize) with the advances of the characters from
+  // aFirst. Returning false gives every character on the page the fallback.
+  using PageFiller = std::function<bool(wchar_t aFirst, int* aAdvances)>;
+
+  GlyphAdvanceTable(PageFiller aFiller, int aFallbackAdvance);
+
+  int GetAdvance(wchar_t aChar);
+  int Measure(std::wstring_view aText);
+  size_t GetFilledPageCount() const { return mFilledPages; }
+
+private:
+  uint16_t const * GetPage(size_t aIndex);
+
+private:
+  GlyphAdvanceTable(GlyphAdvanceTable const &) = delete;
+  GlyphAdvanceTable& operator=(GlyphAdvanceTable const &) = delete;
+
+private:
+  static constexpr size_t kNumPages = 0x10000 / kPageSize;
+
+  PageFiller                                        mFiller;
+  int                                               mFallbackAdvance;
+  std::array<std::unique_ptr<uint16_t[]>, kNumPages> mPages;
+  size_t                                            mFilledPages;
+};
+
+// The widest cell of each column, tracked as rows arrive so that columns can
+// be fitted to their content without rescanning the rows. A copy of each
+// column's widest text is kept, so that widths can be remeasured cheaply when
+// the font or DPI changes; the widest text under the old metrics is assumed
+// to stay the widest. This class has no Win32 dependencies.
+class ColumnExtents
+{
+public:
+  void SetNumColumns(size_t aNumColumns);
+  size_t GetNumColumns() const { return mColumns.size(); }
+
+  // Returns true if aText is now the widest in aColumn
+  bool Add(size_t aColumn, std::wstring_view aText,
+           GlyphAdvanceTable& aAdvances);
+  int GetWidth(size_t aColumn) const;
+
+  // Measures each column's widest text again, with new advances
+  void Remeasure(GlyphAdvanceTable& aAdvances);
+
+  // Columns whose width changed since the last ClearChanges
+  bool HasChanges() const { return mHasChanges; }
+  bool IsChanged(size_t aColumn) const;
+  void ClearChanges();
+
+  void Clear();
+
+private:
+  struct Column
+  {
+    int           mWidth = 0;
+    std::wstring  mWidestText;
+    bool          mChanged = false;
+  };
+
+private:
+  std::vector<Column> mColumns;
+  bool                mHasChanges = false;
+};
+
+} // namespace aspk
+
+#endif // __ASPK_TEXTEXTENTS_H
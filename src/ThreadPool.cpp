@@ -0,0 +1,273 @@
+#include "ThreadPool.h"
+
+#include "Log.h"
+
+#include <system_error>
+
+namespace aspk {
+
+namespace {
+
+struct WorkerIdentity
+{
+  ThreadPool* mPool = nullptr;
+  size_t      mIndex = 0;
+};
+
+thread_local WorkerIdentity tWorker;
+
+size_t
+ResolveThreadCount(size_t aThreadCount)
+{
+  if (aThreadCount) {
+    return aThreadCount;
+  }
+  return std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+}
+
+} // anonymous namespace
+
+void
+ThreadPool::JobDeque::PushBack(Job const &aJob)
+{
+  std::lock_guard<std::mutex> lock(mLock);
+  if (mCount == mRing.size()) {
+    // Unwrap into a ring twice the size
+    std::vector<Job> ring(std::max<size_t>(mRing.size() * 2, 64));
+    for (size_t i = 0; i < mCount; ++i) {
+      ring[i] = mRing[(mHead + i) % mRing.size()];
+    }
+    mRing.swap(ring);
+    mHead = 0;
+  }
+  mRing[(mHead + mCount) % mRing.size()] = aJob;
+  ++mCount;
+}
+
+bool
+ThreadPool::JobDeque::PopBack(Job &aJob)
+{
+  std::lock_guard<std::mutex> lock(mLock);
+  if (!mCount) {
+    return false;
+  }
+  --mCount;
+  aJob = mRing[(mHead + mCount) % mRing.size()];
+  return true;
+}
+
+bool
+ThreadPool::JobDeque::PopFront(Job &aJob)
+{
+  std::lock_guard<std::mutex> lock(mLock);
+  if (!mCount) {
+    return false;
+  }
+  aJob = mRing[mHead];
+  mHead = (mHead + 1) % mRing.size();
+  --mCount;
+  return true;
+}
+
+void
+ThreadPool::JoinCounter::Fail(std::exception_ptr aException)
+{
+  if (!mFailed.exchange(true)) {
+    mException = std::move(aException);
+  }
+}
+
+ThreadPool::ThreadPool(size_t aThreadCount)
+  : mThreadCount(ResolveThreadCount(aThreadCount))
+  , mDeques(std::make_unique<JobDeque[]>(mThreadCount))
+  , mStartedThreads(0)
+  , mQueuedJobs(0)
+  , mStealCount(0)
+  , mStopping(false)
+  , mSleepers(0)
+{
+  mWorkers.reserve(mThreadCount);
+  for (size_t i = 0; i < mThreadCount; ++i) {
+    try {
+      mWorkers.emplace_back(&ThreadPool::WorkerMain, this, i);
+    } catch (std::system_error const &e) {
+      // Fewer workers is slower but still correct; with none, callers of
+      // Invoke and ParallelFor do all the work themselves
+      Log<eLogWarning>(L"ThreadPool: started ", i, L" of ", mThreadCount,
+                       L" threads: ", e.what());
+      break;
+    }
+  }
+  mStartedThreads = mWorkers.size();
+  if (!mStartedThreads) {
+    mStopping.store(true);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  Shutdown();
+}
+
+void
+ThreadPool::Shutdown()
+{
+  if (mWorkers.empty()) {
+    return;
+  }
+
+  mStopping.store(true);
+  WakeSleepers(true);
+  for (std::thread& worker : mWorkers) {
+    worker.join();
+  }
+  mWorkers.clear();
+
+  // Jobs that slipped in as the workers left. A count above zero means the
+  // job is being pushed, is in a deque, or is being taken by a submitter
+  // that saw mStopping.
+  while (mQueuedJobs.load()) {
+    if (!RunOneJob()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+/* static */ ThreadPool*
+ThreadPool::GetForCurrentThread()
+{
+  return tWorker.mPool;
+}
+
+void
+ThreadPool::Submit(JobFn aFn, void* aContext)
+{
+  if (mStopping.load()) {
+    aFn(aContext);
+    return;
+  }
+
+  // Counted before it is pushed, so that a thief's decrement never takes
+  // the count below zero
+  mQueuedJobs.fetch_add(1);
+  if (tWorker.mPool == this) {
+    mDeques[tWorker.mIndex].PushBack(Job{aFn, aContext});
+  } else {
+    mInjected.PushBack(Job{aFn, aContext});
+  }
+  if (mStopping.load()) {
+    // Shutdown began meanwhile and may already have finished draining
+    // without seeing our count; run what is left ourselves
+    while (RunOneJob()) {
+    }
+    return;
+  }
+  WakeSleepers(false);
+}
+
+void
+ThreadPool::WakeSleepers(bool aAll)
+{
+  // Pairs with the increment of mSleepers before a sleeper checks for work:
+  // either it sees our job, or we see it and must take the lock, which it
+  // holds until it is actually waiting
+  if (!mSleepers.load()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mSleepLock);
+  }
+  if (aAll) {
+    mSleepCondition.notify_all();
+  } else {
+    mSleepCondition.notify_one();
+  }
+}
+
+void
+ThreadPool::NotifyJoined()
+{
+  // A sleeping joiner may be any of the sleepers
+  WakeSleepers(true);
+}
+
+bool
+ThreadPool::TryTakeJob(Job &aJob)
+{
+  const bool isWorker = tWorker.mPool == this;
+  const size_t numDeques = mThreadCount;
+  const size_t self = isWorker ? tWorker.mIndex : 0;
+
+  if ((isWorker && mDeques[self].PopBack(aJob)) || mInjected.PopFront(aJob)) {
+    mQueuedJobs.fetch_sub(1);
+    return true;
+  }
+  for (size_t i = 0; i < numDeques; ++i) {
+    const size_t victim = (self + 1 + i) % numDeques;
+    if (isWorker && victim == self) {
+      continue;
+    }
+    if (mDeques[victim].PopFront(aJob)) {
+      mQueuedJobs.fetch_sub(1);
+      mStealCount.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+ThreadPool::RunOneJob()
+{
+  Job job;
+  if (!TryTakeJob(job)) {
+    return false;
+  }
+  job.mFn(job.mContext);
+  return true;
+}
+
+void
+ThreadPool::WorkerMain(size_t aIndex)
+{
+  tWorker.mPool = this;
+  tWorker.mIndex = aIndex;
+
+  for (;;) {
+    if (RunOneJob()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mSleepLock);
+    mSleepers.fetch_add(1);
+    mSleepCondition.wait(lock, [this] {
+      return mQueuedJobs.load() || mStopping.load();
+    });
+    mSleepers.fetch_sub(1);
+    // Drain before leaving, so that Shutdown finishes queued work
+    if (mStopping.load() && !mQueuedJobs.load()) {
+      break;
+    }
+  }
+
+  tWorker = WorkerIdentity();
+}
+
+void
+ThreadPool::Join(JoinCounter &aCounter)
+{
+  while (aCounter.mPending.load()) {
+    if (RunOneJob()) {
+      continue;
+    }
+    // Our jobs are running elsewhere; sleep until one of them finishes the
+    // count, or until there is other work to help with
+    std::unique_lock<std::mutex> lock(mSleepLock);
+    mSleepers.fetch_add(1);
+    mSleepCondition.wait(lock, [this, &aCounter] {
+      return !aCounter.mPending.load() || mQueuedJobs.load();
+    });
+    mSleepers.fetch_sub(1);
+  }
+}
+
+} // namespace aspk
@@ -0,0 +1,243 @@
+#ifndef __ASPK_THREADPOOL_H
+#define __ASPK_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace aspk {
+
+// Work-stealing pool of worker threads. Each worker has its own deque: jobs
+// it submits go on the back and it takes them from the back, so recursive
+// fork/join work stays cache-warm, while idle workers steal from the front of
+// the others. Jobs from other threads go through a shared injection queue.
+// Jobs are a function pointer and a context, so submitting never allocates
+// once the deques have grown to their working size.
+//
+// Invoke and ParallelFor block until their work is done, with the calling
+// thread running pool jobs meanwhile, so they may be nested freely and
+// called from the UI thread. To keep the UI thread responsive instead, call
+// them inside RunInBackground; see UiTask.h. This class has no Win32
+// dependencies.
+class ThreadPool
+{
+public:
+  using JobFn = void (*)(void* aContext);
+
+  // 0 threads means one per hardware thread
+  explicit ThreadPool(size_t aThreadCount = 0);
+  // Shuts down
+  ~ThreadPool();
+
+  // Runs the jobs already queued, then joins the workers. Jobs submitted
+  // once it has begun run on the submitting thread. May race with Submit
+  // from other threads, but must not be called from a worker.
+  void Shutdown();
+
+  // Workers running; 0 once Shutdown has begun
+  size_t GetThreadCount() const
+  {
+    return mStopping.load(std::memory_order_acquire) ? 0 : mStartedThreads;
+  }
+  // Jobs taken from another worker's deque, for tuning grain sizes
+  uint64_t GetStealCount() const { return mStealCount.load(std::memory_order_relaxed); }
+
+  // Queues aFn(aContext). May be called from any thread.
+  void Submit(JobFn aFn, void* aContext);
+
+  // Runs aFirst and aSecond, potentially in parallel, and returns when both
+  // have. If either throws, one of the exceptions is rethrown.
+  template <typename First, typename Second>
+  void Invoke(First&& aFirst, Second&& aSecond);
+
+  // Calls aFn(begin, end) over subranges of [aBegin, aEnd) no longer than
+  // aGrain, in parallel, and returns when all have run. Subranges are handed
+  // out in order, so a worker's consecutive calls tend to be adjacent. If a
+  // call throws, the remaining subranges are skipped and the exception is
+  // rethrown.
+  template <typename Fn>
+  void ParallelFor(size_t aBegin, size_t aEnd, size_t aGrain, Fn&& aFn);
+
+  // The pool whose worker is the calling thread, if any
+  static ThreadPool* GetForCurrentThread();
+
+private:
+  struct Job
+  {
+    JobFn mFn;
+    void* mContext;
+  };
+
+  // A growable ring of jobs. Locked rather than lock-free: the owner and
+  // thieves rarely collide, and every operation is a few stores.
+  struct alignas(64) JobDeque
+  {
+    std::mutex        mLock;
+    std::vector<Job>  mRing;
+    size_t            mHead = 0;
+    size_t            mCount = 0;
+
+    void PushBack(Job const &aJob);
+    bool PopBack(Job &aJob);
+    bool PopFront(Job &aJob);
+  };
+
+  // Counts outstanding jobs of one Invoke or ParallelFor
+  struct JoinCounter
+  {
+    std::atomic<size_t>   mPending{0};
+    std::atomic<bool>     mFailed{false};
+    std::exception_ptr    mException;
+
+    void Fail(std::exception_ptr aException);
+  };
+
+  void WorkerMain(size_t aIndex);
+  // Finds a job for the calling thread: its own deque if it is our worker,
+  // then the injection queue, then the other workers' deques
+  bool TryTakeJob(Job &aJob);
+  bool RunOneJob();
+  // Runs jobs until aCounter reaches zero, sleeping when there are none
+  void Join(JoinCounter &aCounter);
+  // Called by the job that brings a counter to zero, after which the job
+  // must not touch the counter
+  void NotifyJoined();
+  void WakeSleepers(bool aAll);
+
+  template <typename Fn>
+  static void RunCounted(Fn &aFn, JoinCounter &aCounter);
+
+private:
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool& operator=(ThreadPool const &) = delete;
+
+private:
+  // One deque per worker slot. Fixed before any worker starts, since workers
+  // steal from every deque; a slot whose thread failed to start stays empty.
+  const size_t                              mThreadCount;
+  std::unique_ptr<JobDeque[]>               mDeques;
+  // Touched only by the constructor and Shutdown
+  std::vector<std::thread>                  mWorkers;
+  size_t                                    mStartedThreads;
+  JobDeque                                  mInjected;
+  // Jobs in any deque, or about to be pushed to one
+  std::atomic<size_t>                       mQueuedJobs;
+  std::atomic<uint64_t>                     mStealCount;
+  // Set when Shutdown begins, or if no worker could be started. Submit
+  // checks it rather than mWorkers.
+  std::atomic<bool>                         mStopping;
+  // Workers and joiners with nothing to run sleep here
+  std::mutex                                mSleepLock;
+  std::condition_variable                   mSleepCondition;
+  std::atomic<size_t>                       mSleepers;
+};
+
+template <typename Fn>
+/* static */ void
+ThreadPool::RunCounted(Fn &aFn, JoinCounter &aCounter)
+{
+  if (!aCounter.mFailed.load(std::memory_order_relaxed)) {
+    try {
+      aFn();
+    } catch (...) {
+      aCounter.Fail(std::current_exception());
+    }
+  }
+}
+
+template <typename First, typename Second>
+void
+ThreadPool::Invoke(First&& aFirst, Second&& aSecond)
+{
+  struct Forked
+  {
+    ThreadPool*                     mPool;
+    std::remove_reference_t<Second>* mFn;
+    JoinCounter                     mCounter;
+  };
+
+  Forked forked{this, &aSecond, {}};
+  forked.mCounter.mPending.store(1, std::memory_order_relaxed);
+  Submit([](void* aContext) {
+    Forked* self = static_cast<Forked*>(aContext);
+    ThreadPool* pool = self->mPool;
+    RunCounted(*self->mFn, self->mCounter);
+    if (self->mCounter.mPending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      pool->NotifyJoined();
+    }
+  }, &forked);
+
+  RunCounted(aFirst, forked.mCounter);
+  Join(forked.mCounter);
+  if (forked.mCounter.mException) {
+    std::rethrow_exception(forked.mCounter.mException);
+  }
+}
+
+template <typename Fn>
+void
+ThreadPool::ParallelFor(size_t aBegin, size_t aEnd, size_t aGrain, Fn&& aFn)
+{
+  if (aBegin >= aEnd) {
+    return;
+  }
+  aGrain = std::max<size_t>(aGrain, 1);
+  const size_t chunks = (aEnd - aBegin + aGrain - 1) / aGrain;
+
+  // Every helper, and the caller, claims chunks from a shared cursor until
+  // they run out, so an unlucky split cannot leave one thread with the tail
+  struct Range
+  {
+    ThreadPool*                 mPool;
+    std::remove_reference_t<Fn>* mFn;
+    std::atomic<size_t>         mNext;
+    size_t                      mEnd;
+    size_t                      mGrain;
+    JoinCounter                 mCounter;
+
+    void Drain()
+    {
+      for (;;) {
+        const size_t begin = mNext.fetch_add(mGrain, std::memory_order_relaxed);
+        if (begin >= mEnd || mCounter.mFailed.load(std::memory_order_relaxed)) {
+          return;
+        }
+        const size_t end = std::min<size_t>(mEnd, begin + mGrain);
+        auto call = [this, begin, end] { (*mFn)(begin, end); };
+        RunCounted(call, mCounter);
+      }
+    }
+  };
+
+  Range range{this, &aFn, {aBegin}, aEnd, aGrain, {}};
+  const size_t helpers = std::min<size_t>(chunks, GetThreadCount() + 1) - 1;
+  range.mCounter.mPending.store(helpers, std::memory_order_relaxed);
+  for (size_t i = 0; i < helpers; ++i) {
+    Submit([](void* aContext) {
+      Range* self = static_cast<Range*>(aContext);
+      ThreadPool* pool = self->mPool;
+      self->Drain();
+      if (self->mCounter.mPending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        pool->NotifyJoined();
+      }
+    }, &range);
+  }
+
+  range.Drain();
+  Join(range.mCounter);
+  if (range.mCounter.mException) {
+    std::rethrow_exception(range.mCounter.mException);
+  }
+}
+
+} // namespace aspk
+
+#endif // __ASPK_THREADPOOL_H
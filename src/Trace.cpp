@@ -0,0 +1,410 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace aspk {
+
+static_assert(std::endian::native == std::endian::little,
+              "The trace format assumes a little-endian host");
+
+namespace detail {
+
+// Single-producer ring of encoded records. The owning thread advances mHead;
+// flushes, usually by the writer thread, advance mTail under the trace lock.
+struct TraceThreadBuffer
+{
+  std::unique_ptr<uint8_t[]>  mData;
+  size_t                      mCapacity;  // Power of two
+  uint32_t                    mThreadId;
+  std::atomic<uint64_t>       mHead{0};
+  std::atomic<uint64_t>       mTail{0};
+  std::atomic<uint32_t>       mDropped{0};
+};
+
+} // namespace detail
+
+namespace {
+
+struct TraceSiteInfo
+{
+  std::wstring          mFormat;
+  std::vector<uint8_t>  mArgTypes;
+};
+
+struct TraceState
+{
+  ~TraceState();
+
+  // Serializes StartTrace and StopTrace, which start and join the writer
+  std::mutex                                              mControlLock;
+  std::mutex                                              mLock;
+  std::ofstream                                           mFile;
+  std::vector<TraceSiteInfo>                              mSites;
+  size_t                                                  mSitesWritten = 0;
+  std::vector<std::shared_ptr<detail::TraceThreadBuffer>> mBuffers;
+  size_t                                                  mBufferBytes = 256 * 1024;
+  uint32_t                                                mNextThreadId = 1;
+  std::vector<uint8_t>                                    mScratch;
+  // Events lost to full rings since StartTrace, as written to the file
+  uint64_t                                                mDroppedCount = 0;
+
+  // Drains the rings every kTraceFlushInterval, or sooner when asked
+  std::thread                                             mWriter;
+  std::condition_variable                                 mWriterWake;
+  bool                                                    mStopWriter = false;
+};
+
+TraceState&
+GetTraceState()
+{
+  static TraceState sState;
+  return sState;
+}
+
+std::atomic<int64_t> gTraceStartNs{0};
+
+// Set by a producer whose ring is half full, so the writer flushes early
+std::atomic<bool> gFlushWanted{false};
+
+constexpr std::chrono::milliseconds kTraceFlushInterval{50};
+
+int64_t
+GetNowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+void
+AppendRaw(std::vector<uint8_t> &aOut, T const &aValue)
+{
+  const size_t offset = aOut.size();
+  aOut.resize(offset + sizeof(T));
+  std::memcpy(aOut.data() + offset, &aValue, sizeof(T));
+}
+
+void
+AppendUtf16(std::vector<uint8_t> &aOut, std::wstring_view aText)
+{
+  if constexpr (sizeof(wchar_t) == sizeof(char16_t)) {
+    const size_t offset = aOut.size();
+    aOut.resize(offset + aText.size() * sizeof(char16_t));
+    std::memcpy(aOut.data() + offset, aText.data(),
+                aText.size() * sizeof(char16_t));
+  } else {
+    for (wchar_t ch : aText) {
+      uint32_t c = static_cast<uint32_t>(ch);
+      if (c >= 0x10000) {
+        c -= 0x10000;
+        AppendRaw(aOut, static_cast<char16_t>(0xD800 + (c >> 10)));
+        AppendRaw(aOut, static_cast<char16_t>(0xDC00 + (c & 0x3FF)));
+      } else {
+        AppendRaw(aOut, static_cast<char16_t>(c));
+      }
+    }
+  }
+}
+
+size_t
+CountUtf16(std::wstring_view aText)
+{
+  size_t count = aText.size();
+  if constexpr (sizeof(wchar_t) != sizeof(char16_t)) {
+    for (wchar_t ch : aText) {
+      if (static_cast<uint32_t>(ch) >= 0x10000) {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+void
+BeginRecord(std::vector<uint8_t> &aOut, TraceRecordKind aKind)
+{
+  aOut.clear();
+  TraceRecordHeader header = {0, static_cast<uint16_t>(aKind), 0};
+  AppendRaw(aOut, header);
+}
+
+void
+EndRecord(std::vector<uint8_t> &aOut)
+{
+  const uint32_t size = static_cast<uint32_t>(aOut.size());
+  std::memcpy(aOut.data(), &size, sizeof(size));
+}
+
+detail::TraceThreadBuffer&
+GetThreadBuffer()
+{
+  thread_local std::shared_ptr<detail::TraceThreadBuffer> sBuffer;
+  if (!sBuffer) {
+    TraceState& state = GetTraceState();
+    std::lock_guard<std::mutex> lock(state.mLock);
+    auto buffer = std::make_shared<detail::TraceThreadBuffer>();
+    buffer->mCapacity = state.mBufferBytes;
+    buffer->mData = std::make_unique<uint8_t[]>(buffer->mCapacity);
+    buffer->mThreadId = state.mNextThreadId++;
+    // The state keeps the buffer alive after the thread exits, until flushed
+    state.mBuffers.push_back(buffer);
+    sBuffer = std::move(buffer);
+  }
+  return *sBuffer;
+}
+
+// Copies [aBegin, aEnd) of a ring, which may wrap, to the file
+void
+WriteRing(std::ofstream &aFile, detail::TraceThreadBuffer const &aBuffer,
+          uint64_t aBegin, uint64_t aEnd)
+{
+  const size_t mask = aBuffer.mCapacity - 1;
+  while (aBegin < aEnd) {
+    const size_t offset = static_cast<size_t>(aBegin) & mask;
+    const size_t count = static_cast<size_t>(
+      std::min<uint64_t>(aEnd - aBegin, aBuffer.mCapacity - offset));
+    aFile.write(reinterpret_cast<char const *>(aBuffer.mData.get() + offset),
+                count);
+    aBegin += count;
+  }
+}
+
+// Must be called with the trace lock held
+void
+FlushLocked(TraceState &aState)
+{
+  if (!aState.mFile.is_open()) {
+    return;
+  }
+
+  // Snapshot the rings first. Any event in a snapshot registered its site
+  // before being appended, so writing the sites next keeps every site
+  // record ahead of its events.
+  std::vector<uint64_t> heads;
+  heads.reserve(aState.mBuffers.size());
+  for (auto const &buffer : aState.mBuffers) {
+    heads.push_back(buffer->mHead.load(std::memory_order_acquire));
+  }
+
+  std::vector<uint8_t>& record = aState.mScratch;
+  for (; aState.mSitesWritten < aState.mSites.size(); ++aState.mSitesWritten) {
+    TraceSiteInfo const &site = aState.mSites[aState.mSitesWritten];
+    BeginRecord(record, eTraceRecordSite);
+    AppendRaw(record, static_cast<uint32_t>(aState.mSitesWritten + 1));
+    AppendRaw(record, static_cast<uint16_t>(site.mArgTypes.size()));
+    AppendRaw(record, static_cast<uint16_t>(CountUtf16(site.mFormat)));
+    record.insert(record.end(), site.mArgTypes.begin(), site.mArgTypes.end());
+    AppendUtf16(record, site.mFormat);
+    EndRecord(record);
+    aState.mFile.write(reinterpret_cast<char const *>(record.data()),
+                       record.size());
+  }
+
+  for (size_t i = 0; i < aState.mBuffers.size(); ++i) {
+    detail::TraceThreadBuffer& buffer = *aState.mBuffers[i];
+    WriteRing(aState.mFile, buffer,
+              buffer.mTail.load(std::memory_order_relaxed), heads[i]);
+    buffer.mTail.store(heads[i], std::memory_order_release);
+
+    const uint32_t dropped = buffer.mDropped.exchange(0, std::memory_order_relaxed);
+    if (dropped) {
+      aState.mDroppedCount += dropped;
+      BeginRecord(record, eTraceRecordDropped);
+      AppendRaw(record, buffer.mThreadId);
+      AppendRaw(record, dropped);
+      EndRecord(record);
+      aState.mFile.write(reinterpret_cast<char const *>(record.data()),
+                         record.size());
+    }
+  }
+
+  aState.mFile.flush();
+}
+
+void
+RunWriter(TraceState &aState)
+{
+  std::unique_lock<std::mutex> lock(aState.mLock);
+  while (!aState.mStopWriter) {
+    aState.mWriterWake.wait_for(lock, kTraceFlushInterval, [&aState] {
+      return aState.mStopWriter ||
+             gFlushWanted.load(std::memory_order_relaxed);
+    });
+    gFlushWanted.store(false, std::memory_order_relaxed);
+    FlushLocked(aState);
+  }
+}
+
+// Must be called with the control lock held, but not the trace lock
+void
+StopWriter(TraceState &aState)
+{
+  if (!aState.mWriter.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(aState.mLock);
+    aState.mStopWriter = true;
+  }
+  aState.mWriterWake.notify_one();
+  aState.mWriter.join();
+  aState.mStopWriter = false;
+}
+
+TraceState::~TraceState()
+{
+  // A trace left running at exit still gets its tail written
+  StopWriter(*this);
+  FlushLocked(*this);
+}
+
+} // namespace
+
+namespace detail {
+
+uint32_t
+RegisterTraceSite(wchar_t const * aFormat, size_t aFormatLength,
+                  uint8_t const * aArgTypes, size_t aNumArgs)
+{
+  TraceState& state = GetTraceState();
+  std::lock_guard<std::mutex> lock(state.mLock);
+  state.mSites.push_back(TraceSiteInfo{
+    std::wstring(aFormat, aFormatLength),
+    std::vector<uint8_t>(aArgTypes, aArgTypes + aNumArgs)});
+  return static_cast<uint32_t>(state.mSites.size());
+}
+
+static std::vector<uint8_t>&
+GetThreadRecord()
+{
+  thread_local std::vector<uint8_t> sRecord;
+  return sRecord;
+}
+
+TraceEventWriter::TraceEventWriter(uint32_t aSiteId)
+  : mRecord(GetThreadRecord())
+{
+  BeginRecord(mRecord, eTraceRecordEvent);
+  WriteRaw(aSiteId);
+  WriteRaw(GetThreadBuffer().mThreadId);
+  WriteRaw(static_cast<uint64_t>(
+    GetNowNs() - gTraceStartNs.load(std::memory_order_relaxed)));
+}
+
+void
+TraceEventWriter::WriteString(std::wstring_view aText)
+{
+  WriteRaw(static_cast<uint32_t>(CountUtf16(aText)));
+  AppendUtf16(mRecord, aText);
+}
+
+void
+TraceEventWriter::Commit()
+{
+  EndRecord(mRecord);
+
+  TraceThreadBuffer& buffer = GetThreadBuffer();
+  const size_t size = mRecord.size();
+  const uint64_t head = buffer.mHead.load(std::memory_order_relaxed);
+  const uint64_t tail = buffer.mTail.load(std::memory_order_acquire);
+  if (size > buffer.mCapacity - (head - tail)) {
+    buffer.mDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const size_t offset = static_cast<size_t>(head) & (buffer.mCapacity - 1);
+  const size_t first = std::min(size, buffer.mCapacity - offset);
+  std::memcpy(buffer.mData.get() + offset, mRecord.data(), first);
+  std::memcpy(buffer.mData.get(), mRecord.data() + first, size - first);
+  buffer.mHead.store(head + size, std::memory_order_release);
+
+  // Wake the writer before the ring fills, rather than waiting out its
+  // interval. A wakeup lost to the race with its wait costs one interval.
+  if (head + size - tail > buffer.mCapacity / 2 &&
+      !gFlushWanted.load(std::memory_order_relaxed) &&
+      !gFlushWanted.exchange(true, std::memory_order_relaxed)) {
+    GetTraceState().mWriterWake.notify_one();
+  }
+}
+
+} // namespace detail
+
+bool
+StartTrace(std::filesystem::path const &aPath, size_t aThreadBufferBytes)
+{
+  TraceState& state = GetTraceState();
+  std::lock_guard<std::mutex> control(state.mControlLock);
+  StopWriter(state);
+  std::lock_guard<std::mutex> lock(state.mLock);
+
+  detail::gTracing.store(false, std::memory_order_relaxed);
+  FlushLocked(state);
+  state.mFile.close();
+
+  state.mFile.open(aPath, std::ios::binary | std::ios::trunc);
+  if (!state.mFile.is_open()) {
+    return false;
+  }
+
+  TraceFileHeader header = {};
+  std::memcpy(header.mMagic, kTraceMagic, sizeof(header.mMagic));
+  header.mVersion = kTraceVersion;
+  state.mFile.write(reinterpret_cast<char const *>(&header), sizeof(header));
+
+  // Sites are written again into each new file; stale events are discarded.
+  // Existing buffers keep their size; new threads get the requested one.
+  state.mSitesWritten = 0;
+  state.mDroppedCount = 0;
+  for (auto const &buffer : state.mBuffers) {
+    buffer->mTail.store(buffer->mHead.load(std::memory_order_acquire),
+                        std::memory_order_release);
+    buffer->mDropped.store(0, std::memory_order_relaxed);
+  }
+  state.mBufferBytes = std::bit_ceil(std::max<size_t>(aThreadBufferBytes, 4096));
+
+  gTraceStartNs.store(GetNowNs(), std::memory_order_relaxed);
+  detail::gTracing.store(true, std::memory_order_release);
+  state.mWriter = std::thread(RunWriter, std::ref(state));
+  return true;
+}
+
+void
+FlushTrace()
+{
+  TraceState& state = GetTraceState();
+  std::lock_guard<std::mutex> lock(state.mLock);
+  FlushLocked(state);
+}
+
+void
+StopTrace()
+{
+  TraceState& state = GetTraceState();
+  std::lock_guard<std::mutex> control(state.mControlLock);
+  detail::gTracing.store(false, std::memory_order_relaxed);
+  StopWriter(state);
+  std::lock_guard<std::mutex> lock(state.mLock);
+  FlushLocked(state);
+  state.mFile.close();
+}
+
+uint64_t
+GetTraceDroppedCount()
+{
+  TraceState& state = GetTraceState();
+  std::lock_guard<std::mutex> lock(state.mLock);
+  uint64_t count = state.mDroppedCount;
+  for (auto const &buffer : state.mBuffers) {
+    count += buffer->mDropped.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+} // namespace aspk
@@ -0,0 +1,173 @@
+#ifndef __ASPK_TRACE_H
+#define __ASPK_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "CompiledFormat.h"
+#include "TraceFormat.h"
+
+namespace aspk {
+
+// Binary tracing with deferred formatting. Trace<Fmt>(args...) records only
+// a compact event (site id, timestamp and raw argument bytes) in a buffer
+// owned by the calling thread; the text is produced later, offline, by
+// tools/tracedecode. This class has no Win32 dependencies.
+//
+// Each thread's buffer is a lock-free single-producer ring. A writer thread
+// drains every ring into the file every 50ms, and sooner once any ring is
+// half full, so an always-on trace keeps up without help from the app. If a
+// thread still outruns the writer its events are dropped and counted, and
+// the loss is noted in the trace, rather than blocking.
+
+// Begins writing a new trace to aPath. aThreadBufferBytes is rounded up to a
+// power of two. Returns false if the file could not be created.
+bool StartTrace(std::filesystem::path const &aPath,
+                size_t aThreadBufferBytes = 256 * 1024);
+
+// Writes everything buffered so far to the trace file, without waiting for
+// the writer thread. May be called from any thread.
+void FlushTrace();
+
+// Stops the writer thread, then flushes and closes the trace file
+void StopTrace();
+
+// Events dropped because a thread's buffer was full, since StartTrace
+uint64_t GetTraceDroppedCount();
+
+namespace detail {
+
+inline std::atomic<bool> gTracing{false};
+
+uint32_t RegisterTraceSite(wchar_t const * aFormat, size_t aFormatLength,
+                           uint8_t const * aArgTypes, size_t aNumArgs);
+
+// Encodes one event into a per-thread scratch buffer, then copies it into
+// the thread's ring on Commit.
+class TraceEventWriter
+{
+public:
+  explicit TraceEventWriter(uint32_t aSiteId);
+
+  template <typename T>
+  void
+  Write(T const &aArg)
+  {
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, wchar_t>) {
+      WriteRaw(static_cast<uint32_t>(aArg));
+    } else if constexpr (std::is_integral_v<U>) {
+      if constexpr (std::is_signed_v<U>) {
+        if constexpr (sizeof(U) <= 4) {
+          WriteRaw(static_cast<int32_t>(aArg));
+        } else {
+          WriteRaw(static_cast<int64_t>(aArg));
+        }
+      } else if constexpr (sizeof(U) <= 4) {
+        WriteRaw(static_cast<uint32_t>(aArg));
+      } else {
+        WriteRaw(static_cast<uint64_t>(aArg));
+      }
+    } else if constexpr (std::is_floating_point_v<U>) {
+      WriteRaw(static_cast<double>(aArg));
+    } else if constexpr (std::is_same_v<U, wchar_t*> ||
+                         std::is_same_v<U, wchar_t const *>) {
+      wchar_t const * str = aArg;
+      WriteString(str ? std::wstring_view(str) : std::wstring_view(L"(null)"));
+    } else if constexpr (std::is_same_v<U, std::wstring> ||
+                         std::is_same_v<U, std::wstring_view>) {
+      WriteString(aArg);
+    } else {
+      WriteRaw(static_cast<uint64_t>(
+        reinterpret_cast<uintptr_t>(static_cast<void const *>(aArg))));
+    }
+  }
+
+  void Commit();
+
+private:
+  template <typename T>
+  void
+  WriteRaw(T aValue)
+  {
+    const size_t offset = mRecord.size();
+    mRecord.resize(offset + sizeof(T));
+    std::memcpy(mRecord.data() + offset, &aValue, sizeof(T));
+  }
+
+  void WriteString(std::wstring_view aText);
+
+private:
+  std::vector<uint8_t>& mRecord;
+};
+
+template <typename T>
+constexpr uint8_t
+GetTraceArgType()
+{
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, wchar_t>) {
+    return eTraceArgChar;
+  } else if constexpr (std::is_integral_v<U>) {
+    if constexpr (std::is_signed_v<U>) {
+      return sizeof(U) <= 4 ? eTraceArgInt32 : eTraceArgInt64;
+    } else {
+      return sizeof(U) <= 4 ? eTraceArgUInt32 : eTraceArgUInt64;
+    }
+  } else if constexpr (std::is_floating_point_v<U>) {
+    return eTraceArgDouble;
+  } else if constexpr (std::is_same_v<U, wchar_t*> ||
+                       std::is_same_v<U, wchar_t const *> ||
+                       std::is_same_v<U, std::wstring> ||
+                       std::is_same_v<U, std::wstring_view>) {
+    return eTraceArgString;
+  } else {
+    return eTraceArgPointer;
+  }
+}
+
+} // namespace detail
+
+inline bool
+IsTracing()
+{
+  return detail::gTracing.load(std::memory_order_relaxed);
+}
+
+// Records an event with a printf-style format, checked at compile time just
+// like Printf<Fmt>. The format and argument types are registered once per
+// distinct format; each call then costs a few stores into a thread-local
+// buffer. When no trace is running the call is a single relaxed load.
+template <FixedFormat Fmt, typename... Args>
+inline void
+Trace(Args const &... aArgs)
+{
+  static_assert(CompiledFormat<Fmt, Args...>::kNumColumns > 0,
+                "Invalid trace format");
+
+  if (!IsTracing()) {
+    return;
+  }
+
+  static constexpr uint8_t kArgTypes[] = {
+    detail::GetTraceArgType<Args>()..., 0
+  };
+  static const uint32_t sSiteId =
+    detail::RegisterTraceSite(Fmt.mText, Fmt.size(), kArgTypes,
+                              sizeof...(Args));
+
+  detail::TraceEventWriter writer(sSiteId);
+  (writer.Write(aArgs), ...);
+  writer.Commit();
+}
+
+} // namespace aspk
+
+#endif // __ASPK_TRACE_H
@@ -0,0 +1,67 @@
+#ifndef __ASPK_TRACEFORMAT_H
+#define __ASPK_TRACEFORMAT_H
+
+#include <cstdint>
+
+namespace aspk {
+
+// On-disk layout of binary trace files, shared by the writer (Trace.cpp) and
+// the offline decoder (tools/tracedecode.cpp). A file is a TraceFileHeader
+// followed by records, each starting with a TraceRecordHeader. Integers are
+// little-endian and text is UTF-16, so traces written on Windows decode
+// anywhere. Nothing is aligned; readers must memcpy.
+//
+// Site record payload:
+//   uint32 site id, uint16 argument count, uint16 format length in code
+//   units, one TraceArgType byte per argument, then the format text.
+//
+// Event record payload:
+//   uint32 site id, uint32 thread id, uint64 nanoseconds since the trace
+//   started, then each argument in the encoding given by its TraceArgType.
+//   Strings are a uint32 length in code units followed by the text.
+//
+// Dropped record payload:
+//   uint32 thread id, uint32 number of events lost since the last flush
+//   because that thread's buffer was full.
+//
+// A site record always precedes the first event that refers to it.
+
+constexpr char kTraceMagic[8] = {'A', 'S', 'P', 'K', 'T', 'R', 'C', '\0'};
+constexpr uint32_t kTraceVersion = 1;
+
+struct TraceFileHeader
+{
+  char      mMagic[8];
+  uint32_t  mVersion;
+  uint32_t  mReserved;
+};
+
+enum TraceRecordKind : uint16_t
+{
+  eTraceRecordSite = 1,
+  eTraceRecordEvent = 2,
+  eTraceRecordDropped = 3
+};
+
+struct TraceRecordHeader
+{
+  uint32_t  mSize;  // Including this header
+  uint16_t  mKind;
+  uint16_t  mReserved;
+};
+
+enum TraceArgType : uint8_t
+{
+  eTraceArgInt32 = 1,
+  eTraceArgInt64,
+  eTraceArgUInt32,
+  eTraceArgUInt64,
+  eTraceArgDouble,
+  eTraceArgChar,    // uint32 code unit
+  eTraceArgPointer, // uint64
+  eTraceArgString
+};
+
+} // namespace aspk
+
+#endif // __ASPK_TRACEFORMAT_H
@@ -0,0 +1,271 @@
+#include "UiTask.h"
+
+#include "Log.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <system_error>
+#include <thread>
+#endif
+
+#include <array>
+#include <new>
+
+namespace aspk {
+
+namespace {
+
+constexpr size_t kNumSizeClasses =
+  detail::kMaxPooledFrameSize / detail::kFrameGranularity;
+// Frames kept per size class; enough for the tasks of a busy window
+constexpr size_t kMaxCachedFrames = 64;
+
+// Per-thread freelists of coroutine frames. No locking: frames are allocated
+// by the scheduler's thread, and mostly freed there too.
+class FramePool
+{
+public:
+  FramePool()
+    : mFree{}
+    , mCount{}
+  {
+  }
+
+  ~FramePool()
+  {
+    for (FreeFrame* frame : mFree) {
+      while (frame) {
+        FreeFrame* next = frame->mNext;
+        ::operator delete(frame);
+        frame = next;
+      }
+    }
+  }
+
+  void* Allocate(size_t aSize)
+  {
+    const size_t sizeClass = (aSize - 1) / detail::kFrameGranularity;
+    if (FreeFrame* frame = mFree[sizeClass]) {
+      mFree[sizeClass] = frame->mNext;
+      --mCount[sizeClass];
+      return frame;
+    }
+    return ::operator new((sizeClass + 1) * detail::kFrameGranularity);
+  }
+
+  void Free(void* aFrame, size_t aSize)
+  {
+    const size_t sizeClass = (aSize - 1) / detail::kFrameGranularity;
+    if (mCount[sizeClass] == kMaxCachedFrames) {
+      ::operator delete(aFrame);
+      return;
+    }
+    FreeFrame* frame = static_cast<FreeFrame*>(aFrame);
+    frame->mNext = mFree[sizeClass];
+    mFree[sizeClass] = frame;
+    ++mCount[sizeClass];
+  }
+
+private:
+  struct FreeFrame
+  {
+    FreeFrame* mNext;
+  };
+
+private:
+  std::array<FreeFrame*, kNumSizeClasses> mFree;
+  std::array<size_t, kNumSizeClasses>     mCount;
+};
+
+thread_local FramePool tFramePool;
+
+#ifdef _WIN32
+void CALLBACK
+RunPoolWork(PTP_CALLBACK_INSTANCE, void* aContext)
+{
+  static_cast<BackgroundWork*>(aContext)->Run();
+}
+
+void
+SubmitToSystemPool(BackgroundWork* aWork)
+{
+  if (!::TrySubmitThreadpoolCallback(&RunPoolWork, aWork, nullptr)) {
+    // Still resumes through the queue, just later than hoped
+    Log<eLogWarning>(L"TrySubmitThreadpoolCallback failed: ", ::GetLastError());
+    aWork->Run();
+  }
+}
+#else
+void
+SubmitToThread(BackgroundWork* aWork)
+{
+  try {
+    std::thread([aWork] { aWork->Run(); }).detach();
+  } catch (std::system_error const &e) {
+    Log<eLogWarning>(L"Background thread failed to start: ", e.what());
+    aWork->Run();
+  }
+}
+#endif
+
+} // anonymous namespace
+
+namespace detail {
+
+void*
+AllocateTaskFrame(size_t aSize)
+{
+  if (aSize > kMaxPooledFrameSize) {
+    return ::operator new(aSize);
+  }
+  return tFramePool.Allocate(aSize);
+}
+
+void
+FreeTaskFrame(void* aFrame, size_t aSize)
+{
+  if (aSize > kMaxPooledFrameSize) {
+    ::operator delete(aFrame);
+    return;
+  }
+  tFramePool.Free(aFrame, aSize);
+}
+
+} // namespace detail
+
+void
+UiTask::promise_type::unhandled_exception()
+{
+  // Nobody awaits a UiTask, so there is nowhere to rethrow to
+  try {
+    throw;
+  } catch (std::exception const &e) {
+    Log<eLogError>(L"UiTask failed: ", e.what());
+  } catch (...) {
+    Log<eLogError>(L"UiTask failed with an unknown exception");
+  }
+}
+
+TaskScheduler::TaskScheduler(std::function<void()> aWake)
+  : mWake(std::move(aWake))
+#ifdef _WIN32
+  , mExecutor(&SubmitToSystemPool)
+#else
+  , mExecutor(&SubmitToThread)
+#endif
+  , mInFlight(0)
+{
+}
+
+TaskScheduler::~TaskScheduler()
+{
+  {
+    std::unique_lock<std::mutex> lock(mInFlightMutex);
+    mInFlightDone.wait(lock, [this] { return mInFlight == 0; });
+  }
+
+  // Destroying a frame may queue nothing new: every awaitable that could post
+  // is either queued already or has been destroyed along with its frame
+  while (detail::ResumeRequest* request = mQueue.PopNode()) {
+    request->mHandle.destroy();
+  }
+}
+
+size_t
+TaskScheduler::GetInFlightCount() const
+{
+  std::lock_guard<std::mutex> lock(mInFlightMutex);
+  return mInFlight;
+}
+
+size_t
+TaskScheduler::RunPending()
+{
+  // Only what was queued on entry, so that tasks which requeue themselves
+  // (YieldToUi) let the message loop in between
+  const size_t budget = mQueue.GetDepth();
+  size_t handled = 0;
+  while (handled < budget) {
+    detail::ResumeRequest* request = mQueue.PopNode();
+    if (!request) {
+      break;
+    }
+    ++handled;
+    // The request lives in the frame, which resuming or destroying may free
+    std::coroutine_handle<> handle = request->mHandle;
+    if (request->mScope->mCancelled.load(std::memory_order_acquire)) {
+      handle.destroy();
+    } else {
+      handle.resume();
+    }
+  }
+
+  // Whatever is left, including pushes that were midway when Pop gave up,
+  // will not wake us again by itself
+  if (mQueue.GetDepth()) {
+    mWake();
+  }
+  return handled;
+}
+
+void
+TaskScheduler::Submit(BackgroundWork* aWork)
+{
+  {
+    std::lock_guard<std::mutex> lock(mInFlightMutex);
+    ++mInFlight;
+  }
+  mExecutor(aWork);
+}
+
+void
+TaskScheduler::CompleteWork(BackgroundWork* aWork)
+{
+  Post(aWork);
+  std::lock_guard<std::mutex> lock(mInFlightMutex);
+  if (!--mInFlight) {
+    mInFlightDone.notify_all();
+  }
+}
+
+void
+TaskScheduler::Post(detail::ResumeRequest* aRequest)
+{
+  if (mQueue.PushNode(aRequest)) {
+    mWake();
+  }
+}
+
+TaskScope::TaskScope(TaskScheduler& aScheduler)
+  : mState(std::make_shared<detail::TaskScopeState>())
+{
+  mState->mScheduler = &aScheduler;
+  mState->mCancelled.store(false, std::memory_order_relaxed);
+}
+
+TaskScope::~TaskScope()
+{
+  Cancel();
+}
+
+bool
+TaskScope::Spawn(UiTask aTask)
+{
+  if (IsCancelled()) {
+    return false;
+  }
+  std::coroutine_handle<UiTask::promise_type> handle =
+    std::exchange(aTask.mHandle, nullptr);
+  handle.promise().mScope = mState;
+  handle.resume();
+  return true;
+}
+
+void
+TaskScope::Cancel()
+{
+  mState->mCancelled.store(true, std::memory_order_release);
+}
+
+} // namespace aspk
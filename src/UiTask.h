@@ -0,0 +1,309 @@
+#ifndef __ASPK_UITASK_H
+#define __ASPK_UITASK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "MpscQueue.h"
+
+namespace aspk {
+
+// Coroutines that run on a UI thread and hop to background threads for slow
+// work, e.g.
+//
+//   UiTask MyWindow::LoadFile(std::filesystem::path aPath)
+//   {
+//     std::string data = co_await RunInBackground([aPath] {
+//       return ReadWholeFile(aPath);
+//     });
+//     Printf(L"%zu bytes\n", data.size());  // Back on the UI thread
+//   }
+//
+//   window.Spawn(window.LoadFile(path));
+//
+// A task starts when spawned into a TaskScope and runs on the spawning
+// thread until its first co_await. Every resumption is queued to the scope's
+// TaskScheduler and run from its owner's message loop. Cancelling the scope
+// (GlassWindow does so in OnDestroy) destroys its suspended tasks instead of
+// resuming them; background work already started still runs to completion,
+// but its result is dropped.
+//
+// Coroutine frames come from a per-thread pool and queue nodes live inside
+// the frames, so a task that is spawned and resumed repeatedly does not touch
+// the heap in steady state. This header has no Win32 dependencies.
+
+class TaskScheduler;
+class TaskScope;
+class UiTask;
+
+namespace detail {
+
+// Pooled storage for coroutine frames, in kFrameGranularity size classes up
+// to kMaxPooledFrameSize. Larger frames go straight to operator new. Frames
+// may be freed on any thread, but are cached by the freeing thread.
+void* AllocateTaskFrame(size_t aSize);
+void FreeTaskFrame(void* aFrame, size_t aSize);
+
+constexpr size_t kFrameGranularity = 64;
+constexpr size_t kMaxPooledFrameSize = 2048;
+
+struct TaskScopeState
+{
+  TaskScheduler*    mScheduler;
+  std::atomic<bool> mCancelled;
+};
+
+// A suspended coroutine waiting for its turn on the scheduler's thread
+struct ResumeRequest : public MpscNode
+{
+  std::coroutine_handle<> mHandle;
+  TaskScopeState*         mScope = nullptr;
+};
+
+} // namespace detail
+
+// A unit of background work. Executors call Run exactly once, from any thread.
+struct BackgroundWork : public detail::ResumeRequest
+{
+  void (*mRun)(BackgroundWork* aWork) = nullptr;
+
+  void Run() { mRun(this); }
+};
+
+// Runs BackgroundWork off the UI thread. Must not block on the UI thread.
+using BackgroundExecutor = std::function<void(BackgroundWork* aWork)>;
+
+// The return type of a UI coroutine. Holds the coroutine until it is spawned;
+// from then on the coroutine owns itself and frees its frame when it finishes
+// or is cancelled.
+class UiTask
+{
+public:
+  struct promise_type
+  {
+    std::shared_ptr<detail::TaskScopeState> mScope;
+
+    UiTask get_return_object()
+    {
+      return UiTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception();
+
+    static void* operator new(size_t aSize)
+    {
+      return detail::AllocateTaskFrame(aSize);
+    }
+    static void operator delete(void* aFrame, size_t aSize)
+    {
+      detail::FreeTaskFrame(aFrame, aSize);
+    }
+  };
+
+  UiTask(UiTask&& aOther) noexcept
+    : mHandle(std::exchange(aOther.mHandle, nullptr))
+  {
+  }
+
+  ~UiTask()
+  {
+    // Never spawned, so still parked at initial_suspend
+    if (mHandle) {
+      mHandle.destroy();
+    }
+  }
+
+private:
+  explicit UiTask(std::coroutine_handle<promise_type> aHandle)
+    : mHandle(aHandle)
+  {
+  }
+
+private:
+  UiTask(UiTask const &) = delete;
+  UiTask& operator=(UiTask const &) = delete;
+  UiTask& operator=(UiTask&&) = delete;
+
+private:
+  friend class TaskScope;
+  std::coroutine_handle<promise_type> mHandle;
+};
+
+// Queues coroutine resumptions for the thread that owns it. aWake is called,
+// from any thread, when the queue goes from empty to non-empty; the owner
+// responds by calling RunPending on its own thread. On Windows GlassWindowApp
+// owns one and wakes through an event in its message loop; tests can drive
+// one with a fake pump.
+class TaskScheduler
+{
+public:
+  explicit TaskScheduler(std::function<void()> aWake);
+  // Waits for outstanding background work, then destroys every task still
+  // queued. Scopes must not be used afterwards.
+  ~TaskScheduler();
+
+  // Resumes or, if their scope has been cancelled, destroys the queued tasks.
+  // Returns how many were handled.
+  size_t RunPending();
+  size_t GetPendingCount() const { return mQueue.GetDepth(); }
+  size_t GetPendingHighWaterMark() const { return mQueue.GetHighWaterMark(); }
+  size_t GetInFlightCount() const;
+
+  // Replaces the default executor, the system thread pool on Windows and a
+  // thread per item elsewhere. GlassWindowApp substitutes its ThreadPool.
+  void SetBackgroundExecutor(BackgroundExecutor aExecutor) { mExecutor = std::move(aExecutor); }
+
+  // For awaitables: Submit hands aWork to the executor, and the work calls
+  // CompleteWork with itself as its very last action, after which it must not
+  // be touched. Post queues aRequest from any thread.
+  void Submit(BackgroundWork* aWork);
+  void CompleteWork(BackgroundWork* aWork);
+  void Post(detail::ResumeRequest* aRequest);
+
+private:
+  TaskScheduler(TaskScheduler const &) = delete;
+  TaskScheduler& operator=(TaskScheduler const &) = delete;
+
+private:
+  std::function<void()>               mWake;
+  BackgroundExecutor                  mExecutor;
+  MpscQueue<detail::ResumeRequest>    mQueue;
+  // Background work that has yet to call CompleteWork. A mutex rather than an
+  // atomic, so that the last completion is done with us before the destructor
+  // can return.
+  mutable std::mutex                  mInFlightMutex;
+  std::condition_variable             mInFlightDone;
+  size_t                              mInFlight;
+};
+
+// The tasks of one owner, typically a window. Cancelling the scope, or
+// destroying it, stops each task at its next resumption.
+class TaskScope
+{
+public:
+  explicit TaskScope(TaskScheduler& aScheduler);
+  ~TaskScope();
+
+  // Starts aTask on the calling thread, which must be the scheduler's.
+  // Returns false, destroying the task unstarted, if the scope is cancelled.
+  bool Spawn(UiTask aTask);
+  void Cancel();
+  bool IsCancelled() const { return mState->mCancelled.load(std::memory_order_acquire); }
+
+  TaskScheduler& GetScheduler() const { return *mState->mScheduler; }
+
+private:
+  TaskScope(TaskScope const &) = delete;
+  TaskScope& operator=(TaskScope const &) = delete;
+
+private:
+  // Shared with the promise of every task spawned here, which may outlive us
+  std::shared_ptr<detail::TaskScopeState> mState;
+};
+
+// Awaitable returned by RunInBackground
+template <typename Fn>
+class BackgroundAwaiter : private BackgroundWork
+{
+  using Result = std::invoke_result_t<Fn&>;
+  using Storage = std::conditional_t<std::is_void_v<Result>, bool,
+                                     std::optional<Result>>;
+
+public:
+  explicit BackgroundAwaiter(Fn aFn)
+    : mFn(std::move(aFn))
+    , mResult()
+  {
+    mRun = &RunWork;
+  }
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<UiTask::promise_type> aHandle)
+  {
+    mHandle = aHandle;
+    mScope = aHandle.promise().mScope.get();
+    mScope->mScheduler->Submit(this);
+  }
+
+  Result await_resume()
+  {
+    if (mException) {
+      std::rethrow_exception(mException);
+    }
+    if constexpr (!std::is_void_v<Result>) {
+      return std::move(*mResult);
+    }
+  }
+
+private:
+  static void RunWork(BackgroundWork* aWork)
+  {
+    auto* self = static_cast<BackgroundAwaiter*>(aWork);
+    try {
+      if constexpr (std::is_void_v<Result>) {
+        self->mFn();
+      } else {
+        self->mResult.emplace(self->mFn());
+      }
+    } catch (...) {
+      self->mException = std::current_exception();
+    }
+    // Once posted, the UI thread may resume or destroy the frame we live in
+    self->mScope->mScheduler->CompleteWork(self);
+  }
+
+private:
+  Fn                  mFn;
+  Storage             mResult;
+  std::exception_ptr  mException;
+};
+
+// Runs aFn on the scheduler's background executor and resumes the awaiting
+// task on the UI thread with its result. Exceptions thrown by aFn are
+// rethrown by the co_await. Only awaitable from a UiTask.
+template <typename Fn>
+BackgroundAwaiter<std::decay_t<Fn>>
+RunInBackground(Fn&& aFn)
+{
+  return BackgroundAwaiter<std::decay_t<Fn>>(std::forward<Fn>(aFn));
+}
+
+// Awaitable returned by YieldToUi
+class YieldAwaiter : private detail::ResumeRequest
+{
+public:
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<UiTask::promise_type> aHandle)
+  {
+    mHandle = aHandle;
+    mScope = aHandle.promise().mScope.get();
+    mScope->mScheduler->Post(this);
+  }
+
+  void await_resume() const noexcept {}
+};
+
+// Requeues the task behind other pending work, so that long UI-thread loops
+// can let input through and notice cancellation
+inline YieldAwaiter
+YieldToUi()
+{
+  return YieldAwaiter();
+}
+
+} // namespace aspk
+
+#endif // __ASPK_UITASK_H
@@ -1,9 +1,93 @@
 #include "GlassWindow.h"
 #include "GlassWindowApp.h"
+#include "Log.h"
+
+#include <cwchar>
+#include <cwctype>
+#include <memory>
+#include <vector>
 
 using namespace std;
 using namespace aspk;
 
+static void
+PumpPendingMessages()
+{
+  MSG msg;
+  while (::PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+    ::TranslateMessage(&msg);
+    ::DispatchMessageW(&msg);
+  }
+}
+
+// Opens and closes aCount windows in waves, alternating between window class
+// variants, and checks that the process's GDI and USER object counts end
+// where they started. Returns the process exit code.
+static int
+RunWindowStress(HINSTANCE aInstance, int aCount)
+{
+  const int kWaveSize = 25;
+  HANDLE process = ::GetCurrentProcess();
+
+  auto openWave = [aInstance](int aNumWindows, int aFirstId) {
+    vector<unique_ptr<GlassWindow>> windows;
+    for (int i = 0; i < aNumWindows; ++i) {
+      GlassWindow::Params params;
+      params.SetTitleText(L"Stress");
+      params.SetSize(320, 240);
+      // Not eQuitOnDestroy, or the first close would end the test
+      unsigned int flags = GlassWindow::Params::eSolidGlass;
+      if (i % 2) {
+        flags |= GlassWindow::Params::eVisualDebug;
+      }
+      params.SetFlags(flags);
+
+      auto window = make_unique<GlassWindow>(aInstance, params);
+      if (!*window) {
+        break;
+      }
+      window->Show(SW_SHOWNOACTIVATE);
+      window->Printf(L"Window %d\n", aFirstId + i);
+      window->Update();
+      windows.push_back(std::move(window));
+    }
+    PumpPendingMessages();
+    return windows;
+  };
+
+  // Process-wide objects created on first use, such as theme data, belong in
+  // the baseline
+  if (openWave(2, 0).size() != 2) {
+    Log<eLogError>(L"Stress: could not create the warm-up windows");
+    return 1;
+  }
+  PumpPendingMessages();
+
+  const DWORD gdiBefore = ::GetGuiResources(process, GR_GDIOBJECTS);
+  const DWORD userBefore = ::GetGuiResources(process, GR_USEROBJECTS);
+
+  for (int opened = 0; opened < aCount; opened += kWaveSize) {
+    const int waveSize = min(kWaveSize, aCount - opened);
+    if (openWave(waveSize, opened).size() != static_cast<size_t>(waveSize)) {
+      Log<eLogError>(L"Stress: window creation failed after ", opened,
+                     L" windows");
+      return 1;
+    }
+    PumpPendingMessages();
+  }
+
+  const DWORD gdiAfter = ::GetGuiResources(process, GR_GDIOBJECTS);
+  const DWORD userAfter = ::GetGuiResources(process, GR_USEROBJECTS);
+  Log<eLogInfo>(L"Stress: ", aCount, L" windows; GDI objects ", gdiBefore,
+                L" -> ", gdiAfter, L", USER objects ", userBefore, L" -> ",
+                userAfter);
+  if (gdiAfter > gdiBefore || userAfter > userBefore) {
+    Log<eLogError>(L"Stress: GDI or USER objects leaked");
+    return 1;
+  }
+  return 0;
+}
+
 int CALLBACK
 wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLine,
          int nCmdShow)
@@ -14,6 +98,27 @@ wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLine,
     return 1;
   }
 
+  // glass.exe /stress-windows [count [log file]]
+  // The build runs this after linking, so a handle leak fails the build.
+  static const wchar_t kStressSwitch[] = L"/stress-windows";
+  const size_t switchLength = wcslen(kStressSwitch);
+  if (lpCmdLine && !wcsncmp(lpCmdLine, kStressSwitch, switchLength) &&
+      (!lpCmdLine[switchLength] || iswspace(lpCmdLine[switchLength]))) {
+    wchar_t* rest = nullptr;
+    long count = wcstol(lpCmdLine + switchLength, &rest, 10);
+    while (iswspace(*rest)) {
+      ++rest;
+    }
+    if (*rest) {
+      auto logSink = make_shared<FileLogSink>(rest);
+      if (!*logSink) {
+        return 1;
+      }
+      AddLogSink(logSink);
+    }
+    return RunWindowStress(hInstance, count > 0 ? static_cast<int>(count) : 500);
+  }
+
   GlassWindow::Params params;
   params.SetTitleText(L"Scratch Program");
   params.SetFlags(GlassWindow::Params::eDefaultFlags);
@@ -24,4 +129,3 @@ wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLine,
 
   return app.Run();
 }
-
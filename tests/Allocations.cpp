@@ -0,0 +1,63 @@
+// Replaces the global allocator with one that counts, in a translation unit
+// of its own so that no inlined container code sees both definitions.
+
+#include "Test.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> gAllocationCount{0};
+
+// Counted so that tests can check that hot paths do not allocate
+void*
+operator new(size_t aSize)
+{
+  gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(aSize ? aSize : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void*
+operator new[](size_t aSize)
+{
+  return operator new(aSize);
+}
+
+void
+operator delete(void* aPtr) noexcept
+{
+  std::free(aPtr);
+}
+
+void
+operator delete[](void* aPtr) noexcept
+{
+  std::free(aPtr);
+}
+
+void
+operator delete(void* aPtr, size_t) noexcept
+{
+  std::free(aPtr);
+}
+
+void
+operator delete[](void* aPtr, size_t) noexcept
+{
+  std::free(aPtr);
+}
+
+namespace aspk {
+namespace test {
+
+uint64_t
+GetAllocationCount()
+{
+  return gAllocationCount.load(std::memory_order_relaxed);
+}
+
+} // namespace test
+} // namespace aspk
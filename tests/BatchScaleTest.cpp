@@ -0,0 +1,187 @@
+#include "Test.h"
+
+#include "BatchScale.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace aspk;
+
+namespace {
+
+using ScaleFn = void (*)(int*, size_t, size_t, ScaleRatio const &,
+                         ScaleRatio const &);
+
+// The largest magnitude that Apply scales exactly:
+// |value| * mNumerator + mDenominator / 2 < 2^31
+int
+GetExactLimit(ScaleRatio const &aRatio)
+{
+  const uint64_t limit =
+    ((uint64_t(1) << 31) - 1 - aRatio.mDenominator / 2) / aRatio.mNumerator;
+  return static_cast<int>(limit);
+}
+
+// round(aValue * to / from), halves away from zero, in 64 bits
+int
+ScaleExactly(int aValue, ScaleRatio const &aRatio)
+{
+  const int64_t magnitude = std::llabs(aValue);
+  const int64_t scaled = (magnitude * aRatio.mNumerator +
+                          aRatio.mDenominator / 2) / aRatio.mDenominator;
+  return static_cast<int>(aValue < 0 ? -scaled : scaled);
+}
+
+// Scales the same points and rects with the scalar and SSE2 kernels. X
+// coordinates take aValues with aX; y coordinates take them negated with aY,
+// so a mix-up between lanes shows. Rects are one pixel wide, so their
+// exclusive edges are scaled from the same values.
+bool
+KernelsAgree(std::vector<int> const &aValues, ScaleRatio const &aX,
+             ScaleRatio const &aY)
+{
+  const size_t count = aValues.size();
+  std::vector<int> points(count * 2);
+  std::vector<int> rects(count * 4);
+  for (size_t i = 0; i < count; ++i) {
+    points[i * 2] = aValues[i];
+    points[i * 2 + 1] = -aValues[i];
+    rects[i * 4] = aValues[i];
+    rects[i * 4 + 1] = -aValues[i];
+    rects[i * 4 + 2] = aValues[i] + 1;
+    rects[i * 4 + 3] = -aValues[i] + 1;
+  }
+
+  std::vector<int> scalarPoints(points);
+  std::vector<int> scalarRects(rects);
+  detail::ScalePointsScalar(scalarPoints.data(), 2 * sizeof(int), count, aX, aY);
+  detail::ScaleRectsScalar(scalarRects.data(), 4 * sizeof(int), count, aX, aY);
+
+  bool agree = true;
+  for (size_t i = 0; i < count; ++i) {
+    const int x = ScaleExactly(aValues[i], aX);
+    const int y = ScaleExactly(-aValues[i], aY);
+    agree &= scalarPoints[i * 2] == x && scalarPoints[i * 2 + 1] == y;
+    agree &= scalarRects[i * 4] == x && scalarRects[i * 4 + 1] == y &&
+             scalarRects[i * 4 + 2] == x + 1 &&
+             scalarRects[i * 4 + 3] == y + 1;
+  }
+
+#if defined(ASPK_HAVE_X86_SCALE)
+  detail::ScalePointsSse2(points.data(), 2 * sizeof(int), count, aX, aY);
+  detail::ScaleRectsSse2(rects.data(), 4 * sizeof(int), count, aX, aY);
+  agree &= points == scalarPoints && rects == scalarRects;
+#endif
+  return agree;
+}
+
+// Values spread over the whole exact range of both ratios, plus every value
+// near zero, near the limits and around a rounding boundary
+std::vector<int>
+GetSampleValues(ScaleRatio const &aX, ScaleRatio const &aY, int aStep)
+{
+  const int limit = std::min(GetExactLimit(aX), GetExactLimit(aY));
+  std::vector<int> values;
+  for (int v = -limit; v <= limit - aStep; v += aStep) {
+    values.push_back(v);
+  }
+  const int windows[] = {-64, limit - 128, -limit, limit / 2, -limit / 2};
+  for (int first : windows) {
+    for (int i = 0; i <= 128; ++i) {
+      values.push_back(first + i);
+    }
+  }
+  return values;
+}
+
+} // anonymous namespace
+
+ASPK_TEST("BatchScale/StandardRatios")
+{
+  // Every pair of Windows scale steps, sampled across the exact range
+  bool agree = true;
+  for (int from : kStandardScalePercents) {
+    for (int to : kStandardScalePercents) {
+      const ScaleRatio x = GetScaleRatio(from, to);
+      const ScaleRatio y = GetScaleRatio(to, from);
+      agree &= KernelsAgree(GetSampleValues(x, y, 9973), x, y);
+    }
+  }
+  ASPK_CHECK(agree);
+}
+
+ASPK_TEST("BatchScale/OtherRatios")
+{
+  // Scales that are not Windows steps, including reductions to large
+  // denominators
+  bool agree = true;
+  for (int from = 1; from <= 600; from += 23) {
+    for (int to = 1; to <= 600; to += 29) {
+      const ScaleRatio x = GetScaleRatio(from, to);
+      const ScaleRatio y = GetScaleRatio(to + 1, from);
+      agree &= KernelsAgree(GetSampleValues(x, y, 1000003), x, y);
+    }
+  }
+  ASPK_CHECK(agree);
+}
+
+ASPK_TEST("BatchScale/FullRange")
+{
+  // Every value in the exact range, for a ratio whose reduced denominator
+  // leaves halves to round (175% <-> 150%). That is some 600 million values,
+  // so by default this takes every 101st; --exhaustive=1 takes them all.
+  const ScaleRatio x = GetScaleRatio(175, 150);
+  const ScaleRatio y = GetScaleRatio(150, 175);
+  const int limit = std::min(GetExactLimit(x), GetExactLimit(y));
+  const int64_t step = test::GetOption("exhaustive").empty() ? 101 : 1;
+
+  const size_t kChunk = 1 << 16;
+  std::vector<int> values;
+  values.reserve(kChunk);
+  bool agree = true;
+  for (int64_t v = -limit; v <= limit && agree; v += step) {
+    values.push_back(static_cast<int>(v));
+    if (values.size() == kChunk || v + step > limit) {
+      agree &= KernelsAgree(values, x, y);
+      values.clear();
+    }
+  }
+  ASPK_CHECK(agree);
+}
+
+ASPK_TEST("BatchScale/StridesAndTails")
+{
+  // Values embedded in larger structs, at every count around the two-point
+  // SSE2 step; the bytes between values must survive
+  const ScaleRatio x = GetScaleRatio(100, 125);
+  const ScaleRatio y = GetScaleRatio(100, 175);
+  const int kGuard = 0x5A5A5A5A;
+
+  for (size_t ints : {size_t(2), size_t(4)}) {
+    const ScaleFn scalar = ints == 2 ? &detail::ScalePointsScalar :
+                                       &detail::ScaleRectsScalar;
+    std::vector<ScaleFn> kernels = {ints == 2 ? &ScalePoints : &ScaleRects};
+#if defined(ASPK_HAVE_X86_SCALE)
+    kernels.push_back(ints == 2 ? &detail::ScalePointsSse2 :
+                                  &detail::ScaleRectsSse2);
+#endif
+    const size_t strideInts = ints + 1;
+    for (size_t count = 0; count <= 9; ++count) {
+      std::vector<int> original((count + 1) * strideInts, kGuard);
+      for (size_t i = 0; i < count; ++i) {
+        for (size_t j = 0; j < ints; ++j) {
+          original[i * strideInts + j] = static_cast<int>(i * 97 + j * 13) - 200;
+        }
+      }
+      std::vector<int> expected(original);
+      scalar(expected.data(), strideInts * sizeof(int), count, x, y);
+
+      for (ScaleFn kernel : kernels) {
+        std::vector<int> actual(original);
+        kernel(actual.data(), strideInts * sizeof(int), count, x, y);
+        ASPK_CHECK(actual == expected);
+      }
+    }
+  }
+}
@@ -0,0 +1,125 @@
+#include "Test.h"
+
+#include "CompiledFormat.h"
+
+#include <climits>
+#include <cwchar>
+#include <string>
+
+using namespace aspk;
+
+namespace {
+
+template <FixedFormat Fmt, typename... Args>
+std::wstring
+FormatCompiled(Args const &... aArgs)
+{
+  using Formatter = CompiledFormat<Fmt, Args...>;
+  PrintfBuffer buf;
+  typename Formatter::Cells cells;
+  Formatter::Format(buf, cells, aArgs...);
+  return std::wstring(buf.GetText());
+}
+
+// Both sides get the same argument after the usual vararg promotions
+template <typename... Args>
+std::wstring
+FormatCrt(wchar_t const * aFmt, Args const &... aArgs)
+{
+  wchar_t text[256];
+  const int len = std::swprintf(text, 256, aFmt, aArgs...);
+  return std::wstring(text, len > 0 ? len : 0);
+}
+
+#define CHECK_MATCHES_CRT(aFmt, aArg)                                         \
+  ASPK_CHECK(FormatCompiled<aFmt>(aArg) == FormatCrt(aFmt, aArg))
+
+const int kIntValues[] = {
+  0, 1, -1, 44, 127, 128, -128, -129, 255, 256, 300, -300, 4464,
+  32767, 32768, -32768, -32769, 65535, 65536, 70000, -70000,
+  INT_MAX, INT_MIN
+};
+
+} // anonymous namespace
+
+ASPK_TEST("CompiledFormat/Literals")
+{
+  ASPK_CHECK(FormatCompiled<L"100%% done">() == L"100% done");
+  ASPK_CHECK((FormatCompiled<L"%ls=%d", wchar_t const *, int>(L"x", 5)) == L"x=5");
+}
+
+ASPK_TEST("CompiledFormat/Cells")
+{
+  using Formatter = CompiledFormat<L"%d\t\t%ls", int, wchar_t const *>;
+  PrintfBuffer buf;
+  Formatter::Cells cells;
+  Formatter::Format(buf, cells, 7, L"a\tb");
+  ASPK_CHECK(Formatter::kNumColumns == 3);
+  ASPK_CHECK(cells[0] == L"7" && cells[1].empty() && cells[2] == L"a\tb");
+}
+
+ASPK_TEST("CompiledFormat/Signed")
+{
+  for (int value : kIntValues) {
+    CHECK_MATCHES_CRT(L"%d", value);
+    CHECK_MATCHES_CRT(L"%+08d", value);
+    CHECK_MATCHES_CRT(L"%-6i|", value);
+    CHECK_MATCHES_CRT(L"%.4d", value);
+  }
+}
+
+ASPK_TEST("CompiledFormat/SignedNarrowing")
+{
+  // %hd and %hhd convert the promoted int back to short and signed char
+  ASPK_CHECK(FormatCompiled<L"%hd">(70000) == L"4464");
+  ASPK_CHECK(FormatCompiled<L"%hhd">(300) == L"44");
+  for (int value : kIntValues) {
+    CHECK_MATCHES_CRT(L"%hd", value);
+    CHECK_MATCHES_CRT(L"%hhd", value);
+    CHECK_MATCHES_CRT(L"%+6hd", value);
+  }
+  for (int value = 0; value < 256; ++value) {
+    const unsigned char byte = static_cast<unsigned char>(value);
+    ASPK_CHECK(FormatCompiled<L"%hhd">(byte) ==
+               FormatCrt(L"%hhd", static_cast<int>(byte)));
+  }
+}
+
+ASPK_TEST("CompiledFormat/Unsigned")
+{
+  for (int value : kIntValues) {
+    CHECK_MATCHES_CRT(L"%u", value);
+    CHECK_MATCHES_CRT(L"%hu", value);
+    CHECK_MATCHES_CRT(L"%hhu", value);
+    CHECK_MATCHES_CRT(L"%#x", value);
+    CHECK_MATCHES_CRT(L"%08hX", value);
+    CHECK_MATCHES_CRT(L"%#o", value);
+  }
+  ASPK_CHECK(FormatCompiled<L"%zu">(size_t(12345)) == L"12345");
+  ASPK_CHECK(FormatCompiled<L"%llx">(~0ULL) == L"ffffffffffffffff");
+}
+
+ASPK_TEST("CompiledFormat/Bool")
+{
+  // Promoted to int, as a vararg would be
+  ASPK_CHECK(FormatCompiled<L"%d">(true) == L"1");
+  ASPK_CHECK(FormatCompiled<L"%u">(true) == L"1");
+  ASPK_CHECK(FormatCompiled<L"%x">(false) == L"0");
+  ASPK_CHECK(FormatCompiled<L"%hhu">(true) == L"1");
+}
+
+ASPK_TEST("CompiledFormat/CharsAndStrings")
+{
+  ASPK_CHECK(FormatCompiled<L"[%3c]">(L'x') == L"[  x]");
+  ASPK_CHECK(FormatCompiled<L"[%-4ls]">(std::wstring(L"ab")) == L"[ab  ]");
+  ASPK_CHECK(FormatCompiled<L"[%.2ls]">(std::wstring_view(L"abc")) == L"[ab]");
+  ASPK_CHECK(FormatCompiled<L"%ls">(static_cast<wchar_t const *>(nullptr)) ==
+             L"(null)");
+}
+
+ASPK_TEST("CompiledFormat/Float")
+{
+  CHECK_MATCHES_CRT(L"%.3f", 1.25);
+  CHECK_MATCHES_CRT(L"%10.2e", -12345.678);
+  CHECK_MATCHES_CRT(L"%g", 0.0001);
+}
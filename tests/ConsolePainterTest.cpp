@@ -0,0 +1,152 @@
+#include "Test.h"
+
+#include "ConsolePainter.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace aspk;
+
+namespace {
+
+constexpr uint32_t kBackground = 0xFF808080;
+constexpr uint32_t kText = 0xFF000000;
+constexpr uint32_t kPanel = 0xFF0000FF;
+constexpr uint32_t kOverlayText = 0xFFFF0000;
+
+// Reference images are drawn one character per pixel
+char
+GetPixelChar(uint32_t aPixel)
+{
+  switch (aPixel) {
+    case 0: return '.';
+    case kBackground: return '-';
+    case kText: return '#';
+    case kPanel: return 'o';
+    case kOverlayText: return '*';
+    default: return '?';
+  }
+}
+
+// Compares every pixel of aSurface with aExpected, and prints the actual
+// image if they differ
+bool
+MatchesReference(BitmapSurface const &aSurface,
+                 std::vector<std::string> const &aExpected)
+{
+  std::vector<std::string> actual;
+  for (int y = 0; y < aSurface.GetHeight(); ++y) {
+    std::string row;
+    for (int x = 0; x < aSurface.GetWidth(); ++x) {
+      row.push_back(GetPixelChar(aSurface.GetPixel(x, y)));
+    }
+    actual.push_back(row);
+  }
+  if (actual == aExpected) {
+    return true;
+  }
+  for (std::string const &row : actual) {
+    std::fprintf(stderr, "  %s\n", row.c_str());
+  }
+  return false;
+}
+
+// Small glyph cells keep the reference images readable: message font glyphs
+// are 2x2 pixels on a 3x3 grid, fixed font glyphs 1x2 on a 2x3 grid
+void
+UseSmallCells(BitmapSurface& aSurface)
+{
+  aSurface.SetCellSize(PaintSurface::eMessageFont, 3, 3);
+  aSurface.SetCellSize(PaintSurface::eFixedFont, 2, 3);
+}
+
+void
+AppendTestLines(RowStore& aLines)
+{
+  aLines.AppendLines(L"ab\n\nc d\nef gh\n");
+}
+
+} // anonymous namespace
+
+ASPK_TEST("ConsolePainter/Lines")
+{
+  BitmapSurface surface(12, 10);
+  UseSmallCells(surface);
+  RowStore lines(1);
+  AppendTestLines(lines);
+
+  // The empty line is skipped and the last one starts below the client rect
+  const size_t drawn =
+    PaintConsoleLines(surface, lines, 0, 3, PixelRect{1, 1, 12, 10});
+  ASPK_CHECK(drawn == 2);
+  ASPK_CHECK(MatchesReference(surface, {
+    "............",
+    ".##.##......",
+    ".##.##......",
+    "............",
+    "............",
+    "............",
+    "............",
+    ".##....##...",
+    ".##....##...",
+    "............",
+  }));
+}
+
+ASPK_TEST("ConsolePainter/PartialRepaint")
+{
+  BitmapSurface surface(12, 10);
+  UseSmallCells(surface);
+  surface.FillRect(PixelRect{0, 0, 12, 10}, kBackground);
+  RowStore lines(1);
+  AppendTestLines(lines);
+
+  // Scrolled down a line and repainting only the bottom strip. "c d" still
+  // intersects the strip's line range, but its glyphs fall outside the clip.
+  surface.SetClipRect(PixelRect{0, 6, 12, 10});
+  const size_t drawn =
+    PaintConsoleLines(surface, lines, 1, 3, PixelRect{1, 1, 12, 10});
+  ASPK_CHECK(drawn == 2);
+  ASPK_CHECK(MatchesReference(surface, {
+    "------------",
+    "------------",
+    "------------",
+    "------------",
+    "------------",
+    "------------",
+    "------------",
+    "-##-##----##",
+    "-##-##----##",
+    "------------",
+  }));
+
+  // Nothing to draw past the last line, or outside the clip rect
+  ASPK_CHECK(PaintConsoleLines(surface, lines, 4, 3,
+                               PixelRect{1, 1, 12, 10}) == 0);
+  ASPK_CHECK(PaintConsoleLines(surface, lines, 0, 3,
+                               PixelRect{1, 1, 12, 5}) == 0);
+}
+
+ASPK_TEST("ConsolePainter/CornerOverlay")
+{
+  BitmapSurface surface(12, 10);
+  UseSmallCells(surface);
+
+  PaintCornerOverlay(surface, L"ab\nc", PixelRect{0, 0, 12, 10}, 1, kPanel,
+                     kOverlayText);
+  ASPK_CHECK(MatchesReference(surface, {
+    "............",
+    "............",
+    "......oooooo",
+    "......o*o*oo",
+    "......o*o*oo",
+    "......oooooo",
+    "......o*oooo",
+    "......o*oooo",
+    "......oooooo",
+    "......oooooo",
+  }));
+  // The console's font is selected again afterwards
+  ASPK_CHECK(surface.MeasureText(L"x").mWidth == 3);
+}
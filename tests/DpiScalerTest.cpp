@@ -0,0 +1,55 @@
+#include "Test.h"
+
+#include "DpiScaler.h"
+
+#include <vector>
+
+using namespace aspk;
+
+ASPK_TEST("DpiScaler/SharedScalersAreInterned")
+{
+  ASPK_CHECK(DpiScaler::GetForScale(100, 100) == DpiScaler::GetNominal());
+  ASPK_CHECK(DpiScaler::GetForScale(150, 150) ==
+             DpiScaler::GetForScale(150, 150));
+  ASPK_CHECK(DpiScaler::GetForScale(150, 150) !=
+             DpiScaler::GetForScale(150, 125));
+  ASPK_CHECK(DpiScaler::GetForDpi(144, 144) ==
+             DpiScaler::GetForScale(150, 150));
+}
+
+ASPK_TEST("DpiScaler/ScaleToMatchesScaleRatio")
+{
+  // Standard steps, mixed axes and scales that are not Windows steps, which
+  // take the ratios from the scalers rather than the table
+  const int scales[][2] = {
+    {100, 100}, {125, 125}, {150, 150}, {175, 175}, {300, 300}, {500, 500},
+    {125, 150}, {110, 110}, {133, 100}, {90, 90}, {600, 175}
+  };
+  std::vector<DpiScalerHandle> scalers;
+  for (auto const &scale : scales) {
+    scalers.push_back(DpiScaler::GetForScale(scale[0], scale[1]));
+  }
+
+  bool matches = true;
+  for (size_t from = 0; from < scalers.size(); ++from) {
+    for (size_t to = 0; to < scalers.size(); ++to) {
+      const ScaleRatio x = GetScaleRatio(scales[from][0], scales[to][0]);
+      const ScaleRatio y = GetScaleRatio(scales[from][1], scales[to][1]);
+
+      const ScaledRect rect =
+        ScaledRect(scalers[from], {-37, 11, 1021, 768}).ScaleTo(scalers[to]);
+      matches &= rect.GetScaler() == scalers[to];
+      matches &= rect[0] == x.Apply(-37) && rect[1] == y.Apply(11) &&
+                 rect[2] == x.Apply(1020) + 1 && rect[3] == y.Apply(767) + 1;
+
+      const ScaledPoint point =
+        ScaledPoint(scalers[from], {-5, 333}).ScaleTo(scalers[to]);
+      matches &= point[0] == x.Apply(-5) && point[1] == y.Apply(333);
+
+      const ScaledDimensionY height =
+        ScaledDimensionY(scalers[from], 42).ScaleTo(scalers[to]);
+      matches &= height.GetValue() == y.Apply(42);
+    }
+  }
+  ASPK_CHECK(matches);
+}
@@ -0,0 +1,146 @@
+#include "Test.h"
+
+#include "FramePacer.h"
+
+#include <string>
+#include <vector>
+
+using namespace aspk;
+using namespace std::chrono_literals;
+
+namespace {
+
+using Clock = FramePacer::Clock;
+
+// Plays the role of GlassWindow's frame timer on a simulated clock: a
+// request that starts a frame schedules it for GetNextFrameTime, and the
+// frame is presented once the clock reaches that time
+class SimulatedWindow
+{
+public:
+  SimulatedWindow(Clock::time_point aVBlank, std::chrono::nanoseconds aInterval)
+    : mHasDue(false)
+  {
+    mPacer.SetTiming(aVBlank, aInterval);
+  }
+
+  FramePacer& GetPacer() { return mPacer; }
+  std::vector<Clock::time_point> const & GetFrames() const { return mFrames; }
+
+  void
+  RequestAt(Clock::time_point aNow)
+  {
+    AdvanceTo(aNow);
+    if (mPacer.Request()) {
+      mDue = mPacer.GetNextFrameTime(aNow);
+      mHasDue = true;
+    }
+    AdvanceTo(aNow);
+  }
+
+  void
+  AdvanceTo(Clock::time_point aNow)
+  {
+    if (mHasDue && aNow >= mDue) {
+      mPacer.Present(mDue);
+      mFrames.push_back(mDue);
+      mHasDue = false;
+    }
+  }
+
+  void
+  Finish()
+  {
+    if (mHasDue) {
+      AdvanceTo(mDue);
+    }
+  }
+
+private:
+  FramePacer                      mPacer;
+  std::vector<Clock::time_point>  mFrames;
+  Clock::time_point               mDue;
+  bool                            mHasDue;
+};
+
+constexpr std::chrono::nanoseconds k60Hz = FramePacer::kDefaultInterval;
+
+} // anonymous namespace
+
+ASPK_TEST("FramePacer/RequestStorm")
+{
+  // 10,000 requests, one every 10us, over 100ms of a 60Hz display. The first
+  // is presented at once, then one frame per refresh: six intervals begin
+  // within the 100ms, and the requests after the last vblank need one more.
+  const Clock::time_point start = Clock::now();
+  SimulatedWindow window(start, k60Hz);
+  for (int i = 0; i < 10000; ++i) {
+    window.RequestAt(start + std::chrono::microseconds(10) * i);
+  }
+  window.Finish();
+
+  FramePacer const &pacer = window.GetPacer();
+  ASPK_CHECK(pacer.GetRequestCount() == 10000);
+  ASPK_CHECK(pacer.GetPresentedCount() == 7);
+  ASPK_CHECK(pacer.GetSkippedCount() == 10000 - 7);
+  ASPK_CHECK(!pacer.IsPending());
+
+  // The first frame went out immediately, the rest on consecutive vblanks
+  std::vector<Clock::time_point> const &frames = window.GetFrames();
+  ASPK_CHECK(frames.size() == 7);
+  bool onVBlanks = !frames.empty() && frames[0] == start;
+  for (size_t i = 1; i < frames.size(); ++i) {
+    onVBlanks &= frames[i] == start + k60Hz * static_cast<int64_t>(i);
+  }
+  ASPK_CHECK(onVBlanks);
+}
+
+ASPK_TEST("FramePacer/FirstRequestInIntervalIsImmediate")
+{
+  // Refresh phase that does not line up with the requests, including times
+  // before the reference vblank
+  const Clock::time_point vblank = Clock::now();
+  FramePacer pacer;
+  pacer.SetTiming(vblank, 10ms);
+
+  const Clock::time_point early = vblank - 25ms;
+  ASPK_CHECK(pacer.Request());
+  ASPK_CHECK(pacer.GetNextFrameTime(early) == early);
+  pacer.Present(early);
+
+  // Within the same interval, wait for the next vblank
+  ASPK_CHECK(pacer.Request());
+  ASPK_CHECK(pacer.GetNextFrameTime(early + 3ms) == vblank - 20ms);
+  ASPK_CHECK(!pacer.Request());
+  pacer.Present(vblank - 20ms);
+
+  // An idle stretch: the next request goes out at once
+  const Clock::time_point later = vblank + 47ms;
+  ASPK_CHECK(pacer.Request());
+  ASPK_CHECK(pacer.GetNextFrameTime(later) == later);
+  pacer.Present(later);
+  ASPK_CHECK(pacer.Request());
+  ASPK_CHECK(pacer.GetNextFrameTime(later + 1ms) == vblank + 50ms);
+
+  ASPK_CHECK(pacer.GetRequestCount() == 5);
+  ASPK_CHECK(pacer.GetSkippedCount() == 1);
+  ASPK_CHECK(pacer.GetPresentedCount() == 3);
+}
+
+ASPK_TEST("FramePacer/TimingAndReport")
+{
+  FramePacer pacer;
+  ASPK_CHECK(pacer.GetInterval() == FramePacer::kDefaultInterval);
+  // Non-positive intervals are ignored
+  pacer.SetTiming(Clock::now(), 0ns);
+  ASPK_CHECK(pacer.GetInterval() == FramePacer::kDefaultInterval);
+  pacer.SetTiming(Clock::now(), std::chrono::nanoseconds(6944444));
+  ASPK_CHECK(pacer.GetInterval() == std::chrono::nanoseconds(6944444));
+
+  pacer.Request();
+  pacer.Request();
+  pacer.Present(Clock::now());
+  std::wstring report;
+  pacer.AppendReport(report);
+  ASPK_CHECK(report == L"frames: 1 presented, 1 skipped at 144.0 Hz\n");
+}
@@ -0,0 +1,120 @@
+#include "Test.h"
+
+#include "LatencyHistogram.h"
+
+#include <cmath>
+#include <memory>
+
+using namespace aspk;
+
+ASPK_TEST("LatencyHistogram/ExactBelowSubBuckets")
+{
+  for (uint64_t value = 0; value < 32; ++value) {
+    const size_t index = LatencyHistogram::GetBucketIndex(value);
+    ASPK_CHECK(index == value);
+    ASPK_CHECK(LatencyHistogram::GetBucketLowerBound(index) == value);
+    ASPK_CHECK(LatencyHistogram::GetBucketUpperBound(index) == value);
+  }
+}
+
+ASPK_TEST("LatencyHistogram/BucketBoundaries")
+{
+  // Buckets tile the value range: each bound maps back to its own bucket and
+  // the value past the upper bound starts the next one
+  bool tiles = true;
+  for (size_t i = 0; i + 1 < LatencyHistogram::kNumBuckets; ++i) {
+    const uint64_t lower = LatencyHistogram::GetBucketLowerBound(i);
+    const uint64_t upper = LatencyHistogram::GetBucketUpperBound(i);
+    tiles &= lower <= upper;
+    tiles &= LatencyHistogram::GetBucketIndex(lower) == i;
+    tiles &= LatencyHistogram::GetBucketIndex(upper) == i;
+    tiles &= LatencyHistogram::GetBucketIndex(upper + 1) == i + 1;
+    // Each bucket is at most 1/16 of its lower bound wide
+    tiles &= lower < 16 || (upper - lower + 1) * 16 <= lower;
+  }
+  ASPK_CHECK(tiles);
+
+  const size_t last = LatencyHistogram::kNumBuckets - 1;
+  const uint64_t maxTracked = uint64_t(1) << LatencyHistogram::kMaxValueBits;
+  ASPK_CHECK(LatencyHistogram::GetBucketIndex(maxTracked - 1) == last);
+  ASPK_CHECK(LatencyHistogram::GetBucketIndex(maxTracked) == last);
+  ASPK_CHECK(LatencyHistogram::GetBucketIndex(UINT64_MAX) == last);
+  ASPK_CHECK(LatencyHistogram::GetBucketUpperBound(last) == UINT64_MAX);
+}
+
+ASPK_TEST("LatencyHistogram/Empty")
+{
+  LatencyHistogram histogram;
+  ASPK_CHECK(histogram.GetCount() == 0);
+  ASPK_CHECK(histogram.GetMin() == 0 && histogram.GetMax() == 0);
+  ASPK_CHECK(histogram.GetPercentile(50) == 0);
+}
+
+ASPK_TEST("LatencyHistogram/Percentiles")
+{
+  auto histogram = std::make_unique<LatencyHistogram>();
+  for (uint64_t value = 1; value <= 10000; ++value) {
+    histogram->Record(value * 1000);
+  }
+  ASPK_CHECK(histogram->GetCount() == 10000);
+  ASPK_CHECK(histogram->GetMin() == 1000);
+  ASPK_CHECK(histogram->GetMax() == 10000000);
+  ASPK_CHECK(histogram->GetTotal() == 1000ULL * 10000 * 10001 / 2);
+
+  // Never below the true percentile, and at most one bucket (1/16) above
+  bool withinBound = true;
+  for (double percentile = 1; percentile <= 100; percentile += 1) {
+    const double exact = std::ceil(percentile * 100) * 1000;
+    const double reported = double(histogram->GetPercentile(percentile));
+    withinBound &= reported >= exact && reported <= exact * (1 + 1.0 / 16);
+  }
+  ASPK_CHECK(withinBound);
+  // The lowest rank still rounds up to the end of the minimum's bucket
+  ASPK_CHECK(histogram->GetPercentile(0) ==
+             LatencyHistogram::GetBucketUpperBound(
+               LatencyHistogram::GetBucketIndex(histogram->GetMin())));
+  ASPK_CHECK(histogram->GetPercentile(100) == histogram->GetMax());
+  // Out-of-range percentiles are clamped
+  ASPK_CHECK(histogram->GetPercentile(250) == histogram->GetMax());
+}
+
+ASPK_TEST("LatencyHistogram/SingleSample")
+{
+  // Rounding up to the bucket end never goes past the only sample
+  LatencyHistogram histogram;
+  histogram.Record(123457);
+  ASPK_CHECK(histogram.GetPercentile(50) == 123457);
+  ASPK_CHECK(histogram.GetPercentile(99.9) == 123457);
+}
+
+ASPK_TEST("LatencyHistogram/Merge")
+{
+  auto even = std::make_unique<LatencyHistogram>();
+  auto odd = std::make_unique<LatencyHistogram>();
+  auto all = std::make_unique<LatencyHistogram>();
+  for (uint64_t value = 3; value < 50000; value += 7) {
+    ((value & 1) ? *odd : *even).Record(value);
+    all->Record(value);
+  }
+
+  even->Merge(*odd);
+  ASPK_CHECK(even->GetCount() == all->GetCount());
+  ASPK_CHECK(even->GetTotal() == all->GetTotal());
+  ASPK_CHECK(even->GetMin() == all->GetMin());
+  ASPK_CHECK(even->GetMax() == all->GetMax());
+  bool samePercentiles = true;
+  for (double percentile = 0; percentile <= 100; percentile += 0.5) {
+    samePercentiles &= even->GetPercentile(percentile) ==
+                       all->GetPercentile(percentile);
+  }
+  ASPK_CHECK(samePercentiles);
+
+  // Merging an empty histogram changes nothing, including the minimum
+  LatencyHistogram empty;
+  even->Merge(empty);
+  ASPK_CHECK(even->GetCount() == all->GetCount());
+  ASPK_CHECK(even->GetMin() == all->GetMin());
+
+  even->Reset();
+  ASPK_CHECK(even->GetCount() == 0 && even->GetPercentile(50) == 0);
+}
@@ -0,0 +1,101 @@
+#include "Test.h"
+
+#include "MessageStats.h"
+
+#include <string>
+
+using namespace aspk;
+using namespace aspk::test;
+
+namespace {
+
+wchar_t const *
+GetTestMessageName(uint32_t aMsg)
+{
+  return aMsg == 0x000F ? L"WM_PAINT" : nullptr;
+}
+
+} // anonymous namespace
+
+ASPK_TEST("MessageStats/EntriesByTotalTime")
+{
+  MessageStats stats;
+  stats.Record(0x0200, 1000);
+  stats.Record(0x000F, 50000);
+  stats.Record(0x0200, 2000);
+  stats.Record(0x0113, 10000);
+
+  const auto entries = stats.GetEntries();
+  ASPK_CHECK(entries.size() == 3);
+  if (entries.size() == 3) {
+    ASPK_CHECK(entries[0].mMsg == 0x000F);
+    ASPK_CHECK(entries[1].mMsg == 0x0113);
+    ASPK_CHECK(entries[2].mMsg == 0x0200);
+    ASPK_CHECK(entries[2].mHistogram->GetCount() == 2);
+    ASPK_CHECK(entries[2].mHistogram->GetTotal() == 3000);
+  }
+}
+
+ASPK_TEST("MessageStats/RecordDoesNotAllocate")
+{
+  MessageStats stats;
+  const uint64_t before = GetAllocationCount();
+  for (uint32_t i = 0; i < 10000; ++i) {
+    // New messages as well as repeats, in no particular order
+    stats.Record((i * 37) % MessageStats::kDefaultCapacity, i);
+  }
+  ASPK_CHECK(GetAllocationCount() == before);
+}
+
+ASPK_TEST("MessageStats/BeyondCapacity")
+{
+  MessageStats stats(4);
+  const uint64_t before = GetAllocationCount();
+  for (uint32_t msg = 1; msg <= 10; ++msg) {
+    stats.Record(msg, 100);
+  }
+  stats.Record(2, 100);
+  ASPK_CHECK(GetAllocationCount() == before);
+
+  // The first four messages keep their own histograms; the rest share one
+  const auto entries = stats.GetEntries();
+  ASPK_CHECK(entries.size() == 5);
+  uint64_t otherCount = 0;
+  for (MessageStats::Entry const &entry : entries) {
+    if (entry.mMsg == MessageStats::kOtherMessages) {
+      otherCount = entry.mHistogram->GetCount();
+    } else {
+      ASPK_CHECK(entry.mMsg >= 1 && entry.mMsg <= 4);
+    }
+  }
+  ASPK_CHECK(otherCount == 6);
+
+  // Reset makes the capacity available again
+  stats.Reset();
+  ASPK_CHECK(stats.GetEntries().empty());
+  stats.Record(9, 100);
+  ASPK_CHECK(stats.GetEntries().size() == 1 &&
+             stats.GetEntries()[0].mHistogram->GetCount() == 1);
+}
+
+ASPK_TEST("MessageStats/Report")
+{
+  MessageStats stats(1);
+  stats.Record(0x000F, 2000000);
+  stats.Record(0x0200, 1000);
+
+  std::wstring report;
+  stats.AppendReport(report, &GetTestMessageName);
+  ASPK_CHECK(report.find(L"WM_PAINT") != std::wstring::npos);
+  ASPK_CHECK(report.find(L"(other)") != std::wstring::npos);
+  ASPK_CHECK(report.find(L"0x0200") == std::wstring::npos);
+
+  // Header plus one line
+  report.clear();
+  stats.AppendReport(report, nullptr, 1);
+  size_t lines = 0;
+  for (wchar_t c : report) {
+    lines += c == L'\n';
+  }
+  ASPK_CHECK(lines == 2);
+}
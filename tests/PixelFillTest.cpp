@@ -0,0 +1,89 @@
+#include "Test.h"
+
+#include "PixelFill.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace aspk;
+
+namespace {
+
+using FillFn = void (*)(uint32_t*, ptrdiff_t, int, int, uint32_t);
+
+constexpr uint32_t kGuard = 0xDEADBEEF;
+constexpr uint32_t kFill = 0x80402010;
+
+// Fills a rectangle inside a guarded buffer at every alignment and width up
+// to a few vectors wide, and checks that exactly the rectangle was written
+bool
+FillsExactly(FillFn aFill)
+{
+  constexpr int kStride = 96;
+  constexpr int kHeight = 3;
+  std::vector<uint32_t> pixels((kHeight + 2) * kStride);
+
+  for (int offset = 0; offset < 8; ++offset) {
+    for (int width = 0; width <= 70; ++width) {
+      std::fill(pixels.begin(), pixels.end(), kGuard);
+      uint32_t* origin = pixels.data() + kStride + offset;
+      aFill(origin, kStride, width, kHeight, kFill);
+
+      for (size_t i = 0; i < pixels.size(); ++i) {
+        const ptrdiff_t rel = static_cast<ptrdiff_t>(i) - kStride - offset;
+        const bool inside = rel >= 0 && rel / kStride < kHeight &&
+                            rel % kStride < width;
+        if (pixels[i] != (inside ? kFill : kGuard)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+ASPK_TEST("PixelFill/Premultiply")
+{
+  ASPK_CHECK(MakePremultipliedPixel(0x12, 0x34, 0x56) == 0xFF123456);
+  ASPK_CHECK(MakePremultipliedPixel(0xFF, 0xFF, 0xFF, 0x80) == 0x80808080);
+  ASPK_CHECK(MakePremultipliedPixel(0xFF, 0x00, 0x80, 0x00) == 0);
+}
+
+ASPK_TEST("PixelFill/Scalar")
+{
+  ASPK_CHECK(FillsExactly(detail::FillPixelsScalar));
+}
+
+#ifdef ASPK_HAVE_X86_FILL
+ASPK_TEST("PixelFill/Sse2")
+{
+  ASPK_CHECK(FillsExactly(detail::FillPixelsSse2));
+}
+
+ASPK_TEST("PixelFill/Avx2")
+{
+  if (detail::HasAvx2()) {
+    ASPK_CHECK(FillsExactly(detail::FillPixelsAvx2));
+  }
+}
+#endif
+
+ASPK_TEST("PixelFill/Dispatch")
+{
+  ASPK_CHECK(FillsExactly(FillPixels));
+}
+
+ASPK_TEST("PixelFill/NegativeStride")
+{
+  // Bottom-up DIBs are walked with a negative stride
+  std::vector<uint32_t> pixels(4 * 8, kGuard);
+  FillPixels(pixels.data() + 3 * 8 + 1, -8, 5, 4, kFill);
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 8; ++x) {
+      const bool inside = x >= 1 && x < 6;
+      ASPK_CHECK(pixels[y * 8 + x] == (inside ? kFill : kGuard));
+    }
+  }
+}
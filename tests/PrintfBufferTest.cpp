@@ -0,0 +1,51 @@
+#include "Test.h"
+
+#include "PrintfBuffer.h"
+
+#include <string>
+#include <vector>
+
+using namespace aspk;
+
+ASPK_TEST("PrintfBuffer/Format")
+{
+  PrintfBuffer buf;
+  ASPK_CHECK(buf.Format(L"%d\t%ls", 42, L"abc"));
+  ASPK_CHECK(buf.GetText() == L"42\tabc");
+  ASPK_CHECK(buf.AppendFormat(L"-%03d", 7));
+  ASPK_CHECK(buf.GetText() == L"42\tabc-007");
+}
+
+ASPK_TEST("PrintfBuffer/GrowsToFit")
+{
+  PrintfBuffer buf;
+  std::wstring big(5000, L'x');
+  ASPK_CHECK(buf.Format(L"%ls!", big.c_str()));
+  ASPK_CHECK(buf.GetLength() == big.size() + 1);
+  ASPK_CHECK(buf.GetText().back() == L'!');
+
+  // Once grown, formatting again reuses the storage
+  const size_t grows = buf.GetGrowCount();
+  ASPK_CHECK(buf.Format(L"%ls?", big.c_str()));
+  ASPK_CHECK(buf.GetGrowCount() == grows);
+}
+
+ASPK_TEST("PrintfBuffer/EncodingErrorDoesNotGrow")
+{
+  // Invalid UTF-8 in a narrow string argument fails at any buffer size, so
+  // it must fail on the first attempt rather than growing to the cap
+  PrintfBuffer buf;
+  ASPK_CHECK(!buf.Format(L"%s", "\xff\xfe"));
+  ASPK_CHECK(buf.IsEmpty());
+  ASPK_CHECK(buf.GetGrowCount() == 1);
+}
+
+ASPK_TEST("PrintfBuffer/SplitInPlace")
+{
+  PrintfBuffer buf;
+  buf.Assign(L"\ta\t\tbc\t");
+  std::vector<std::wstring_view> tokens;
+  buf.SplitInPlace(L'\t', tokens);
+  ASPK_CHECK(tokens.size() == 2);
+  ASPK_CHECK(tokens.size() == 2 && tokens[0] == L"a" && tokens[1] == L"bc");
+}
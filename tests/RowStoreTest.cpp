@@ -0,0 +1,152 @@
+#include "Test.h"
+
+#include "RowStore.h"
+#include "SpillFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+using namespace aspk;
+
+namespace {
+
+std::wstring
+MakeLine(size_t aIndex)
+{
+  return L"line " + std::to_wstring(aIndex) + L" of the scrollback";
+}
+
+} // anonymous namespace
+
+ASPK_TEST("RowStore/Cells")
+{
+  RowStore store(3);
+  store.AppendCell(L"a");
+  store.AppendCell(L"");
+  store.AppendCell(L"c");
+  store.AppendCell(L"d");
+  ASPK_CHECK(store.GetCurrentColumn() == 1);
+  store.AppendCell(L"e\n");
+  ASPK_CHECK(store.GetCurrentColumn() == 0);
+  store.AppendCell(L"f");
+
+  ASPK_CHECK(store.GetRowCount() == 3);
+  ASPK_CHECK(store.GetCell(0, 0) == L"a");
+  ASPK_CHECK(store.GetCell(0, 1).empty());
+  ASPK_CHECK(store.GetCell(0, 2) == L"c");
+  ASPK_CHECK(store.GetCell(1, 1) == L"e");
+  // Past the end of a short row, and past the last row
+  ASPK_CHECK(store.GetCell(1, 2).empty());
+  ASPK_CHECK(store.GetCell(2, 0) == L"f");
+  ASPK_CHECK(store.GetCell(3, 0).empty());
+
+  // Views are null-terminated, for LVN_GETDISPINFO
+  ASPK_CHECK(store.GetCell(0, 2).data()[1] == L'\0');
+}
+
+ASPK_TEST("RowStore/AppendLines")
+{
+  RowStore store(1);
+  store.AppendLines(L"one\ntw");
+  ASPK_CHECK(store.IsLineOpen());
+  store.AppendLines(L"o\n\nthree");
+  ASPK_CHECK(store.GetRowCount() == 4);
+  ASPK_CHECK(store.GetCell(0, 0) == L"one");
+  ASPK_CHECK(store.GetCell(1, 0) == L"two");
+  ASPK_CHECK(store.GetCell(2, 0).empty());
+  ASPK_CHECK(store.GetCell(3, 0) == L"three");
+
+  store.Clear();
+  ASPK_CHECK(store.GetRowCount() == 0 && !store.IsLineOpen());
+}
+
+ASPK_TEST("RowStore/ManyChunksInMemory")
+{
+  RowStore store(1);
+  for (size_t i = 0; i < 50000; ++i) {
+    store.AppendLines(MakeLine(i) + L"\n");
+  }
+  ASPK_CHECK(store.GetRowCount() == 50000);
+  ASPK_CHECK(store.GetSpilledChunkCount() == 0);
+  bool allMatch = true;
+  for (size_t i = 0; i < 50000; i += 7) {
+    allMatch &= store.GetCell(i, 0) == MakeLine(i);
+  }
+  ASPK_CHECK(allMatch);
+}
+
+ASPK_TEST("RowStore/SpillStaysWithinBudget")
+{
+  // 200k lines is several times the budget; memory use must level off
+  const size_t kBudget = 1024 * 1024;
+  const size_t kLines = 200000;
+  RowStore store(1);
+  store.SetMemoryBudget(kBudget);
+
+  size_t peakResident = 0;
+  for (size_t i = 0; i < kLines; ++i) {
+    store.AppendLines(MakeLine(i) + L"\n");
+    peakResident = std::max(peakResident, store.GetResidentBytes());
+  }
+
+  ASPK_CHECK(store.GetRowCount() == kLines);
+  ASPK_CHECK(store.GetSpilledChunkCount() > 0);
+  ASPK_CHECK(store.GetSpilledBytes() > 0);
+  // The budget covers sealed chunks; the open chunk comes on top
+  ASPK_CHECK(peakResident < 2 * kBudget);
+
+  // Read back everything, oldest first, then jump around so that spilled
+  // chunks are mapped, evicted and mapped again
+  bool allMatch = true;
+  for (size_t i = 0; i < kLines; ++i) {
+    allMatch &= store.GetCell(i, 0) == MakeLine(i);
+  }
+  for (size_t i = 0; i < 2000; ++i) {
+    const size_t row = (i * 7919) % kLines;
+    allMatch &= store.GetCell(row, 0) == MakeLine(row);
+  }
+  ASPK_CHECK(allMatch);
+}
+
+ASPK_TEST("RowStore/SpillMultiColumn")
+{
+  RowStore store(2);
+  store.SetMemoryBudget(64 * 1024);
+  for (size_t i = 0; i < 60000; ++i) {
+    store.AppendCell(std::to_wstring(i));
+    store.AppendCell(i % 3 ? MakeLine(i) : std::wstring());
+  }
+  ASPK_CHECK(store.GetSpilledChunkCount() > 0);
+  bool allMatch = true;
+  for (size_t i = 0; i < 60000; i += 13) {
+    allMatch &= store.GetCell(i, 0) == std::to_wstring(i);
+    allMatch &= store.GetCell(i, 1) == (i % 3 ? MakeLine(i) : std::wstring());
+  }
+  ASPK_CHECK(allMatch);
+}
+
+ASPK_TEST("SpillFile/AppendAndMap")
+{
+  std::unique_ptr<SpillFile> file = SpillFile::CreateTemporary();
+  ASPK_CHECK(file != nullptr);
+  if (!file) {
+    return;
+  }
+
+  // Records that straddle page boundaries, at unaligned offsets
+  std::string first(5000, 'a');
+  std::string second(9000, 'b');
+  uint64_t firstOffset = 0;
+  uint64_t secondOffset = 0;
+  ASPK_CHECK(file->Append(first.data(), first.size(), firstOffset));
+  ASPK_CHECK(file->Append(second.data(), second.size(), secondOffset));
+  ASPK_CHECK(firstOffset == 0 && secondOffset == first.size());
+  ASPK_CHECK(file->GetSize() == first.size() + second.size());
+
+  auto mapping = file->Map(secondOffset, second.size());
+  ASPK_CHECK(mapping && !std::memcmp(mapping->GetData(), second.data(),
+                                     second.size()));
+  mapping = file->Map(firstOffset + 100, 10);
+  ASPK_CHECK(mapping && !std::memcmp(mapping->GetData(), first.data(), 10));
+}
@@ -0,0 +1,130 @@
+// Unit tests for the platform-neutral core.
+//
+// Usage: glasstest [--filter=<substring>] [--list] [--<option>=<value>...]
+//
+// Prints one line per test and exits non-zero if any failed. Options other
+// than --filter are made available to tests through GetOption.
+
+#include "Test.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace aspk {
+namespace test {
+
+namespace {
+
+struct RegisteredTest
+{
+  char const *  mName;
+  TestFn        mFn;
+};
+
+// Function statics, since registrations run during static initialization
+std::vector<RegisteredTest>&
+GetRegistry()
+{
+  static std::vector<RegisteredTest> sTests;
+  return sTests;
+}
+
+std::vector<std::pair<std::string, std::string>>&
+GetOptions()
+{
+  static std::vector<std::pair<std::string, std::string>> sOptions;
+  return sOptions;
+}
+
+size_t sFailedChecks = 0;
+
+} // anonymous namespace
+
+TestRegistration::TestRegistration(char const * aName, TestFn aFn)
+{
+  GetRegistry().push_back({aName, aFn});
+}
+
+void
+Fail(char const * aFile, int aLine, char const * aExpr)
+{
+  std::fprintf(stderr, "  %s:%d: check failed: %s\n", aFile, aLine, aExpr);
+  ++sFailedChecks;
+}
+
+std::string_view
+GetOption(std::string_view aName)
+{
+  for (auto const &option : GetOptions()) {
+    if (option.first == aName) {
+      return option.second;
+    }
+  }
+  return std::string_view();
+}
+
+size_t
+RunTests(std::string_view aFilter, bool aList)
+{
+  size_t numRun = 0;
+  size_t numFailed = 0;
+  for (RegisteredTest const &test : GetRegistry()) {
+    if (std::string_view(test.mName).find(aFilter) == std::string_view::npos) {
+      continue;
+    }
+    if (aList) {
+      std::printf("%s\n", test.mName);
+      continue;
+    }
+
+    const size_t failedBefore = sFailedChecks;
+    test.mFn();
+    const bool passed = sFailedChecks == failedBefore;
+    std::printf("%-6s %s\n", passed ? "ok" : "FAIL", test.mName);
+    std::fflush(stdout);
+    ++numRun;
+    numFailed += passed ? 0 : 1;
+  }
+
+  if (!aList) {
+    std::printf("%zu run, %zu failed\n", numRun, numFailed);
+  }
+  return numFailed;
+}
+
+} // namespace test
+} // namespace aspk
+
+int
+main(int argc, char* argv[])
+{
+  using namespace aspk::test;
+
+  std::string_view filter;
+  bool list = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg(argv[i]);
+    const size_t equals = arg.find('=');
+    if (arg == "--list") {
+      list = true;
+    } else if (arg.substr(0, 2) == "--" && equals != std::string_view::npos) {
+      std::string_view name = arg.substr(2, equals - 2);
+      std::string_view value = arg.substr(equals + 1);
+      if (name == "filter") {
+        filter = value;
+      } else {
+        GetOptions().emplace_back(name, value);
+      }
+    } else {
+      std::fprintf(stderr, "Usage: %s [--filter=<substring>] [--list] "
+                           "[--<option>=<value>...]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  return RunTests(filter, list) ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+#ifndef __ASPK_TEST_H
+#define __ASPK_TEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace aspk {
+namespace test {
+
+using TestFn = void (*)();
+
+// Adds a test to the list that RunTests walks. Use ASPK_TEST rather than
+// constructing these directly.
+struct TestRegistration
+{
+  TestRegistration(char const * aName, TestFn aFn);
+};
+
+// Runs each registered test whose name contains aFilter, in registration
+// order, and prints one line per test. Returns the number that failed.
+size_t RunTests(std::string_view aFilter, bool aList);
+
+// Marks the running test as failed; see ASPK_CHECK
+void Fail(char const * aFile, int aLine, char const * aExpr);
+
+// Heap allocations made through operator new so far, on any thread
+uint64_t GetAllocationCount();
+
+// Options from the command line that some tests need, e.g. the path of a tool
+// to run. Returns an empty view if the option was not given.
+std::string_view GetOption(std::string_view aName);
+
+} // namespace test
+} // namespace aspk
+
+#define ASPK_TEST_CONCAT2(a, b) a##b
+#define ASPK_TEST_CONCAT(a, b) ASPK_TEST_CONCAT2(a, b)
+
+// Defines and registers a test:
+//   ASPK_TEST("ThreadPool/Join") { ... }
+#define ASPK_TEST(aName)                                                      \
+  static void ASPK_TEST_CONCAT(TestBody, __LINE__)();                         \
+  static ::aspk::test::TestRegistration ASPK_TEST_CONCAT(sTest, __LINE__)(    \
+    aName, ASPK_TEST_CONCAT(TestBody, __LINE__));                             \
+  static void ASPK_TEST_CONCAT(TestBody, __LINE__)()
+
+// Records a failure and carries on, so one run reports every broken check
+#define ASPK_CHECK(aExpr)                                                     \
+  ((aExpr) ? (void)0 : ::aspk::test::Fail(__FILE__, __LINE__, #aExpr))
+
+#endif // __ASPK_TEST_H
@@ -0,0 +1,158 @@
+#include "Test.h"
+
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace aspk;
+
+namespace {
+
+void
+Increment(void* aContext)
+{
+  static_cast<std::atomic<size_t>*>(aContext)->fetch_add(1);
+}
+
+size_t
+Fibonacci(ThreadPool& aPool, size_t aN)
+{
+  if (aN < 2) {
+    return aN;
+  }
+  size_t a = 0;
+  size_t b = 0;
+  aPool.Invoke([&] { a = Fibonacci(aPool, aN - 1); },
+               [&] { b = Fibonacci(aPool, aN - 2); });
+  return a + b;
+}
+
+} // anonymous namespace
+
+ASPK_TEST("ThreadPool/SubmitFromManyThreads")
+{
+  std::atomic<size_t> ran{0};
+  const size_t kThreads = 4;
+  const size_t kJobsPerThread = 20000;
+  {
+    ThreadPool pool(4);
+    std::vector<std::thread> submitters;
+    for (size_t t = 0; t < kThreads; ++t) {
+      submitters.emplace_back([&pool, &ran] {
+        for (size_t i = 0; i < kJobsPerThread; ++i) {
+          pool.Submit(&Increment, &ran);
+        }
+      });
+    }
+    for (std::thread& submitter : submitters) {
+      submitter.join();
+    }
+  }
+  // The destructor runs everything still queued
+  ASPK_CHECK(ran.load() == kThreads * kJobsPerThread);
+}
+
+ASPK_TEST("ThreadPool/SubmitRacesShutdown")
+{
+  // Whether a job lands before, during or after Shutdown, it runs exactly
+  // once: queued and drained, or inline on the submitting thread
+  bool noneLost = true;
+  for (int round = 0; round < 50; ++round) {
+    std::atomic<size_t> ran{0};
+    std::atomic<size_t> submitted{0};
+    std::atomic<bool> go{false};
+    ThreadPool pool(3);
+
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < 3; ++t) {
+      submitters.emplace_back([&] {
+        while (!go.load()) {
+          std::this_thread::yield();
+        }
+        for (int i = 0; i < 2000; ++i) {
+          pool.Submit(&Increment, &ran);
+          submitted.fetch_add(1);
+          // Pool size is read concurrently with Shutdown too
+          (void)pool.GetThreadCount();
+        }
+      });
+    }
+    go.store(true);
+    pool.Shutdown();
+    for (std::thread& submitter : submitters) {
+      submitter.join();
+    }
+    noneLost &= ran.load() == submitted.load();
+    noneLost &= pool.GetThreadCount() == 0;
+  }
+  ASPK_CHECK(noneLost);
+}
+
+ASPK_TEST("ThreadPool/StartAndStopImmediately")
+{
+  // Workers start stealing while the constructor is still starting others
+  std::atomic<size_t> ran{0};
+  for (int round = 0; round < 200; ++round) {
+    ThreadPool pool(4);
+    pool.Submit(&Increment, &ran);
+  }
+  ASPK_CHECK(ran.load() == 200);
+}
+
+ASPK_TEST("ThreadPool/ParallelForCoversRangeOnce")
+{
+  ThreadPool pool(4);
+  ASPK_CHECK(pool.GetThreadCount() == 4);
+
+  std::vector<std::atomic<int>> visits(100003);
+  pool.ParallelFor(3, visits.size(), 97, [&visits](size_t aBegin, size_t aEnd) {
+    for (size_t i = aBegin; i < aEnd; ++i) {
+      visits[i].fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  bool once = true;
+  for (size_t i = 0; i < visits.size(); ++i) {
+    once &= visits[i].load() == (i >= 3 ? 1 : 0);
+  }
+  ASPK_CHECK(once);
+}
+
+ASPK_TEST("ThreadPool/NestedInvoke")
+{
+  ThreadPool pool(4);
+  ASPK_CHECK(Fibonacci(pool, 22) == 17711);
+
+  // Nested from another thread, and after shutdown, where it all runs inline
+  size_t fromThread = 0;
+  std::thread([&pool, &fromThread] { fromThread = Fibonacci(pool, 18); }).join();
+  ASPK_CHECK(fromThread == 2584);
+  pool.Shutdown();
+  ASPK_CHECK(Fibonacci(pool, 15) == 610);
+}
+
+ASPK_TEST("ThreadPool/ExceptionsPropagate")
+{
+  ThreadPool pool(2);
+  bool caught = false;
+  try {
+    pool.ParallelFor(0, 1000, 10, [](size_t aBegin, size_t) {
+      if (aBegin == 500) {
+        throw std::runtime_error("expected");
+      }
+    });
+  } catch (std::runtime_error const &) {
+    caught = true;
+  }
+  ASPK_CHECK(caught);
+
+  caught = false;
+  try {
+    pool.Invoke([] {}, [] { throw std::runtime_error("expected"); });
+  } catch (std::runtime_error const &) {
+    caught = true;
+  }
+  ASPK_CHECK(caught);
+}
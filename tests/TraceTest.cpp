@@ -0,0 +1,162 @@
+#include "Test.h"
+
+#include "Trace.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace aspk;
+
+namespace {
+
+struct DecodedTrace
+{
+  bool                      mOk = false;
+  // Formatted messages, without the timestamp and thread prefix
+  std::vector<std::string>  mEvents;
+  uint64_t                  mDropped = 0;
+};
+
+std::filesystem::path
+GetTracePath(char const * aName)
+{
+  return std::filesystem::temp_directory_path() /
+         (std::string("glasstest-") + std::to_string(::getpid()) + "-" +
+          aName + ".trace");
+}
+
+// Runs tools/tracedecode, whose path the build passes as --tracedecode
+bool
+Decode(std::filesystem::path const &aPath, DecodedTrace& aTrace)
+{
+  const std::string_view decoder = test::GetOption("tracedecode");
+  if (decoder.empty()) {
+    std::fprintf(stderr, "  needs --tracedecode=<path to tools/tracedecode>\n");
+    return false;
+  }
+
+  const std::string command = std::string(decoder) + " '" + aPath.string() +
+                              "' 2>/dev/null";
+  FILE* pipe = ::popen(command.c_str(), "r");
+  if (!pipe) {
+    return false;
+  }
+
+  std::string line;
+  for (int c; (c = std::fgetc(pipe)) != EOF; ) {
+    if (c != '\n') {
+      line.push_back(static_cast<char>(c));
+      continue;
+    }
+    unsigned threadId = 0;
+    unsigned count = 0;
+    if (std::sscanf(line.c_str(), "-- [%u] %u events dropped", &threadId,
+                    &count) == 2) {
+      aTrace.mDropped += count;
+    } else {
+      // "<seconds> [<thread>] <message>"
+      const size_t prefixEnd = line.find("] ");
+      aTrace.mEvents.push_back(prefixEnd == std::string::npos ?
+                                 line : line.substr(prefixEnd + 2));
+    }
+    line.clear();
+  }
+
+  aTrace.mOk = ::pclose(pipe) == 0;
+  std::filesystem::remove(aPath);
+  return aTrace.mOk;
+}
+
+} // anonymous namespace
+
+ASPK_TEST("Trace/DecodeRoundTrip")
+{
+  const std::filesystem::path path = GetTracePath("roundtrip");
+  ASPK_CHECK(StartTrace(path, 64 * 1024));
+
+  int value = -42;
+  void const * pointer = reinterpret_cast<void const *>(uintptr_t(0x1234));
+  Trace<L"int %d unsigned %u hex %#x">(value, 7u, 255u);
+  Trace<L"narrowed %hd %hhu">(70000, 300);
+  Trace<L"wide %lld %llu">(-1234567890123LL, 18446744073709551615ULL);
+  Trace<L"double %.3f %g">(1.25, 0.5);
+  Trace<L"char %c string [%-6ls] view %ls">(L'x', L"ab",
+                                            std::wstring_view(L"été"));
+  Trace<L"pointer %p">(pointer);
+  std::thread([] { Trace<L"from %ls">(L"another thread"); }).join();
+  StopTrace();
+
+  DecodedTrace trace;
+  ASPK_CHECK(Decode(path, trace));
+  ASPK_CHECK(trace.mDropped == 0);
+
+  const std::vector<std::string> expected = {
+    "int -42 unsigned 7 hex 0xff",
+    "narrowed 4464 44",
+    "wide -1234567890123 18446744073709551615",
+    "double 1.250 0.5",
+    "char x string [ab    ] view \xc3\xa9t\xc3\xa9",
+    "pointer 0x1234",
+    "from another thread",
+  };
+  ASPK_CHECK(trace.mEvents == expected);
+  for (size_t i = 0; i < trace.mEvents.size(); ++i) {
+    if (i >= expected.size() || trace.mEvents[i] != expected[i]) {
+      std::fprintf(stderr, "  event %zu: %s\n", i, trace.mEvents[i].c_str());
+    }
+  }
+}
+
+ASPK_TEST("Trace/WriterKeepsUpWithoutFlushTrace")
+{
+  // An always-on trace with a small ring, which a few hundred events fill.
+  // Nobody calls FlushTrace, so only the writer thread can keep up. Rings
+  // keep their size across traces, so produce on a fresh thread.
+  const std::filesystem::path path = GetTracePath("writer");
+  ASPK_CHECK(StartTrace(path, 4096));
+
+  const int kEvents = 2000;
+  std::thread([] {
+    for (int i = 0; i < kEvents; ++i) {
+      Trace<L"event %d">(i);
+      if (i % 10 == 9) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }).join();
+  ASPK_CHECK(GetTraceDroppedCount() == 0);
+  StopTrace();
+
+  DecodedTrace trace;
+  ASPK_CHECK(Decode(path, trace));
+  ASPK_CHECK(trace.mEvents.size() == size_t(kEvents));
+  ASPK_CHECK(!trace.mEvents.empty() && trace.mEvents.back() == "event 1999");
+}
+
+ASPK_TEST("Trace/DropsAreCounted")
+{
+  // A burst far bigger than the ring. However much the writer manages to
+  // drain, every event is either in the file or counted as dropped.
+  const std::filesystem::path path = GetTracePath("drops");
+  ASPK_CHECK(StartTrace(path, 4096));
+
+  const size_t kEvents = 100000;
+  std::thread([] {
+    for (size_t i = 0; i < kEvents; ++i) {
+      Trace<L"burst %zu">(i);
+    }
+  }).join();
+  StopTrace();
+  const uint64_t dropped = GetTraceDroppedCount();
+
+  DecodedTrace trace;
+  ASPK_CHECK(Decode(path, trace));
+  ASPK_CHECK(trace.mDropped == dropped);
+  ASPK_CHECK(trace.mEvents.size() + dropped == kEvents);
+}
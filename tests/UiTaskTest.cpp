@@ -0,0 +1,245 @@
+#include "Test.h"
+
+#include "UiTask.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace aspk;
+using namespace aspk::test;
+
+namespace {
+
+// Stands in for GlassWindowApp's message loop: the scheduler's wake only
+// sets a flag, and Pump runs the queue until it stops asking to be woken.
+// Background work is parked until the test runs it, in whatever order it
+// likes, so every interleaving is deterministic.
+class FakePump
+{
+public:
+  FakePump()
+    : mWakes(0)
+    , mScheduler([this] { ++mWakes; })
+  {
+    mWork.reserve(64);
+    mScheduler.SetBackgroundExecutor([this](BackgroundWork* aWork) {
+      mWork.push_back(aWork);
+    });
+  }
+
+  TaskScheduler& GetScheduler() { return mScheduler; }
+  size_t GetWakeCount() const { return mWakes; }
+  std::vector<BackgroundWork*>& GetWork() { return mWork; }
+
+  // One turn of the message loop, if the scheduler asked for one
+  size_t
+  RunOnce()
+  {
+    if (!mWakes) {
+      return 0;
+    }
+    mWakes = 0;
+    return mScheduler.RunPending();
+  }
+
+  size_t
+  Pump()
+  {
+    size_t handled = 0;
+    while (mWakes) {
+      handled += RunOnce();
+    }
+    return handled;
+  }
+
+  // Runs the parked background work, last submitted first
+  void
+  RunWorkInReverse()
+  {
+    while (!mWork.empty()) {
+      BackgroundWork* work = mWork.back();
+      mWork.pop_back();
+      work->Run();
+    }
+  }
+
+private:
+  std::atomic<size_t>           mWakes;
+  std::vector<BackgroundWork*>  mWork;
+  // Last, so that it waits for background work before the rest goes away
+  TaskScheduler                 mScheduler;
+};
+
+// Counts the frames of the tasks that hold one, when they go away
+struct FrameGuard
+{
+  int* mDestroyed;
+
+  ~FrameGuard() { ++*mDestroyed; }
+};
+
+UiTask
+YieldSteps(std::vector<int>* aLog, int aId, int aSteps)
+{
+  for (int step = 0; step < aSteps; ++step) {
+    aLog->push_back(aId * 10 + step);
+    co_await YieldToUi();
+  }
+  aLog->push_back(aId * 10 + 9);
+}
+
+UiTask
+Double(std::vector<int>* aLog, int aValue)
+{
+  const int result = co_await RunInBackground([aValue] { return aValue * 2; });
+  aLog->push_back(result);
+}
+
+UiTask
+ThrowInBackground(std::vector<int>* aLog)
+{
+  try {
+    co_await RunInBackground([] { throw std::runtime_error("expected"); });
+    aLog->push_back(1);
+  } catch (std::runtime_error const &) {
+    aLog->push_back(-1);
+  }
+}
+
+UiTask
+YieldThenRecord(std::vector<int>* aLog, int* aDestroyed, int aValue)
+{
+  FrameGuard guard{aDestroyed};
+  co_await YieldToUi();
+  aLog->push_back(aValue);
+}
+
+UiTask
+BackgroundThenRecord(std::vector<int>* aLog, int* aDestroyed, int aValue)
+{
+  FrameGuard guard{aDestroyed};
+  co_await RunInBackground([] {});
+  aLog->push_back(aValue);
+}
+
+UiTask
+YieldAndBackground(int* aFinished)
+{
+  co_await YieldToUi();
+  co_await RunInBackground([] {});
+  ++*aFinished;
+}
+
+} // anonymous namespace
+
+ASPK_TEST("UiTask/YieldsResumeInOrder")
+{
+  FakePump pump;
+  TaskScope scope(pump.GetScheduler());
+  std::vector<int> log;
+
+  // Each task runs up to its first co_await when spawned
+  ASPK_CHECK(scope.Spawn(YieldSteps(&log, 1, 2)));
+  ASPK_CHECK(scope.Spawn(YieldSteps(&log, 2, 2)));
+  ASPK_CHECK(scope.Spawn(YieldSteps(&log, 3, 2)));
+  ASPK_CHECK((log == std::vector<int>{10, 20, 30}));
+  // Only the first post wakes the pump
+  ASPK_CHECK(pump.GetWakeCount() == 1);
+
+  // A turn resumes only what was queued on entry, so tasks that yield again
+  // wait for the next one, behind whatever was already queued
+  ASPK_CHECK(pump.RunOnce() == 3);
+  ASPK_CHECK((log == std::vector<int>{10, 20, 30, 11, 21, 31}));
+  ASPK_CHECK(pump.GetWakeCount() == 1);
+
+  ASPK_CHECK(pump.RunOnce() == 3);
+  ASPK_CHECK((log == std::vector<int>{10, 20, 30, 11, 21, 31, 19, 29, 39}));
+  ASPK_CHECK(pump.GetWakeCount() == 0);
+  ASPK_CHECK(pump.GetScheduler().GetPendingCount() == 0);
+}
+
+ASPK_TEST("UiTask/BackgroundResumesInCompletionOrder")
+{
+  FakePump pump;
+  TaskScope scope(pump.GetScheduler());
+  std::vector<int> log;
+
+  scope.Spawn(Double(&log, 1));
+  scope.Spawn(Double(&log, 2));
+  scope.Spawn(Double(&log, 3));
+  scope.Spawn(ThrowInBackground(&log));
+  ASPK_CHECK(pump.GetWork().size() == 4);
+  ASPK_CHECK(pump.GetScheduler().GetInFlightCount() == 4);
+  ASPK_CHECK(pump.Pump() == 0 && log.empty());
+
+  pump.RunWorkInReverse();
+  ASPK_CHECK(pump.GetScheduler().GetInFlightCount() == 0);
+  ASPK_CHECK(log.empty());
+  ASPK_CHECK(pump.Pump() == 4);
+  ASPK_CHECK((log == std::vector<int>{-1, 6, 4, 2}));
+}
+
+ASPK_TEST("UiTask/CancelledScopeDestroysTasks")
+{
+  FakePump pump;
+  std::vector<int> log;
+  int destroyed = 0;
+
+  TaskScope cancelled(pump.GetScheduler());
+  TaskScope live(pump.GetScheduler());
+  cancelled.Spawn(YieldThenRecord(&log, &destroyed, 1));
+  live.Spawn(YieldThenRecord(&log, &destroyed, 2));
+  cancelled.Spawn(YieldThenRecord(&log, &destroyed, 3));
+  cancelled.Spawn(BackgroundThenRecord(&log, &destroyed, 4));
+  {
+    // Destroying a scope cancels it too
+    TaskScope shortLived(pump.GetScheduler());
+    shortLived.Spawn(YieldThenRecord(&log, &destroyed, 5));
+  }
+
+  cancelled.Cancel();
+  ASPK_CHECK(cancelled.IsCancelled() && !live.IsCancelled());
+  // Spawning into a cancelled scope never starts the task
+  ASPK_CHECK(!cancelled.Spawn(YieldThenRecord(&log, &destroyed, 6)));
+  ASPK_CHECK(destroyed == 0);
+
+  // Queued tasks are destroyed at their resumption, not resumed
+  ASPK_CHECK(pump.Pump() == 4);
+  ASPK_CHECK((log == std::vector<int>{2}));
+  ASPK_CHECK(destroyed == 4);
+
+  // Background work already started finishes, but its task is not resumed
+  pump.RunWorkInReverse();
+  ASPK_CHECK(pump.Pump() == 1);
+  ASPK_CHECK((log == std::vector<int>{2}));
+  ASPK_CHECK(destroyed == 5);
+}
+
+ASPK_TEST("UiTask/FramesAreReused")
+{
+  FakePump pump;
+  TaskScope scope(pump.GetScheduler());
+  int finished = 0;
+  const int kConcurrent = 8;
+
+  auto runRound = [&pump, &scope, &finished]() {
+    for (int i = 0; i < kConcurrent; ++i) {
+      scope.Spawn(YieldAndBackground(&finished));
+    }
+    pump.Pump();
+    pump.RunWorkInReverse();
+    pump.Pump();
+  };
+
+  // The first round fills the pool; after that, frames and queue nodes are
+  // recycled and nothing touches the heap
+  runRound();
+  ASPK_CHECK(finished == kConcurrent);
+  const uint64_t before = GetAllocationCount();
+  for (int round = 0; round < 100; ++round) {
+    runRound();
+  }
+  ASPK_CHECK(GetAllocationCount() == before);
+  ASPK_CHECK(finished == kConcurrent * 101);
+}
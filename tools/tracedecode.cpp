@@ -0,0 +1,365 @@
+// Decodes a binary trace written by aspk::StartTrace into text, one event per
+// line:
+//
+//   <seconds since start> [<thread id>] <formatted message>
+//
+// Usage: tracedecode <trace file> [output file]
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "PrintfBuffer.h"
+#include "TraceFormat.h"
+
+using namespace aspk;
+
+namespace {
+
+struct Site
+{
+  std::vector<uint8_t>  mArgTypes;
+  std::wstring          mFormat;
+};
+
+// Bounds-checked reader over one record
+class Reader
+{
+public:
+  Reader(uint8_t const * aData, size_t aSize)
+    : mData(aData)
+    , mSize(aSize)
+    , mPos(0)
+  {
+  }
+
+  template <typename T>
+  bool
+  Read(T& aValue)
+  {
+    if (mSize - mPos < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&aValue, mData + mPos, sizeof(T));
+    mPos += sizeof(T);
+    return true;
+  }
+
+  bool
+  ReadUtf16(size_t aLength, std::wstring& aText)
+  {
+    if ((mSize - mPos) / sizeof(char16_t) < aLength) {
+      return false;
+    }
+
+    aText.clear();
+    for (size_t i = 0; i < aLength; ++i) {
+      char16_t unit;
+      std::memcpy(&unit, mData + mPos + i * sizeof(char16_t), sizeof(unit));
+      uint32_t c = unit;
+      if (sizeof(wchar_t) > sizeof(char16_t) && c >= 0xD800 && c < 0xDC00 &&
+          i + 1 < aLength) {
+        char16_t low;
+        std::memcpy(&low, mData + mPos + (i + 1) * sizeof(char16_t),
+                    sizeof(low));
+        if (low >= 0xDC00 && low < 0xE000) {
+          c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+          ++i;
+        }
+      }
+      aText.push_back(static_cast<wchar_t>(c));
+    }
+    mPos += aLength * sizeof(char16_t);
+    return true;
+  }
+
+private:
+  uint8_t const * mData;
+  size_t          mSize;
+  size_t          mPos;
+};
+
+void
+AppendUtf8(std::string& aOut, std::wstring_view aText)
+{
+  for (wchar_t ch : aText) {
+    uint32_t c = static_cast<uint32_t>(ch);
+    if (c < 0x80) {
+      aOut.push_back(static_cast<char>(c));
+    } else if (c < 0x800) {
+      aOut.push_back(static_cast<char>(0xC0 | (c >> 6)));
+      aOut.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+      aOut.push_back(static_cast<char>(0xE0 | (c >> 12)));
+      aOut.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+      aOut.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    } else {
+      aOut.push_back(static_cast<char>(0xF0 | (c >> 18)));
+      aOut.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+      aOut.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+      aOut.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+  }
+}
+
+// Formats one argument with its conversion specification. The writer
+// checked the format against the argument types at compile time, but length
+// modifiers differ between platforms (long is 32-bit on Windows), so the
+// specification is rebuilt with modifiers that suit the decoded value.
+bool
+FormatArg(PrintfBuffer& aOut, std::wstring const &aSpec, uint8_t aType,
+          Reader& aReader)
+{
+  // aSpec is "%[flags][width][.precision][length]conversion"
+  const wchar_t conversion = aSpec.back();
+  std::wstring spec = aSpec.substr(0, aSpec.find_first_of(L"hlzjt"));
+  if (spec.size() == aSpec.size()) {
+    spec.pop_back();
+  }
+  const std::wstring_view length(aSpec.data() + spec.size(),
+                                 aSpec.size() - spec.size() - 1);
+
+  switch (aType) {
+    case eTraceArgInt32:
+    case eTraceArgInt64:
+    case eTraceArgUInt32:
+    case eTraceArgUInt64: {
+      long long value = 0;
+      if (aType == eTraceArgInt32) {
+        int32_t v;
+        if (!aReader.Read(v)) return false;
+        value = v;
+      } else if (aType == eTraceArgInt64) {
+        int64_t v;
+        if (!aReader.Read(v)) return false;
+        value = v;
+      } else if (aType == eTraceArgUInt32) {
+        uint32_t v;
+        if (!aReader.Read(v)) return false;
+        value = static_cast<long long>(v);
+      } else {
+        uint64_t v;
+        if (!aReader.Read(v)) return false;
+        value = static_cast<long long>(v);
+      }
+
+      const bool isSigned = conversion == L'd' || conversion == L'i';
+      if (length == L"hh") {
+        value = isSigned ? static_cast<signed char>(value)
+                         : static_cast<unsigned char>(value);
+      } else if (length == L"h") {
+        value = isSigned ? static_cast<short>(value)
+                         : static_cast<unsigned short>(value);
+      } else if (length.empty() && !isSigned &&
+                 (aType == eTraceArgInt32 || aType == eTraceArgUInt32)) {
+        // Promoted to int, then reinterpreted as unsigned int
+        value = static_cast<unsigned int>(value);
+      }
+
+      spec += L"ll";
+      spec.push_back(conversion);
+      return aOut.AppendFormat(spec.c_str(), value);
+    }
+    case eTraceArgDouble: {
+      double value;
+      if (!aReader.Read(value)) return false;
+      spec.push_back(conversion);
+      return aOut.AppendFormat(spec.c_str(), value);
+    }
+    case eTraceArgChar: {
+      uint32_t value;
+      if (!aReader.Read(value)) return false;
+      spec += L"lc";
+      return aOut.AppendFormat(spec.c_str(), static_cast<wint_t>(value));
+    }
+    case eTraceArgPointer: {
+      uint64_t value;
+      if (!aReader.Read(value)) return false;
+      // Pointers may be wider than ours; print them the same way everywhere
+      spec.insert(1, 1, L'#');
+      spec += L"llx";
+      return aOut.AppendFormat(spec.c_str(),
+                               static_cast<unsigned long long>(value));
+    }
+    case eTraceArgString: {
+      uint32_t count;
+      std::wstring text;
+      if (!aReader.Read(count) || !aReader.ReadUtf16(count, text)) {
+        return false;
+      }
+      spec += L"ls";
+      return aOut.AppendFormat(spec.c_str(), text.c_str());
+    }
+    default:
+      return false;
+  }
+}
+
+bool
+FormatEvent(PrintfBuffer& aOut, Site const &aSite, Reader& aReader)
+{
+  std::wstring const &fmt = aSite.mFormat;
+  size_t arg = 0;
+  size_t i = 0;
+  while (i < fmt.size()) {
+    if (fmt[i] != L'%') {
+      const size_t next = fmt.find(L'%', i);
+      aOut.Append(std::wstring_view(fmt).substr(i, next - i));
+      i = next == std::wstring::npos ? fmt.size() : next;
+      continue;
+    }
+
+    if (i + 1 < fmt.size() && fmt[i + 1] == L'%') {
+      aOut.Append(1, L'%');
+      i += 2;
+      continue;
+    }
+
+    const size_t end = fmt.find_first_of(L"diuoxXcsfFeEgGaAp", i + 1);
+    if (end == std::wstring::npos || arg >= aSite.mArgTypes.size()) {
+      return false;
+    }
+
+    if (!FormatArg(aOut, fmt.substr(i, end + 1 - i), aSite.mArgTypes[arg++],
+                   aReader)) {
+      return false;
+    }
+    i = end + 1;
+  }
+  return true;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 3) {
+    std::fprintf(stderr, "Usage: %s <trace file> [output file]\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in) {
+    std::fprintf(stderr, "Could not open %s\n", argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+
+  FILE* out = stdout;
+  if (argc == 3) {
+    out = std::fopen(argv[2], "wb");
+    if (!out) {
+      std::fprintf(stderr, "Could not create %s\n", argv[2]);
+      return 1;
+    }
+  }
+
+  TraceFileHeader header;
+  if (data.size() < sizeof(header)) {
+    std::fprintf(stderr, "Not a trace file\n");
+    return 1;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (std::memcmp(header.mMagic, kTraceMagic, sizeof(header.mMagic)) ||
+      header.mVersion != kTraceVersion) {
+    std::fprintf(stderr, "Not a trace file, or an unsupported version\n");
+    return 1;
+  }
+
+  std::unordered_map<uint32_t, Site> sites;
+  PrintfBuffer text;
+  std::string line;
+  size_t numEvents = 0;
+  size_t numErrors = 0;
+
+  size_t pos = sizeof(header);
+  while (data.size() - pos >= sizeof(TraceRecordHeader)) {
+    TraceRecordHeader record;
+    std::memcpy(&record, data.data() + pos, sizeof(record));
+    if (record.mSize < sizeof(record) || record.mSize > data.size() - pos) {
+      std::fprintf(stderr, "Truncated record at offset %zu\n", pos);
+      ++numErrors;
+      break;
+    }
+
+    Reader reader(data.data() + pos + sizeof(record),
+                  record.mSize - sizeof(record));
+    pos += record.mSize;
+
+    switch (record.mKind) {
+      case eTraceRecordSite: {
+        uint32_t id;
+        uint16_t numArgs;
+        uint16_t formatLength;
+        Site site;
+        bool ok = reader.Read(id) && reader.Read(numArgs) &&
+                  reader.Read(formatLength);
+        for (uint16_t i = 0; ok && i < numArgs; ++i) {
+          uint8_t type = 0;
+          ok = reader.Read(type);
+          site.mArgTypes.push_back(type);
+        }
+        if (!ok || !reader.ReadUtf16(formatLength, site.mFormat)) {
+          ++numErrors;
+          break;
+        }
+        sites[id] = std::move(site);
+        break;
+      }
+      case eTraceRecordEvent: {
+        uint32_t siteId;
+        uint32_t threadId;
+        uint64_t timestamp;
+        if (!reader.Read(siteId) || !reader.Read(threadId) ||
+            !reader.Read(timestamp)) {
+          ++numErrors;
+          break;
+        }
+
+        auto site = sites.find(siteId);
+        text.Clear();
+        if (site == sites.end() || !FormatEvent(text, site->second, reader)) {
+          text.Assign(L"<undecodable event>");
+          ++numErrors;
+        }
+
+        char prefix[64];
+        std::snprintf(prefix, sizeof(prefix), "%llu.%09llu [%u] ",
+                      static_cast<unsigned long long>(timestamp / 1000000000),
+                      static_cast<unsigned long long>(timestamp % 1000000000),
+                      threadId);
+        line = prefix;
+        AppendUtf8(line, text.GetText());
+        line.push_back('\n');
+        std::fwrite(line.data(), 1, line.size(), out);
+        ++numEvents;
+        break;
+      }
+      case eTraceRecordDropped: {
+        uint32_t threadId;
+        uint32_t count;
+        if (reader.Read(threadId) && reader.Read(count)) {
+          std::fprintf(out, "-- [%u] %u events dropped\n", threadId, count);
+        }
+        break;
+      }
+      default:
+        // Unknown records are skipped, so newer writers stay readable
+        break;
+    }
+  }
+
+  if (out != stdout) {
+    std::fclose(out);
+  }
+
+  std::fprintf(stderr, "%zu events, %zu errors\n", numEvents, numErrors);
+  return numErrors ? 1 : 0;
+}